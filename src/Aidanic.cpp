@@ -3,31 +3,54 @@
 #include "Model.h"
 #include "IOInterface.h"
 #include "Renderer.h"
+#include "RenderBackend.h"
+#include "CPURenderer.h"
+#include "SpatialIndex.h"
+#include "Benchmarks.h"
+#include "tools/JobSystem.h"
 #include "ImGuiVk.h"
 #include "tools/Log.h"
 #include "tools/config.h"
+#include "tools/MemoryAllocator.h"
 
 #include "imgui.h"
 #include "glm.hpp"
 #include "gtx/rotate_vector.hpp"
+#include "gtc/quaternion.hpp"
 
 #include <iostream>
 #include <chrono>
 #include <atomic>
+#include <random>
+#include <thread>
+#include <string>
 
 using namespace std::chrono;
 
+// --headless-gpu fails when a larger fraction of the object ids differ from the cpu reference. the gpu and cpu float
+// operations aren't bit identical, so a few pixels on silhouettes may see another ellipsoid
+#define HEADLESS_MAX_ID_MISMATCH_FRACTION 0.001f
+
 namespace Aidanic {
 
     // private function declarations
 
     void init();
     void initImGui();
+    int runHeadless(int argc, char** argv);
+    int runHeadlessGPU(int argc, char** argv);
 
     void loop();
     void updateImGui();
     void processInputs();
     void updateMatrices();
+    glm::mat4 projectionInverse(int width, int height);
+    void addRandomEllipsoids(uint32_t count);
+    void updatePicks();
+    void updateSelection();
+    void renderCPUReference();
+    glm::vec4 rotationFromAngles(glm::vec3 degrees);
+    glm::vec3 anglesFromRotation(glm::vec4 rotation);
 
     void cleanup();
 
@@ -59,11 +82,29 @@ namespace Aidanic {
     glm::mat4 viewInverse = glm::mat4(1.0f);
     glm::mat4 projInverse = glm::mat4(1.0f);
 
+    // object under the screen center, picked asynchronously so the frame never waits for it
+    Renderer::PickTicket centerPick = 0;
+    int32_t centerObjectID = -1;
+    int benchmarkPicksPerFrame = 0; // extra random picks per frame, frame time shouldn't change with them
+
+    // right mouse drag selects a rectangle, with shift held a lasso. in framebuffer pixels
+    bool selecting = false;
+    glm::vec2 selectionStart = glm::vec2(0.f);
+    std::vector<glm::vec2> lassoPoints;
+    Renderer::SelectionBenchmark selectionBenchmark;
+    SpatialIndex::BuilderComparison builderComparison;
+    SpatialIndex::BoundsStats boundsStats;
+    CPURenderer::PacketComparison packetComparison;
+    JobSystem::Settings jobSettings;
+
     void init() {
         Log::init();
         AID_INFO("Logger initialized");
         AID_INFO("~ Initializing Aidanic...");
 
+        JobSystem::init(jobSettings);
+        AID_INFO("Job system initialized with {} threads", JobSystem::getThreadCount());
+
         std::vector<const char*> requiredExtensions;
         IOInterface::init(requiredExtensions, WINDOW_SIZE_X, WINDOW_SIZE_Y);
         AID_INFO("IO interface initialized");
@@ -71,7 +112,7 @@ namespace Aidanic {
         updateMatrices();
 
         Renderer::init(requiredExtensions, viewInverse, projInverse, viewerPosition);
-        AID_INFO("Vulkan renderer RTX initialized");
+        AID_INFO("Vulkan renderer initialized, tracing with the {} pipeline", Renderer::isRayTracing() ? "ray tracing" : "compute");
 
         initImGui();
         AID_INFO("ImGui initialized");
@@ -88,6 +129,122 @@ namespace Aidanic {
         memcpy(ImGuiVk::getpClearValue(), &clear_color, 4 * sizeof(float));
     }
 
+    // traces a random scene on the cpu, without a window or gpu:
+    // Aidanic --headless [width] [height] [ellipsoid count] [output path]
+    // renders once per job system size, doubling from 1 to the hardware threads, and writes the last frame
+    int runHeadless(int argc, char** argv) {
+        Log::init();
+        JobSystem::init(jobSettings);
+        RenderBackend::select(RenderBackend::Type::CPU);
+
+        uint32_t width = argc > 0 ? std::stoul(argv[0]) : WINDOW_SIZE_X;
+        uint32_t height = argc > 1 ? std::stoul(argv[1]) : WINDOW_SIZE_Y;
+        uint32_t ellipsoidCount = argc > 2 ? std::stoul(argv[2]) : 10000;
+        std::string path = argc > 3 ? argv[3] : "aidanic_cpu";
+        if (width == 0 || height == 0) {
+            AID_ERROR("Aidanic::runHeadless() image size can't be 0");
+        }
+
+        addRandomEllipsoids(ellipsoidCount);
+        projInverse = projectionInverse(width, height);
+        viewInverse = glm::inverse(glm::lookAt(viewerPosition, viewerPosition + viewerForward, viewerUp));
+        RenderBackend::Camera camera(viewInverse, projInverse, viewerPosition);
+        AID_REPORT("Headless cpu render of {} ellipsoids at {}x{}, {}", ellipsoidCount, width, height,
+            CPURenderer::getTraceModeName(CPURenderer::getTraceMode()));
+
+        CPURenderer::Image image(width, height);
+        Benchmarks::tileScaling(camera, image, jobSettings);
+        Benchmarks::packetTracing(camera, glm::uvec2(width, height));
+
+        if (!CPURenderer::writeImages(image, path)) return EXIT_FAILURE;
+        AID_REPORT("Wrote {}.ppm and {}_ids.ppm", path, path);
+        return EXIT_SUCCESS;
+    }
+
+    // traces a random scene with the vulkan renderer into offscreen images, without a window or swapchain:
+    // Aidanic --headless-gpu [width] [height] [ellipsoid count] [frame count] [output path]
+    // runs the frame loop once polling the readbacks and once waiting for every frame, then compares the last frame
+    // and the gpu trace time per frame with the cpu reference renderer and writes it
+    int runHeadlessGPU(int argc, char** argv) {
+        Log::init();
+        JobSystem::init(jobSettings);
+        RenderBackend::select(RenderBackend::Type::VULKAN_RTX);
+
+        uint32_t width = argc > 0 ? std::stoul(argv[0]) : WINDOW_SIZE_X;
+        uint32_t height = argc > 1 ? std::stoul(argv[1]) : WINDOW_SIZE_Y;
+        uint32_t ellipsoidCount = argc > 2 ? std::stoul(argv[2]) : 10000;
+        uint32_t frameCount = argc > 3 ? std::stoul(argv[3]) : 300;
+        std::string path = argc > 4 ? argv[4] : "aidanic_gpu";
+        if (width == 0 || height == 0 || frameCount == 0) {
+            AID_ERROR("Aidanic::runHeadlessGPU() image size and frame count can't be 0");
+        }
+
+        projInverse = projectionInverse(width, height);
+        viewInverse = glm::inverse(glm::lookAt(viewerPosition, viewerPosition + viewerForward, viewerUp));
+        Renderer::initHeadless(width, height, viewInverse, projInverse, viewerPosition);
+        addRandomEllipsoids(ellipsoidCount);
+        AID_REPORT("Headless gpu render of {} ellipsoids at {}x{}, {} frames per run, {} pipeline", ellipsoidCount, width, height,
+            frameCount, Renderer::isRayTracing() ? "ray tracing" : "compute");
+
+        Renderer::Stats traceBefore = Renderer::getStats();
+        Renderer::ReadbackFrame frame;
+        for (int blocking = 0; blocking < 2; blocking++) {
+            Renderer::HeadlessStats before = Renderer::getStats().headless;
+            auto start = high_resolution_clock::now();
+            for (uint32_t f = 0; f < frameCount; f++) {
+                Renderer::drawFrameHeadless(viewInverse, projInverse, viewerPosition);
+                if (blocking) Renderer::finishReadbacks();
+                while (Renderer::pollReadback(frame));
+            }
+            Renderer::finishReadbacks();
+            while (Renderer::pollReadback(frame));
+            float milliseconds = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+
+            Renderer::HeadlessStats stats = Renderer::getStats().headless;
+            AID_REPORT("{} readback: {} ms, {} fps, {} frames read, {} dropped, {} ms waiting for frame slots, last frame copied out {} ms after submit ({} ms copy)",
+                blocking ? "Blocking" : "Pipelined", milliseconds, frameCount * 1000.f / milliseconds, stats.framesRead - before.framesRead,
+                stats.framesDropped - before.framesDropped, stats.fenceWaitTotal - before.fenceWaitTotal, stats.readbackLatency, stats.copyTime);
+        }
+
+        CPURenderer::Image reference(width, height);
+        CPURenderer::render(RenderBackend::Camera(viewInverse, projInverse, viewerPosition), reference);
+        Renderer::Stats traceStats = Renderer::getStats();
+        CPURenderer::Stats cpuStats = CPURenderer::getStats();
+        uint64_t tracedFrames = traceStats.tracedFrames - traceBefore.tracedFrames;
+        AID_REPORT("Trace per frame: gpu {} ms over {} frames, cpu reference {} ms (+{} ms bvh) on {} threads",
+            (traceStats.traceTimeTotal - traceBefore.traceTimeTotal) / std::max<uint64_t>(tracedFrames, 1), tracedFrames,
+            cpuStats.renderTime, cpuStats.buildTime, cpuStats.threadCount);
+        if (!traceStats.rayTracing)
+            AID_REPORT("Compute bvh of {} nodes built in {} ms on the cpu", traceStats.computeBVHNodeCount, traceStats.computeBVHBuildTime);
+
+        // a missing or wrongly sized frame counts as all ids differing
+        size_t pixelCount = reference.objectIDs.size();
+        size_t idMismatches = pixelCount;
+        if (frame.objectIDs.size() == pixelCount) {
+            idMismatches = 0;
+            for (size_t p = 0; p < pixelCount; p++) idMismatches += frame.objectIDs[p] != reference.objectIDs[p];
+        }
+        AID_REPORT("{} of {} object ids differ from the cpu reference", idMismatches, pixelCount);
+        bool idsMatch = idMismatches <= static_cast<size_t>(HEADLESS_MAX_ID_MISMATCH_FRACTION * pixelCount);
+        if (!idsMatch) {
+            AID_WARN("Aidanic::runHeadlessGPU() object ids differ from the cpu reference in more than {}% of the pixels",
+                HEADLESS_MAX_ID_MISMATCH_FRACTION * 100.f);
+        }
+
+        CPURenderer::Image image;
+        image.width = frame.width;
+        image.height = frame.height;
+        image.colors = std::move(frame.colors);
+        image.objectIDs = std::move(frame.objectIDs);
+        bool written = CPURenderer::writeImages(image, path);
+        Renderer::cleanUp();
+        JobSystem::shutdown();
+
+        if (!written) return EXIT_FAILURE;
+        AID_REPORT("Wrote {}.ppm and {}_ids.ppm", path, path);
+        return idsMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     void loop() {
         AID_INFO("~ Entering main loop...");
         while (!quit && !IOInterface::windowCloseCheck()) {
@@ -99,9 +256,9 @@ namespace Aidanic {
             // prepare ImGui
             if (renderImGui) updateImGui();
 
+            updatePicks();
+
             // submit draw commands for this frame
-            int32_t id = Renderer::getRenderedObjectID(glm::uvec2(600, 400));
-            AID_INFO("-- {} --", id);
             Renderer::drawFrame(windowResized, viewInverse, projInverse, viewerPosition, renderImGui);
         }
     }
@@ -114,6 +271,7 @@ namespace Aidanic {
 
         IOInterface::updateImGui();
         ImGui::NewFrame();
+        updateSelection();
 
         enum struct EditorState {
             NEW,
@@ -126,8 +284,23 @@ namespace Aidanic {
         // ellipsoid parameters
         static glm::vec3 ellipsoidPos = glm::vec3(0.f);
         static glm::vec3 ellipsoidRadius = glm::vec3(0.5f);
+        static glm::vec3 ellipsoidAngles = glm::vec3(0.f); // euler, degrees
         static glm::vec4 ellipsoidColor = glm::vec4(1.0f);
 
+        // left click edits the ellipsoid under the cursor, picked on the cpu so the result is there immediately
+        if (!io.WantCaptureMouse && ImGui::IsMouseClicked(0)) {
+            SpatialIndex::PickResult hit = SpatialIndex::pick(Benchmarks::cameraRay(RenderBackend::Camera(viewInverse, projInverse, viewerPosition), glm::vec2(io.MousePos.x, io.MousePos.y), glm::vec2(io.DisplaySize.x, io.DisplaySize.y)));
+            if (hit.id.isValid()) {
+                editorState = EditorState::EDIT;
+                selectedEllipsoid = hit.id;
+
+                ellipsoidPos = glm::vec3(PrimitiveManager::getEllipsoid(hit.id).center);
+                ellipsoidRadius = glm::vec3(PrimitiveManager::getEllipsoid(hit.id).radius);
+                ellipsoidAngles = anglesFromRotation(PrimitiveManager::getEllipsoid(hit.id).rotation);
+                ellipsoidColor = PrimitiveManager::getEllipsoid(hit.id).color;
+            }
+        }
+
         // object editor
         {
             ImGui::Begin("Editor");
@@ -147,21 +320,30 @@ namespace Aidanic {
             ImGui::SliderFloat("radius x", &ellipsoidRadius.x, 0.0f, 2.0f);
             ImGui::SliderFloat("radius y", &ellipsoidRadius.y, 0.0f, 2.0f);
             ImGui::SliderFloat("radius z", &ellipsoidRadius.z, 0.0f, 2.0f);
+            ImGui::SliderFloat3("rotation", &ellipsoidAngles.x, -180.0f, 180.0f);
             ImGui::ColorEdit3("color", &ellipsoidColor.r);
 
             switch (editorState)
             {
             case EditorState::NEW:
                 if (ImGui::Button("Add ellipsoid")) {
-                    Model::EllipsoidID id = PrimitiveManager::addEllipsoid(ellipsoidPos, ellipsoidRadius, ellipsoidColor);
-                    editorState = EditorState::EDIT;
-                    selectedEllipsoid = id;
+                    Model::EllipsoidID id = PrimitiveManager::addEllipsoid(ellipsoidPos, ellipsoidRadius, ellipsoidColor, rotationFromAngles(ellipsoidAngles));
+                    if (id.isValid()) {
+                        editorState = EditorState::EDIT;
+                        selectedEllipsoid = id;
+                    }
                 }
                 break;
 
             case EditorState::EDIT:
                 if (ImGui::Button("Update")) {
-                    PrimitiveManager::updateEllipsoid(selectedEllipsoid, ellipsoidPos, ellipsoidRadius, ellipsoidColor);
+                    PrimitiveManager::updateEllipsoid(selectedEllipsoid, ellipsoidPos, ellipsoidRadius, ellipsoidColor, rotationFromAngles(ellipsoidAngles));
+                }
+
+                bool sphereTraced = PrimitiveManager::getEllipsoid(selectedEllipsoid).intersection == Model::IntersectionMethod::SPHERE_TRACE;
+                if (ImGui::Checkbox("sphere traced", &sphereTraced)) {
+                    PrimitiveManager::setIntersectionMethod(selectedEllipsoid,
+                        sphereTraced ? Model::IntersectionMethod::SPHERE_TRACE : Model::IntersectionMethod::ANALYTIC);
                 }
 
                 if (ImGui::Button("Delete")) {
@@ -186,6 +368,7 @@ namespace Aidanic {
             std::vector<Model::EllipsoidID> ellipsoidIDs = PrimitiveManager::getEllipsoidIDs();
             for (Model::EllipsoidID id : ellipsoidIDs) {
                 std::string message = std::string("Ellipsoid ") + std::to_string(id.getID());
+                if (PrimitiveManager::isSelected(id)) message += " (selected)";
 
                 if (ImGui::Button(message.c_str())) {
                     editorState = EditorState::EDIT;
@@ -193,6 +376,7 @@ namespace Aidanic {
 
                     ellipsoidPos = glm::vec3(PrimitiveManager::getEllipsoid(id).center);
                     ellipsoidRadius = glm::vec3(PrimitiveManager::getEllipsoid(id).radius);
+                    ellipsoidAngles = anglesFromRotation(PrimitiveManager::getEllipsoid(id).rotation);
                     ellipsoidColor = PrimitiveManager::getEllipsoid(id).color;
                 }
             }
@@ -200,9 +384,246 @@ namespace Aidanic {
             ImGui::End();
         }
 
+        // renderer stats
+        {
+            ImGui::Begin("Renderer");
+
+            Renderer::Stats stats = Renderer::getStats();
+            ImGui::Text("ellipsoids: %u (buffer capacity %u)", stats.ellipsoidCount, stats.ellipsoidBufferCapacity);
+            ImGui::Text("trace: %s pipeline, %.3f ms gpu", stats.rayTracing ? "ray tracing" : "compute", stats.traceTime);
+            if (!stats.rayTracing)
+                ImGui::Text("compute bvh: %u nodes, last build %.3f ms cpu", stats.computeBVHNodeCount, stats.computeBVHBuildTime);
+            ImGui::Text("BLASs: %u, surface area %.1f, rebuild cost %.1f", stats.blasCount, stats.blasSurfaceArea, stats.estimatedRebuildCost);
+            ImGui::Text("updates: %u material, %u translate, %u shape", stats.lastFrame.materialUpdates, stats.lastFrame.translateUpdates, stats.lastFrame.shapeUpdates);
+
+            ImGui::Text("last BLAS build: %u aabbs in %.3f ms", stats.blasBuildAABBCount, stats.blasBuildTime);
+            if (stats.blasBuildTime > 0.f)
+                ImGui::Text("BLAS build throughput: %.2f M aabbs/s", stats.blasBuildAABBCount / (stats.blasBuildTime * 1000.f));
+
+            ImGui::Text("TLAS rebuild: %.3f ms gpu, %.3f ms cpu", stats.tlasRebuildTime, stats.tlasRebuildCPUTime);
+            ImGui::Text("TLAS refit: %.3f ms gpu, %.3f ms cpu", stats.tlasRefitTime, stats.tlasRefitCPUTime);
+            ImGui::Text("host writes: %llu B uniforms, %llu B tlas instances, %llu B aabbs, %llu B imgui",
+                (unsigned long long)stats.uniformBytesWritten, (unsigned long long)stats.tlasInstanceBytesWritten,
+                (unsigned long long)stats.blasAABBBytesWritten, (unsigned long long)ImGuiVk::getBytesWritten());
+            ImGui::Text("staging ring: %.2f/%.2f MB (peak %.2f), %u stalls, %u growths", stats.staging.used / 1048576.f,
+                stats.staging.capacity / 1048576.f, stats.staging.peakUsed / 1048576.f, stats.staging.stalls, stats.staging.growths);
+            ImGui::Text("last upload: %llu B in %u regions, %u copies", (unsigned long long)stats.staging.bytesUploaded, stats.staging.regionCount, stats.staging.copyCount);
+
+            if (ImGui::CollapsingHeader("Device memory")) {
+                MemoryAllocator::Report memory = MemoryAllocator::getReport();
+                ImGui::Text("%u vkDeviceMemory objects, %u dedicated (%.1f MB)", memory.deviceMemoryCount, memory.dedicatedCount, memory.dedicatedBytes / 1048576.f);
+                for (size_t c = 0; c < static_cast<size_t>(MemoryAllocator::Category::COUNT); c++) {
+                    ImGui::Text("%s: %.2f MB in %u allocations", MemoryAllocator::getCategoryName(static_cast<MemoryAllocator::Category>(c)),
+                        memory.categories[c].bytes / 1048576.f, memory.categories[c].allocations);
+                }
+                for (const MemoryAllocator::PoolStats& pool : memory.pools) {
+                    ImGui::Text("type %u%s%s: %u blocks, %.1f/%.1f MB, fragmentation %.2f", pool.memoryTypeIndex, pool.images ? " images" : "", pool.linear ? " linear" : "",
+                        pool.blockCount, pool.usedBytes / 1048576.f, pool.blockBytes / 1048576.f, pool.fragmentation);
+                }
+            }
+
+            ImGui::Text("frame time: %.2f ms, object at center: %d", 1000.f / ImGui::GetIO().Framerate, centerObjectID);
+            bool renderOnDemand = Renderer::isRenderOnDemand();
+            if (ImGui::Checkbox("render on demand", &renderOnDemand)) Renderer::setRenderOnDemand(renderOnDemand);
+            const Renderer::OnDemandStats& onDemand = stats.onDemand;
+            ImGui::Text("frames: %llu traced, %llu reused, %.1f ms gpu saved", (unsigned long long)onDemand.framesTraced,
+                (unsigned long long)onDemand.framesReused, onDemand.gpuTimeSaved);
+            ImGui::Text("cpu per frame: %.3f ms traced, %.3f ms reused", onDemand.framesTraced > 0 ? onDemand.cpuTimeTraced / onDemand.framesTraced : 0.f,
+                onDemand.framesReused > 0 ? onDemand.cpuTimeReused / onDemand.framesReused : 0.f);
+
+            bool dynamicResolution = Renderer::isDynamicResolution();
+            float traceBudget = Renderer::getTraceBudget();
+            bool resolutionChanged = ImGui::Checkbox("dynamic resolution", &dynamicResolution);
+            resolutionChanged |= ImGui::SliderFloat("trace budget (ms)", &traceBudget, 0.5f, 33.f);
+            if (resolutionChanged) Renderer::setDynamicResolution(dynamicResolution, traceBudget);
+            ImGui::Text("render scale %.3f: %ux%u, %.3f ms gpu at full resolution, %u changes", stats.renderScale, stats.renderExtent.width,
+                stats.renderExtent.height, stats.fullResolutionTraceTime, stats.renderScaleChanges);
+
+            bool refinement = Renderer::isRefinement();
+            int refinementStride = static_cast<int>(Renderer::getRefinementStride());
+            bool refinementChanged = ImGui::Checkbox("progressive refinement", &refinement);
+            ImGui::SameLine();
+            refinementChanged |= ImGui::RadioButton("1/4", &refinementStride, 2);
+            ImGui::SameLine();
+            refinementChanged |= ImGui::RadioButton("1/16", &refinementStride, 4);
+            if (refinementChanged) Renderer::setRefinement(refinement, static_cast<uint32_t>(refinementStride));
+            const Renderer::RefinementStats& refine = stats.refinement;
+            ImGui::Text("rays: %u for %u pixels, phase %u/%u, %llu sparse frames (last %.3f ms gpu)", refine.raysTraced, refine.pixelCount,
+                refine.phasesTraced, refine.phaseCount, (unsigned long long)refine.sparseFrames, refine.sparseFrameTime);
+            ImGui::Text("converged %.1f ms (%u frames) after the camera stopped", refine.convergenceTime, refine.convergenceFrames);
+            ImGui::Text("picks: %u resolved, %u pending, latency %.2f ms (%u frames)", stats.picksResolved, stats.picksPending, stats.pickLatency, stats.pickLatencyFrames);
+            ImGui::SliderInt("benchmark picks per frame", &benchmarkPicksPerFrame, 0, MAX_PICKS_PER_FRAME);
+
+            ImGui::Text("selection (right drag, shift for lasso): %u ellipsoids%s, %.3f ms gpu", stats.selectionCount,
+                stats.selectionTruncated ? " (truncated)" : "", stats.selectionTime);
+            if (ImGui::Button("Benchmark full screen selection")) {
+                int width = 0, height = 0;
+                IOInterface::getWindowSize(&width, &height);
+                glm::vec2 scale = glm::vec2(io.DisplayFramebufferScale.x, io.DisplayFramebufferScale.y);
+                selectionBenchmark = Renderer::benchmarkSelection(Vk::IDRegion::fromRect(glm::vec2(0.f), glm::vec2(width, height) * scale));
+            }
+            if (selectionBenchmark.idCount > 0 || selectionBenchmark.gpuPassTime > 0.f) {
+                ImGui::Text("gpu: %.3f ms pass, %.3f ms total", selectionBenchmark.gpuPassTime, selectionBenchmark.gpuTotalTime);
+                ImGui::Text("cpu: %.3f ms copy back + %.3f ms scan", selectionBenchmark.readbackTime, selectionBenchmark.cpuScanTime);
+                ImGui::Text("%u ids%s, %s", selectionBenchmark.idCount, selectionBenchmark.truncated ? " (truncated)" : "",
+                    selectionBenchmark.matches ? "results match" : "results differ");
+            }
+
+            SpatialIndex::Stats index = SpatialIndex::getStats();
+            ImGui::Text("cpu bvh: %u ellipsoids, %u nodes, depth %u, sah cost %.1f", index.ellipsoidCount, index.nodeCount, index.depth, index.sahCost);
+            ImGui::Text("%u builds (last %.3f ms), %u refits (last %.3f ms), last pick %.2f us", index.builds, index.buildTime, index.refits, index.refitTime, index.pickTime);
+            Spatial::BuildMethod buildMethod = SpatialIndex::getBuildMethod();
+            if (ImGui::RadioButton("sah build", buildMethod == Spatial::BuildMethod::SAH)) SpatialIndex::setBuildMethod(Spatial::BuildMethod::SAH);
+            ImGui::SameLine();
+            if (ImGui::RadioButton("lbvh build (rebuilds on every edit)", buildMethod == Spatial::BuildMethod::LBVH)) SpatialIndex::setBuildMethod(Spatial::BuildMethod::LBVH);
+            if (ImGui::Button("Compare builders")) builderComparison = SpatialIndex::compareBuilders();
+            if (builderComparison.ellipsoidCount > 0)
+                ImGui::Text("%u ellipsoids: sah %.2f ms cost %.1f, lbvh %.2f ms cost %.1f", builderComparison.ellipsoidCount,
+                    builderComparison.sahBuildTime, builderComparison.sahCost, builderComparison.lbvhBuildTime, builderComparison.lbvhCost);
+            RenderBackend::Camera camera(viewInverse, projInverse, viewerPosition);
+            int width = 0, height = 0;
+            IOInterface::getWindowSize(&width, &height);
+            glm::uvec2 windowSize = glm::uvec2(std::max(width, 0), std::max(height, 0));
+            bool windowVisible = width > 0 && height > 0;
+            if (ImGui::Button("Benchmark 100k cpu picks") && windowVisible) Benchmarks::spatialIndex(camera, windowSize, 100000);
+            if (ImGui::Button("Measure bounds with 100k rays") && windowVisible) boundsStats = Benchmarks::bounds(camera, windowSize, 100000);
+            if (ImGui::Button("All analytic")) PrimitiveManager::setIntersectionMethod(PrimitiveManager::getEllipsoidIDs(), Model::IntersectionMethod::ANALYTIC);
+            ImGui::SameLine();
+            if (ImGui::Button("All sphere traced")) PrimitiveManager::setIntersectionMethod(PrimitiveManager::getEllipsoidIDs(), Model::IntersectionMethod::SPHERE_TRACE);
+            ImGui::SameLine();
+            if (ImGui::Button("Benchmark intersection kernels")) Benchmarks::intersectionKernels(1000000);
+            if (boundsStats.rayCount > 0) {
+                ImGui::Text("box hits per true hit: %.2f padded, %.2f tight (%u of %u rays hit)",
+                    boundsStats.paddedBoxHits / std::max(1.0, static_cast<double>(boundsStats.paddedTrueHits)),
+                    boundsStats.tightBoxHits / std::max(1.0, static_cast<double>(boundsStats.tightTrueHits)), boundsStats.hitRayCount, boundsStats.rayCount);
+                ImGui::Text("box volume per ellipsoid volume: %.2f padded, %.2f tight", boundsStats.paddedVolumeRatio, boundsStats.tightVolumeRatio);
+            }
+            if (index.batchSize > 0 && index.batchTime > 0.f)
+                ImGui::Text("last batch: %u queries on %u threads in %.2f ms (%.2f M/s)", index.batchSize, index.batchThreads, index.batchTime, index.batchSize / (index.batchTime * 1000.f));
+
+            if (ImGui::Button("CPU reference frame")) renderCPUReference();
+            ImGui::SameLine();
+            if (ImGui::Button("Compare packet tracing") && windowVisible) packetComparison = Benchmarks::packetTracing(camera, windowSize);
+            CPURenderer::TraceMode traceMode = CPURenderer::getTraceMode();
+            for (CPURenderer::TraceMode mode : { CPURenderer::TraceMode::SCALAR, CPURenderer::TraceMode::PACKET_SSE, CPURenderer::TraceMode::PACKET_AVX2 }) {
+                if (mode != CPURenderer::TraceMode::SCALAR) ImGui::SameLine();
+                if (ImGui::RadioButton(CPURenderer::getTraceModeName(mode), traceMode == mode)) CPURenderer::setTraceMode(mode);
+            }
+            CPURenderer::Stats cpuFrame = CPURenderer::getStats();
+            if (cpuFrame.renderTime > 0.f)
+                ImGui::Text("cpu frame: %ux%u, %s on %u threads in %.1f ms (+%.1f ms bvh), %.2f M rays/s", cpuFrame.width, cpuFrame.height,
+                    CPURenderer::getTraceModeName(cpuFrame.traceMode), cpuFrame.threadCount, cpuFrame.renderTime, cpuFrame.buildTime, cpuFrame.raysPerSecond / 1000000.f);
+            if (packetComparison.pixelCount > 0)
+                ImGui::Text("scalar %.1f ms, sse %.1f ms (%.2fx), avx2 %.1f ms (%.2fx), %u ids / %u colors differ", packetComparison.scalarTime,
+                    packetComparison.sseTime, packetComparison.scalarTime / std::max(packetComparison.sseTime, 0.001f), packetComparison.avx2Time,
+                    packetComparison.scalarTime / std::max(packetComparison.avx2Time, 0.001f), packetComparison.idMismatches, packetComparison.colorMismatches);
+
+            // job system size, 0 = one thread per hardware thread
+            static int jobThreads = static_cast<int>(jobSettings.threadCount);
+            ImGui::SliderInt("job threads", &jobThreads, 0, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+            ImGui::SameLine();
+            ImGui::Checkbox("pin", &jobSettings.pinWorkers);
+            ImGui::SameLine();
+            if (ImGui::Button("Restart jobs")) {
+                jobSettings.threadCount = static_cast<uint32_t>(jobThreads);
+                JobSystem::init(jobSettings);
+            }
+            if (ImGui::Button("Benchmark cpu tile scaling") && windowVisible) {
+                CPURenderer::Image image(width, height);
+                Benchmarks::tileScaling(camera, image, jobSettings);
+            }
+
+            if (ImGui::Button("Benchmark slot map 100k")) Benchmarks::slotMap(100000, 2000);
+            ImGui::SameLine();
+            if (ImGui::Button("Per item vs batch edits 10k")) Benchmarks::batchEdits(10000);
+            if (ImGui::Button("Benchmark bvh builder 1k - 1M")) Benchmarks::bvhBuilder(1000000, jobSettings);
+            ImGui::SameLine();
+            if (ImGui::Button("1k - 10M")) Benchmarks::bvhBuilder(10000000, jobSettings);
+
+            if (ImGui::Button("Benchmark BLAS builds 1k, 10k")) Benchmarks::blasBuilds(10000);
+            ImGui::SameLine();
+            if (ImGui::Button("Add 1k ellipsoids")) addRandomEllipsoids(1000);
+            ImGui::SameLine();
+            if (ImGui::Button("Add 10k ellipsoids")) addRandomEllipsoids(10000);
+
+            ImGui::End();
+        }
+
         ImGui::Render();
     }
 
+    void updatePicks() {
+        int width = 0, height = 0;
+        IOInterface::getWindowSize(&width, &height);
+        if (width <= 0 || height <= 0) return;
+
+        int32_t id;
+        if (centerPick != 0) {
+            Renderer::PickStatus status = Renderer::pollObjectID(centerPick, id);
+            if (status == Renderer::PickStatus::READY) centerObjectID = id;
+            if (status != Renderer::PickStatus::PENDING) centerPick = 0;
+        }
+        if (centerPick == 0) centerPick = Renderer::requestObjectID(glm::uvec2(width / 2, height / 2));
+
+        // results are never polled, they only show up in the pick throughput stats
+        static std::mt19937 rng(7);
+        for (int p = 0; p < benchmarkPicksPerFrame; p++)
+            Renderer::requestObjectID(glm::uvec2(rng() % width, rng() % height));
+    }
+
+    void updateSelection() {
+        ImGuiIO& io = ImGui::GetIO();
+        glm::vec2 mouse = glm::vec2(io.MousePos.x * io.DisplayFramebufferScale.x, io.MousePos.y * io.DisplayFramebufferScale.y);
+
+        if (!selecting) {
+            if (!io.WantCaptureMouse && ImGui::IsMouseClicked(1)) {
+                selecting = true;
+                selectionStart = mouse;
+                lassoPoints.clear();
+                lassoPoints.push_back(mouse);
+            }
+            return;
+        }
+
+        if (ImGui::IsMouseDown(1)) {
+            if (glm::distance(lassoPoints.back(), mouse) >= 2.f) lassoPoints.push_back(mouse);
+            return;
+        }
+
+        // released
+        selecting = false;
+        if (glm::distance(selectionStart, mouse) < 2.f) {
+            PrimitiveManager::clearSelection();
+            return;
+        }
+        if (io.KeyShift && lassoPoints.size() >= 3) Renderer::requestSelection(Vk::IDRegion::fromLasso(lassoPoints));
+        else Renderer::requestSelection(Vk::IDRegion::fromRect(selectionStart, mouse));
+    }
+
+    glm::vec4 rotationFromAngles(glm::vec3 degrees) {
+        glm::quat rotation = glm::quat(glm::radians(degrees));
+        return glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+    }
+
+    glm::vec3 anglesFromRotation(glm::vec4 rotation) {
+        return glm::degrees(glm::eulerAngles(glm::quat(rotation.w, rotation.x, rotation.y, rotation.z)));
+    }
+
+    // the current view traced by CPURenderer at the window size, written next to the executable to compare with a screenshot
+    void renderCPUReference() {
+        int width = 0, height = 0;
+        IOInterface::getWindowSize(&width, &height);
+        if (width <= 0 || height <= 0) return;
+
+        CPURenderer::Image image(width, height);
+        CPURenderer::render(RenderBackend::Camera(viewInverse, projInverse, viewerPosition), image);
+        CPURenderer::writeImages(image, "aidanic_cpu");
+
+        CPURenderer::Stats stats = CPURenderer::getStats();
+        AID_REPORT("CPU reference frame: {}x{} on {} threads in {} ms (bvh build {} ms), {} primary + {} shadow rays, {} M rays/s",
+            stats.width, stats.height, stats.threadCount, stats.renderTime, stats.buildTime, stats.primaryRays, stats.shadowRays, stats.raysPerSecond / 1000000.f);
+    }
+
     void processInputs() {
         quit |= inputs.conatinsInput(INPUTS::ESC);
 
@@ -252,10 +673,20 @@ namespace Aidanic {
     void updateMatrices() {
         int width = 0, height = 0;
         IOInterface::getWindowSize(&width, &height);
-        projInverse = glm::inverse(glm::perspective(glm::radians(fovDegrees), static_cast<float>(width / height), nearPlane, farPlane));
+        projInverse = projectionInverse(width, height);
         viewInverse = glm::inverse(glm::lookAt(viewerPosition, viewerPosition + viewerForward, viewerUp));
     }
 
+    glm::mat4 projectionInverse(int width, int height) {
+        return glm::inverse(glm::perspective(glm::radians(fovDegrees), static_cast<float>(width / height), nearPlane, farPlane));
+    }
+
+    void addRandomEllipsoids(uint32_t count) {
+        static std::mt19937 generator;
+        std::vector<Model::EllipsoidID> ids = PrimitiveManager::addEllipsoids(Benchmarks::randomEllipsoids(count, generator));
+        AID_INFO("Added {} random ellipsoids", ids.size());
+    }
+
     void cleanup() {
         AID_INFO("~ Shutting down Aidanic...");
 
@@ -269,6 +700,9 @@ namespace Aidanic {
         IOInterface::cleanUp();
         AID_INFO("IO interface cleaned up");
 
+        JobSystem::shutdown();
+        AID_INFO("Job system shut down");
+
         cleanedUp = true;
     }
 
@@ -277,10 +711,19 @@ namespace Aidanic {
 
 // ENTRY POINT
 
-int main() {
+int main(int argc, char** argv) {
     std::cout << "I'm Aidanic, nice to meet you!" << std::endl;
 
     try {
+        // the compute tracing pipeline even on a ray tracing gpu, ahead of the other arguments
+        if (argc > 1 && std::string(argv[1]) == "--compute") {
+            Renderer::forceComputeTracing(true);
+            argc--;
+            argv++;
+        }
+        if (argc > 1 && std::string(argv[1]) == "--headless") return Aidanic::runHeadless(argc - 2, argv + 2);
+        if (argc > 1 && std::string(argv[1]) == "--headless-gpu") return Aidanic::runHeadlessGPU(argc - 2, argv + 2);
+
         Aidanic::init();
         Aidanic::loop();
         Aidanic::cleanup();
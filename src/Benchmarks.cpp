@@ -0,0 +1,422 @@
+#include "Benchmarks.h"
+
+#include "Renderer.h"
+#include "tools/BVHBuilder.h"
+#include "tools/Intersection.h"
+#include "tools/Log.h"
+
+#include "gtc/quaternion.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace std::chrono;
+
+namespace Benchmarks {
+
+    // private function declarations
+
+    void flushEdits();
+
+    // function implimentations
+
+    Spatial::Ray cameraRay(const RenderBackend::Camera& camera, glm::vec2 pixel, glm::vec2 size) {
+        glm::vec2 uv = (pixel - size * 0.5f) / size.x;
+        glm::vec4 target = camera.projInverse * glm::vec4(uv.x, -uv.y, 1.f, 1.f);
+        glm::vec4 direction = camera.viewInverse * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0.f);
+        return Spatial::Ray(glm::vec3(camera.position), glm::normalize(glm::vec3(direction)), 10000.f);
+    }
+
+    void spatialIndex(const RenderBackend::Camera& camera, glm::uvec2 size, uint32_t queryCount) {
+        static std::mt19937 rng(11);
+        std::vector<Spatial::Ray> rays(queryCount);
+        for (Spatial::Ray& ray : rays) ray = cameraRay(camera, glm::vec2(rng() % size.x, rng() % size.y), glm::vec2(size));
+
+        std::vector<SpatialIndex::PickResult> hits(queryCount);
+        SpatialIndex::pick(rays, hits);
+        SpatialIndex::Stats pickStats = SpatialIndex::getStats();
+
+        uint32_t hitCount = 0;
+        std::vector<glm::vec3> points;
+        std::vector<Vk::AABB> boxes;
+        for (uint32_t r = 0; r < queryCount; r++) {
+            if (!hits[r].id.isValid()) continue;
+            hitCount++;
+            glm::vec3 point = rays[r].origin + rays[r].direction * hits[r].distance;
+            points.push_back(point);
+            boxes.push_back(Vk::AABB(point - glm::vec3(1.f), point + glm::vec3(1.f)));
+        }
+
+        std::vector<std::vector<Model::EllipsoidID>> results;
+        SpatialIndex::nearest(points, 8, results);
+        float nearestTime = SpatialIndex::getStats().batchTime;
+        SpatialIndex::overlapping(boxes, results);
+        float overlapTime = SpatialIndex::getStats().batchTime;
+
+        AID_REPORT("CPU BVH benchmark: {} picks ({} hits) in {} ms on {} threads, {} 8-nearest in {} ms, {} overlaps in {} ms",
+            queryCount, hitCount, pickStats.batchTime, pickStats.batchThreads, points.size(), nearestTime, boxes.size(), overlapTime);
+    }
+
+    SpatialIndex::BoundsStats bounds(const RenderBackend::Camera& camera, glm::uvec2 size, uint32_t rayCount) {
+        static std::mt19937 rng(17);
+        std::vector<Spatial::Ray> rays(rayCount);
+        for (Spatial::Ray& ray : rays) ray = cameraRay(camera, glm::vec2(rng() % size.x, rng() % size.y), glm::vec2(size));
+
+        SpatialIndex::BoundsStats boundsStats = SpatialIndex::measureBounds(rays);
+        AID_REPORT("Bounds: {} of {} rays hit, padded boxes {} hits for {} true hits, tight boxes {} hits for {} true hits, box / ellipsoid volume {} padded, {} tight",
+            boundsStats.hitRayCount, boundsStats.rayCount, boundsStats.paddedBoxHits, boundsStats.paddedTrueHits,
+            boundsStats.tightBoxHits, boundsStats.tightTrueHits, boundsStats.paddedVolumeRatio, boundsStats.tightVolumeRatio);
+        return boundsStats;
+    }
+
+    void intersectionKernels(uint32_t rayCount) {
+        std::mt19937 rng(19);
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        std::uniform_real_distribution<float> radiusDistribution(0.05f, 0.5f);
+        std::uniform_real_distribution<float> distanceDistribution(1.f, 20.f);
+
+        // local frame: ray towards a random point of the box from a random direction outside it
+        struct Query {
+            glm::vec3 origin, direction, radius;
+        };
+        std::vector<Query> queries(rayCount);
+        for (Query& query : queries) {
+            query.radius = glm::vec3(radiusDistribution(rng), radiusDistribution(rng), radiusDistribution(rng));
+            glm::vec3 target = glm::vec3(unit(rng), unit(rng), unit(rng)) * query.radius;
+            glm::vec3 away = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.f, 0.f, 1e-3f));
+            query.origin = target + away * distanceDistribution(rng);
+            query.direction = glm::normalize(target - query.origin);
+        }
+        const float tMin = 0.001f, tMax = 10000.f; // as in scene.rgen
+
+        std::vector<float> analyticT(rayCount, -1.f), tracedT(rayCount, -1.f);
+        std::vector<glm::vec3> analyticNormal(rayCount), tracedNormal(rayCount);
+
+        auto start = high_resolution_clock::now();
+        for (uint32_t r = 0; r < rayCount; r++) {
+            const Query& q = queries[r];
+            if (!Spatial::intersectEllipsoidAnalytic(q.origin, q.direction, q.radius, tMin, tMax, analyticT[r], analyticNormal[r])) analyticT[r] = -1.f;
+        }
+        float analyticTime = duration<float, std::nano>(high_resolution_clock::now() - start).count();
+
+        uint64_t totalSteps = 0;
+        start = high_resolution_clock::now();
+        for (uint32_t r = 0; r < rayCount; r++) {
+            const Query& q = queries[r];
+            uint32_t steps;
+            if (!Spatial::intersectEllipsoidSphereTraced(q.origin, q.direction, q.radius, tracedT[r], tracedNormal[r], steps)) tracedT[r] = -1.f;
+            totalSteps += steps;
+        }
+        float tracedTime = duration<float, std::nano>(high_resolution_clock::now() - start).count();
+
+        // agreement, t relative to the ray's distance to the ellipsoid and the angle between normals
+        uint32_t bothHit = 0, onlyAnalytic = 0, onlyTraced = 0;
+        float maxRelativeError = 0.f, maxNormalAngle = 0.f;
+        double sumRelativeError = 0.0, sumNormalAngle = 0.0;
+        for (uint32_t r = 0; r < rayCount; r++) {
+            bool a = analyticT[r] >= 0.f, t = tracedT[r] >= 0.f;
+            if (a && t) {
+                bothHit++;
+                float relativeError = std::abs(analyticT[r] - tracedT[r]) / analyticT[r];
+                float angle = glm::degrees(std::acos(std::min(1.f, glm::dot(analyticNormal[r], tracedNormal[r]))));
+                maxRelativeError = std::max(maxRelativeError, relativeError);
+                maxNormalAngle = std::max(maxNormalAngle, angle);
+                sumRelativeError += relativeError;
+                sumNormalAngle += angle;
+            } else if (a) {
+                onlyAnalytic++;
+            } else if (t) {
+                onlyTraced++;
+            }
+        }
+
+        AID_REPORT("Intersection kernels: {} rays, analytic {} ns/ray, sphere traced {} ns/ray ({} sdf steps/ray + 6 for the normal), {}x",
+            rayCount, analyticTime / rayCount, tracedTime / rayCount, static_cast<double>(totalSteps) / rayCount, tracedTime / analyticTime);
+        AID_REPORT("Intersection kernels: {} hit both, {} only analytic, {} only sphere traced, relative t difference {} mean {} max, normal angle {} mean {} max degrees",
+            bothHit, onlyAnalytic, onlyTraced, sumRelativeError / std::max(1u, bothHit), maxRelativeError, sumNormalAngle / std::max(1u, bothHit), maxNormalAngle);
+    }
+
+    CPURenderer::PacketComparison packetTracing(const RenderBackend::Camera& camera, glm::uvec2 size) {
+        CPURenderer::PacketComparison packetComparison = CPURenderer::comparePacketTracing(camera, size.x, size.y);
+        AID_REPORT("Packet tracing: scalar {} ms, sse {} ms, avx2 {} ms (0 = not supported), {} object ids and {} colors differ from scalar (max {}/255)",
+            packetComparison.scalarTime, packetComparison.sseTime, packetComparison.avx2Time, packetComparison.idMismatches,
+            packetComparison.colorMismatches, packetComparison.maxColorDifference);
+        return packetComparison;
+    }
+
+    void tileScaling(const RenderBackend::Camera& camera, CPURenderer::Image& image, const JobSystem::Settings& jobSettings) {
+        uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        float singleThreadRate = 0.f;
+        for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+            JobSystem::Settings settings = jobSettings;
+            settings.threadCount = threads;
+            JobSystem::init(settings);
+            JobSystem::resetStats();
+            CPURenderer::render(camera, image);
+            CPURenderer::Stats stats = CPURenderer::getStats();
+            JobSystem::Stats jobs = JobSystem::getStats();
+            if (threads == 1) singleThreadRate = stats.raysPerSecond;
+
+            float busiest = 0.f, total = 0.f;
+            std::string workers;
+            for (size_t w = 0; w < stats.workers.size(); w++) {
+                workers += " " + std::to_string(stats.workers[w].tiles) + "/" + std::to_string(stats.workers[w].time) + "/" + std::to_string(jobs.workers[w].steals);
+                busiest = std::max(busiest, stats.workers[w].time);
+                total += stats.workers[w].time;
+            }
+            AID_REPORT("Tile scaling: {} threads in {} ms (+{} ms bvh build), {} primary + {} shadow rays, {} M rays/s, {}x",
+                threads, stats.renderTime, stats.buildTime, stats.primaryRays, stats.shadowRays, stats.raysPerSecond / 1000000.f,
+                stats.raysPerSecond / singleThreadRate);
+            AID_REPORT("Tile scaling: tiles/ms/steals per thread{}, busiest thread {}x the mean", workers,
+                busiest / std::max(total / stats.workers.size(), 1e-6f));
+            if (threads == maxThreads) break;
+        }
+        JobSystem::init(jobSettings);
+    }
+
+    void slotMap(uint32_t count, uint32_t legacyCount) {
+        std::mt19937 rng(29);
+        auto elapsed = [](time_point<high_resolution_clock> start) { return duration<float, std::milli>(high_resolution_clock::now() - start).count(); };
+        volatile float checksum = 0.f; // keeps the updates from being optimized out
+
+        for (uint32_t n : { count, legacyCount }) {
+            Model::SlotMap<Model::Ellipsoid> ellipsoids;
+            std::vector<Model::EllipsoidID> ids(n);
+            auto start = high_resolution_clock::now();
+            for (Model::EllipsoidID& id : ids) {
+                id = ellipsoids.insert(Model::Ellipsoid());
+                ellipsoids.find(id)->objectID = id.getID();
+            }
+            float insertTime = elapsed(start);
+
+            std::shuffle(ids.begin(), ids.end(), rng);
+            start = high_resolution_clock::now();
+            for (Model::EllipsoidID id : ids) checksum += ++ellipsoids.find(id)->center.x;
+            float updateTime = elapsed(start);
+
+            start = high_resolution_clock::now();
+            for (Model::EllipsoidID id : ids) ellipsoids.erase(id);
+            float deleteTime = elapsed(start);
+
+            AID_REPORT("Slot map: {} ellipsoids inserted in {} ms, updated in {} ms, deleted in {} ms, {} / {} / {} ns per operation",
+                n, insertTime, updateTime, deleteTime, insertTime * 1e6f / n, updateTime * 1e6f / n, deleteTime * 1e6f / n);
+        }
+
+        // the old ids: a new one is the smallest value not in the vector, deletes search the vector for the position
+        std::vector<int32_t> ids;
+        std::map<int32_t, Model::Ellipsoid> ellipsoids;
+        auto contains = [&ids](int32_t id) { return std::find(ids.begin(), ids.end(), id) != ids.end(); };
+        auto start = high_resolution_clock::now();
+        for (uint32_t i = 0; i < legacyCount; i++) {
+            int32_t id = 0;
+            while (contains(id)) id++;
+            ellipsoids[id].objectID = id;
+            ids.push_back(id);
+        }
+        float insertTime = elapsed(start);
+
+        std::vector<int32_t> order = ids;
+        std::shuffle(order.begin(), order.end(), rng);
+        start = high_resolution_clock::now();
+        for (int32_t id : order) checksum += ++ellipsoids.at(id).center.x;
+        float updateTime = elapsed(start);
+
+        start = high_resolution_clock::now();
+        for (int32_t id : order) {
+            ellipsoids.erase(id);
+            ids.erase(std::find(ids.begin(), ids.end(), id));
+        }
+        float deleteTime = elapsed(start);
+
+        AID_REPORT("Old id scan: {} ellipsoids (capped, {} requested) inserted in {} ms, updated in {} ms, deleted in {} ms, {} / {} / {} ns per operation",
+            legacyCount, count, insertTime, updateTime, deleteTime, insertTime * 1e6f / legacyCount, updateTime * 1e6f / legacyCount,
+            deleteTime * 1e6f / legacyCount);
+    }
+
+    void batchEdits(uint32_t count) {
+        std::mt19937 rng(31);
+        auto elapsed = [](time_point<high_resolution_clock> start) { return duration<float, std::milli>(high_resolution_clock::now() - start).count(); };
+        std::vector<Model::EllipsoidParams> added = randomEllipsoids(count, rng), updated = randomEllipsoids(count, rng);
+
+        // edits made before the benchmark are caught up first, so they don't count
+        flushEdits();
+
+        std::vector<Model::EllipsoidID> ids;
+        ids.reserve(count);
+        auto start = high_resolution_clock::now();
+        for (const Model::EllipsoidParams& p : added) {
+            Model::EllipsoidID id = PrimitiveManager::addEllipsoid(p.center, p.radius, p.color, p.rotation);
+            if (id.isValid()) ids.push_back(id);
+        }
+        flushEdits();
+        float itemAddTime = elapsed(start);
+        start = high_resolution_clock::now();
+        for (uint32_t i = 0; i < ids.size(); i++)
+            PrimitiveManager::updateEllipsoid(ids[i], updated[i].center, updated[i].radius, updated[i].color, updated[i].rotation);
+        flushEdits();
+        float itemUpdateTime = elapsed(start);
+        start = high_resolution_clock::now();
+        for (Model::EllipsoidID& id : ids) PrimitiveManager::deleteEllipsoid(id);
+        flushEdits();
+        float itemDeleteTime = elapsed(start);
+        uint32_t itemCount = static_cast<uint32_t>(ids.size());
+
+        start = high_resolution_clock::now();
+        ids = PrimitiveManager::addEllipsoids(added);
+        flushEdits();
+        float batchAddTime = elapsed(start);
+        start = high_resolution_clock::now();
+        if (!ids.empty()) PrimitiveManager::updateEllipsoids(ids, updated);
+        flushEdits();
+        float batchUpdateTime = elapsed(start);
+        start = high_resolution_clock::now();
+        PrimitiveManager::deleteEllipsoids(ids);
+        flushEdits();
+        float batchDeleteTime = elapsed(start);
+
+        AID_REPORT("Batch edits: {} ellipsoids one at a time added in {} ms, updated in {} ms, deleted in {} ms",
+            itemCount, itemAddTime, itemUpdateTime, itemDeleteTime);
+        AID_REPORT("Batch edits: {} ellipsoids as one batch added in {} ms ({}x), updated in {} ms ({}x), deleted in {} ms ({}x)",
+            count, batchAddTime, itemAddTime / std::max(batchAddTime, 1e-6f), batchUpdateTime, itemUpdateTime / std::max(batchUpdateTime, 1e-6f),
+            batchDeleteTime, itemDeleteTime / std::max(batchDeleteTime, 1e-6f));
+    }
+
+    // rebuilds the cpu renderer's bvh with a one pixel render and submits and waits for the dirty cluster BLAS builds
+    void flushEdits() {
+        CPURenderer::Image image(1, 1);
+        CPURenderer::render(RenderBackend::Camera(), image);
+        if (RenderBackend::getSelected() == RenderBackend::Type::VULKAN_RTX && Renderer::isRayTracing()) Renderer::flushClusterBuilds();
+    }
+
+    void blasBuilds(uint32_t maxCount) {
+        if (RenderBackend::getSelected() != RenderBackend::Type::VULKAN_RTX || !Renderer::isRayTracing()) {
+            AID_WARN("Benchmarks::blasBuilds() needs the vulkan renderer with ray tracing");
+            return;
+        }
+        std::mt19937 rng(37);
+
+        // clusters edited before the benchmark are built first, so they don't count
+        Renderer::flushClusterBuilds();
+
+        for (uint32_t count = 1000; count <= maxCount; count *= 10) {
+            std::vector<Model::EllipsoidID> ids = PrimitiveManager::addEllipsoids(randomEllipsoids(count, rng));
+            Renderer::BLASBuildTiming timing = Renderer::flushClusterBuilds();
+            PrimitiveManager::deleteEllipsoids(ids);
+
+            AID_REPORT("BLAS builds: {} ellipsoids in {} BLASs ({} aabbs), {} ms cpu to record and submit, {} ms gpu ({} M aabbs/s), {} ms until the fence signaled",
+                count, timing.blasCount, timing.aabbCount, timing.cpuTime, timing.gpuTime,
+                timing.aabbCount / std::max(timing.gpuTime * 1000.f, 1e-6f), timing.totalTime);
+        }
+    }
+
+    std::vector<Model::EllipsoidParams> randomEllipsoids(uint32_t count, std::mt19937& rng) {
+        std::uniform_real_distribution<float> position(-20.f, 20.f);
+        std::uniform_real_distribution<float> radius(0.05f, 0.5f);
+        std::uniform_real_distribution<float> color(0.f, 1.f);
+        std::uniform_real_distribution<float> angle(-180.f, 180.f);
+
+        std::vector<Model::EllipsoidParams> params(count);
+        for (Model::EllipsoidParams& p : params) {
+            p.center = glm::vec3(position(rng), position(rng), position(rng));
+            p.radius = glm::vec3(radius(rng), radius(rng), radius(rng));
+            p.color = glm::vec4(color(rng), color(rng), color(rng), 1.f);
+            glm::quat rotation = glm::quat(glm::radians(glm::vec3(angle(rng), angle(rng), angle(rng))));
+            p.rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+        }
+        return params;
+    }
+
+    void bvhBuilder(uint32_t maxCount, const JobSystem::Settings& jobSettings) {
+        const uint32_t rayCount = 100000;
+        std::mt19937 rng(13);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        auto elapsed = [](time_point<high_resolution_clock> start) { return duration<float, std::milli>(high_resolution_clock::now() - start).count(); };
+
+        std::vector<Vk::AABB> aabbs;
+        for (uint32_t count = 1000; count <= maxCount; count *= 10) {
+            float side = std::cbrt(static_cast<float>(count)) * 2.f;
+            aabbs.resize(count);
+            for (Vk::AABB& aabb : aabbs) {
+                glm::vec3 center = glm::vec3(unit(rng), unit(rng), unit(rng)) * side;
+                glm::vec3 radius = glm::vec3(0.05f) + glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.45f;
+                aabb = Vk::AABB(center - radius, center + radius);
+            }
+
+            auto start = high_resolution_clock::now();
+            Spatial::BinaryBVH tree = Spatial::buildBinnedSAH(aabbs.data(), count);
+            float buildTime = elapsed(start);
+            start = high_resolution_clock::now();
+            Spatial::BVH4 tree4 = Spatial::collapse<4>(tree);
+            float collapse4Time = elapsed(start);
+            start = high_resolution_clock::now();
+            Spatial::BVH8 tree8 = Spatial::collapse<8>(tree);
+            float collapse8Time = elapsed(start);
+
+            AID_REPORT("BVH builder: {} primitives built in {} ms ({} M/s), {} nodes, depth {}, sah cost {}, collapsed in {} ms (4 wide) {} ms (8 wide)",
+                count, buildTime, count / (buildTime * 1000.f), tree.nodes.size(), tree.depth, Spatial::sahCost(tree.nodes),
+                collapse4Time, collapse8Time);
+
+            for (uint32_t mortonBits : { 30u, 63u }) {
+                Spatial::BuildSettings settings;
+                settings.mortonBits = mortonBits;
+                start = high_resolution_clock::now();
+                Spatial::BinaryBVH linear = Spatial::buildLBVH(aabbs.data(), count, settings);
+                float linearTime = elapsed(start);
+                AID_REPORT("BVH builder: LBVH with {} bit codes built in {} ms ({} M/s), {} nodes, depth {}, sah cost {}",
+                    mortonBits, linearTime, count / (linearTime * 1000.f), linear.nodes.size(), linear.depth, Spatial::sahCost(linear.nodes));
+            }
+
+            // rays from outside the volume through it, the closest box hit ends each ray
+            std::vector<Spatial::Ray> rays(rayCount);
+            for (Spatial::Ray& ray : rays) {
+                glm::vec3 origin = glm::vec3(-side, unit(rng) * side, unit(rng) * side);
+                glm::vec3 target = glm::vec3(side, unit(rng) * side, unit(rng) * side) * 2.f;
+                ray = Spatial::Ray(origin, glm::normalize(target - origin));
+            }
+            auto hitBox = [&aabbs](uint32_t primitive, Spatial::Ray& ray) {
+                float t;
+                if (!Spatial::intersectRayAABB(ray.origin, glm::vec3(1.f) / ray.direction, ray.tMax, aabbs[primitive], t)) return false;
+                ray.tMax = t;
+                return true;
+            };
+
+            Spatial::BVH binary;
+            std::vector<uint32_t> keys(count);
+            for (uint32_t i = 0; i < count; i++) keys[i] = i;
+            binary.build(keys.data(), aabbs.data(), count);
+
+            float rayTimes[3];
+            for (int layout = 0; layout < 3; layout++) {
+                start = high_resolution_clock::now();
+                for (Spatial::Ray ray : rays) {
+                    if (layout == 0) binary.intersect(ray, hitBox);
+                    else if (layout == 1) tree4.intersect(ray, hitBox);
+                    else tree8.intersect(ray, hitBox);
+                }
+                rayTimes[layout] = elapsed(start);
+            }
+            AID_REPORT("BVH builder: {} rays in {} ms (binary), {} ms (4 wide), {} ms (8 wide), single thread",
+                rayCount, rayTimes[0], rayTimes[1], rayTimes[2]);
+        }
+
+        // the last and largest set
+        uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        float singleThreadTime = 0.f;
+        for (uint32_t threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+            JobSystem::Settings jobs = jobSettings;
+            jobs.threadCount = threads;
+            JobSystem::init(jobs);
+            auto start = high_resolution_clock::now();
+            Spatial::buildBinnedSAH(aabbs.data(), static_cast<uint32_t>(aabbs.size()));
+            float buildTime = elapsed(start);
+            if (threads == 1) singleThreadTime = buildTime;
+            AID_REPORT("BVH builder: {} primitives on {} threads in {} ms, {}x speedup", aabbs.size(), threads, buildTime, singleThreadTime / buildTime);
+            if (threads == hardwareThreads) break;
+        }
+        JobSystem::init(jobSettings);
+    }
+};
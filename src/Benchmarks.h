@@ -0,0 +1,57 @@
+#pragma once
+
+#include "RenderBackend.h"
+#include "CPURenderer.h"
+#include "SpatialIndex.h"
+#include "tools/JobSystem.h"
+
+#include <glm.hpp>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+/*
+    CPU side benchmarks started from the imgui Renderer window and the headless modes. Each one reports its results
+    with AID_REPORT, the ones the window keeps showing are returned as well. Ray benchmarks shoot camera rays through
+    random pixels of an image of the given size. Benchmarks that restart the job system restore jobSettings when done
+*/
+namespace Benchmarks {
+
+    // public function declarations
+
+    // same ray as the raygen shader for a pixel of a size image
+    Spatial::Ray cameraRay(const RenderBackend::Camera& camera, glm::vec2 pixel, glm::vec2 size);
+
+    // random screen rays, then the k nearest and overlap queries around the hits
+    void spatialIndex(const RenderBackend::Camera& camera, glm::uvec2 size, uint32_t queryCount);
+    // random screen rays against the padded and tight bounds of the scene
+    SpatialIndex::BoundsStats bounds(const RenderBackend::Camera& camera, glm::uvec2 size, uint32_t rayCount);
+    // the cpu mirrors of both intersection shader kernels on rays that hit the ellipsoid's box, like the shader is run
+    void intersectionKernels(uint32_t rayCount);
+    // the camera's view in every cpu trace mode
+    CPURenderer::PacketComparison packetTracing(const RenderBackend::Camera& camera, glm::uvec2 size);
+
+    // renders image with the job system restarted at 1, 2, 4... up to the hardware threads. reports the speedup and
+    // how evenly the tiles spread over the threads, busiest thread against the mean
+    void tileScaling(const RenderBackend::Camera& camera, CPURenderer::Image& image, const JobSystem::Settings& jobSettings);
+
+    // inserts, updates and deletes count ellipsoids in a SlotMap and in the vector of ids plus std::map that
+    // PrimitiveManager used before. finding a free id scanned the vector once per candidate value, which makes the old
+    // inserts cubic in the ellipsoid count, so it only runs up to legacyCount ellipsoids. the slot map runs both counts
+    void slotMap(uint32_t count, uint32_t legacyCount);
+    // count random rotated ellipsoids around the origin, the scene the window's add buttons and the headless modes use
+    std::vector<Model::EllipsoidParams> randomEllipsoids(uint32_t count, std::mt19937& rng);
+
+    // adds, updates and deletes count random ellipsoids through PrimitiveManager, once per ellipsoid and once as one
+    // batch each. every step is timed until the backends caught up: the cpu renderer's bvh rebuilt and, with the vulkan
+    // renderer ray tracing, the cluster BLAS builds flushed. the compute pipeline builds its bvh in the next frame, untimed
+    void batchEdits(uint32_t count);
+    // adds batches of 1k, 10k... up to maxCount random ellipsoids, flushes their cluster BLAS builds and deletes them
+    // again. reports the vulkan renderer's build times and aabb throughput, needs it selected and ray tracing
+    void blasBuilds(uint32_t maxCount);
+
+    // builds over random boxes of 1k, 10k... up to maxCount primitives, with the same density so the trees are comparable.
+    // logs build and collapse times, sah cost, closest hit throughput of the binary and wide layouts, and the thread
+    // scaling of the largest build
+    void bvhBuilder(uint32_t maxCount, const JobSystem::Settings& jobSettings);
+};
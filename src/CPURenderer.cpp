@@ -0,0 +1,449 @@
+#include "CPURenderer.h"
+
+#include "tools/AABB.h"
+#include "tools/BVH.h"
+#include "tools/Intersection.h"
+#include "tools/JobSystem.h"
+#include "tools/Log.h"
+#include "tools/PacketTraversal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+
+using namespace std::chrono;
+
+// pixels per side of the square tiles, one job each
+#define CPU_TILE_SIZE 16
+// pixels of a ray packet, PACKET_SIZE in total. divides the tile size
+#define PACKET_WIDTH 4
+#define PACKET_HEIGHT 2
+
+// same as in the shaders, see scene.rgen, scene.rchit and shaders/common.glsl
+#define PRIMARY_T_MIN 0.001f
+#define PRIMARY_T_MAX 10000.f
+#define SHADOW_T_MIN 0.0001f
+#define SHADOW_T_MAX 1000.f
+#define AMBIENT 0.2f
+#define LIGHT_SOURCE glm::vec3(-1.f, 5.f, 0.5f)
+
+namespace CPURenderer {
+
+    // private variables
+
+    // the ray payload of scene.rgen
+    struct _RayPayload {
+        glm::vec4 color = glm::vec4(-1.f);
+        int32_t objectID = -1;
+    };
+
+    // the hit attributes reported by ellipsoid.rint
+    struct _HitPayload {
+        glm::vec3 normal = glm::vec3(0.f);
+        glm::vec4 color = glm::vec4(0.f);
+        int32_t objectID = -1;
+    };
+
+    // per job system slot, summed into stats after the frame
+    struct _Counters {
+        uint64_t primaryRays = 0;
+        uint64_t shadowRays = 0;
+        uint64_t intersectionTests = 0;
+        uint32_t tiles = 0;
+        float time = 0.f;
+    };
+
+    Spatial::BVH bvh;
+    std::vector<Model::Ellipsoid> ellipsoids; // by ellipsoid slot index, objectID -1 for free slots
+    bool needsBuild = false;
+    Spatial::InstructionSet instructionSet = Spatial::detectInstructionSet();
+    TraceMode traceMode = getBestTraceMode();
+    Stats stats;
+
+    // private function declarations
+
+    void storeEllipsoid(Model::EllipsoidID id);
+    void build();
+    Spatial::Ray primaryRay(const RenderBackend::Camera& camera, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    void tracePixel(const RenderBackend::Camera& camera, uint32_t x, uint32_t y, Image& image, _Counters& counters);
+    void tracePacket(const Spatial::PacketScene& scene, const RenderBackend::Camera& camera, uint32_t x0, uint32_t y0, Image& image, _Counters& counters);
+    glm::vec4 shade(const _HitPayload& hit, glm::vec3 toLight, bool inShadow);
+    glm::vec4 background(glm::vec3 direction);
+    void storePixel(Image& image, uint32_t x, uint32_t y, const _RayPayload& payload);
+    bool isSupported(TraceMode mode);
+    bool intersectEllipsoid(uint32_t index, const Spatial::Ray& ray, float tMin, float& t, glm::vec3& normal);
+    bool traceClosest(Spatial::Ray ray, float tMin, _HitPayload& hit, float& t, _Counters& counters);
+    bool traceShadow(const Spatial::Ray& ray, float tMin, _Counters& counters);
+    uint8_t toUnorm8(float value);
+
+    // function implimentations
+
+    void addEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        for (Model::EllipsoidID id : ids) storeEllipsoid(id);
+        needsBuild |= !ids.empty();
+    }
+
+    void updateEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        for (Model::EllipsoidID id : ids) storeEllipsoid(id);
+        needsBuild |= !ids.empty();
+    }
+
+    void removeEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        for (Model::EllipsoidID id : ids) {
+            if (id.getIndex() < ellipsoids.size()) ellipsoids[id.getIndex()].objectID = -1;
+        }
+        needsBuild |= !ids.empty();
+    }
+
+    void storeEllipsoid(Model::EllipsoidID id) {
+        if (id.getIndex() >= ellipsoids.size()) ellipsoids.resize(static_cast<size_t>(id.getIndex()) + 1);
+        ellipsoids[id.getIndex()] = PrimitiveManager::getEllipsoid(id);
+    }
+
+    void build() {
+        auto start = high_resolution_clock::now();
+
+        std::vector<uint32_t> keys;
+        std::vector<Vk::AABB> aabbs;
+        for (uint32_t i = 0; i < ellipsoids.size(); i++) {
+            if (ellipsoids[i].objectID < 0) continue;
+            keys.push_back(i);
+            aabbs.push_back(Vk::AABB(ellipsoids[i]));
+        }
+        bvh.build(keys.data(), aabbs.data(), static_cast<uint32_t>(keys.size()));
+        needsBuild = false;
+
+        stats.ellipsoidCount = static_cast<uint32_t>(keys.size());
+        stats.buildTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    }
+
+    void render(const RenderBackend::Camera& camera, Image& image) {
+        stats.buildTime = 0.f;
+        if (needsBuild) build();
+
+        auto start = high_resolution_clock::now();
+        uint32_t tilesX = (image.width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+        uint32_t tileCount = tilesX * ((image.height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE);
+
+        Spatial::PacketScene scene;
+        scene.nodes = bvh.getNodes().data();
+        scene.nodeCount = bvh.getNodeCount();
+        scene.primitiveKeys = bvh.getPrimitiveKeys().data();
+        scene.ellipsoids = ellipsoids.data();
+
+        // one job per tile, workers that got cheap tiles steal more of them
+        std::vector<_Counters> counters(JobSystem::getThreadCount());
+        JobSystem::parallelFor(0, tileCount, 1, [&](uint32_t firstTile, uint32_t lastTile) {
+            _Counters& counter = counters[JobSystem::getSlot()];
+            auto tileStart = high_resolution_clock::now();
+            for (uint32_t tile = firstTile; tile < lastTile; tile++) {
+                uint32_t x0 = (tile % tilesX) * CPU_TILE_SIZE;
+                uint32_t y0 = (tile / tilesX) * CPU_TILE_SIZE;
+                uint32_t x1 = std::min(x0 + CPU_TILE_SIZE, image.width), y1 = std::min(y0 + CPU_TILE_SIZE, image.height);
+
+                if (traceMode == TraceMode::SCALAR) {
+                    for (uint32_t y = y0; y < y1; y++) {
+                        for (uint32_t x = x0; x < x1; x++) tracePixel(camera, x, y, image, counter);
+                    }
+                } else {
+                    for (uint32_t y = y0; y < y1; y += PACKET_HEIGHT) {
+                        for (uint32_t x = x0; x < x1; x += PACKET_WIDTH) tracePacket(scene, camera, x, y, image, counter);
+                    }
+                }
+                counter.tiles++;
+            }
+            counter.time += duration<float, std::milli>(high_resolution_clock::now() - tileStart).count();
+        }, JobSystem::Priority::HIGH);
+
+        stats.width = image.width;
+        stats.height = image.height;
+        stats.threadCount = std::min(static_cast<uint32_t>(counters.size()), std::max(1u, tileCount));
+        stats.traceMode = traceMode;
+        stats.primaryRays = stats.shadowRays = stats.intersectionTests = 0;
+        stats.workers.clear();
+        for (const _Counters& c : counters) {
+            stats.primaryRays += c.primaryRays;
+            stats.shadowRays += c.shadowRays;
+            stats.intersectionTests += c.intersectionTests;
+            stats.workers.push_back({ c.tiles, c.time });
+        }
+        stats.renderTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+        stats.raysPerSecond = (stats.primaryRays + stats.shadowRays) / std::max(stats.renderTime * 0.001f, 1e-6f);
+    }
+
+    // the ray of scene.rgen
+    Spatial::Ray primaryRay(const RenderBackend::Camera& camera, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+        glm::vec2 size = glm::vec2(width, height);
+        glm::vec2 uv = (glm::vec2(x, y) + glm::vec2(0.5f) - size / 2.f) / size.x; // between -0.5 and 0.5
+        glm::vec4 target = camera.projInverse * glm::vec4(uv.x, -uv.y, 1.f, 1.f);
+        glm::vec4 direction = camera.viewInverse * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0.f);
+        return Spatial::Ray(glm::vec3(camera.position), glm::normalize(glm::vec3(direction)), PRIMARY_T_MAX);
+    }
+
+    // scene.rgen, with scene.rchit and the miss shaders inlined where it traces
+    void tracePixel(const RenderBackend::Camera& camera, uint32_t x, uint32_t y, Image& image, _Counters& counters) {
+        Spatial::Ray ray = primaryRay(camera, x, y, image.width, image.height);
+        _RayPayload payload;
+        _HitPayload hit;
+        float t;
+        counters.primaryRays++;
+
+        if (traceClosest(ray, PRIMARY_T_MIN, hit, t, counters)) {
+            glm::vec3 origin = ray.origin + ray.direction * t;
+            glm::vec3 toLight = LIGHT_SOURCE - origin;
+            counters.shadowRays++;
+            bool inShadow = traceShadow(Spatial::Ray(origin, glm::normalize(toLight), SHADOW_T_MAX), SHADOW_T_MIN, counters);
+
+            payload.color = shade(hit, toLight, inShadow);
+            payload.objectID = hit.objectID;
+        } else {
+            payload.color = background(ray.direction);
+        }
+        storePixel(image, x, y, payload);
+    }
+
+    // tracePixel() for the PACKET_WIDTH x PACKET_HEIGHT pixels from (x0, y0), the primary and the shadow rays each
+    // traced as one packet. lanes outside the image are inactive
+    void tracePacket(const Spatial::PacketScene& scene, const RenderBackend::Camera& camera, uint32_t x0, uint32_t y0, Image& image, _Counters& counters) {
+        bool avx2 = traceMode == TraceMode::PACKET_AVX2;
+        Spatial::Ray rays[PACKET_SIZE];
+        Spatial::RayPacket primary;
+        uint32_t activeLanes = 0;
+
+        for (uint32_t lane = 0; lane < PACKET_SIZE; lane++) {
+            uint32_t x = x0 + lane % PACKET_WIDTH, y = y0 + lane / PACKET_WIDTH;
+            if (x < image.width && y < image.height) activeLanes |= 1u << lane;
+            rays[lane] = primaryRay(camera, std::min(x, image.width - 1), std::min(y, image.height - 1), image.width, image.height);
+
+            primary.originX[lane] = rays[lane].origin.x;
+            primary.originY[lane] = rays[lane].origin.y;
+            primary.originZ[lane] = rays[lane].origin.z;
+            primary.directionX[lane] = rays[lane].direction.x;
+            primary.directionY[lane] = rays[lane].direction.y;
+            primary.directionZ[lane] = rays[lane].direction.z;
+            primary.tMax[lane] = PRIMARY_T_MAX;
+        }
+
+        uint32_t keys[PACKET_SIZE];
+        uint32_t hitLanes = avx2 ?
+            Spatial::intersectPacketAVX2(scene, primary, activeLanes, PRIMARY_T_MIN, keys, counters.intersectionTests) :
+            Spatial::intersectPacketSSE(scene, primary, activeLanes, PRIMARY_T_MIN, keys, counters.intersectionTests);
+
+        // the packet only finds the closest ellipsoid, the scalar kernel gives its normal (and the same t)
+        _HitPayload hits[PACKET_SIZE];
+        glm::vec3 toLights[PACKET_SIZE];
+        Spatial::RayPacket shadow = {};
+        uint32_t shadowLanes = 0;
+        for (uint32_t lane = 0; lane < PACKET_SIZE; lane++) {
+            float t;
+            if (!(hitLanes & (1u << lane)) || !intersectEllipsoid(keys[lane], rays[lane], PRIMARY_T_MIN, t, hits[lane].normal)) continue;
+            hits[lane].color = ellipsoids[keys[lane]].color;
+            hits[lane].objectID = ellipsoids[keys[lane]].objectID;
+            shadowLanes |= 1u << lane;
+            counters.shadowRays++;
+
+            glm::vec3 origin = rays[lane].origin + rays[lane].direction * t;
+            toLights[lane] = LIGHT_SOURCE - origin;
+            glm::vec3 direction = glm::normalize(toLights[lane]);
+            shadow.originX[lane] = origin.x;
+            shadow.originY[lane] = origin.y;
+            shadow.originZ[lane] = origin.z;
+            shadow.directionX[lane] = direction.x;
+            shadow.directionY[lane] = direction.y;
+            shadow.directionZ[lane] = direction.z;
+            shadow.tMax[lane] = SHADOW_T_MAX;
+        }
+
+        uint32_t occludedLanes = 0;
+        if (shadowLanes != 0) {
+            occludedLanes = avx2 ?
+                Spatial::occludedPacketAVX2(scene, shadow, shadowLanes, SHADOW_T_MIN, counters.intersectionTests) :
+                Spatial::occludedPacketSSE(scene, shadow, shadowLanes, SHADOW_T_MIN, counters.intersectionTests);
+        }
+
+        for (uint32_t lane = 0; lane < PACKET_SIZE; lane++) {
+            if (!(activeLanes & (1u << lane))) continue;
+            counters.primaryRays++;
+            _RayPayload payload;
+            if (shadowLanes & (1u << lane)) {
+                payload.color = shade(hits[lane], toLights[lane], (occludedLanes & (1u << lane)) != 0);
+                payload.objectID = hits[lane].objectID;
+            } else {
+                payload.color = background(rays[lane].direction);
+            }
+            storePixel(image, x0 + lane % PACKET_WIDTH, y0 + lane / PACKET_WIDTH, payload);
+        }
+    }
+
+    // scene.rchit after its shadow ray
+    glm::vec4 shade(const _HitPayload& hit, glm::vec3 toLight, bool inShadow) {
+        float shadow = inShadow ? AMBIENT : std::max(glm::dot(glm::normalize(toLight), glm::normalize(hit.normal)), AMBIENT);
+        return hit.color * shadow;
+    }
+
+    // background.rmiss
+    glm::vec4 background(glm::vec3 direction) {
+        return glm::vec4(glm::vec3(0.3f, 0.4f, 0.5f) + 0.3f * direction.y, 1.f);
+    }
+
+    // imageStore() of both images
+    void storePixel(Image& image, uint32_t x, uint32_t y, const _RayPayload& payload) {
+        size_t pixel = static_cast<size_t>(y) * image.width + x;
+        for (uint32_t c = 0; c < 4; c++) image.colors[pixel * 4 + c] = toUnorm8(payload.color[c]);
+        image.objectIDs[pixel] = payload.objectID;
+    }
+
+    // ellipsoid.rint, ray.tMax is gl_RayTmaxNV. accepts the hit like reportIntersectionNV() does, within [tMin, tMax]
+    bool intersectEllipsoid(uint32_t index, const Spatial::Ray& ray, float tMin, float& t, glm::vec3& normal) {
+        const Model::Ellipsoid& ellipsoid = ellipsoids[index];
+        glm::vec3 radius = glm::vec3(ellipsoid.radius);
+
+        // intersect in the ellipsoid's local frame, centered and unrotated
+        glm::vec3 origin = Spatial::inverseRotate(ellipsoid.rotation, ray.origin - glm::vec3(ellipsoid.center));
+        glm::vec3 direction = Spatial::inverseRotate(ellipsoid.rotation, ray.direction);
+
+        bool hit;
+        if (ellipsoid.intersection == Model::IntersectionMethod::SPHERE_TRACE) {
+            uint32_t steps;
+            hit = Spatial::intersectEllipsoidSphereTraced(origin, direction, radius, t, normal, steps);
+        } else {
+            hit = Spatial::intersectEllipsoidAnalytic(origin, direction, radius, tMin, ray.tMax, t, normal);
+        }
+        if (!hit || t < tMin || t > ray.tMax) return false;
+
+        normal = Spatial::rotate(ellipsoid.rotation, normal);
+        return true;
+    }
+
+    // traceNV() without the terminate on first hit flag, the closest reported hit wins
+    bool traceClosest(Spatial::Ray ray, float tMin, _HitPayload& hit, float& t, _Counters& counters) {
+        bool found = false;
+        bvh.intersect(ray, [&](uint32_t index, Spatial::Ray& r) {
+            counters.intersectionTests++;
+            float tHit;
+            glm::vec3 normal;
+            if (!intersectEllipsoid(index, r, tMin, tHit, normal)) return false;
+
+            r.tMax = tHit;
+            t = tHit;
+            hit.normal = normal;
+            hit.color = ellipsoids[index].color;
+            hit.objectID = ellipsoids[index].objectID;
+            found = true;
+            return true;
+        });
+        return found;
+    }
+
+    // the shadow ray of scene.rchit: terminates on the first hit and skips the closest hit shader, so the attributes
+    // don't matter. shadow.rmiss clears in_shadow when nothing was hit
+    bool traceShadow(const Spatial::Ray& ray, float tMin, _Counters& counters) {
+        return bvh.intersectAny(ray, [&](uint32_t index, const Spatial::Ray& r) {
+            counters.intersectionTests++;
+            float t;
+            glm::vec3 normal;
+            return intersectEllipsoid(index, r, tMin, t, normal);
+        });
+    }
+
+    // imageStore() to an rgba8 unorm image
+    uint8_t toUnorm8(float value) {
+        return static_cast<uint8_t>(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+    }
+
+    bool writeImages(const Image& image, const std::string& path) {
+        std::ofstream colorFile(path + ".ppm", std::ios::binary);
+        std::ofstream idFile(path + "_ids.ppm", std::ios::binary);
+        if (!colorFile || !idFile) {
+            AID_WARN("CPURenderer::writeImages() couldn't open {} for writing", path);
+            return false;
+        }
+
+        std::string header = "P6\n" + std::to_string(image.width) + " " + std::to_string(image.height) + "\n255\n";
+        std::vector<uint8_t> colors(static_cast<size_t>(image.width) * image.height * 3);
+        std::vector<uint8_t> ids(colors.size());
+        for (size_t p = 0; p < image.objectIDs.size(); p++) {
+            for (uint32_t c = 0; c < 3; c++) colors[p * 3 + c] = image.colors[p * 4 + c];
+
+            // black for the background, otherwise a hash of the id so neighbouring ids differ
+            uint32_t hash = image.objectIDs[p] < 0 ? 0u : (static_cast<uint32_t>(image.objectIDs[p]) + 1u) * 2654435761u;
+            for (uint32_t c = 0; c < 3; c++) ids[p * 3 + c] = static_cast<uint8_t>(hash >> (8 * (c + 1)));
+        }
+
+        colorFile << header;
+        colorFile.write(reinterpret_cast<const char*>(colors.data()), colors.size());
+        idFile << header;
+        idFile.write(reinterpret_cast<const char*>(ids.data()), ids.size());
+        return colorFile.good() && idFile.good();
+    }
+
+    bool isSupported(TraceMode mode) {
+        switch (mode) {
+        case TraceMode::PACKET_SSE: return instructionSet != Spatial::InstructionSet::NONE;
+        case TraceMode::PACKET_AVX2: return instructionSet == Spatial::InstructionSet::AVX2;
+        default: return true;
+        }
+    }
+
+    void setTraceMode(TraceMode mode) {
+        if (!isSupported(mode)) {
+            AID_WARN("CPURenderer::setTraceMode() {} isn't supported on this cpu, using {}", getTraceModeName(mode), getTraceModeName(getBestTraceMode()));
+            mode = getBestTraceMode();
+        }
+        traceMode = mode;
+    }
+
+    TraceMode getTraceMode() { return traceMode; }
+
+    TraceMode getBestTraceMode() {
+        if (isSupported(TraceMode::PACKET_AVX2)) return TraceMode::PACKET_AVX2;
+        return isSupported(TraceMode::PACKET_SSE) ? TraceMode::PACKET_SSE : TraceMode::SCALAR;
+    }
+
+    const char* getTraceModeName(TraceMode mode) {
+        switch (mode) {
+        case TraceMode::PACKET_SSE: return "sse packets";
+        case TraceMode::PACKET_AVX2: return "avx2 packets";
+        default: return "scalar";
+        }
+    }
+
+    PacketComparison comparePacketTracing(const RenderBackend::Camera& camera, uint32_t width, uint32_t height) {
+        TraceMode previousMode = traceMode;
+        PacketComparison comparison;
+        comparison.pixelCount = width * height;
+
+        Image reference(width, height);
+        traceMode = TraceMode::SCALAR;
+        render(camera, reference);
+        comparison.scalarTime = stats.renderTime;
+
+        for (TraceMode mode : { TraceMode::PACKET_SSE, TraceMode::PACKET_AVX2 }) {
+            if (!isSupported(mode)) continue;
+            Image image(width, height);
+            traceMode = mode;
+            render(camera, image);
+            (mode == TraceMode::PACKET_SSE ? comparison.sseTime : comparison.avx2Time) = stats.renderTime;
+
+            uint32_t idMismatches = 0, colorMismatches = 0;
+            for (size_t p = 0; p < reference.objectIDs.size(); p++) {
+                idMismatches += image.objectIDs[p] != reference.objectIDs[p];
+                bool colorDiffers = false;
+                for (size_t c = p * 4; c < p * 4 + 4; c++) {
+                    uint32_t difference = std::abs(static_cast<int>(image.colors[c]) - static_cast<int>(reference.colors[c]));
+                    comparison.maxColorDifference = std::max(comparison.maxColorDifference, difference);
+                    colorDiffers |= difference > 0;
+                }
+                colorMismatches += colorDiffers;
+            }
+            comparison.idMismatches = std::max(comparison.idMismatches, idMismatches);
+            comparison.colorMismatches = std::max(comparison.colorMismatches, colorMismatches);
+        }
+
+        traceMode = previousMode;
+        return comparison;
+    }
+
+    Stats getStats() { return stats; }
+};
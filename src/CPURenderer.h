@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Model.h"
+#include "RenderBackend.h"
+
+#include <glm.hpp>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/*
+    Reference ray tracer on the CPU, without vulkan or a window. Mirrors the ray tracing pipeline shader by shader:
+    scene.rgen makes the camera rays, ellipsoid.rint intersects them with the kernel each ellipsoid selects,
+    scene.rchit shades the closest hit and traces its shadow ray, background.rmiss and shadow.rmiss handle the misses.
+    Produces the same rgba8 color and object id images as the vulkan renderer from the same camera and
+    PrimitiveManager scene, up to float differences between the gpu and the cpu. The acceleration structure is a
+    Spatial::BVH over the tight ellipsoid bounds, rebuilt on the next render after the scene changed.
+    Square tiles of the image are JobSystem jobs, render() returns once the whole image is done.
+    Primary and shadow rays are traced one at a time or in packets of 4x2 pixels (PacketTraversal.h). Every lane of a
+    packet hits what the single ray would, comparePacketTracing() checks that and measures the speedup.
+*/
+namespace CPURenderer {
+
+    // how render() traces the rays
+    enum struct TraceMode {
+        SCALAR,
+        PACKET_SSE,     // x86 only
+        PACKET_AVX2     // if the cpu has AVX2
+    };
+
+    struct Image {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> colors;        // r, g, b, a per pixel, rows top to bottom like the render image
+        std::vector<int32_t> objectIDs;     // -1 where nothing was hit, like the object id image
+
+        Image() {}
+        Image(uint32_t width, uint32_t height) : width(width), height(height),
+            colors(static_cast<size_t>(width) * height * 4, 0), objectIDs(static_cast<size_t>(width) * height, -1) {}
+    };
+
+    // share of one job system slot in a render
+    struct WorkerLoad {
+        uint32_t tiles = 0;
+        float time = 0.f;                   // milliseconds tracing
+    };
+
+    // of the last render
+    struct Stats {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t threadCount = 0;           // job system threads, at most one per tile
+        TraceMode traceMode = TraceMode::SCALAR;
+        uint32_t ellipsoidCount = 0;
+        uint64_t primaryRays = 0;
+        uint64_t shadowRays = 0;
+        uint64_t intersectionTests = 0;     // intersection shader invocations, one per ray and overlapped box
+        float buildTime = 0.f;              // milliseconds to rebuild the bvh, 0 if the scene didn't change
+        float renderTime = 0.f;             // milliseconds of tracing, without the build
+        float raysPerSecond = 0.f;          // primary and shadow rays
+        std::vector<WorkerLoad> workers;    // by JobSystem slot, 0 is the calling thread
+    };
+
+    // every supported mode on the same frame, compared with the scalar image
+    struct PacketComparison {
+        uint32_t pixelCount = 0;
+        float scalarTime = 0.f;         // milliseconds
+        float sseTime = 0.f;            // 0 if not supported
+        float avx2Time = 0.f;
+        uint32_t idMismatches = 0;      // pixels with another object id than the scalar image, worst packet mode
+        uint32_t colorMismatches = 0;   // pixels with another color
+        uint32_t maxColorDifference = 0; // of a channel, out of 255
+    };
+
+    // called by RenderBackend
+    void addEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+    void updateEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+    void removeEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+
+    // traces every pixel of image, its size is the launch size. on every job system thread, set up with JobSystem::init()
+    void render(const RenderBackend::Camera& camera, Image& image);
+
+    // binary ppm files: path + ".ppm" with the colors (alpha dropped) and path + "_ids.ppm" with a color per object id.
+    // returns false if a file couldn't be written
+    bool writeImages(const Image& image, const std::string& path);
+
+    // unsupported modes fall back to the best supported one. the default is the best supported one
+    void setTraceMode(TraceMode mode);
+    TraceMode getTraceMode();
+    TraceMode getBestTraceMode();
+    const char* getTraceModeName(TraceMode mode);
+    PacketComparison comparePacketTracing(const RenderBackend::Camera& camera, uint32_t width, uint32_t height);
+
+    Stats getStats();
+};
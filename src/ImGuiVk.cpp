@@ -26,9 +26,10 @@ namespace ImGuiVk {
         bool render = false;
 
         VkFramebuffer framebuffer;
-        VkImageMemoryBarrier renderImageBarrier;
+        VkImageMemoryBarrier overlayImageBarrier;
     };
     PerFrame perFrame[MAX_FRAMES_IN_FLIGHT];
+    VkDeviceSize bytesWritten = 0;
 
     VkRenderPass renderpass;
     VkPipeline pipeline;
@@ -53,6 +54,7 @@ namespace ImGuiVk {
     float* getpClearValue() { return &clearValue.color.float32[0]; }
     VkCommandBuffer getCommandBuffer(uint32_t frame) { return perFrame[frame].commandBuffer; }
     bool shouldRender(uint32_t frame) { return perFrame[frame].render; }
+    VkDeviceSize getBytesWritten() { return bytesWritten; }
 
     void init() {
         createFontTexture();
@@ -70,13 +72,13 @@ namespace ImGuiVk {
             framebufferInfo.attachmentCount = 1;
             framebufferInfo.layers = 1;
             VkImageView attachments[] = {
-                Renderer::getRenderImage(f).view
+                Renderer::getOverlayImage(f).view
             };
 
             framebufferInfo.pAttachments = attachments;
             framebufferInfo.renderPass = renderpass;
-            framebufferInfo.width = Renderer::getRenderImage(f).extent.width;
-            framebufferInfo.height = Renderer::getRenderImage(f).extent.height;
+            framebufferInfo.width = Renderer::getOverlayImage(f).extent.width;
+            framebufferInfo.height = Renderer::getOverlayImage(f).extent.height;
 
             VK_CHECK_RESULT(vkCreateFramebuffer(Renderer::getDevice(), &framebufferInfo, nullptr, &perFrame[f].framebuffer), "failed to create imgui framebuffer");
 
@@ -84,16 +86,16 @@ namespace ImGuiVk {
 
             VkImageSubresourceRange imageSubresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-            perFrame[f].renderImageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            perFrame[f].renderImageBarrier.pNext = VK_NULL_HANDLE;
-            perFrame[f].renderImageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            perFrame[f].renderImageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            perFrame[f].renderImageBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            perFrame[f].renderImageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-            perFrame[f].renderImageBarrier.srcQueueFamilyIndex = 0;
-            perFrame[f].renderImageBarrier.dstQueueFamilyIndex = 0;
-            perFrame[f].renderImageBarrier.image = Renderer::getRenderImage(f).image;
-            perFrame[f].renderImageBarrier.subresourceRange = imageSubresourceRange;
+            perFrame[f].overlayImageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            perFrame[f].overlayImageBarrier.pNext = VK_NULL_HANDLE;
+            perFrame[f].overlayImageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            perFrame[f].overlayImageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            perFrame[f].overlayImageBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            perFrame[f].overlayImageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            perFrame[f].overlayImageBarrier.srcQueueFamilyIndex = 0;
+            perFrame[f].overlayImageBarrier.dstQueueFamilyIndex = 0;
+            perFrame[f].overlayImageBarrier.image = Renderer::getOverlayImage(f).image;
+            perFrame[f].overlayImageBarrier.subresourceRange = imageSubresourceRange;
         }
     }
 
@@ -128,12 +130,8 @@ namespace ImGuiVk {
 
             VkMemoryRequirements req;
             vkGetImageMemoryRequirements(Renderer::getDevice(), fontTexture.image, &req);
-            VkMemoryAllocateInfo allocInfo = {};
-            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            allocInfo.allocationSize = req.size;
-            allocInfo.memoryTypeIndex = Vk::findMemoryType(Renderer::getPhysicalDevice(), req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-            VK_CHECK_RESULT(vkAllocateMemory(Renderer::getDevice(), &allocInfo, VK_ALLOCATOR, &fontTexture.memory), "failed to allocate imgui font texture memory");
-            VK_CHECK_RESULT(vkBindImageMemory(Renderer::getDevice(), fontTexture.image, fontTexture.memory, 0), "failed to bind imgui font image memory");
+            fontTexture.allocation = MemoryAllocator::allocate(req, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryAllocator::Category::IMAGE);
+            VK_CHECK_RESULT(vkBindImageMemory(Renderer::getDevice(), fontTexture.image, fontTexture.allocation.memory, fontTexture.allocation.offset), "failed to bind imgui font image memory");
         }
 
         // create image view
@@ -152,7 +150,7 @@ namespace ImGuiVk {
         // upload pixel data
         {
             Vk::BufferHostVisible uploadBuffer;
-            uploadBuffer.create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, uploadSize, Renderer::getDevice(), Renderer::getPhysicalDevice());
+            uploadBuffer.create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, uploadSize, Renderer::getDevice(), Renderer::getPhysicalDevice(), MemoryAllocator::Category::STAGING);
             uploadBuffer.upload(static_cast<void*>(pixels), uploadSize, 0, Renderer::getDevice());
 
             VkImageMemoryBarrier copyBarrier[1] = {};
@@ -277,7 +275,7 @@ namespace ImGuiVk {
 
     void createRenderPass() {
         VkAttachmentDescription colorAttachment = {};
-        colorAttachment.format = Renderer::getRenderImage(0).format;
+        colorAttachment.format = Renderer::getOverlayImage(0).format;
         colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
         colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
         colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -499,19 +497,18 @@ namespace ImGuiVk {
 
         if (perFrame[frame].vertexBuffer.buffer == VK_NULL_HANDLE || perFrame[frame].vertexBuffer.size < vertex_size) {
             perFrame[frame].vertexBuffer.destroy(Renderer::getDevice());
-            perFrame[frame].vertexBuffer.create(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertex_size, Renderer::getDevice(), Renderer::getPhysicalDevice());
+            perFrame[frame].vertexBuffer.create(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertex_size, Renderer::getDevice(), Renderer::getPhysicalDevice(), MemoryAllocator::Category::IMGUI);
         }
         if (perFrame[frame].indexBuffer.buffer == VK_NULL_HANDLE || perFrame[frame].indexBuffer.size < index_size) {
             perFrame[frame].indexBuffer.destroy(Renderer::getDevice());
-            perFrame[frame].indexBuffer.create(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, index_size, Renderer::getDevice(), Renderer::getPhysicalDevice());
+            perFrame[frame].indexBuffer.create(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, index_size, Renderer::getDevice(), Renderer::getPhysicalDevice(), MemoryAllocator::Category::IMGUI);
         }
 
         // Upload vertex/index data
         {
-            ImDrawVert* vtx_dst;
-            ImDrawIdx* idx_dst;
-            VK_CHECK_RESULT(vkMapMemory(Renderer::getDevice(), perFrame[frame].vertexBuffer.memory, 0, vertex_size, 0, (void**)(&vtx_dst)), "failed to map imgui vertex buffer memory");
-            VK_CHECK_RESULT(vkMapMemory(Renderer::getDevice(), perFrame[frame].indexBuffer.memory, 0, index_size, 0, (void**)(&idx_dst)), "failed to map imgui index buffer memory");
+            // both buffers stay mapped
+            ImDrawVert* vtx_dst = perFrame[frame].vertexBuffer.write<ImDrawVert>(0, static_cast<uint32_t>(draw_data->TotalVtxCount)).data();
+            ImDrawIdx* idx_dst = perFrame[frame].indexBuffer.write<ImDrawIdx>(0, static_cast<uint32_t>(draw_data->TotalIdxCount)).data();
 
             for (int n = 0; n < draw_data->CmdListsCount; n++) {
                 const ImDrawList* cmd_list = draw_data->CmdLists[n];
@@ -520,17 +517,9 @@ namespace ImGuiVk {
                 vtx_dst += cmd_list->VtxBuffer.Size;
                 idx_dst += cmd_list->IdxBuffer.Size;
             }
-            VkMappedMemoryRange range[2] = {};
-            range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-            range[0].memory = perFrame[frame].vertexBuffer.memory;
-            range[0].size = VK_WHOLE_SIZE;
-            range[1].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-            range[1].memory = perFrame[frame].indexBuffer.memory;
-            range[1].size = VK_WHOLE_SIZE;
-            VK_CHECK_RESULT(vkFlushMappedMemoryRanges(Renderer::getDevice(), 2, range), "failed to flush imgui vertex and index memory");
-
-            vkUnmapMemory(Renderer::getDevice(), perFrame[frame].vertexBuffer.memory);
-            vkUnmapMemory(Renderer::getDevice(), perFrame[frame].indexBuffer.memory);
+            bytesWritten = perFrame[frame].vertexBuffer.resetBytesWritten() + perFrame[frame].indexBuffer.resetBytesWritten();
+            perFrame[frame].vertexBuffer.flush(Renderer::getDevice());
+            perFrame[frame].indexBuffer.flush(Renderer::getDevice());
         }
 
         // Will project scissor/clipping rectangles into framebuffer space
@@ -591,7 +580,7 @@ namespace ImGuiVk {
         }
 
         vkCmdEndRenderPass(commandBuffer);
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &perFrame[frame].renderImageBarrier);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &perFrame[frame].overlayImageBarrier);
         vkEndCommandBuffer(commandBuffer);
         perFrame[frame].render = true;
     }
@@ -607,7 +596,7 @@ namespace ImGuiVk {
         renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassBeginInfo.renderPass = renderpass;
         renderPassBeginInfo.framebuffer = perFrame[frame].framebuffer;
-        renderPassBeginInfo.renderArea.extent = Renderer::getRenderImage(frame).extent;
+        renderPassBeginInfo.renderArea.extent = Renderer::getOverlayImage(frame).extent;
         renderPassBeginInfo.clearValueCount = 1;
         renderPassBeginInfo.pClearValues = &clearValue;
 
@@ -17,6 +17,7 @@ namespace ImGuiVk {
     float* getpClearValue();
     VkCommandBuffer getCommandBuffer(uint32_t frame);
     bool shouldRender(uint32_t frame);
+    VkDeviceSize getBytesWritten(); // vertex + index bytes written by the last recorded frame
 
     void cleanup();
 
@@ -1,27 +1,19 @@
 #include "Model.h"
-#include "Renderer.h"
+#include "RenderBackend.h"
+#include "SpatialIndex.h"
 #include "tools/Log.h"
 
-#include <map>
+#include <algorithm>
 #include <stdexcept>
 
 using namespace Model;
 
-template <class ID_Class>
-int Model::containsID(std::vector<ID_Class>& set, ID_Class id) {
-    if (!id.isValid()) return -1;
-    for (int i = 0; i < set.size(); i++) {
-        if (set[i] == id) return i;
-    }
-    return -1;
-}
-
 namespace PrimitiveManager {
 
     // private variables
 
-    std::vector<EllipsoidID> ellipsoidIDs;
-    std::map<EllipsoidID, Ellipsoid> ellipsoids;
+    SlotMap<Ellipsoid> ellipsoids;
+    std::vector<SelectedEllipsoid> selection;
 
     // function implimentations
 
@@ -30,51 +22,138 @@ namespace PrimitiveManager {
             AID_WARN("ObjectManager::getEllipsoid() invalid id");
         }
 
-        try {
-            return ellipsoids.at(id);
-
-        } catch (const std::out_of_range& e) {
+        Ellipsoid* ellipsoid = ellipsoids.find(id);
+        if (ellipsoid == nullptr) {
             AID_ERROR("ObjectManager::getEllipsoid() ellipsoid not found with a valid id");
         }
-    }
-
-    EllipsoidID getNewEllipsoidID() {
-        uint32_t idValue = 0;
-        while (true) {
-            EllipsoidID idTemp(idValue);
-            if (containsID(ellipsoidIDs, idTemp) == -1) // id not already taken
-                return idTemp;
-            idValue++;
-        }
+        return *ellipsoid;
     }
 
     Ellipsoid getEllipsoid(EllipsoidID id) {
         return getEllipsoidRef(id);
     }
 
-    EllipsoidID addEllipsoid(glm::vec3 center, glm::vec3 radius, glm::vec4 color) {
-        EllipsoidID id = getNewEllipsoidID();
-        ellipsoids[id] = Model::Ellipsoid(center, radius, color, id);
-        ellipsoidIDs.push_back(id);
+    EllipsoidID getEllipsoidID(int32_t objectID) {
+        if (objectID < 0) return EllipsoidID();
+        return ellipsoids.handleFromSlot(static_cast<uint32_t>(objectID));
+    }
+
+    EllipsoidID addEllipsoid(glm::vec3 center, glm::vec3 radius, glm::vec4 color, glm::vec4 rotation) {
+        EllipsoidID id = ellipsoids.insert(Ellipsoid());
+        getEllipsoidRef(id) = Model::Ellipsoid(center, radius, color, id, rotation);
 
-        Renderer::addEllipsoid(id);
+        if (RenderBackend::addEllipsoids(id) != 0) {
+            AID_WARN("ObjectManager::addEllipsoid() the renderer rejected ellipsoid {}, it was not added", id.getID());
+            ellipsoids.erase(id);
+            return EllipsoidID();
+        }
+        SpatialIndex::addEllipsoids(id);
         return id;
     }
 
-    void updateEllipsoid(EllipsoidID id, glm::vec3 center, glm::vec3 radius, glm::vec4 color) {
+    void updateEllipsoid(EllipsoidID id, glm::vec3 center, glm::vec3 radius, glm::vec4 color, glm::vec4 rotation) {
         Ellipsoid& ellipsoid = getEllipsoidRef(id);
-        ellipsoid.update(center, radius, color);
-        Renderer::updateEllipsoid(id);
+        ellipsoid.update(center, radius, color, rotation);
+        SpatialIndex::updateEllipsoids(id);
+        RenderBackend::updateEllipsoids(id);
+    }
+
+    void removeFromSelection(EllipsoidID id) {
+        selection.erase(std::remove_if(selection.begin(), selection.end(),
+            [id](const SelectedEllipsoid& s) { return s.id == id; }), selection.end());
     }
 
     void deleteEllipsoid(EllipsoidID& id) {
-        Renderer::removeEllipsoid(id);
+        removeFromSelection(id);
+        SpatialIndex::removeEllipsoids(id);
+        RenderBackend::removeEllipsoids(id);
         ellipsoids.erase(id);
-        ellipsoidIDs.erase(ellipsoidIDs.begin() + containsID(ellipsoidIDs, id));
         id.invalidate();
     }
 
-    uint32_t getNumEllipsoids() { return ellipsoidIDs.size(); }
+    std::vector<EllipsoidID> addEllipsoids(Span<const EllipsoidParams> params) {
+        std::vector<EllipsoidID> ids;
+        ids.reserve(params.size());
+        ellipsoids.reserve(ellipsoids.size() + params.size());
+
+        for (const EllipsoidParams& p : params) {
+            EllipsoidID id = ellipsoids.insert(Ellipsoid());
+            getEllipsoidRef(id) = Model::Ellipsoid(p.center, p.radius, p.color, id, p.rotation);
+            ids.push_back(id);
+        }
+
+        // the renderer validates the whole batch before changing anything, so a rejected batch only has to leave the slot map
+        if (RenderBackend::addEllipsoids(ids) != 0) {
+            AID_WARN("ObjectManager::addEllipsoids() the renderer rejected the batch of {} ellipsoids, none were added", ids.size());
+            for (EllipsoidID id : ids) ellipsoids.erase(id);
+            return {};
+        }
+        SpatialIndex::addEllipsoids(ids);
+        return ids;
+    }
+
+    void updateEllipsoids(Span<const EllipsoidID> ids, Span<const EllipsoidParams> params) {
+        if (ids.size() != params.size()) {
+            AID_ERROR("ObjectManager::updateEllipsoids() id and parameter counts don't match");
+        }
+
+        // validate the whole batch before modifying anything
+        for (EllipsoidID id : ids) {
+            if (!ellipsoids.contains(id)) {
+                AID_ERROR("ObjectManager::updateEllipsoids() ellipsoid not found with id " + std::to_string(id.getID()));
+            }
+        }
 
-    std::vector<Model::EllipsoidID> getEllipsoidIDs() { return ellipsoidIDs; }
+        for (uint32_t i = 0; i < ids.size(); i++)
+            getEllipsoidRef(ids[i]).update(params[i].center, params[i].radius, params[i].color, params[i].rotation);
+
+        SpatialIndex::updateEllipsoids(ids);
+        RenderBackend::updateEllipsoids(ids);
+    }
+
+    void setIntersectionMethod(Span<const EllipsoidID> ids, IntersectionMethod method) {
+        for (EllipsoidID id : ids) {
+            if (!ellipsoids.contains(id)) {
+                AID_ERROR("ObjectManager::setIntersectionMethod() ellipsoid not found with id " + std::to_string(id.getID()));
+            }
+        }
+
+        for (EllipsoidID id : ids) getEllipsoidRef(id).intersection = method;
+        RenderBackend::updateEllipsoids(ids);
+    }
+
+    void deleteEllipsoids(Span<EllipsoidID> ids) {
+        SpatialIndex::removeEllipsoids(Span<const EllipsoidID>(ids.data(), ids.size()));
+        RenderBackend::removeEllipsoids(Span<const EllipsoidID>(ids.data(), ids.size()));
+        for (EllipsoidID& id : ids) {
+            removeFromSelection(id);
+            ellipsoids.erase(id);
+            id.invalidate();
+        }
+    }
+
+    uint32_t getNumEllipsoids() { return ellipsoids.size(); }
+
+    uint32_t getObjectIDCapacity() { return ellipsoids.slotCount(); }
+
+    const std::vector<Model::EllipsoidID>& getEllipsoidIDs() { return ellipsoids.handles(); }
+
+    void setSelection(std::vector<SelectedEllipsoid> newSelection) {
+        std::sort(newSelection.begin(), newSelection.end(), [](const SelectedEllipsoid& a, const SelectedEllipsoid& b) { return a.id < b.id; });
+
+        // the ids may have been read back a few frames after an ellipsoid was deleted
+        newSelection.erase(std::remove_if(newSelection.begin(), newSelection.end(),
+            [](const SelectedEllipsoid& s) { return !ellipsoids.contains(s.id); }), newSelection.end());
+        selection = std::move(newSelection);
+    }
+
+    void clearSelection() { selection.clear(); }
+
+    const std::vector<SelectedEllipsoid>& getSelection() { return selection; }
+
+    bool isSelected(EllipsoidID id) {
+        std::vector<SelectedEllipsoid>::const_iterator it = std::lower_bound(selection.begin(), selection.end(), id,
+            [](const SelectedEllipsoid& s, EllipsoidID id) { return s.id < id; });
+        return it != selection.end() && it->id == id;
+    }
 };
\ No newline at end of file
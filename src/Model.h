@@ -1,32 +1,16 @@
 #pragma once
 
+#include "tools/SlotMap.h"
+#include "tools/Span.h"
+
 #include "glm.hpp"
 #include <vector>
 
 namespace Model {
 
-    class _ObjectID {
-    public:
-        _ObjectID() {}
-        _ObjectID(int32_t id) : id(id) {}
-
-        int32_t getID() { return id; }
-        void invalidate() { id = -1; }
-        bool isValid() { return id != -1; }
+    struct Ellipsoid;
 
-        bool operator == (const _ObjectID& other) const { return id == other.id; }
-        bool operator <  (const _ObjectID& other) const { return id < other.id; }
-
-    protected:
-        int32_t id = -1;
-    };
-
-    class EllipsoidID : public _ObjectID {
-        using _ObjectID::_ObjectID;
-    };
-
-    template <class ID_Class>
-    int containsID(std::vector<ID_Class>& set, ID_Class id);
+    using EllipsoidID = Handle<Ellipsoid>;
 
     struct Sphere {
         glm::vec4 posRadius = glm::vec4(0.f);
@@ -36,31 +20,79 @@ namespace Model {
         Sphere(glm::vec3 position, float radius, glm::vec4 color) : posRadius(glm::vec4(position, radius)), color(color) {}
     };
 
+    // how the intersection shader finds the surface, matches INTERSECTION_* in shaders/common.glsl
+    enum struct IntersectionMethod : int32_t {
+        ANALYTIC = 0,       // closed form quadratic and gradient normal
+        SPHERE_TRACE = 1    // marching the signed distance function, for shapes without a closed form
+    };
+
+    // unit quaternion (x, y, z, w) of no rotation
+    const glm::vec4 IDENTITY_ROTATION = glm::vec4(0.f, 0.f, 0.f, 1.f);
+
+    // layout matches the Ellipsoid struct in shaders/common.glsl
     struct Ellipsoid {
         glm::vec4 center = glm::vec4(0.f);
-        glm::vec4 radius = glm::vec4(0.f);
+        glm::vec4 radius = glm::vec4(0.f);     // along the local axes
+        glm::vec4 rotation = IDENTITY_ROTATION; // unit quaternion (x, y, z, w), local to world
         glm::vec4 color = glm::vec4(0.f);
         int32_t objectID = -1;
-        int32_t padding1 = 0, padding2 = 0, padding3 = 0;
+        IntersectionMethod intersection = IntersectionMethod::ANALYTIC;
+        int32_t padding2 = 0, padding3 = 0;
     
         Ellipsoid() {}
-        Ellipsoid(glm::vec3 center, glm::vec3 radius, glm::vec4 color, EllipsoidID id) :
-            center(glm::vec4(center, 1.0)), radius(glm::vec4(radius, 1.0)), color(color), objectID(id.getID()) {}
+        Ellipsoid(glm::vec3 center, glm::vec3 radius, glm::vec4 color, EllipsoidID id, glm::vec4 rotation = IDENTITY_ROTATION) :
+            center(glm::vec4(center, 1.0)), radius(glm::vec4(radius, 1.0)), rotation(rotation), color(color), objectID(id.getID()) {}
 
-        void update(glm::vec3 center, glm::vec3 radius, glm::vec4 color) {
+        void update(glm::vec3 center, glm::vec3 radius, glm::vec4 color, glm::vec4 rotation = IDENTITY_ROTATION) {
             this->center = glm::vec4(center, 1.0);
             this->radius = glm::vec4(radius, 1.0);
+            this->rotation = rotation;
             this->color = color;
         }
     };
+
+    // input to the batch primitive functions
+    struct EllipsoidParams {
+        glm::vec3 center = glm::vec3(0.f);
+        glm::vec3 radius = glm::vec3(0.f);
+        glm::vec4 color = glm::vec4(0.f);
+        glm::vec4 rotation = IDENTITY_ROTATION;
+
+        EllipsoidParams() {}
+        EllipsoidParams(glm::vec3 center, glm::vec3 radius, glm::vec4 color, glm::vec4 rotation = IDENTITY_ROTATION) :
+            center(center), radius(radius), color(color), rotation(rotation) {}
+    };
+
+    // result of a rectangle or lasso selection
+    struct SelectedEllipsoid {
+        EllipsoidID id;
+        uint32_t pixelCount = 0; // covered pixels inside the selection region
+    };
 }
 
 namespace PrimitiveManager {
-    Model::EllipsoidID addEllipsoid(glm::vec3 center, glm::vec3 radius, glm::vec4 color);
-    void updateEllipsoid(Model::EllipsoidID id, glm::vec3 center, glm::vec3 radius, glm::vec4 color);
+    // invalid id if the renderer rejected it
+    Model::EllipsoidID addEllipsoid(glm::vec3 center, glm::vec3 radius, glm::vec4 color, glm::vec4 rotation = Model::IDENTITY_ROTATION);
+    void updateEllipsoid(Model::EllipsoidID id, glm::vec3 center, glm::vec3 radius, glm::vec4 color, glm::vec4 rotation = Model::IDENTITY_ROTATION);
     void deleteEllipsoid(Model::EllipsoidID& id);
 
+    // batch versions, all gpu work for the batch is submitted at once. a batch the renderer rejects adds nothing and
+    // returns no ids
+    std::vector<Model::EllipsoidID> addEllipsoids(Model::Span<const Model::EllipsoidParams> params);
+    void updateEllipsoids(Model::Span<const Model::EllipsoidID> ids, Model::Span<const Model::EllipsoidParams> params);
+    void deleteEllipsoids(Model::Span<Model::EllipsoidID> ids);
+    // doesn't change the geometry, only how the gpu intersects it
+    void setIntersectionMethod(Model::Span<const Model::EllipsoidID> ids, Model::IntersectionMethod method);
+
     Model::Ellipsoid getEllipsoid(Model::EllipsoidID id);
+    Model::EllipsoidID getEllipsoidID(int32_t objectID); // resolves an id read back from the object id image
     uint32_t getNumEllipsoids();
-    std::vector<Model::EllipsoidID> getEllipsoidIDs();
+    uint32_t getObjectIDCapacity(); // one past the largest object id an ellipsoid can have
+    const std::vector<Model::EllipsoidID>& getEllipsoidIDs();
+
+    // current selection sorted by id, deleted ellipsoids are dropped from it
+    void setSelection(std::vector<Model::SelectedEllipsoid> selection);
+    void clearSelection();
+    const std::vector<Model::SelectedEllipsoid>& getSelection();
+    bool isSelected(Model::EllipsoidID id);
 };
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include "RenderBackend.h"
+
+#include "CPURenderer.h"
+#include "Renderer.h"
+
+namespace RenderBackend {
+
+    // private variables
+
+    Type selected = Type::VULKAN_RTX;
+
+    // function implimentations
+
+    void select(Type type) { selected = type; }
+
+    Type getSelected() { return selected; }
+
+    int addEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        // the cpu renderer only learns about batches the vulkan renderer accepted
+        if (selected == Type::VULKAN_RTX && Renderer::addEllipsoids(ids) != 0) return -1;
+        CPURenderer::addEllipsoids(ids);
+        return 0;
+    }
+
+    int updateEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        CPURenderer::updateEllipsoids(ids);
+        return selected == Type::VULKAN_RTX ? Renderer::updateEllipsoids(ids) : 0;
+    }
+
+    int removeEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        CPURenderer::removeEllipsoids(ids);
+        return selected == Type::VULKAN_RTX ? Renderer::removeEllipsoids(ids) : 0;
+    }
+};
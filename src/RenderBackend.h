@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Model.h"
+
+#include <glm.hpp>
+
+/*
+    Which renderer draws the scene. PrimitiveManager reports its edits here and they're forwarded to the selected
+    backend: the vulkan RTX renderer when it's selected, the CPU reference renderer always, since it only marks its
+    copy of the scene stale and can render a frame for comparison on demand. Select the backend before adding
+    ellipsoids, the vulkan renderer only knows about the ellipsoids added while it was selected.
+*/
+namespace RenderBackend {
+
+    enum struct Type {
+        VULKAN_RTX, // NV ray tracing, or a compute shader on other gpus. a window unless Renderer::initHeadless() is used
+        CPU         // CPURenderer, runs headless
+    };
+
+    // the camera both backends trace from, layout matches UniformData in Renderer.cpp and CameraProperties in scene.rgen
+    struct Camera {
+        glm::mat4 viewInverse = glm::mat4(1.0f);
+        glm::mat4 projInverse = glm::mat4(1.0f);
+        glm::vec4 position = glm::vec4(0.0f);
+
+        Camera() {}
+        Camera(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 position) :
+            viewInverse(viewInverse), projInverse(projInverse), position(glm::vec4(position, 0.0f)) {}
+    };
+
+    void select(Type type);
+    Type getSelected();
+
+    // called by PrimitiveManager, return 0 for success like the Renderer versions
+    int addEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+    int updateEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+    int removeEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+};
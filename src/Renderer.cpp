@@ -4,6 +4,12 @@
 #include "IOInterface.h"
 #include "ImGuiVk.h"
 #include "tools/config.h"
+#include "tools/BVHBuilder.h"
+#include "tools/ClusterPlanner.h"
+#include "tools/IDHistogram.h"
+#include "tools/MemoryAllocator.h"
+#include "tools/SparsePattern.h"
+#include "tools/StagingRing.h"
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 //#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
@@ -13,6 +19,14 @@
 #include <string>
 #include <stdexcept>
 #include <set>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
+
+using namespace std::chrono;
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -26,6 +40,8 @@ const bool enableValidationLayers = true;
 #define SHADER_SRC_MISS_SHADOW              "spirv/shadow.rmiss.spv"
 #define SHADER_SRC_CLOSEST_HIT_SCENE        "spirv/scene.rchit.spv"
 #define SHADER_SRC_INTERSECTION_ELLIPSOID   "spirv/ellipsoid.rint.spv"
+#define SHADER_SRC_COMPUTE_SCENE            "spirv/scene.comp.spv"
+#define SHADER_SRC_COMPUTE_REFINE           "spirv/refine.comp.spv"
 
 // shader stage indices
 enum {
@@ -46,6 +62,57 @@ enum {
     GROUP_COUNT
 };
 
+// ellipsoid buffers start with this capacity and double when they run out of space
+#define ELLIPSOID_BUFFER_MIN_CAPACITY 64
+// refitting degrades a bvh, a cluster is rebuilt after this many refits in a row
+#define CLUSTER_MAX_REFITS 16
+// smallest size class of the BLAS build arenas (bytes), they grow in powers of two
+#define BLAS_ARENA_MIN_SIZE 65536
+// tlases are created with room for this many instances and double when they run out of space
+#define TLAS_MIN_CAPACITY 64
+// initial size of the staging ring shared by the frames in flight (bytes), grows when one frame needs more
+#define STAGING_RING_SIZE (1 << 20)
+// resolved picks are kept this long for pollObjectID(), the oldest are dropped
+#define MAX_PICK_RESULTS 1024
+// headless frames copied out of the readback buffers are kept this long for pollReadback(), the oldest are dropped
+#define MAX_READBACK_FRAMES 8
+// offscreen render image format without a swapchain, matches the rgba8 qualifier in scene.rgen and CPURenderer::Image
+#define HEADLESS_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+// compute tracing: workgroup width and height, matches local_size in scene.comp
+#define COMPUTE_TRACE_GROUP_SIZE 8
+// compute tracing: bvh node and primitive buffers start with this capacity and double when they run out of space
+#define COMPUTE_BVH_MIN_CAPACITY 64
+// dynamic resolution: smallest fraction of the window width and height that is traced
+#define RENDER_SCALE_MIN 0.25f
+// dynamic resolution: scales are multiples of this, so the recorded commands only change in steps
+#define RENDER_SCALE_STEP 0.0625f
+// dynamic resolution: the scale goes up once the trace takes less than this fraction of the budget
+#define RENDER_SCALE_HYSTERESIS 0.2f
+// dynamic resolution: traced frames to measure at a new scale before the next change
+#define RENDER_SCALE_SETTLE_FRAMES 8
+// dynamic resolution: weight of the newest frame in the smoothed trace time
+#define RENDER_SCALE_SMOOTHING 0.25f
+// dynamic resolution: default gpu milliseconds for the trace of a frame
+#define DEFAULT_TRACE_BUDGET 8.f
+// refinement: workgroup width and height, matches local_size in refine.comp
+#define REFINE_GROUP_SIZE 8
+// refinement: a quarter of the pixels per frame while the camera moves (see SparsePattern)
+#define DEFAULT_REFINEMENT_STRIDE 2
+
+// pending acceleration structure work, ordered so the larger of two requests wins
+enum {
+    AS_UPDATE_NONE,
+    AS_UPDATE_REFIT,    // same primitives/instances that only moved, update the existing bvh
+    AS_UPDATE_REBUILD
+};
+
+// how refine.comp fills the pixels a sparse trace skipped, matches REFINE_* in common.glsl
+enum {
+    REFINE_NONE,        // every pixel traced, refine.comp doesn't run
+    REFINE_REPROJECT,   // the camera moved since the history image was traced
+    REFINE_COPY         // same camera, the history pixels stay
+};
+
 // TODO: DOD object building (vulkan commands take arrays of objects)
 
 namespace Renderer {
@@ -73,11 +140,17 @@ struct {
     VkExtent2D extent;
 } swapchain;
 
+// false when the device has no VK_NV_ray_tracing or forceComputeTracing() was called, scene.comp traces instead
+bool rayTracing = true;
+bool computeTracingForced = false;
+
 VkPhysicalDeviceRayTracingPropertiesNV rayTracingProperties{};
 Vk::BufferHostVisible shaderBindingTable;
 
 VkPipeline pipeline;
 VkPipelineLayout pipelineLayout;
+VkPipeline refinePipeline; // refine.comp, with either tracing pipeline
+VkPipelineLayout refinePipelineLayout;
 
 VkCommandPool commandPool;
 
@@ -86,23 +159,87 @@ VkDescriptorSetLayout descriptorSetLayoutRender, descriptorSetLayoutModels;
 
 struct _PerSwapchainImage {
     VkCommandBuffer commandBufferImageCopy[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer commandBufferOverlayCopy[MAX_FRAMES_IN_FLIGHT]; // from the overlay image when imgui rendered
     VkFence renderCompleteFenceReference; // do not allocate
 };
 std::vector<_PerSwapchainImage> perSwapchainImage;
 
+// object id pick, requested between frames and read back by the next frame that traces
+struct _Pick {
+    PickTicket ticket;
+    glm::uvec2 position;
+    time_point<high_resolution_clock> requestTime;
+    uint64_t requestFrame;
+};
+
 struct _PerFrame {
     Vk::StorageImage renderImage;
     VkCommandBuffer commandBufferRender;
     bool rerecordRenderCommands = false;
-
+    uint64_t tracedSceneVersion = 0; // sceneVersion the render and id images show, 0 if they have to be traced
+    // traced part of the render and id images, starting at the top left. the commands of this slot are recorded for it
+    VkExtent2D renderExtent = { 0, 0 };
+
+    // refinement: commandBufferRender traces every pixel, commandBufferRefine one per SparsePattern cell and runs
+    // refine.comp with the previous slot's images as history
+    VkCommandBuffer commandBufferRefine;
+    uint32_t refineMode = REFINE_NONE;      // of the last trace
+    glm::uvec2 patternOffset = glm::uvec2(0);
+    uint32_t phasesTraced = 0;              // distinct pattern phases since the camera last moved, complete at SparsePattern::getPhaseCount()
+    bool historyValid = false;              // the images hold a trace of the current extent
+    glm::mat4 tracedViewInverse = glm::mat4(1.0f); // camera of that trace
+    glm::mat4 tracedProjInverse = glm::mat4(1.0f);
+    glm::vec4 tracedCameraPos = glm::vec4(0.0f);
+
+    // windowed only: imgui draws on a copy of the render image, so the render image stays a clean trace to reuse
+    Vk::StorageImage overlayImage;
+    VkCommandBuffer commandBufferComposite; // render image -> overlay image
+
+    // built in place, only recreated (new handle) when the instance count exceeds the capacity
     Vk::AccelerationStructure tlas;
+    uint32_t tlasCapacity = 0;              // in instances, grows geometrically
+    uint32_t tlasInstanceCount = 0;         // of the last build, a refit needs the same count
+    Vk::BufferHostVisible tlasInstanceBuffer; // persistently mapped, tlasCapacity instances
+    Vk::BufferDeviceLocal tlasScratchBuffer;  // big enough for a build or a refit at capacity
+    VkCommandBuffer commandBufferTLAS;
+    VkQueryPool tlasTimestampQueryPool;
+    uint32_t tlasTimestampsPending = AS_UPDATE_NONE; // what the timestamps of the last submission measured
+
+    // compute tracing only: this frame's copy of computeBVH, uploaded when updateEllipsoidTLAS is set
+    Vk::BufferDeviceLocal bvhNodeBuffer, bvhPrimitiveBuffer;
+    uint32_t bvhNodeCapacity = 0, bvhPrimitiveCapacity = 0;
+
+    VkQueryPool traceTimestampQueryPool; // around the trace or dispatch in commandBufferRender or commandBufferRefine
+    bool traceTimestampsPending = false;
+    bool refineTimestamps = false; // they measured a sparse trace and refine.comp
+
     VkDescriptorSet descriptorSetModels, descriptorSetRender;
     Vk::BufferDeviceLocal spheresBuffer;
+    uint32_t ellipsoidCapacity = 0; // in ellipsoids, grows geometrically
+    Vk::BufferDeviceLocal retiredEllipsoidBuffer; // outgrown, its contents are copied by this frame's upload commands
 
-    bool updateEllipsoidTLAS = false;
+    // staging ring copies and buffer growth copies, submitted ahead of the tlas build and the render commands
+    VkCommandBuffer commandBufferUpload;
+    bool uploadCommandsRecording = false;
+
+    uint32_t updateEllipsoidTLAS = AS_UPDATE_NONE;
     std::vector<Model::EllipsoidID> updateEllipsoidIDs;
 
     Vk::StorageImage objectIDsImage;
+    Vk::StorageImage depthImage; // distance along the camera ray, -1 for misses. refine.comp reprojects with it
+
+    // picks copied out of this frame's id image, slot i of the readback buffer belongs to picks[i]
+    VkCommandBuffer commandBufferPick;
+    Vk::BufferHostVisible pickReadbackBuffer; // MAX_PICKS_PER_FRAME ids
+    std::vector<_Pick> picks;
+    bool selection = false; // the selection pass was recorded after the picks
+
+    // headless only: render and id image copied into host memory at the end of the frame's submissions
+    VkCommandBuffer commandBufferReadback;
+    Vk::BufferHostVisible colorReadbackBuffer, idReadbackBuffer;
+    bool readbackPending = false; // submitted, not copied out yet
+    uint64_t readbackFrameNumber = 0;
+    time_point<high_resolution_clock> readbackSubmitTime;
 
     VkSemaphore semaphoreImageAvailable, semaphoreRenderFinished, semaphoreImGuiFinished, semaphoreImageCopyFinished;
     VkFence fenceRenderComplete;
@@ -111,20 +248,132 @@ _PerFrame perFrame[MAX_FRAMES_IN_FLIGHT];
 uint32_t currentFrame = 0, lastRenderedFrame = 0;
 
 Vk::BufferHostVisible bufferUBO; // per frame
+Vk::StagingRing stagingRing;
+
+/*
+    Ellipsoids are packed into clusters of up to MAX_PRIMITIVES_PER_BLAS, each cluster is one BLAS with an aabb per
+    ellipsoid and one tlas instance. Cluster c owns the ellipsoid buffer range starting at c * MAX_PRIMITIVES_PER_BLAS,
+    this offset is the instance custom index and the intersection shader adds gl_PrimitiveID to it.
+*/
+struct _Cluster {
+    Vk::AccelerationStructure blas; // created with room for MAX_PRIMITIVES_PER_BLAS aabbs and rebuilt in place
+    std::vector<Model::EllipsoidID> ellipsoidIDs; // index = gl_PrimitiveID
+    Vk::AABB bounds = Vk::AABB::empty();
+    uint32_t update = AS_UPDATE_NONE;
+    uint32_t refitCount = 0; // since the last rebuild
+    bool hasInstance = false; // empty clusters are left out of the tlas
+};
+std::vector<_Cluster> clusters;
 
-std::vector<Model::EllipsoidID> ellipsoidIDs;
-std::vector<Vk::AccelerationStructure> ellipsoidBLASs; // one ellipsoid per blas
-std::vector<Vk::BLASInstance> ellipsoidInstances;
+struct _EllipsoidLocation {
+    uint32_t cluster;
+    uint32_t primitive;
+    glm::vec4 center, radius, rotation; // last geometry seen by the renderer, diffed against to classify updates
+};
+Model::SparseSet<_EllipsoidLocation, Model::EllipsoidID> ellipsoidLocations;
+
+/*
+    All BLAS builds and refits of a frame are recorded into one command buffer and submitted once. The aabb inputs and
+    scratch memory are sub-allocated from persistent arenas that grow in power of two size classes and never shrink.
+    The submission signals a fence which is only waited on before the arenas are reused.
+*/
+struct {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE; // start and end of the last submission
+    bool timestampsPending = false;
+    uint32_t aabbCount = 0; // in the last submission
+
+    Vk::BufferHostVisible aabbArena;
+    Vk::BufferDeviceLocal scratchArena;
+} blasBuildQueue;
+
+/*
+    Without ray tracing the clusters only lay out the ellipsoid buffer. Whenever the tlas would be updated, one binary
+    bvh over all ellipsoid aabbs is built on the cpu with the linear builder instead of the BLASs and the tlas, every
+    frame uploads it through the staging ring and scene.comp traverses it.
+*/
+struct _ComputeBVHNode {
+    glm::vec3 lower;
+    uint32_t first;
+    glm::vec3 upper;
+    uint32_t count;
+}; // matches BVHNode in scene.comp
+struct {
+    std::vector<_ComputeBVHNode> nodes; // root first, one node with inverted bounds for an empty scene
+    std::vector<uint32_t> primitives;   // leaf order -> ellipsoid buffer index
+} computeBVH;
 
 VkDescriptorPool descriptorPoolModels;
 
+Stats stats;
+UpdateCounters frameCounters; // accumulates until the next updateModels()
+
 struct UniformData {
     glm::mat4 viewInverse = glm::mat4(1.0f);
     glm::mat4 projInverse = glm::mat4(1.0f);
     glm::vec4 cameraPos = glm::vec4(0.0f);
+    glm::vec4 renderSize = glm::vec4(0.0f); // xy: the frame's renderExtent
+    glm::vec4 pattern = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f); // x: stride, yz: patternOffset, w: refineMode (REFINE_NONE)
+    glm::mat4 historyView = glm::mat4(1.0f); // camera of the previous slot's trace, refine.comp only
+    glm::mat4 historyProj = glm::mat4(1.0f);
+    glm::vec4 historyPosition = glm::vec4(0.0f);
 };
 
-Vk::BufferHostVisible bufferObjectIDFetch;
+// render on demand, a frame slot traces when its render image is older than sceneVersion
+bool renderOnDemand = true;
+uint64_t sceneVersion = 1;  // bumped by camera changes and ellipsoid edits, recreated render images start at 0
+UniformData lastCamera;     // of the last drawFrame(), diffed to detect camera changes
+
+/*
+    Dynamic resolution: the render and id images keep the window size and only their top left renderExtent is traced,
+    then blitted with a linear filter to the swapchain image (or the overlay image imgui draws on). A scale change
+    never reallocates an image or waits for the device, every frame slot re-records its commands for the new extent
+    the next time it is used. The trace time is assumed to grow with the traced pixels: each measured frame updates a
+    smoothed estimate of the full resolution time, and the scale changes when the estimate at the current scale leaves
+    the band between (1 - RENDER_SCALE_HYSTERESIS) * budget and the budget.
+*/
+struct {
+    bool enabled = true;
+    float budget = DEFAULT_TRACE_BUDGET;    // gpu milliseconds
+    float scale = 1.f;                      // of the window width and height
+    float fullResolutionTime = 0.f;         // smoothed gpu milliseconds the trace would take at scale 1
+    uint32_t framesSinceChange = 0;         // measured
+    uint64_t measuredFrames = 0;            // stats.tracedFrames of the last measurement
+} dynamicResolution;
+
+/*
+    Progressive refinement: with the camera moving, a frame traces one pixel per stride x stride cell and refine.comp
+    fills in the rest from the previous frame slot's images, reprojected where depth and object id agree and
+    interpolated from the traced pixels elsewhere. Once the camera stops every frame traces the next phase of the
+    pattern and keeps the other pixels, so the image is complete after stride * stride frames and render on demand
+    reuses it from then on. Scene edits, scale changes and recreated images start over with a full trace, the
+    history would show an outdated scene.
+*/
+struct {
+    bool enabled = false;
+    uint32_t stride = DEFAULT_REFINEMENT_STRIDE;
+    uint32_t phase = 0;         // of the next sparse trace, consecutive frames trace consecutive phases
+    bool restart = true;        // the next trace traces every pixel
+    bool converging = false;    // the camera moved and no complete frame was traced since
+    uint32_t convergingFrames = 0; // since it stopped
+    time_point<high_resolution_clock> motionStopTime;
+} refinement;
+
+std::vector<_Pick> pendingPicks; // not submitted yet
+std::map<PickTicket, int32_t> pickResults; // resolved, until polled
+PickTicket nextPickTicket = 1;
+
+// rectangle/lasso selection, one in flight. the latest request replaces one that wasn't submitted yet
+Vk::IDHistogramPass selectionPass;
+Vk::IDRegion pendingSelection;
+bool selectionRequested = false;
+bool selectionInFlight = false;
+uint64_t frameNumber = 0; // frames submitted so far
+
+// no window, surface, swapchain or present queue, see initHeadless()
+bool headless = false;
+std::deque<ReadbackFrame> readbackFrames; // copied out, until polled
 
 const char* validationLayers[1] = {
     "VK_LAYER_KHRONOS_validation"
@@ -160,34 +409,68 @@ void setupDebugMessenger();
 void createSurface();
 void pickPhysicalDevice();
 void createLogicalDevice();
+void initRenderResources(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos);
 
 void createSwapChain();
+void createOffscreenTarget(uint32_t width, uint32_t height);
+void createReadbackResources();
 void createCommandPool();
 void createSyncObjects();
 
 void createRenderImages();
 void createIDImages();
-void createIDFetchBuffer();
+void createPickResources();
+void submitIDReadbacks(uint32_t frame);
+void readIDReadbacks(uint32_t frame);
 void initPerFrameRenderResources();
 void createUBO(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos);
 
 void createDescriptorSetLayouts();
 void createRayTracingPipeline();
 void createShaderBindingTable();
+void createComputePipeline();
+void createRefinePipeline();
 void createDescriptorSetsRender();
 
 void createCommandBuffersRender();
 void createCommandBuffersImageCopy();
+void recordSwapchainCopy(VkCommandBuffer commandBuffer, VkImage source, VkExtent2D sourceExtent, uint32_t swapchainImage);
+void recordCommandBufferComposite(uint32_t frame);
 
 // main loop
 
 void updateModels(uint32_t frame);
-void updateModelTLAS(uint32_t frame);
+void buildDirtyClusters();
+void updateModelTLAS(uint32_t frame, bool refit);
+bool reserveModelTLAS(uint32_t frame, uint32_t instanceCount);
+void readTLASTimestamps(uint32_t frame);
+void readTraceTimestamps(uint32_t frame);
+void buildComputeBVH();
+void uploadComputeBVH(uint32_t frame);
+bool reserveComputeBVH(uint32_t frame, uint32_t nodeCount, uint32_t primitiveCount);
+uint32_t getClusterInstanceCount();
 void updateEllipsoidBuffer(uint32_t frame);
+bool reserveEllipsoidBuffer(uint32_t frame, uint32_t ellipsoidCount);
+void createStagingRing();
+VkCommandBuffer beginUploadCommands(uint32_t frame);
+void submitUploadCommands(uint32_t frame);
 void updateModelDescriptorSet(uint32_t frame);
+void writeTLASDescriptor(uint32_t frame);
+void writeEllipsoidBufferDescriptor(uint32_t frame);
+void writeComputeBVHDescriptor(uint32_t frame);
 void recordCommandBufferRender(uint32_t frame);
+void recordTraceCommands(VkCommandBuffer commandBuffer, uint32_t frame, bool sparse);
+VkExtent2D getLaunchExtent(uint32_t frame);
 
 void updateUniformBuffer(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos, uint32_t frame);
+void trackCameraChanges(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos);
+void markSceneChanged(); // the traced images are outdated, refinement starts over
+void chooseRefinement(uint32_t frame);
+void updateRenderScale(uint32_t frame);
+VkExtent2D getRenderExtent(); // the window size times the render scale, the whole image when headless
+Vk::IDRegion toRenderPixels(const Vk::IDRegion& region, VkExtent2D renderExtent); // from swapchain pixels
+void collectReadback(uint32_t frame);
+int getOldestPendingReadback(); // frame slot, -1 if none
 
 void recreateSwapChain();
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData);
@@ -206,6 +489,8 @@ void testDebugMessenger();
 
 bool isDeviceSuitable(VkPhysicalDevice device);
 bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+std::vector<const char*> getDeviceExtensions(); // without the swapchain extension when headless, without ray tracing for compute tracing
+VkPipelineStageFlags getTraceStage(); // writes the render and id images
 std::vector<const char*> getRequiredExtensions();
 
 VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -217,9 +502,24 @@ void recordImageLayoutTransition(VkCommandBuffer commandBuffer, VkImage image, V
 
 VkDeviceSize getUBOOffsetAligned(VkDeviceSize stride);
 
+// clusters
+
+uint32_t createCluster();
+uint32_t chooseCluster(const Vk::AABB& aabb);
+void insertIntoCluster(uint32_t clusterIndex, Model::EllipsoidID ellipsoidID, const Vk::AABB& aabb);
+void requestClusterUpdate(uint32_t clusterIndex, uint32_t update);
+void removeFromCluster(Model::EllipsoidID ellipsoidID);
+uint32_t getEllipsoidBufferIndex(Model::EllipsoidID ellipsoidID);
+void queueEllipsoidUploads(Model::Span<const Model::EllipsoidID> ellipsoidIDs);
+
 // todo move to VkHelper after switching to khr ray tracing
-void createBLAS(Vk::AccelerationStructure& blas, Vk::AABB aabb);
-Vk::BLASInstance createInstance(uint64_t blasHandle);
+VkGeometryNV createAABBGeometry(VkBuffer aabbBuffer, uint32_t aabbCount, VkDeviceSize offset);
+void createClusterBLAS(Vk::AccelerationStructure& blas);
+void createBLASBuildQueue();
+void submitClusterBLASBuilds(const std::vector<uint32_t>& rebuildClusters, const std::vector<uint32_t>& refitClusters);
+void waitForBLASBuilds();
+VkDeviceSize getArenaSizeClass(VkDeviceSize size);
+Vk::BLASInstance createInstance(uint64_t blasHandle, uint32_t customIndex);
 void createTopLevelAccelerationStructure(Vk::AccelerationStructure& tlas, uint32_t instanceCount);
 
 #pragma endregion
@@ -233,6 +533,17 @@ VkSurfaceKHR getSurface() { return surface; }
 VkCommandPool getCommandPool() { return commandPool; }
 uint32_t getNumSwapchainImages() { return swapchain.numImages; }
 Vk::StorageImage getRenderImage(uint32_t frame) { return perFrame[frame].renderImage; }
+Vk::StorageImage getOverlayImage(uint32_t frame) { return perFrame[frame].overlayImage; }
+bool isHeadless() { return headless; }
+bool isRayTracing() { return rayTracing; }
+
+void forceComputeTracing(bool force) {
+    if (device != VK_NULL_HANDLE) {
+        AID_WARN("Renderer::forceComputeTracing() has to be called before init()");
+        return;
+    }
+    computeTracingForced = force;
+}
 
 void init(std::vector<const char*>& requiredExtensions, glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos) {
     AID_INFO("Initializing vulkan renderer...");
@@ -242,24 +553,57 @@ void init(std::vector<const char*>& requiredExtensions, glm::mat4 viewInverse, g
     createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
+    MemoryAllocator::init(device, physicalDevice);
 
     createSwapChain();
+    initRenderResources(viewInverse, projInverse, cameraPos);
+    createCommandBuffersImageCopy();
+}
+
+void initHeadless(uint32_t width, uint32_t height, glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos) {
+    AID_INFO("Initializing headless vulkan renderer...");
+    if (width == 0 || height == 0) {
+        AID_ERROR("Renderer::initHeadless() image size can't be 0");
+    }
+    headless = true;
+    surface = VK_NULL_HANDLE;
+
+    std::vector<const char*> requiredExtensions; // no window system extensions
+    createInstance(requiredExtensions);
+    setupDebugMessenger();
+    pickPhysicalDevice();
+    createLogicalDevice();
+    MemoryAllocator::init(device, physicalDevice);
+
+    createOffscreenTarget(width, height);
+    initRenderResources(viewInverse, projInverse, cameraPos);
+    createReadbackResources();
+}
+
+// everything but the surface, swapchain and the copies to it
+void initRenderResources(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos) {
     createCommandPool();
     createSyncObjects();
+    createBLASBuildQueue();
+    createStagingRing();
 
     createRenderImages();
     createIDImages();
-    createIDFetchBuffer();
+    createPickResources();
     createDescriptorSetLayouts();
     initPerFrameRenderResources();
     createUBO(viewInverse, projInverse, cameraPos);
 
-    createRayTracingPipeline();
-    createShaderBindingTable();
+    if (rayTracing) {
+        createRayTracingPipeline();
+        createShaderBindingTable();
+    } else {
+        createComputePipeline();
+    }
+    createRefinePipeline();
     createDescriptorSetsRender();
 
     createCommandBuffersRender();
-    createCommandBuffersImageCopy();
 }
 
 void createInstance(std::vector<const char*>& requiredExtensions) {
@@ -331,16 +675,22 @@ void pickPhysicalDevice() {
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-    for (const auto& device : devices) {
-        if (isDeviceSuitable(device)) {
-            physicalDevice = device;
-            break;
+    // a device with ray tracing first, then any device for the compute pipeline
+    for (bool withRayTracing : { true, false }) {
+        if (withRayTracing && computeTracingForced) continue;
+        rayTracing = withRayTracing;
+        for (const auto& device : devices) {
+            if (isDeviceSuitable(device)) {
+                physicalDevice = device;
+                break;
+            }
         }
+        if (physicalDevice != VK_NULL_HANDLE) break;
     }
 
     if (physicalDevice == VK_NULL_HANDLE) {
         std::string extensionWarning = "vulkan extensions required by Aidanic: ";
-        for (const char* extension : deviceExtensions) extensionWarning += std::string(extension) + ", ";
+        for (const char* extension : getDeviceExtensions()) extensionWarning += std::string(extension) + ", ";
         AID_WARN(extensionWarning);
         AID_ERROR("failed to find a suitable GPU!");
     }
@@ -348,6 +698,11 @@ void pickPhysicalDevice() {
     // get physical device properties and limits
     vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
 
+    if (!rayTracing) {
+        if (!computeTracingForced) AID_WARN("{} doesn't support {}, tracing with the compute pipeline", physicalDeviceProperties.deviceName, VK_NV_RAY_TRACING_EXTENSION_NAME);
+        return;
+    }
+
     // Query the ray tracing properties of the current implementation
     rayTracingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PROPERTIES_NV;
     VkPhysicalDeviceProperties2 deviceProps2{};
@@ -360,7 +715,8 @@ void createLogicalDevice() {
     Vk::QueueFamilyIndices queueIndices = Vk::findQueueFamilies(physicalDevice, surface);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = { queueIndices.graphicsFamily.value(), queueIndices.computeFamily.value(), queueIndices.presentFamily.value() };
+    std::set<uint32_t> uniqueQueueFamilies = { queueIndices.graphicsFamily.value(), queueIndices.computeFamily.value() };
+    if (queueIndices.presentFamily.has_value()) uniqueQueueFamilies.insert(queueIndices.presentFamily.value());
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -382,8 +738,9 @@ void createLogicalDevice() {
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = ARRAY_SIZE(deviceExtensions);
-    createInfo.ppEnabledExtensionNames = deviceExtensions;
+    std::vector<const char*> extensions = getDeviceExtensions();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (enableValidationLayers) {
         createInfo.enabledLayerCount = ARRAY_SIZE(validationLayers);
@@ -396,7 +753,8 @@ void createLogicalDevice() {
 
     vkGetDeviceQueue(device, queueIndices.graphicsFamily.value(), 0, &queues.graphics);
     vkGetDeviceQueue(device, queueIndices.computeFamily.value(), 0, &queues.compute);
-    vkGetDeviceQueue(device, queueIndices.presentFamily.value(), 0, &queues.present);
+    if (!headless) vkGetDeviceQueue(device, queueIndices.presentFamily.value(), 0, &queues.present);
+    if (!rayTracing) return;
 
     // Get VK_NV_ray_tracing related function pointers
     vkCreateAccelerationStructureNV = reinterpret_cast<PFN_vkCreateAccelerationStructureNV>(vkGetDeviceProcAddr(device, "vkCreateAccelerationStructureNV"));
@@ -462,6 +820,63 @@ void createSwapChain() {
     perSwapchainImage.resize(imageCount);
 }
 
+// the render and id images are created at swapchain.extent, headless there are no swapchain images to copy to
+void createOffscreenTarget(uint32_t width, uint32_t height) {
+    swapchain.swapchain = VK_NULL_HANDLE;
+    swapchain.images.clear();
+    swapchain.numImages = 0;
+    swapchain.format = HEADLESS_FORMAT;
+    swapchain.extent = { width, height };
+}
+
+void createReadbackResources() {
+    uint32_t width = swapchain.extent.width, height = swapchain.extent.height;
+    VkDeviceSize pixelCount = static_cast<VkDeviceSize>(width) * height;
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    VkBufferImageCopy copyRegion{};
+    copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    copyRegion.imageExtent = { width, height, 1 };
+
+    for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+        perFrame[f].colorReadbackBuffer.create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, 4 * pixelCount, device, physicalDevice, MemoryAllocator::Category::STAGING);
+        perFrame[f].idReadbackBuffer.create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(int32_t) * pixelCount, device, physicalDevice, MemoryAllocator::Category::STAGING);
+
+        // the images never change, so the copies are recorded once
+        VkCommandBuffer& commandBuffer = perFrame[f].commandBufferReadback;
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer), "failed to allocate readback command buffer");
+        VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "failed to begin readback command buffer");
+
+        // the trace submitted before this writes both images, they stay in the general layout like for the picks
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            getTraceStage(), VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdCopyImageToBuffer(commandBuffer, perFrame[f].renderImage.image, VK_IMAGE_LAYOUT_GENERAL, perFrame[f].colorReadbackBuffer.buffer, 1, &copyRegion);
+        vkCmdCopyImageToBuffer(commandBuffer, perFrame[f].objectIDsImage.image, VK_IMAGE_LAYOUT_GENERAL, perFrame[f].idReadbackBuffer.buffer, 1, &copyRegion);
+
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end readback command buffer");
+    }
+}
+
 void createCommandPool() {
     Vk::QueueFamilyIndices queueFamilyIndices = Vk::findQueueFamilies(physicalDevice, surface);
 
@@ -515,33 +930,41 @@ void createRenderImages() {
     colorImageView.subresourceRange.baseArrayLayer = 0;
     colorImageView.subresourceRange.layerCount = 1;
 
+    // the overlay image is only blitted into, drawn on and copied out of
+    VkImageUsageFlags usages[2] = { imageCI.usage, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+
     for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
-        perFrame[f].renderImage.extent = swapchain.extent;
-        perFrame[f].renderImage.format = swapchain.format;
+        perFrame[f].tracedSceneVersion = 0;
+        perFrame[f].renderExtent = getRenderExtent();
+        perFrame[f].historyValid = false;
+
+        Vk::StorageImage* images[2] = { &perFrame[f].renderImage, &perFrame[f].overlayImage };
+        for (uint32_t i = 0; i < (headless ? 1u : 2u); i++) {
+            Vk::StorageImage& image = *images[i];
+            image.extent = swapchain.extent;
+            image.format = swapchain.format;
 
-        imageCI.format = perFrame[f].renderImage.format;
-        imageCI.extent.width = perFrame[f].renderImage.extent.width;
-        imageCI.extent.height = perFrame[f].renderImage.extent.height;
+            imageCI.format = image.format;
+            imageCI.extent.width = image.extent.width;
+            imageCI.extent.height = image.extent.height;
+            imageCI.usage = usages[i];
 
-        VK_CHECK_RESULT(vkCreateImage(device, &imageCI, VK_ALLOCATOR, &perFrame[f].renderImage.image), "failed to create ray tracing storage image");
+            VK_CHECK_RESULT(vkCreateImage(device, &imageCI, VK_ALLOCATOR, &image.image), "failed to create ray tracing storage image");
 
-        VkMemoryRequirements memReqs;
-        vkGetImageMemoryRequirements(device, perFrame[f].renderImage.image, &memReqs);
-        VkMemoryAllocateInfo memoryAllocateInfo{};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.allocationSize = memReqs.size;
-        memoryAllocateInfo.memoryTypeIndex = Vk::findMemoryType(physicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            VkMemoryRequirements memReqs;
+            vkGetImageMemoryRequirements(device, image.image, &memReqs);
+            image.allocation = MemoryAllocator::allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryAllocator::Category::IMAGE);
 
-        VK_CHECK_RESULT(vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &perFrame[f].renderImage.memory), "failed to allocate render image memory");
-        VK_CHECK_RESULT(vkBindImageMemory(device, perFrame[f].renderImage.image, perFrame[f].renderImage.memory, 0), "failed to bind image memory");
+            VK_CHECK_RESULT(vkBindImageMemory(device, image.image, image.allocation.memory, image.allocation.offset), "failed to bind image memory");
 
-        colorImageView.format = perFrame[f].renderImage.format;
-        colorImageView.image = perFrame[f].renderImage.image;
-        VK_CHECK_RESULT(vkCreateImageView(device, &colorImageView, nullptr, &perFrame[f].renderImage.view), "failed to create render image view");
+            colorImageView.format = image.format;
+            colorImageView.image = image.image;
+            VK_CHECK_RESULT(vkCreateImageView(device, &colorImageView, nullptr, &image.view), "failed to create render image view");
 
-        VkCommandBuffer cmdBuffer = Vk::beginSingleTimeCommands(device, commandPool);
-        recordImageLayoutTransition(cmdBuffer, perFrame[f].renderImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-        Vk::endSingleTimeCommands(device, cmdBuffer, queues.graphics, commandPool);
+            VkCommandBuffer cmdBuffer = Vk::beginSingleTimeCommands(device, commandPool);
+            recordImageLayoutTransition(cmdBuffer, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+            Vk::endSingleTimeCommands(device, cmdBuffer, queues.graphics, commandPool);
+        }
     }
 }
 
@@ -568,63 +991,98 @@ void createIDImages() {
     colorImageView.subresourceRange.layerCount = 1;
 
     for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
-        perFrame[f].objectIDsImage.extent = swapchain.extent;
-        perFrame[f].objectIDsImage.format = VK_FORMAT_R32_SINT;
+        // the depth image only exists for refine.comp, it's never copied out
+        Vk::StorageImage* images[2] = { &perFrame[f].objectIDsImage, &perFrame[f].depthImage };
+        VkFormat formats[2] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32_SFLOAT };
+        for (uint32_t i = 0; i < 2; i++) {
+            Vk::StorageImage& image = *images[i];
+            image.extent = swapchain.extent;
+            image.format = formats[i];
 
-        imageCI.format = perFrame[f].objectIDsImage.format;
-        imageCI.extent.width = perFrame[f].objectIDsImage.extent.width;
-        imageCI.extent.height = perFrame[f].objectIDsImage.extent.height;
+            imageCI.format = image.format;
+            imageCI.extent.width = image.extent.width;
+            imageCI.extent.height = image.extent.height;
 
-        VK_CHECK_RESULT(vkCreateImage(device, &imageCI, VK_ALLOCATOR, &perFrame[f].objectIDsImage.image), "failed to create ray tracing storage image");
+            VK_CHECK_RESULT(vkCreateImage(device, &imageCI, VK_ALLOCATOR, &image.image), "failed to create ray tracing storage image");
 
-        VkMemoryRequirements memReqs;
-        vkGetImageMemoryRequirements(device, perFrame[f].objectIDsImage.image, &memReqs);
-        VkMemoryAllocateInfo memoryAllocateInfo{};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.allocationSize = memReqs.size;
-        memoryAllocateInfo.memoryTypeIndex = Vk::findMemoryType(physicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            VkMemoryRequirements memReqs;
+            vkGetImageMemoryRequirements(device, image.image, &memReqs);
+            image.allocation = MemoryAllocator::allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryAllocator::Category::IMAGE);
 
-        VK_CHECK_RESULT(vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &perFrame[f].objectIDsImage.memory), "failed to allocate render image memory");
-        VK_CHECK_RESULT(vkBindImageMemory(device, perFrame[f].objectIDsImage.image, perFrame[f].objectIDsImage.memory, 0), "failed to bind image memory");
+            VK_CHECK_RESULT(vkBindImageMemory(device, image.image, image.allocation.memory, image.allocation.offset), "failed to bind image memory");
 
-        colorImageView.format = perFrame[f].objectIDsImage.format;
-        colorImageView.image = perFrame[f].objectIDsImage.image;
-        VK_CHECK_RESULT(vkCreateImageView(device, &colorImageView, nullptr, &perFrame[f].objectIDsImage.view), "failed to create render image view");
+            colorImageView.format = image.format;
+            colorImageView.image = image.image;
+            VK_CHECK_RESULT(vkCreateImageView(device, &colorImageView, nullptr, &image.view), "failed to create render image view");
 
-        VkCommandBuffer cmdBuffer = Vk::beginSingleTimeCommands(device, commandPool);
-        recordImageLayoutTransition(cmdBuffer, perFrame[f].objectIDsImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
-        Vk::endSingleTimeCommands(device, cmdBuffer, queues.graphics, commandPool);
+            VkCommandBuffer cmdBuffer = Vk::beginSingleTimeCommands(device, commandPool);
+            recordImageLayoutTransition(cmdBuffer, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+            Vk::endSingleTimeCommands(device, cmdBuffer, queues.graphics, commandPool);
+        }
     }
 }
 
-void createIDFetchBuffer() {
-    bufferObjectIDFetch.create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(int32_t), device, physicalDevice);
+void createPickResources() {
+    for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+        perFrame[f].pickReadbackBuffer.create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(int32_t) * MAX_PICKS_PER_FRAME, device, physicalDevice);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocInfo, &perFrame[f].commandBufferPick), "failed to allocate pick command buffer");
+    }
+
+    selectionPass.create(device, physicalDevice);
 }
 
 void initPerFrameRenderResources() {
 
     // create descriptor pool
 
+    // one set per frame in flight, there may be no swapchain images
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, static_cast<uint32_t>(perSwapchainImage.size()) },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<uint32_t>(perSwapchainImage.size()) }
+        { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, MAX_FRAMES_IN_FLIGHT },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MAX_FRAMES_IN_FLIGHT }
     };
+    if (!rayTracing) {
+        // bvh nodes, ellipsoids and bvh primitives
+        poolSizes = { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * MAX_FRAMES_IN_FLIGHT } };
+        buildComputeBVH();
+    }
 
     VkDescriptorPoolCreateInfo descriptorPoolCI{};
     descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     descriptorPoolCI.pPoolSizes = poolSizes.data();
-    descriptorPoolCI.maxSets = static_cast<uint32_t>(perSwapchainImage.size());
+    descriptorPoolCI.maxSets = MAX_FRAMES_IN_FLIGHT;
     VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, VK_ALLOCATOR, &descriptorPoolModels), "failed to create descriptor pool");
 
     for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
-        // create tlas
-
-        updateModelTLAS(f);
+        // create tlas, it gets built before the first frame is traced
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocInfo, &perFrame[f].commandBufferTLAS), "failed to allocate tlas build command buffer");
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2;
+        VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, VK_ALLOCATOR, &perFrame[f].tlasTimestampQueryPool), "failed to create tlas query pool");
+        VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, VK_ALLOCATOR, &perFrame[f].traceTimestampQueryPool), "failed to create trace query pool");
+
+        if (rayTracing) reserveModelTLAS(f, TLAS_MIN_CAPACITY);
+        else reserveComputeBVH(f, COMPUTE_BVH_MIN_CAPACITY, COMPUTE_BVH_MIN_CAPACITY);
+        perFrame[f].updateEllipsoidTLAS = AS_UPDATE_REBUILD;
 
         // init ellipsoids buffer
 
-        perFrame[f].spheresBuffer.create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(Model::Ellipsoid) * SPHERE_COUNT_PER_TLAS, device, physicalDevice);
+        reserveEllipsoidBuffer(f, ELLIPSOID_BUFFER_MIN_CAPACITY);
 
         // create descriptor set
 
@@ -646,29 +1104,40 @@ void createUBO(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos
 }
 
 void createDescriptorSetLayouts() {
+    // refine.comp binds the render set of its own and of the previous frame slot
+    VkShaderStageFlags traceStage = VK_SHADER_STAGE_COMPUTE_BIT;
+    if (rayTracing) traceStage |= VK_SHADER_STAGE_RAYGEN_BIT_NV;
+
     {
         VkDescriptorSetLayoutBinding layoutBindingRenderImage{};
         layoutBindingRenderImage.binding = 0;
         layoutBindingRenderImage.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
         layoutBindingRenderImage.descriptorCount = 1;
-        layoutBindingRenderImage.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+        layoutBindingRenderImage.stageFlags = traceStage;
 
         VkDescriptorSetLayoutBinding layoutBindingUniformBuffer{};
         layoutBindingUniformBuffer.binding = 1;
         layoutBindingUniformBuffer.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         layoutBindingUniformBuffer.descriptorCount = 1;
-        layoutBindingUniformBuffer.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+        layoutBindingUniformBuffer.stageFlags = traceStage;
 
         VkDescriptorSetLayoutBinding layoutBindingObjectIDsImage{};
         layoutBindingObjectIDsImage.binding = 2;
         layoutBindingObjectIDsImage.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
         layoutBindingObjectIDsImage.descriptorCount = 1;
-        layoutBindingObjectIDsImage.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+        layoutBindingObjectIDsImage.stageFlags = traceStage;
+
+        VkDescriptorSetLayoutBinding layoutBindingDepthImage{};
+        layoutBindingDepthImage.binding = 3;
+        layoutBindingDepthImage.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        layoutBindingDepthImage.descriptorCount = 1;
+        layoutBindingDepthImage.stageFlags = traceStage;
 
         std::vector<VkDescriptorSetLayoutBinding> bindings({
             layoutBindingRenderImage,
             layoutBindingUniformBuffer,
-            layoutBindingObjectIDsImage });
+            layoutBindingObjectIDsImage,
+            layoutBindingDepthImage });
 
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
         descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -677,7 +1146,23 @@ void createDescriptorSetLayouts() {
         VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, VK_ALLOCATOR, &descriptorSetLayoutRender), "failed to create descriptor set layout");
     }
 
-    {
+    if (!rayTracing) {
+        // scene.comp: bvh nodes, ellipsoids, bvh primitives
+        std::vector<VkDescriptorSetLayoutBinding> bindings(3);
+        for (uint32_t b = 0; b < bindings.size(); b++) {
+            bindings[b] = {};
+            bindings[b].binding = b;
+            bindings[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[b].descriptorCount = 1;
+            bindings[b].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI{};
+        descriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutCI.bindingCount = static_cast<uint32_t>(bindings.size());
+        descriptorSetLayoutCI.pBindings = bindings.data();
+        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, VK_ALLOCATOR, &descriptorSetLayoutModels), "failed to create descriptor set layout");
+    } else {
         VkDescriptorSetLayoutBinding layoutBindingAccelerationStructure{};
         layoutBindingAccelerationStructure.binding = 0;
         layoutBindingAccelerationStructure.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV;
@@ -769,9 +1254,50 @@ void createShaderBindingTable() {
     shaderBindingTable.upload(shaderGroupHandleStorage, sbtSize, 0, device);
 }
 
+// same descriptor set layouts as the ray tracing pipeline, with the bvh buffers instead of the tlas in set 1
+void createComputePipeline() {
+    VkDescriptorSetLayout descriptorLayouts[] = { descriptorSetLayoutRender, descriptorSetLayoutModels };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCI.setLayoutCount = 2;
+    pipelineLayoutCI.pSetLayouts = descriptorLayouts;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, VK_ALLOCATOR, &pipelineLayout), "failed to create compute tracing pipeline layout");
+
+    VkShaderModule shaderModule;
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage = Vk::loadShader(device, std::string(_CONFIG::getAssetsPath()) + std::string(SHADER_SRC_COMPUTE_SCENE), VK_SHADER_STAGE_COMPUTE_BIT, shaderModule);
+    pipelineCI.layout = pipelineLayout;
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineCI, VK_ALLOCATOR, &pipeline), "failed to create compute tracing pipeline");
+
+    vkDestroyShaderModule(device, shaderModule, VK_ALLOCATOR);
+}
+
+void createRefinePipeline() {
+    // set 0 of this frame slot, set 1 of the previous one (the history)
+    VkDescriptorSetLayout descriptorLayouts[] = { descriptorSetLayoutRender, descriptorSetLayoutRender };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+    pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCI.setLayoutCount = 2;
+    pipelineLayoutCI.pSetLayouts = descriptorLayouts;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, VK_ALLOCATOR, &refinePipelineLayout), "failed to create refine pipeline layout");
+
+    VkShaderModule shaderModule;
+    VkComputePipelineCreateInfo pipelineCI{};
+    pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCI.stage = Vk::loadShader(device, std::string(_CONFIG::getAssetsPath()) + std::string(SHADER_SRC_COMPUTE_REFINE), VK_SHADER_STAGE_COMPUTE_BIT, shaderModule);
+    pipelineCI.layout = refinePipelineLayout;
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineCI, VK_ALLOCATOR, &refinePipeline), "failed to create refine pipeline");
+
+    vkDestroyShaderModule(device, shaderModule, VK_ALLOCATOR);
+}
+
 void createDescriptorSetsRender() {
+    // render, id and depth image
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_FRAMES_IN_FLIGHT },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 * MAX_FRAMES_IN_FLIGHT },
         { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, MAX_FRAMES_IN_FLIGHT }
     };
 
@@ -822,6 +1348,16 @@ void createDescriptorSetsRender() {
     objectIDsImageWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
     objectIDsImageWrite.dstBinding = 2;
 
+    // depth image descriptor
+
+    VkDescriptorImageInfo depthImageDescriptor[MAX_FRAMES_IN_FLIGHT];
+
+    VkWriteDescriptorSet depthImageWrite{};
+    depthImageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    depthImageWrite.descriptorCount = 1;
+    depthImageWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    depthImageWrite.dstBinding = 3;
+
     std::vector<VkWriteDescriptorSet> writeDescriptorSets;
     for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
         VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &perFrame[f].descriptorSetRender), "failed to allocate render descriptor set");
@@ -842,6 +1378,14 @@ void createDescriptorSetsRender() {
         objectIDsImageWrite.dstSet = perFrame[f].descriptorSetRender;
         writeDescriptorSets.push_back(objectIDsImageWrite);
 
+        depthImageDescriptor[f] = {};
+        depthImageDescriptor[f].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        depthImageDescriptor[f].imageView = perFrame[f].depthImage.view;
+
+        depthImageWrite.pImageInfo = &depthImageDescriptor[f];
+        depthImageWrite.dstSet = perFrame[f].descriptorSetRender;
+        writeDescriptorSets.push_back(depthImageWrite);
+
         uniformBufferWrite.dstSet = perFrame[f].descriptorSetRender;
         writeDescriptorSets.push_back(uniformBufferWrite);
     }
@@ -858,6 +1402,7 @@ void createCommandBuffersRender() {
 
     for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
         vkAllocateCommandBuffers(device, &allocInfo, &perFrame[f].commandBufferRender);
+        vkAllocateCommandBuffers(device, &allocInfo, &perFrame[f].commandBufferRefine);
         recordCommandBufferRender(f);
     }
 }
@@ -868,66 +1413,117 @@ void createCommandBuffersImageCopy() {
     allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
     allocInfo.commandPool = commandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    for (int s = 0; s < perSwapchainImage.size(); s++)
+    for (int s = 0; s < perSwapchainImage.size(); s++) {
         vkAllocateCommandBuffers(device, &allocInfo, perSwapchainImage[s].commandBufferImageCopy);
+        vkAllocateCommandBuffers(device, &allocInfo, perSwapchainImage[s].commandBufferOverlayCopy);
+    }
+
+    for (int s = 0; s < swapchain.numImages; s++) {
+        for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+            recordSwapchainCopy(perSwapchainImage[s].commandBufferImageCopy[f], perFrame[f].renderImage.image, perFrame[f].renderExtent, s);
+            recordSwapchainCopy(perSwapchainImage[s].commandBufferOverlayCopy[f], perFrame[f].overlayImage.image, swapchain.extent, s);
+        }
+    }
+
+    allocInfo.commandBufferCount = 1;
+    for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+        vkAllocateCommandBuffers(device, &allocInfo, &perFrame[f].commandBufferComposite);
+        recordCommandBufferComposite(f);
+    }
+}
 
-    // begin info
+// source is a render or overlay image in the general layout, its top left sourceExtent is scaled to the swapchain image
+void recordSwapchainCopy(VkCommandBuffer commandBuffer, VkImage source, VkExtent2D sourceExtent, uint32_t swapchainImage) {
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-    for (int s = 0; s < swapchain.numImages; s++) {
-        for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
-            VkCommandBuffer& commandBuffer = perSwapchainImage[s].commandBufferImageCopy[f];
-            VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "failed to begin command buffer");
-
-            // copy ray tracing output to swapchain image
-
-            recordImageLayoutTransition(
-                commandBuffer,
-                swapchain.images[s],
-                VK_IMAGE_LAYOUT_UNDEFINED,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                subresourceRange);
-
-            recordImageLayoutTransition(
-                commandBuffer,
-                perFrame[f].renderImage.image,
-                VK_IMAGE_LAYOUT_GENERAL,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                subresourceRange);
-
-            VkImageCopy copyRegion{};
-            copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-            copyRegion.srcOffset = { 0, 0, 0 };
-            copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-            copyRegion.dstOffset = { 0, 0, 0 };
-            copyRegion.extent = { swapchain.extent.width, swapchain.extent.height, 1 };
-            vkCmdCopyImage(commandBuffer, perFrame[f].renderImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapchain.images[s], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-            recordImageLayoutTransition(
-                commandBuffer,
-                swapchain.images[s],
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                subresourceRange);
-
-            recordImageLayoutTransition(
-                commandBuffer,
-                perFrame[f].renderImage.image,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                VK_IMAGE_LAYOUT_GENERAL,
-                subresourceRange);
-
-            VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end rendering command buffer {}", s);
-        }
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "failed to begin command buffer");
+
+    // copy ray tracing output to swapchain image
+
+    recordImageLayoutTransition(
+        commandBuffer,
+        swapchain.images[swapchainImage],
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        subresourceRange);
+
+    recordImageLayoutTransition(
+        commandBuffer,
+        source,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        subresourceRange);
+
+    if (sourceExtent.width == swapchain.extent.width && sourceExtent.height == swapchain.extent.height) {
+        VkImageCopy copyRegion{};
+        copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copyRegion.srcOffset = { 0, 0, 0 };
+        copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copyRegion.dstOffset = { 0, 0, 0 };
+        copyRegion.extent = { swapchain.extent.width, swapchain.extent.height, 1 };
+        vkCmdCopyImage(commandBuffer, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapchain.images[swapchainImage], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+    } else {
+        VkImageBlit blitRegion{};
+        blitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        blitRegion.srcOffsets[1] = { static_cast<int32_t>(sourceExtent.width), static_cast<int32_t>(sourceExtent.height), 1 };
+        blitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        blitRegion.dstOffsets[1] = { static_cast<int32_t>(swapchain.extent.width), static_cast<int32_t>(swapchain.extent.height), 1 };
+        vkCmdBlitImage(commandBuffer, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapchain.images[swapchainImage], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitRegion, VK_FILTER_LINEAR);
     }
+
+    recordImageLayoutTransition(
+        commandBuffer,
+        swapchain.images[swapchainImage],
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        subresourceRange);
+
+    recordImageLayoutTransition(
+        commandBuffer,
+        source,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_IMAGE_LAYOUT_GENERAL,
+        subresourceRange);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end rendering command buffer {}", swapchainImage);
+}
+
+// submitted ahead of the imgui commands, which draw on the overlay image
+void recordCommandBufferComposite(uint32_t frame) {
+    VkCommandBuffer commandBuffer = perFrame[frame].commandBufferComposite;
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "failed to begin composite command buffer");
+
+    recordImageLayoutTransition(commandBuffer, perFrame[frame].renderImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
+    // the last overlay is overwritten completely
+    recordImageLayoutTransition(commandBuffer, perFrame[frame].overlayImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+
+    // the traced part, scaled to the whole overlay so imgui stays at the window resolution
+    VkExtent2D renderExtent = perFrame[frame].renderExtent;
+    VkExtent2D overlayExtent = perFrame[frame].overlayImage.extent;
+    VkImageBlit blitRegion{};
+    blitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    blitRegion.srcOffsets[1] = { static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1 };
+    blitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    blitRegion.dstOffsets[1] = { static_cast<int32_t>(overlayExtent.width), static_cast<int32_t>(overlayExtent.height), 1 };
+    vkCmdBlitImage(commandBuffer, perFrame[frame].renderImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, perFrame[frame].overlayImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitRegion, VK_FILTER_LINEAR);
+
+    recordImageLayoutTransition(commandBuffer, perFrame[frame].renderImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
+    recordImageLayoutTransition(commandBuffer, perFrame[frame].overlayImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end composite command buffer {}", frame);
 }
 
 // MAIN LOOP
 
 void drawFrame(bool framebufferResized, glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos, bool renderImGui) {
     vkWaitForFences(device, 1, &perFrame[currentFrame].fenceRenderComplete, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
+    readIDReadbacks(currentFrame);
 
     uint32_t imageIndex;
     VkResult resultAcquire = vkAcquireNextImageKHR(device, swapchain.swapchain, UINT64_MAX, perFrame[currentFrame].semaphoreImageAvailable, VK_NULL_HANDLE, &imageIndex);
@@ -940,50 +1536,80 @@ void drawFrame(bool framebufferResized, glm::mat4 viewInverse, glm::mat4 projInv
     } else if (resultAcquire != VK_SUCCESS && resultAcquire != VK_SUBOPTIMAL_KHR) {
         AID_ERROR("failed to acquire swap chain image!");
     }
+    time_point<high_resolution_clock> cpuStart = high_resolution_clock::now();
 
+    trackCameraChanges(viewInverse, projInverse, cameraPos);
     updateModels(currentFrame);
+    updateRenderScale(currentFrame);
+    // edits still go into this frame's buffers above, only the trace is skipped
+    bool trace = !renderOnDemand || perFrame[currentFrame].rerecordRenderCommands || perFrame[currentFrame].tracedSceneVersion != sceneVersion;
     if (perFrame[currentFrame].rerecordRenderCommands) {
         recordCommandBufferRender(currentFrame);
         perFrame[currentFrame].rerecordRenderCommands = false;
     }
-    updateUniformBuffer(viewInverse, projInverse, cameraPos, currentFrame);
+    if (trace) {
+        chooseRefinement(currentFrame);
+        updateUniformBuffer(viewInverse, projInverse, cameraPos, currentFrame);
+    } else {
+        stats.refinement.raysTraced = 0;
+    }
+
+    // host writes through the mapped buffers for this frame
+    stats.uniformBytesWritten = bufferUBO.resetBytesWritten();
+    stats.tlasInstanceBytesWritten = perFrame[currentFrame].tlasInstanceBuffer.resetBytesWritten();
+    stats.blasAABBBytesWritten = blasBuildQueue.aabbArena.resetBytesWritten();
 
     if (perSwapchainImage[imageIndex].renderCompleteFenceReference != VK_NULL_HANDLE) {
         vkWaitForFences(device, 1, &perSwapchainImage[imageIndex].renderCompleteFenceReference, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
     }
     perSwapchainImage[imageIndex].renderCompleteFenceReference = perFrame[currentFrame].fenceRenderComplete;
 
-    // ray tracing dispatch
-    {
-        VkSemaphore signalSemaphores[] = { perFrame[currentFrame].semaphoreRenderFinished };
+    // ray tracing dispatch, unless the render image already shows this camera and scene
+    if (trace) {
+        _PerFrame& f = perFrame[currentFrame];
+        bool sparse = f.refineMode != REFINE_NONE;
+        VkSemaphore signalSemaphores[] = { f.semaphoreRenderFinished };
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &perFrame[currentFrame].commandBufferRender;
+        submitInfo.pCommandBuffers = sparse ? &f.commandBufferRefine : &f.commandBufferRender;
         submitInfo.waitSemaphoreCount = 0;
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
         VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, VK_NULL_HANDLE), "failed to submit render queue {}", imageIndex);
+        f.traceTimestampsPending = true;
+        f.refineTimestamps = sparse;
+        // an unfinished refinement is traced again by the slot's next frame
+        f.tracedSceneVersion = f.phasesTraced == SparsePattern::getPhaseCount(refinement.stride) ? sceneVersion : 0;
+        f.historyValid = true;
+        f.tracedViewInverse = viewInverse;
+        f.tracedProjInverse = projInverse;
+        f.tracedCameraPos = glm::vec4(cameraPos, 1.0f);
     }
 
+    // object id picks and selections, read back once the frame fence signals
+    submitIDReadbacks(currentFrame);
+
     // render imGui
     if (renderImGui) ImGuiVk::recordRenderCommands(currentFrame);
     renderImGui &= ImGuiVk::shouldRender(currentFrame);
     if (renderImGui) {
 
+        // a reused render image was finished by an earlier frame's submission, the composite barrier orders the copy
         VkSemaphore waitSemaphores[] = { perFrame[currentFrame].semaphoreRenderFinished };
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_TRANSFER_BIT };
         VkSemaphore signalSemaphores[] = { perFrame[currentFrame].semaphoreImGuiFinished };
 
-        VkCommandBuffer commandBuffers[] = { ImGuiVk::getCommandBuffer(currentFrame) };
+        // onto a copy of the render image, so it stays reusable
+        VkCommandBuffer commandBuffers[] = { perFrame[currentFrame].commandBufferComposite, ImGuiVk::getCommandBuffer(currentFrame) };
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
+        submitInfo.commandBufferCount = 2;
         submitInfo.pCommandBuffers = commandBuffers;
-        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.waitSemaphoreCount = trace ? 1 : 0;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.signalSemaphoreCount = 1;
@@ -996,16 +1622,17 @@ void drawFrame(bool framebufferResized, glm::mat4 viewInverse, glm::mat4 projInv
     {
         VkSemaphore signalSemaphores[] = { perFrame[currentFrame].semaphoreImageCopyFinished };
         VkSemaphore waitSemaphores[2];
-        waitSemaphores[0] = perFrame[currentFrame].semaphoreImageAvailable;
-        if (renderImGui) waitSemaphores[1] = perFrame[currentFrame].semaphoreImGuiFinished;
-        else waitSemaphores[1] = perFrame[currentFrame].semaphoreRenderFinished;
+        uint32_t waitSemaphoreCount = 0;
+        waitSemaphores[waitSemaphoreCount++] = perFrame[currentFrame].semaphoreImageAvailable;
+        if (renderImGui) waitSemaphores[waitSemaphoreCount++] = perFrame[currentFrame].semaphoreImGuiFinished;
+        else if (trace) waitSemaphores[waitSemaphoreCount++] = perFrame[currentFrame].semaphoreRenderFinished;
         VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT };
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &perSwapchainImage[imageIndex].commandBufferImageCopy[currentFrame];
-        submitInfo.waitSemaphoreCount = 2;
+        submitInfo.pCommandBuffers = renderImGui ? &perSwapchainImage[imageIndex].commandBufferOverlayCopy[currentFrame] : &perSwapchainImage[imageIndex].commandBufferImageCopy[currentFrame];
+        submitInfo.waitSemaphoreCount = waitSemaphoreCount;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.signalSemaphoreCount = 1;
@@ -1015,6 +1642,15 @@ void drawFrame(bool framebufferResized, glm::mat4 viewInverse, glm::mat4 projInv
         VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, perFrame[currentFrame].fenceRenderComplete), "failed to submit render queue {}", imageIndex);
     }
 
+    float cpuTime = duration<float, std::milli>(high_resolution_clock::now() - cpuStart).count();
+    if (trace) {
+        stats.onDemand.framesTraced++;
+        stats.onDemand.cpuTimeTraced += cpuTime;
+    } else {
+        stats.onDemand.framesReused++;
+        stats.onDemand.cpuTimeReused += cpuTime;
+    }
+
     // present
     {
         VkSemaphore waitSemaphores[] = { perFrame[currentFrame].semaphoreImageCopyFinished };
@@ -1040,172 +1676,754 @@ void drawFrame(bool framebufferResized, glm::mat4 viewInverse, glm::mat4 projInv
 
     lastRenderedFrame = currentFrame;
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    frameNumber++;
 }
 
-int addEllipsoid(Model::EllipsoidID ellipsoidID) {
-    // preset limit for now
-    if (SPHERE_COUNT_PER_TLAS <= ellipsoidIDs.size()) return -1;
+void drawFrameHeadless(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos) {
+    time_point<high_resolution_clock> waitStart = high_resolution_clock::now();
+    vkWaitForFences(device, 1, &perFrame[currentFrame].fenceRenderComplete, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
+    stats.headless.fenceWaitTime = duration<float, std::milli>(high_resolution_clock::now() - waitStart).count();
+    stats.headless.fenceWaitTotal += stats.headless.fenceWaitTime;
+    readIDReadbacks(currentFrame);
+    // the slot's buffers are overwritten by this frame, its last frame is queued if it wasn't polled yet
+    collectReadback(currentFrame);
+
+    updateModels(currentFrame);
+    if (perFrame[currentFrame].rerecordRenderCommands) {
+        recordCommandBufferRender(currentFrame);
+        perFrame[currentFrame].rerecordRenderCommands = false;
+    }
+    updateUniformBuffer(viewInverse, projInverse, cameraPos, currentFrame);
+
+    stats.uniformBytesWritten = bufferUBO.resetBytesWritten();
+    stats.tlasInstanceBytesWritten = perFrame[currentFrame].tlasInstanceBuffer.resetBytesWritten();
+    stats.blasAABBBytesWritten = blasBuildQueue.aabbArena.resetBytesWritten();
+
+    // ray tracing dispatch
+    {
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &perFrame[currentFrame].commandBufferRender;
+        VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, VK_NULL_HANDLE), "failed to submit render queue");
+        perFrame[currentFrame].traceTimestampsPending = true;
+        perFrame[currentFrame].refineTimestamps = false;
+        perFrame[currentFrame].tracedSceneVersion = sceneVersion;
+    }
+
+    submitIDReadbacks(currentFrame);
 
-    uint32_t ellipsoidIndex = ellipsoidIDs.size();
-    ellipsoidIDs.push_back(ellipsoidID);
-    ellipsoidBLASs.push_back(Vk::AccelerationStructure());
+    // copy render and id image into host memory, the fence covers everything submitted before on the queue
+    {
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &perFrame[currentFrame].commandBufferReadback;
 
-    // add a BLAS
+        vkResetFences(device, 1, &perFrame[currentFrame].fenceRenderComplete);
+        VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, perFrame[currentFrame].fenceRenderComplete), "failed to submit readback");
+    }
 
-    Vk::AABB sphereAABB(PrimitiveManager::getEllipsoid(ellipsoidID));
-    createBLAS(ellipsoidBLASs[ellipsoidIndex], sphereAABB);
+    perFrame[currentFrame].readbackPending = true;
+    perFrame[currentFrame].readbackFrameNumber = frameNumber;
+    perFrame[currentFrame].readbackSubmitTime = high_resolution_clock::now();
+    stats.headless.framesSubmitted++;
 
-    // add instance
+    lastRenderedFrame = currentFrame;
+    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    frameNumber++;
+}
 
-    ellipsoidInstances.push_back(createInstance(ellipsoidBLASs[ellipsoidIndex].handle));
+bool pollReadback(ReadbackFrame& frame) {
+    // the oldest slot finishes first, frames on one queue complete in submission order
+    int oldest = getOldestPendingReadback();
+    if (readbackFrames.empty() && oldest >= 0 && vkGetFenceStatus(device, perFrame[oldest].fenceRenderComplete) == VK_SUCCESS)
+        collectReadback(oldest);
 
-    // signal that a tlas update is required
+    if (readbackFrames.empty()) return false;
+    frame = std::move(readbackFrames.front());
+    readbackFrames.pop_front();
+    return true;
+}
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        perFrame[i].updateEllipsoidTLAS = true;
-        perFrame[i].updateEllipsoidIDs.push_back(ellipsoidID);
+void finishReadbacks() {
+    for (int oldest = getOldestPendingReadback(); oldest >= 0; oldest = getOldestPendingReadback()) {
+        vkWaitForFences(device, 1, &perFrame[oldest].fenceRenderComplete, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
+        collectReadback(oldest);
     }
-    return 0;
 }
 
-int updateEllipsoid(Model::EllipsoidID ellipsoidID) {
+void collectReadback(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+    if (!f.readbackPending) return;
+
+    time_point<high_resolution_clock> copyStart = high_resolution_clock::now();
+    uint32_t pixelCount = f.renderImage.extent.width * f.renderImage.extent.height;
+
+    ReadbackFrame readback;
+    readback.frameNumber = f.readbackFrameNumber;
+    readback.width = f.renderImage.extent.width;
+    readback.height = f.renderImage.extent.height;
+    Model::Span<const uint8_t> colors = f.colorReadbackBuffer.read<uint8_t>(0, 4 * pixelCount);
+    readback.colors.assign(colors.begin(), colors.end());
+    Model::Span<const int32_t> ids = f.idReadbackBuffer.read<int32_t>(0, pixelCount);
+    readback.objectIDs.assign(ids.begin(), ids.end());
+    f.readbackPending = false;
+
+    time_point<high_resolution_clock> copyEnd = high_resolution_clock::now();
+    stats.headless.copyTime = duration<float, std::milli>(copyEnd - copyStart).count();
+    stats.headless.readbackLatency = duration<float, std::milli>(copyEnd - f.readbackSubmitTime).count();
+    stats.headless.framesRead++;
+
+    readbackFrames.push_back(std::move(readback));
+    while (readbackFrames.size() > MAX_READBACK_FRAMES) {
+        readbackFrames.pop_front();
+        stats.headless.framesDropped++;
+    }
+}
 
-    int ellipsoidIndex = Model::containsID(ellipsoidIDs, ellipsoidID);
-    if (ellipsoidIndex == -1) {
-        AID_WARN("Renderer::updateEllipsoid() tried to update ellpisoid {} that hasn't been added", ellipsoidID.getID());
-        return -1;
+int getOldestPendingReadback() {
+    int oldest = -1;
+    for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+        if (perFrame[f].readbackPending && (oldest < 0 || perFrame[f].readbackFrameNumber < perFrame[oldest].readbackFrameNumber))
+            oldest = f;
     }
+    return oldest;
+}
 
-    // recreate BLAS
+int addEllipsoid(Model::EllipsoidID ellipsoidID) {
+    return addEllipsoids(Model::Span<const Model::EllipsoidID>(&ellipsoidID, 1));
+}
 
-    cleanUpAccelerationStructure(ellipsoidBLASs[ellipsoidIndex]);
+int updateEllipsoid(Model::EllipsoidID ellipsoidID) {
+    return updateEllipsoids(Model::Span<const Model::EllipsoidID>(&ellipsoidID, 1));
+}
 
-    Vk::AABB sphereAABB(PrimitiveManager::getEllipsoid(ellipsoidID));
-    createBLAS(ellipsoidBLASs[ellipsoidIndex], sphereAABB);
+int removeEllipsoid(Model::EllipsoidID ellipsoidID) {
+    return removeEllipsoids(Model::Span<const Model::EllipsoidID>(&ellipsoidID, 1));
+}
 
-    // recreate instance
+int addEllipsoids(Model::Span<const Model::EllipsoidID> newEllipsoidIDs) {
+    if (newEllipsoidIDs.empty()) return 0;
 
-    ellipsoidInstances[ellipsoidIndex] = createInstance(ellipsoidBLASs[ellipsoidIndex].handle);
+    for (uint32_t i = 0; i < newEllipsoidIDs.size(); i++) {
+        if (ellipsoidLocations.contains(newEllipsoidIDs[i])) {
+            AID_WARN("Renderer::addEllipsoids() ellipsoid {} has already been added", newEllipsoidIDs[i].getID());
+            return -1;
+        }
+    }
 
-    // signal that a tlas update is required
+    std::vector<Model::EllipsoidID> sortedIDs(newEllipsoidIDs.begin(), newEllipsoidIDs.end());
+    std::sort(sortedIDs.begin(), sortedIDs.end());
+    auto duplicate = std::adjacent_find(sortedIDs.begin(), sortedIDs.end());
+    if (duplicate != sortedIDs.end()) {
+        AID_WARN("Renderer::addEllipsoids() ellipsoid {} is in the batch more than once", duplicate->getID());
+        return -1;
+    }
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        perFrame[i].updateEllipsoidTLAS = true;
-        perFrame[i].updateEllipsoidIDs.push_back(ellipsoidID);
+    std::vector<Vk::AABB> aabbs;
+    aabbs.reserve(newEllipsoidIDs.size());
+    for (Model::EllipsoidID ellipsoidID : newEllipsoidIDs)
+        aabbs.push_back(Vk::AABB(PrimitiveManager::getEllipsoid(ellipsoidID)));
+
+    if (newEllipsoidIDs.size() >= MAX_PRIMITIVES_PER_BLAS) {
+        // big batches (e.g. loading a scene) get their own spatially sorted clusters
+        uint32_t clusterCount = ClusterPlanner::clusterCountFor(newEllipsoidIDs.size(), MAX_PRIMITIVES_PER_BLAS);
+        ClusterPlanner::Plan plan = ClusterPlanner::plan(aabbs.data(), newEllipsoidIDs.size(), clusterCount);
+
+        for (const ClusterPlanner::Cluster& plannedCluster : plan.clusters) {
+            uint32_t clusterIndex = createCluster();
+            for (uint32_t i = plannedCluster.firstPrimitive; i < plannedCluster.firstPrimitive + plannedCluster.primitiveCount; i++) {
+                uint32_t primitive = plan.primitiveOrder[i];
+                insertIntoCluster(clusterIndex, newEllipsoidIDs[primitive], aabbs[primitive]);
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < newEllipsoidIDs.size(); i++)
+            insertIntoCluster(chooseCluster(aabbs[i]), newEllipsoidIDs[i], aabbs[i]);
     }
+
+    queueEllipsoidUploads(newEllipsoidIDs);
+    markSceneChanged();
     return 0;
 }
 
-int removeEllipsoid(Model::EllipsoidID ellipsoidID) {
-
-    int ellipsoidIndex = Model::containsID(ellipsoidIDs, ellipsoidID);
-    if (ellipsoidIndex == -1) {
-        AID_WARN("Renderer::removeEllipsoid() tried to remove ellpisoid {} that hasn't been added", ellipsoidID.getID());
-        return -1;
+int updateEllipsoids(Model::Span<const Model::EllipsoidID> updatedEllipsoidIDs) {
+    for (Model::EllipsoidID ellipsoidID : updatedEllipsoidIDs) {
+        if (!ellipsoidLocations.contains(ellipsoidID)) {
+            AID_WARN("Renderer::updateEllipsoids() tried to update ellpisoid {} that hasn't been added", ellipsoidID.getID());
+            return -1;
+        }
     }
 
-    cleanUpAccelerationStructure(ellipsoidBLASs[ellipsoidIndex]);
-
-    ellipsoidBLASs.erase(ellipsoidBLASs.begin() + ellipsoidIndex);
-    ellipsoidInstances.erase(ellipsoidInstances.begin() + ellipsoidIndex);
-    ellipsoidIDs.erase(ellipsoidIDs.begin() + ellipsoidIndex);
+    // diff against the last seen geometry to do as little acceleration structure work as possible:
+    // material only -> buffer patch, translation -> refit of the cluster BLAS, shape or rotation change -> rebuild of the cluster BLAS
+
+    for (Model::EllipsoidID ellipsoidID : updatedEllipsoidIDs) {
+        Model::Ellipsoid ellipsoid = PrimitiveManager::getEllipsoid(ellipsoidID);
+        _EllipsoidLocation& location = ellipsoidLocations[ellipsoidLocations.denseIndex(ellipsoidID)];
+
+        if (ellipsoid.radius != location.radius || ellipsoid.rotation != location.rotation) {
+            requestClusterUpdate(location.cluster, AS_UPDATE_REBUILD);
+            frameCounters.shapeUpdates++;
+        } else if (ellipsoid.center != location.center) {
+            requestClusterUpdate(location.cluster, AS_UPDATE_REFIT);
+            frameCounters.translateUpdates++;
+        } else {
+            frameCounters.materialUpdates++;
+        }
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        perFrame[i].updateEllipsoidTLAS = true;
-        for (int i = ellipsoidIndex; i < ellipsoidIDs.size(); i++)
-            perFrame[i].updateEllipsoidIDs.push_back(ellipsoidIDs[i]);
+        location.center = ellipsoid.center;
+        location.radius = ellipsoid.radius;
+        location.rotation = ellipsoid.rotation;
     }
+
+    queueEllipsoidUploads(updatedEllipsoidIDs);
+    markSceneChanged();
     return 0;
 }
 
-void updateModels(uint32_t frame) {
-    updateEllipsoidBuffer(frame);
-
-    if (!perFrame[frame].updateEllipsoidTLAS) return;
+int removeEllipsoids(Model::Span<const Model::EllipsoidID> removedEllipsoidIDs) {
+    int result = 0;
 
-    vkFreeMemory(device, perFrame[frame].tlas.memory, VK_ALLOCATOR);
-    vkDestroyAccelerationStructureNV(device, perFrame[frame].tlas.accelerationStructure, nullptr);
-    updateModelTLAS(frame);
+    for (Model::EllipsoidID ellipsoidID : removedEllipsoidIDs) {
+        if (!ellipsoidLocations.contains(ellipsoidID)) {
+            AID_WARN("Renderer::removeEllipsoids() tried to remove ellpisoid {} that hasn't been added", ellipsoidID.getID());
+            result = -1;
+            continue;
+        }
+        removeFromCluster(ellipsoidID);
+        markSceneChanged();
+    }
+    return result;
+}
 
-    updateModelDescriptorSet(frame);
-    perFrame[frame].rerecordRenderCommands = true;
+uint32_t createCluster() {
+    // reuse a cluster that has been emptied
+    for (uint32_t c = 0; c < clusters.size(); c++) {
+        if (clusters[c].ellipsoidIDs.empty()) return c;
+    }
 
-    perFrame[frame].updateEllipsoidTLAS = false;
+    clusters.push_back(_Cluster());
+    clusters.back().ellipsoidIDs.reserve(MAX_PRIMITIVES_PER_BLAS);
+    if (rayTracing) createClusterBLAS(clusters.back().blas);
+    return static_cast<uint32_t>(clusters.size() - 1);
 }
 
-void updateModelTLAS(uint32_t frame) {
-    Vk::AccelerationStructure& tlas = perFrame[frame].tlas;
+uint32_t chooseCluster(const Vk::AABB& aabb) {
+    // the cluster whose bounds grow the least
+    uint32_t bestCluster = UINT32_MAX;
+    float bestCost = 0.f;
 
-    Vk::BufferHostVisible instanceBuffer;
+    for (uint32_t c = 0; c < clusters.size(); c++) {
+        if (clusters[c].ellipsoidIDs.size() >= MAX_PRIMITIVES_PER_BLAS) continue;
 
-    if (ellipsoidInstances.size() != 0) {
-        instanceBuffer.create(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, sizeof(Vk::BLASInstance) * ellipsoidInstances.size(), device, physicalDevice);
-        instanceBuffer.upload(ellipsoidInstances.data(), sizeof(Vk::BLASInstance) * ellipsoidInstances.size(), 0, device);
+        Vk::AABB grown = clusters[c].bounds;
+        grown.grow(aabb);
+        float cost = grown.surfaceArea() - clusters[c].bounds.surfaceArea();
+        if (bestCluster == UINT32_MAX || cost < bestCost) {
+            bestCluster = c;
+            bestCost = cost;
+        }
     }
 
-    // create top-level acceleration structure
-    // todo: don't have to recreate! create with max_spheres
-    createTopLevelAccelerationStructure(tlas, ellipsoidInstances.size());
+    if (bestCluster == UINT32_MAX) bestCluster = createCluster();
+    return bestCluster;
+}
 
-    // acceleration structure building requires some scratch space to store temporary information
+void insertIntoCluster(uint32_t clusterIndex, Model::EllipsoidID ellipsoidID, const Vk::AABB& aabb) {
+    _Cluster& cluster = clusters[clusterIndex];
 
-    VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{};
-    memoryRequirementsInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
-    memoryRequirementsInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
+    Model::Ellipsoid ellipsoid = PrimitiveManager::getEllipsoid(ellipsoidID);
 
-    VkMemoryRequirements2 memReqTopLevelAS;
-    memoryRequirementsInfo.accelerationStructure = tlas.accelerationStructure;
-    vkGetAccelerationStructureMemoryRequirementsNV(device, &memoryRequirementsInfo, &memReqTopLevelAS);
+    _EllipsoidLocation location;
+    location.cluster = clusterIndex;
+    location.primitive = static_cast<uint32_t>(cluster.ellipsoidIDs.size());
+    location.center = ellipsoid.center;
+    location.radius = ellipsoid.radius;
+    location.rotation = ellipsoid.rotation;
+    ellipsoidLocations.insert(ellipsoidID, location);
 
-    Vk::BufferDeviceLocal scratchBuffer;
-    scratchBuffer.create(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, memReqTopLevelAS.memoryRequirements.size, device, physicalDevice);
+    cluster.ellipsoidIDs.push_back(ellipsoidID);
+    cluster.bounds.grow(aabb);
+    requestClusterUpdate(clusterIndex, AS_UPDATE_REBUILD);
+}
 
-    // build top-level acceleration structure
+void requestClusterUpdate(uint32_t clusterIndex, uint32_t update) {
+    clusters[clusterIndex].update = std::max(clusters[clusterIndex].update, update);
+}
 
-    VkAccelerationStructureInfoNV buildInfo{};
-    buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
-    buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
+void removeFromCluster(Model::EllipsoidID ellipsoidID) {
+    _EllipsoidLocation location = ellipsoidLocations[ellipsoidLocations.denseIndex(ellipsoidID)];
+    _Cluster& cluster = clusters[location.cluster];
+
+    // swap remove so the cluster's aabbs stay packed, the moved ellipsoid has to be uploaded to its new index
+    cluster.ellipsoidIDs[location.primitive] = cluster.ellipsoidIDs.back();
+    cluster.ellipsoidIDs.pop_back();
+    if (location.primitive < cluster.ellipsoidIDs.size()) {
+        Model::EllipsoidID movedID = cluster.ellipsoidIDs[location.primitive];
+        ellipsoidLocations[ellipsoidLocations.denseIndex(movedID)].primitive = location.primitive;
+        queueEllipsoidUploads(Model::Span<const Model::EllipsoidID>(&movedID, 1));
+    }
+
+    ellipsoidLocations.erase(ellipsoidID);
+    requestClusterUpdate(location.cluster, AS_UPDATE_REBUILD);
+}
+
+uint32_t getEllipsoidBufferIndex(Model::EllipsoidID ellipsoidID) {
+    uint32_t index = ellipsoidLocations.denseIndex(ellipsoidID);
+    if (index == ellipsoidLocations.INVALID_INDEX) return UINT32_MAX;
+    return ellipsoidLocations[index].cluster * MAX_PRIMITIVES_PER_BLAS + ellipsoidLocations[index].primitive;
+}
+
+void queueEllipsoidUploads(Model::Span<const Model::EllipsoidID> ellipsoidIDs) {
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        perFrame[i].updateEllipsoidIDs.insert(perFrame[i].updateEllipsoidIDs.end(), ellipsoidIDs.begin(), ellipsoidIDs.end());
+}
+
+void updateModels(uint32_t frame) {
+    // the frame's fence has been waited on, so its last tlas, upload and render submissions are done
+    readTLASTimestamps(frame);
+    readTraceTimestamps(frame);
+    stagingRing.beginFrame(frame, perFrame[frame].fenceRenderComplete);
+    if (perFrame[frame].retiredEllipsoidBuffer.buffer != VK_NULL_HANDLE) {
+        perFrame[frame].retiredEllipsoidBuffer.destroy(device);
+        perFrame[frame].retiredEllipsoidBuffer = Vk::BufferDeviceLocal();
+    }
+
+    buildDirtyClusters();
+
+    // the buffer descriptor only needs rewriting when the buffer was reallocated
+    if (reserveEllipsoidBuffer(frame, static_cast<uint32_t>(clusters.size()) * MAX_PRIMITIVES_PER_BLAS)) {
+        writeEllipsoidBufferDescriptor(frame);
+        perFrame[frame].rerecordRenderCommands = true;
+    }
+    updateEllipsoidBuffer(frame);
+    if (!rayTracing && perFrame[frame].updateEllipsoidTLAS != AS_UPDATE_NONE) uploadComputeBVH(frame);
+    submitUploadCommands(frame);
+
+    if (rayTracing && perFrame[frame].updateEllipsoidTLAS != AS_UPDATE_NONE) {
+        time_point<high_resolution_clock> timeStart = high_resolution_clock::now();
+
+        // the descriptor and render commands only need updating when the tlas handle changes
+        uint32_t instanceCount = getClusterInstanceCount();
+        if (reserveModelTLAS(frame, instanceCount)) {
+            writeTLASDescriptor(frame);
+            perFrame[frame].rerecordRenderCommands = true;
+        }
+
+        // same instances that only moved can be refit
+        bool refit = perFrame[frame].updateEllipsoidTLAS == AS_UPDATE_REFIT && instanceCount == perFrame[frame].tlasInstanceCount;
+        updateModelTLAS(frame, refit);
+
+        float milliseconds = duration<float, std::milli>(high_resolution_clock::now() - timeStart).count();
+        if (refit) {
+            frameCounters.tlasRefits++;
+            stats.tlasRefitCPUTime = milliseconds;
+        } else {
+            frameCounters.tlasRebuilds++;
+            stats.tlasRebuildCPUTime = milliseconds;
+        }
+    }
+    perFrame[frame].updateEllipsoidTLAS = AS_UPDATE_NONE;
+
+    stats.lastFrame = frameCounters;
+    frameCounters = UpdateCounters();
+}
+
+void buildDirtyClusters() {
+    std::vector<uint32_t> rebuildClusters, refitClusters;
+    uint32_t tlasUpdate = AS_UPDATE_NONE;
+
+    for (uint32_t c = 0; c < clusters.size(); c++) {
+        _Cluster& cluster = clusters[c];
+        if (cluster.update == AS_UPDATE_NONE) continue;
+
+        // the tlas can only be refit if the set of instances stays the same
+        bool hasInstance = !cluster.ellipsoidIDs.empty();
+        tlasUpdate = std::max<uint32_t>(tlasUpdate, hasInstance == cluster.hasInstance ? AS_UPDATE_REFIT : AS_UPDATE_REBUILD);
+        cluster.hasInstance = hasInstance;
+
+        if (!hasInstance) {
+            cluster.bounds = Vk::AABB::empty();
+            cluster.refitCount = 0;
+        } else if (cluster.update == AS_UPDATE_REFIT && cluster.refitCount < CLUSTER_MAX_REFITS) {
+            refitClusters.push_back(c);
+            cluster.refitCount++;
+        } else {
+            rebuildClusters.push_back(c);
+            cluster.refitCount = 0;
+        }
+        cluster.update = AS_UPDATE_NONE;
+    }
+    if (tlasUpdate == AS_UPDATE_NONE) return;
+
+    if (!rayTracing) {
+        // no BLASs, the bvh replaces them and the tlas. the frames in flight trace their own copy
+        buildComputeBVH();
+    } else if (!rebuildClusters.empty() || !refitClusters.empty()) {
+        // the BLASs are built in place, the builds wait on the gpu for the frames still tracing against them (see
+        // submitClusterBLASBuilds())
+        submitClusterBLASBuilds(rebuildClusters, refitClusters);
+
+        frameCounters.blasRebuilds += static_cast<uint32_t>(rebuildClusters.size());
+        frameCounters.blasRefits += static_cast<uint32_t>(refitClusters.size());
+    }
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        perFrame[i].updateEllipsoidTLAS = std::max(perFrame[i].updateEllipsoidTLAS, tlasUpdate);
+}
+
+void updateModelTLAS(uint32_t frame, bool refit) {
+    _PerFrame& f = perFrame[frame];
+
+    // one instance per non empty cluster, written straight into the mapped instance buffer
+
+    uint32_t instanceCount = 0;
+    for (const _Cluster& cluster : clusters) instanceCount += !cluster.ellipsoidIDs.empty();
+
+    Model::Span<Vk::BLASInstance> instances = f.tlasInstanceBuffer.write<Vk::BLASInstance>(0, instanceCount);
+    uint32_t i = 0;
+    for (uint32_t c = 0; c < clusters.size(); c++) {
+        if (!clusters[c].ellipsoidIDs.empty())
+            instances[i++] = createInstance(clusters[c].blas.handle, c * MAX_PRIMITIVES_PER_BLAS);
+    }
+    f.tlasInstanceBuffer.flush(device);
+    f.tlasInstanceCount = instanceCount;
+
+    // record the build, the render submission after it on the same queue is covered by the barrier
+
+    VkCommandBuffer commandBuffer = f.commandBufferTLAS;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "failed to begin tlas build command buffer");
+
+    vkCmdResetQueryPool(commandBuffer, f.tlasTimestampQueryPool, 0, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, f.tlasTimestampQueryPool, 0);
+
+    VkAccelerationStructureInfoNV buildInfo{};
+    buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+    buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
+    buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV;
     buildInfo.geometryCount = 0;
     buildInfo.pGeometries = nullptr;
-    buildInfo.instanceCount = ellipsoidInstances.size();
-
-    VkCommandBuffer cmdBuffer = Vk::beginSingleTimeCommands(device, commandPool);
+    buildInfo.instanceCount = instanceCount;
 
     vkCmdBuildAccelerationStructureNV(
-        cmdBuffer,
+        commandBuffer,
         &buildInfo,
-        instanceBuffer.buffer,
+        f.tlasInstanceBuffer.buffer,
         0,
-        VK_FALSE,
-        tlas.accelerationStructure,
-        VK_NULL_HANDLE,
-        scratchBuffer.buffer,
+        refit ? VK_TRUE : VK_FALSE,
+        f.tlas.accelerationStructure,
+        refit ? f.tlas.accelerationStructure : VK_NULL_HANDLE,
+        f.tlasScratchBuffer.buffer,
         0);
 
-    Vk::endSingleTimeCommands(device, cmdBuffer, queues.compute, commandPool);
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+    memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, f.tlasTimestampQueryPool, 1);
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end tlas build command buffer");
+
+    // same queue as the BLAS builds so their barrier covers this build, the frame fence covers the reuse of the buffers
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, VK_NULL_HANDLE), "failed to submit tlas build");
+
+    f.tlasTimestampsPending = refit ? AS_UPDATE_REFIT : AS_UPDATE_REBUILD;
+}
+
+bool reserveModelTLAS(uint32_t frame, uint32_t instanceCount) {
+    _PerFrame& f = perFrame[frame];
+    if (instanceCount <= f.tlasCapacity) return false;
+
+    uint32_t newCapacity = std::max<uint32_t>(f.tlasCapacity, TLAS_MIN_CAPACITY);
+    while (newCapacity < instanceCount) newCapacity *= 2;
+
+    // the frame's previous submissions are done (fence) so the old resources can go
+    if (f.tlasCapacity != 0) {
+        cleanUpAccelerationStructure(f.tlas);
+        f.tlasInstanceBuffer.destroy(device);
+        f.tlasScratchBuffer.destroy(device);
+        AID_INFO("TLAS {} grew from {} to {} instances", frame, f.tlasCapacity, newCapacity);
+    }
+
+    createTopLevelAccelerationStructure(f.tlas, newCapacity);
+
+    f.tlasInstanceBuffer.create(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, sizeof(Vk::BLASInstance) * static_cast<VkDeviceSize>(newCapacity), device, physicalDevice);
+
+    // scratch space for either a build or a refit
+
+    VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{};
+    memoryRequirementsInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
+    memoryRequirementsInfo.accelerationStructure = f.tlas.accelerationStructure;
+
+    VkMemoryRequirements2 buildRequirements{}, updateRequirements{};
+    memoryRequirementsInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
+    vkGetAccelerationStructureMemoryRequirementsNV(device, &memoryRequirementsInfo, &buildRequirements);
+    memoryRequirementsInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_UPDATE_SCRATCH_NV;
+    vkGetAccelerationStructureMemoryRequirementsNV(device, &memoryRequirementsInfo, &updateRequirements);
+
+    VkDeviceSize scratchSize = std::max(buildRequirements.memoryRequirements.size, updateRequirements.memoryRequirements.size);
+    f.tlasScratchBuffer.create(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, scratchSize, device, physicalDevice);
+
+    f.tlasCapacity = newCapacity;
+    f.tlasInstanceCount = 0;
+    return true;
+}
+
+void readTLASTimestamps(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+    if (f.tlasTimestampsPending == AS_UPDATE_NONE) return;
 
-    instanceBuffer.destroy(device);
-    scratchBuffer.destroy(device);
+    uint64_t timestamps[2] = {};
+    if (vkGetQueryPoolResults(device, f.tlasTimestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        float milliseconds = static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * physicalDeviceProperties.limits.timestampPeriod * 1e-6);
+        if (f.tlasTimestampsPending == AS_UPDATE_REFIT) stats.tlasRefitTime = milliseconds;
+        else stats.tlasRebuildTime = milliseconds;
+    }
+    f.tlasTimestampsPending = AS_UPDATE_NONE;
 }
 
-void updateEllipsoidBuffer(uint32_t frame) {
-    for (Model::EllipsoidID ellipsoidID : perFrame[frame].updateEllipsoidIDs) {
+void readTraceTimestamps(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+    if (!f.traceTimestampsPending) return;
+
+    uint64_t timestamps[2] = {};
+    if (vkGetQueryPoolResults(device, f.traceTimestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        float milliseconds = static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * physicalDeviceProperties.limits.timestampPeriod * 1e-6);
+        // sparse traces don't count, dynamic resolution and render on demand assume every pixel was traced
+        if (f.refineTimestamps) {
+            stats.refinement.sparseFrameTime = milliseconds;
+        } else {
+            stats.traceTime = milliseconds;
+            stats.traceTimeTotal += stats.traceTime;
+            stats.tracedFrames++;
+        }
+    }
+    f.traceTimestampsPending = false;
+}
 
-        int ellipsoidIndex = Model::containsID(ellipsoidIDs, ellipsoidID);
-        if (ellipsoidIndex == -1) {
-            AID_ERROR("Renderer::updateEllipsoidBuffer() attempting to update ellipsoid id {} that hasn't been added", ellipsoidID.getID());
+void buildComputeBVH() {
+    time_point<high_resolution_clock> timeStart = high_resolution_clock::now();
+
+    // the cluster bounds are recomputed on the way, like submitClusterBLASBuilds() does for the clusters it builds
+    std::vector<Vk::AABB> aabbs;
+    std::vector<uint32_t> ellipsoidIndices;
+    aabbs.reserve(ellipsoidLocations.size());
+    ellipsoidIndices.reserve(ellipsoidLocations.size());
+    for (uint32_t c = 0; c < clusters.size(); c++) {
+        _Cluster& cluster = clusters[c];
+        cluster.bounds = Vk::AABB::empty();
+        for (uint32_t p = 0; p < cluster.ellipsoidIDs.size(); p++) {
+            aabbs.push_back(Vk::AABB(PrimitiveManager::getEllipsoid(cluster.ellipsoidIDs[p])));
+            ellipsoidIndices.push_back(c * MAX_PRIMITIVES_PER_BLAS + p);
+            cluster.bounds.grow(aabbs.back());
         }
+    }
+
+    computeBVH.nodes.clear();
+    computeBVH.primitives.clear();
+    if (aabbs.empty()) {
+        Vk::AABB empty = Vk::AABB::empty();
+        computeBVH.nodes.push_back({ empty.minPoint(), 0, empty.maxPoint(), 0 });
+    } else {
+        Spatial::BinaryBVH bvh = Spatial::buildLBVH(aabbs.data(), static_cast<uint32_t>(aabbs.size()));
+        computeBVH.nodes.reserve(bvh.nodes.size());
+        for (const Spatial::BVHNode& node : bvh.nodes)
+            computeBVH.nodes.push_back({ node.bounds.minPoint(), node.first, node.bounds.maxPoint(), node.count });
+        computeBVH.primitives.reserve(bvh.primitiveOrder.size());
+        for (uint32_t primitive : bvh.primitiveOrder) computeBVH.primitives.push_back(ellipsoidIndices[primitive]);
+    }
+
+    stats.computeBVHNodeCount = static_cast<uint32_t>(computeBVH.nodes.size());
+    stats.computeBVHBuildTime = duration<float, std::milli>(high_resolution_clock::now() - timeStart).count();
+}
+
+void uploadComputeBVH(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+
+    // the descriptor and render commands only need updating when a buffer was reallocated
+    if (reserveComputeBVH(frame, static_cast<uint32_t>(computeBVH.nodes.size()), static_cast<uint32_t>(computeBVH.primitives.size()))) {
+        writeComputeBVHDescriptor(frame);
+        f.rerecordRenderCommands = true;
+    }
+
+    // the whole tree, its topology changes with every build
+    stagingRing.upload(f.bvhNodeBuffer.buffer, 0, computeBVH.nodes.data(), sizeof(_ComputeBVHNode) * computeBVH.nodes.size());
+    if (!computeBVH.primitives.empty())
+        stagingRing.upload(f.bvhPrimitiveBuffer.buffer, 0, computeBVH.primitives.data(), sizeof(uint32_t) * computeBVH.primitives.size());
+}
 
-        Model::Ellipsoid ellipsoid = PrimitiveManager::getEllipsoid(ellipsoidIDs[ellipsoidIndex]);
+bool reserveComputeBVH(uint32_t frame, uint32_t nodeCount, uint32_t primitiveCount) {
+    _PerFrame& f = perFrame[frame];
+    if (nodeCount <= f.bvhNodeCapacity && primitiveCount <= f.bvhPrimitiveCapacity) return false;
+
+    // the frame's previous submissions are done (fence) and the whole tree is uploaded, so nothing is copied over
+    if (nodeCount > f.bvhNodeCapacity) {
+        uint32_t newCapacity = std::max<uint32_t>(f.bvhNodeCapacity, COMPUTE_BVH_MIN_CAPACITY);
+        while (newCapacity < nodeCount) newCapacity *= 2;
+        f.bvhNodeBuffer.destroy(device);
+        f.bvhNodeBuffer.create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(_ComputeBVHNode) * static_cast<VkDeviceSize>(newCapacity), device, physicalDevice);
+        f.bvhNodeCapacity = newCapacity;
+    }
+    if (primitiveCount > f.bvhPrimitiveCapacity) {
+        uint32_t newCapacity = std::max<uint32_t>(f.bvhPrimitiveCapacity, COMPUTE_BVH_MIN_CAPACITY);
+        while (newCapacity < primitiveCount) newCapacity *= 2;
+        f.bvhPrimitiveBuffer.destroy(device);
+        f.bvhPrimitiveBuffer.create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * static_cast<VkDeviceSize>(newCapacity), device, physicalDevice);
+        f.bvhPrimitiveCapacity = newCapacity;
+    }
+    return true;
+}
 
-        perFrame[frame].spheresBuffer.upload(&ellipsoid, sizeof(Model::Ellipsoid), sizeof(Model::Ellipsoid) * ellipsoidIndex,
-            device, physicalDevice, queues.graphics, commandPool);
+uint32_t getClusterInstanceCount() {
+    uint32_t instanceCount = 0;
+    for (const _Cluster& cluster : clusters) {
+        if (!cluster.ellipsoidIDs.empty()) instanceCount++;
     }
+    return instanceCount;
+}
 
+void updateEllipsoidBuffer(uint32_t frame) {
+    if (perFrame[frame].updateEllipsoidIDs.empty()) return;
+
+    // sort by buffer index and remove duplicates so neighbouring ellipsoids can share a copy region
+    std::vector<std::pair<uint32_t, Model::EllipsoidID>> ellipsoidIndices;
+    ellipsoidIndices.reserve(perFrame[frame].updateEllipsoidIDs.size());
+    for (Model::EllipsoidID ellipsoidID : perFrame[frame].updateEllipsoidIDs) {
+        // may have been removed since the update was queued
+        uint32_t ellipsoidIndex = getEllipsoidBufferIndex(ellipsoidID);
+        if (ellipsoidIndex != UINT32_MAX) ellipsoidIndices.push_back({ ellipsoidIndex, ellipsoidID });
+    }
     perFrame[frame].updateEllipsoidIDs.clear();
+
+    std::sort(ellipsoidIndices.begin(), ellipsoidIndices.end());
+    ellipsoidIndices.erase(std::unique(ellipsoidIndices.begin(), ellipsoidIndices.end(),
+        [](const std::pair<uint32_t, Model::EllipsoidID>& a, const std::pair<uint32_t, Model::EllipsoidID>& b) { return a.first == b.first; }),
+        ellipsoidIndices.end());
+    if (ellipsoidIndices.empty()) return;
+
+    // written straight into the staging ring, one region per run of neighbouring ellipsoids
+
+    VkBuffer dst = perFrame[frame].spheresBuffer.buffer;
+    size_t runStart = 0;
+    for (size_t i = 1; i <= ellipsoidIndices.size(); i++) {
+        if (i < ellipsoidIndices.size() && ellipsoidIndices[i].first == ellipsoidIndices[i - 1].first + 1) continue;
+
+        uint32_t count = static_cast<uint32_t>(i - runStart);
+        Model::Span<Model::Ellipsoid> run = stagingRing.upload<Model::Ellipsoid>(dst, sizeof(Model::Ellipsoid) * ellipsoidIndices[runStart].first, count);
+        for (uint32_t e = 0; e < count; e++) run[e] = PrimitiveManager::getEllipsoid(ellipsoidIndices[runStart + e].second);
+        runStart = i;
+    }
+}
+
+bool reserveEllipsoidBuffer(uint32_t frame, uint32_t ellipsoidCount) {
+    uint32_t oldCapacity = perFrame[frame].ellipsoidCapacity;
+    if (ellipsoidCount <= oldCapacity) return false;
+
+    uint32_t newCapacity = std::max<uint32_t>(oldCapacity, ELLIPSOID_BUFFER_MIN_CAPACITY);
+    while (newCapacity < ellipsoidCount) newCapacity *= 2;
+
+    Vk::BufferDeviceLocal newBuffer;
+    newBuffer.create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        sizeof(Model::Ellipsoid) * static_cast<VkDeviceSize>(newCapacity), device, physicalDevice);
+
+    // only dirty ellipsoids get uploaded each frame so the existing contents have to come along,
+    // recorded ahead of this frame's staging copies into the new buffer
+    if (oldCapacity != 0) {
+        VkBufferCopy copyRegion{};
+        copyRegion.size = perFrame[frame].spheresBuffer.size;
+
+        VkCommandBuffer commandBuffer = beginUploadCommands(frame);
+        vkCmdCopyBuffer(commandBuffer, perFrame[frame].spheresBuffer.buffer, newBuffer.buffer, 1, &copyRegion);
+
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        perFrame[frame].retiredEllipsoidBuffer = perFrame[frame].spheresBuffer;
+        stats.ellipsoidBufferGrowths++;
+        AID_INFO("Ellipsoid buffer {} grew from {} to {} ellipsoids", frame, oldCapacity, newCapacity);
+    }
+
+    perFrame[frame].spheresBuffer = newBuffer;
+    perFrame[frame].ellipsoidCapacity = newCapacity;
+    return true;
+}
+
+void createStagingRing() {
+    stagingRing.create(STAGING_RING_SIZE, device, physicalDevice);
+
+    for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocInfo, &perFrame[f].commandBufferUpload), "failed to allocate upload command buffer");
+    }
+}
+
+VkCommandBuffer beginUploadCommands(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+    if (f.uploadCommandsRecording) return f.commandBufferUpload;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(f.commandBufferUpload, &beginInfo), "failed to begin upload command buffer");
+
+    f.uploadCommandsRecording = true;
+    return f.commandBufferUpload;
+}
+
+void submitUploadCommands(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+    if (!f.uploadCommandsRecording && !stagingRing.hasPendingCopies()) return;
+
+    VkCommandBuffer commandBuffer = beginUploadCommands(frame);
+    stagingRing.record(commandBuffer);
+
+    // read by the intersection shader (or scene.comp) of this frame's trace
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, getTraceStage(),
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end upload command buffer");
+    f.uploadCommandsRecording = false;
+
+    // the frame fence (signaled after the render submission on the same queue) guards the ring and the retired buffer
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, VK_NULL_HANDLE), "failed to submit uploads");
 }
 
 void updateModelDescriptorSet(uint32_t frame) {
+    if (rayTracing) writeTLASDescriptor(frame);
+    else writeComputeBVHDescriptor(frame);
+    writeEllipsoidBufferDescriptor(frame);
+}
+
+void writeTLASDescriptor(uint32_t frame) {
     VkDescriptorSet& descriptorSet = perFrame[frame].descriptorSetModels;
 
     // acceleration structure descriptor
@@ -1224,6 +2442,12 @@ void updateModelDescriptorSet(uint32_t frame) {
     accelerationStructureWrite.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV;
     accelerationStructureWrite.dstBinding = 0;
 
+    vkUpdateDescriptorSets(device, 1, &accelerationStructureWrite, 0, VK_NULL_HANDLE);
+}
+
+void writeEllipsoidBufferDescriptor(uint32_t frame) {
+    VkDescriptorSet& descriptorSet = perFrame[frame].descriptorSetModels;
+
     // sphere ssbo
 
     VkDescriptorBufferInfo spheresDescriptor{};
@@ -1239,97 +2463,598 @@ void updateModelDescriptorSet(uint32_t frame) {
     spheresWrite.pBufferInfo = &spheresDescriptor;
     spheresWrite.dstBinding = 1;
 
-    std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-        accelerationStructureWrite,
-        spheresWrite
-    };
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, VK_NULL_HANDLE);
+    vkUpdateDescriptorSets(device, 1, &spheresWrite, 0, VK_NULL_HANDLE);
+}
+
+void writeComputeBVHDescriptor(uint32_t frame) {
+    VkDescriptorSet& descriptorSet = perFrame[frame].descriptorSetModels;
+
+    VkDescriptorBufferInfo nodesDescriptor{};
+    nodesDescriptor.buffer = perFrame[frame].bvhNodeBuffer.buffer;
+    nodesDescriptor.offset = 0;
+    nodesDescriptor.range = perFrame[frame].bvhNodeBuffer.size;
+
+    VkDescriptorBufferInfo primitivesDescriptor{};
+    primitivesDescriptor.buffer = perFrame[frame].bvhPrimitiveBuffer.buffer;
+    primitivesDescriptor.offset = 0;
+    primitivesDescriptor.range = perFrame[frame].bvhPrimitiveBuffer.size;
+
+    VkWriteDescriptorSet writes[2] = {};
+    for (VkWriteDescriptorSet& write : writes) {
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+    writes[0].pBufferInfo = &nodesDescriptor;
+    writes[0].dstBinding = 0;
+    writes[1].pBufferInfo = &primitivesDescriptor;
+    writes[1].dstBinding = 2;
+
+    vkUpdateDescriptorSets(device, ARRAY_SIZE(writes), writes, 0, VK_NULL_HANDLE);
 }
 
 void recordCommandBufferRender(uint32_t frame) {
-    // shader binding offsets
-    VkDeviceSize bindingOffsetRayGenShader = static_cast<VkDeviceSize>(rayTracingProperties.shaderGroupHandleSize) * GROUP_RAYGEN;
-    VkDeviceSize bindingOffsetMissShader   = static_cast<VkDeviceSize>(rayTracingProperties.shaderGroupHandleSize) * GROUP_MISS_BACKGROUND;
-    VkDeviceSize bindingOffsetHitShader    = static_cast<VkDeviceSize>(rayTracingProperties.shaderGroupHandleSize) * GROUP_HIT_SCENE;
-    VkDeviceSize bindingStride = static_cast<VkDeviceSize>(rayTracingProperties.shaderGroupHandleSize);
+    recordTraceCommands(perFrame[frame].commandBufferRender, frame, false);
+    recordTraceCommands(perFrame[frame].commandBufferRefine, frame, true);
+}
 
+// sparse: one launch per refinement.stride x refinement.stride cell, then refine.comp over the whole launch extent
+void recordTraceCommands(VkCommandBuffer commandBuffer, uint32_t frame, bool sparse) {
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-    VkCommandBuffer& commandBuffer = perFrame[frame].commandBufferRender;
     VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "failed to begin command buffer");
 
-    // ray tracing dispath
+    // the previous frame's refine.comp may still read this slot's images as its history, and wrote the images this
+    // frame's refine.comp reads
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        getTraceStage() | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, getTraceStage() | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdResetQueryPool(commandBuffer, perFrame[frame].traceTimestampQueryPool, 0, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, perFrame[frame].traceTimestampQueryPool, 0);
 
     uint32_t uboDynamicOffset = frame * bufferUBO.dynamicStride;
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, pipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, pipelineLayout, 0, 1, &perFrame[frame].descriptorSetRender, 1, &uboDynamicOffset);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, pipelineLayout, 1, 1, &perFrame[frame].descriptorSetModels, 0, nullptr);
+    VkExtent2D launchExtent = getLaunchExtent(frame);
+    VkExtent2D imageExtent = launchExtent;
+    if (sparse) {
+        glm::uvec2 launchSize = SparsePattern::getLaunchSize(glm::uvec2(launchExtent.width, launchExtent.height), refinement.stride);
+        launchExtent = { launchSize.x, launchSize.y };
+    }
+
+    if (rayTracing) {
+        // shader binding offsets
+        VkDeviceSize bindingOffsetRayGenShader = static_cast<VkDeviceSize>(rayTracingProperties.shaderGroupHandleSize) * GROUP_RAYGEN;
+        VkDeviceSize bindingOffsetMissShader   = static_cast<VkDeviceSize>(rayTracingProperties.shaderGroupHandleSize) * GROUP_MISS_BACKGROUND;
+        VkDeviceSize bindingOffsetHitShader    = static_cast<VkDeviceSize>(rayTracingProperties.shaderGroupHandleSize) * GROUP_HIT_SCENE;
+        VkDeviceSize bindingStride = static_cast<VkDeviceSize>(rayTracingProperties.shaderGroupHandleSize);
+
+        // ray tracing dispath
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, pipelineLayout, 0, 1, &perFrame[frame].descriptorSetRender, 1, &uboDynamicOffset);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, pipelineLayout, 1, 1, &perFrame[frame].descriptorSetModels, 0, nullptr);
+
+        vkCmdTraceRaysNV(commandBuffer,
+            shaderBindingTable.buffer, bindingOffsetRayGenShader,
+            shaderBindingTable.buffer, bindingOffsetMissShader, bindingStride,
+            shaderBindingTable.buffer, bindingOffsetHitShader, bindingStride,
+            VK_NULL_HANDLE, 0, 0,
+            launchExtent.width, launchExtent.height, 1);
+    } else {
+        // compute dispatch, one invocation per pixel
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &perFrame[frame].descriptorSetRender, 1, &uboDynamicOffset);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &perFrame[frame].descriptorSetModels, 0, nullptr);
+
+        vkCmdDispatch(commandBuffer,
+            (launchExtent.width + COMPUTE_TRACE_GROUP_SIZE - 1) / COMPUTE_TRACE_GROUP_SIZE,
+            (launchExtent.height + COMPUTE_TRACE_GROUP_SIZE - 1) / COMPUTE_TRACE_GROUP_SIZE, 1);
+    }
 
-    vkCmdTraceRaysNV(commandBuffer,
-        shaderBindingTable.buffer, bindingOffsetRayGenShader,
-        shaderBindingTable.buffer, bindingOffsetMissShader, bindingStride,
-        shaderBindingTable.buffer, bindingOffsetHitShader, bindingStride,
-        VK_NULL_HANDLE, 0, 0,
-        swapchain.extent.width, swapchain.extent.height, 1);
+    if (sparse) {
+        // refine.comp reads the traced pixels
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            getTraceStage(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        // the history is the previous frame slot, the dynamic offset of its ubo binding is unused
+        VkDescriptorSet descriptorSets[] = { perFrame[frame].descriptorSetRender, perFrame[(frame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT].descriptorSetRender };
+        uint32_t dynamicOffsets[] = { uboDynamicOffset, uboDynamicOffset };
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, refinePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, refinePipelineLayout, 0, 2, descriptorSets, 2, dynamicOffsets);
+        vkCmdDispatch(commandBuffer,
+            (imageExtent.width + REFINE_GROUP_SIZE - 1) / REFINE_GROUP_SIZE,
+            (imageExtent.height + REFINE_GROUP_SIZE - 1) / REFINE_GROUP_SIZE, 1);
+    }
 
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, perFrame[frame].traceTimestampQueryPool, 1);
     VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end rendering command buffer");
 }
 
+// one more row and column than renderExtent when it's smaller than the image, the linear blit to the swapchain
+// reads them at the right and bottom edge. the shaders map pixels to rays by renderSize, not by the launch size
+VkExtent2D getLaunchExtent(uint32_t frame) {
+    VkExtent2D launchExtent = perFrame[frame].renderExtent;
+    launchExtent.width = std::min(launchExtent.width + 1, perFrame[frame].renderImage.extent.width);
+    launchExtent.height = std::min(launchExtent.height + 1, perFrame[frame].renderImage.extent.height);
+    return launchExtent;
+}
+
 void updateUniformBuffer(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos, uint32_t frame) {
     UniformData uniformData;
     uniformData.viewInverse = viewInverse;
     uniformData.projInverse = projInverse;
     uniformData.cameraPos = glm::vec4(cameraPos, 1.0f);
+    uniformData.renderSize = glm::vec4(perFrame[frame].renderExtent.width, perFrame[frame].renderExtent.height, 0.0f, 0.0f);
+
+    const _PerFrame& f = perFrame[frame];
+    if (f.refineMode != REFINE_NONE) {
+        const _PerFrame& history = perFrame[(frame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT];
+        uniformData.pattern = glm::vec4(refinement.stride, f.patternOffset.x, f.patternOffset.y, f.refineMode);
+        uniformData.historyView = glm::inverse(history.tracedViewInverse);
+        uniformData.historyProj = glm::inverse(history.tracedProjInverse);
+        uniformData.historyPosition = history.tracedCameraPos;
+    }
 
-    bufferUBO.upload(&uniformData, sizeof(UniformData), static_cast<VkDeviceSize>(frame) * bufferUBO.dynamicStride, device);
+    bufferUBO.write<UniformData>(static_cast<VkDeviceSize>(frame) * bufferUBO.dynamicStride, 1)[0] = uniformData;
+    bufferUBO.flush(device);
 }
 
-int32_t getRenderedObjectID(glm::uvec2 position) {
-    // copy the image texel to a host visible buffer
+void trackCameraChanges(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos) {
+    glm::vec4 position = glm::vec4(cameraPos, 1.0f);
+    if (viewInverse == lastCamera.viewInverse && projInverse == lastCamera.projInverse && position == lastCamera.cameraPos) return;
 
-    // todo needed? recordImageLayoutTransition already has an image barrier
-    vkWaitForFences(device, 1, &perFrame[lastRenderedFrame].fenceRenderComplete, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
+    lastCamera.viewInverse = viewInverse;
+    lastCamera.projInverse = projInverse;
+    lastCamera.cameraPos = position;
+    sceneVersion++;
+}
 
-    VkCommandBuffer commandBuffer = Vk::beginSingleTimeCommands(device, commandPool);
-    VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+void markSceneChanged() {
+    sceneVersion++;
+    refinement.restart = true;
+}
 
-    recordImageLayoutTransition(
-        commandBuffer,
-        perFrame[lastRenderedFrame].objectIDsImage.image,
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        subresourceRange);
+// the previous frame slot is the history: sparse when it holds a trace of this extent and scene, the rest of the
+// pixels are copied from it if it was traced from the current camera
+void chooseRefinement(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+    const _PerFrame& history = perFrame[(frame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT];
+    uint32_t phaseCount = SparsePattern::getPhaseCount(refinement.stride);
+    VkExtent2D launchExtent = getLaunchExtent(frame);
+    glm::uvec2 launchSize(launchExtent.width, launchExtent.height);
+
+    bool sparse = refinement.enabled && !refinement.restart && refinement.stride > 1 && history.historyValid &&
+        history.renderExtent.width == f.renderExtent.width && history.renderExtent.height == f.renderExtent.height &&
+        launchSize.x >= refinement.stride && launchSize.y >= refinement.stride;
+    refinement.restart = false;
+
+    stats.refinement.pixelCount = launchSize.x * launchSize.y;
+    if (!sparse) {
+        f.refineMode = REFINE_NONE;
+        f.patternOffset = glm::uvec2(0);
+        f.phasesTraced = phaseCount;
+        refinement.converging = false;
+        stats.refinement.raysTraced = stats.refinement.pixelCount;
+        stats.refinement.phasesTraced = phaseCount;
+        return;
+    }
+
+    bool cameraMoved = history.tracedViewInverse != lastCamera.viewInverse || history.tracedProjInverse != lastCamera.projInverse ||
+        history.tracedCameraPos != lastCamera.cameraPos;
+    f.refineMode = cameraMoved ? REFINE_REPROJECT : REFINE_COPY;
+    f.patternOffset = SparsePattern::getOffset(refinement.stride, refinement.phase);
+    refinement.phase = (refinement.phase + 1) % phaseCount;
+    // consecutive phases, so the last phaseCount frames from the same camera traced every pixel once
+    f.phasesTraced = cameraMoved ? 1 : std::min(history.phasesTraced + 1, phaseCount);
+
+    stats.refinement.raysTraced = SparsePattern::getTracedPixelCount(launchSize, refinement.stride, f.patternOffset);
+    stats.refinement.phasesTraced = f.phasesTraced;
+    stats.refinement.sparseFrames++;
+
+    if (cameraMoved) {
+        refinement.converging = true;
+        refinement.convergingFrames = 0;
+    } else if (refinement.converging) {
+        time_point<high_resolution_clock> now = high_resolution_clock::now();
+        if (refinement.convergingFrames++ == 0) refinement.motionStopTime = now;
+        if (f.phasesTraced == phaseCount) {
+            stats.refinement.convergenceTime = duration<float, std::milli>(now - refinement.motionStopTime).count();
+            stats.refinement.convergenceFrames = refinement.convergingFrames;
+            refinement.converging = false;
+        }
+    }
+}
+
+void updateRenderScale(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+
+    // a trace time read by updateModels() measured this slot's last trace, at its renderExtent
+    if (dynamicResolution.enabled && !headless && stats.tracedFrames != dynamicResolution.measuredFrames) {
+        dynamicResolution.measuredFrames = stats.tracedFrames;
+        float tracedFraction = static_cast<float>(f.renderExtent.width) * f.renderExtent.height / (static_cast<float>(swapchain.extent.width) * swapchain.extent.height);
+        float fullResolutionTime = stats.traceTime / tracedFraction;
+        dynamicResolution.fullResolutionTime = dynamicResolution.fullResolutionTime == 0.f ? fullResolutionTime :
+            glm::mix(dynamicResolution.fullResolutionTime, fullResolutionTime, RENDER_SCALE_SMOOTHING);
+        dynamicResolution.framesSinceChange++;
+
+        float expectedTime = dynamicResolution.fullResolutionTime * dynamicResolution.scale * dynamicResolution.scale;
+        bool overBudget = expectedTime > dynamicResolution.budget;
+        bool underBudget = expectedTime < dynamicResolution.budget * (1.f - RENDER_SCALE_HYSTERESIS) && dynamicResolution.scale < 1.f;
+        if (dynamicResolution.framesSinceChange >= RENDER_SCALE_SETTLE_FRAMES && (overBudget || underBudget)) {
+            // aim for the middle of the band, rounded down to a step so it doesn't overshoot the budget
+            float targetTime = dynamicResolution.budget * (1.f - RENDER_SCALE_HYSTERESIS / 2.f);
+            float scale = std::sqrt(targetTime / std::max(dynamicResolution.fullResolutionTime, 1e-6f));
+            scale = glm::clamp(std::floor(scale / RENDER_SCALE_STEP) * RENDER_SCALE_STEP, RENDER_SCALE_MIN, 1.f);
+            if (scale != dynamicResolution.scale) {
+                dynamicResolution.scale = scale;
+                dynamicResolution.framesSinceChange = 0;
+                stats.renderScaleChanges++;
+                markSceneChanged();
+            }
+        }
+    }
+
+    // this slot's commands aren't in flight anymore, re-record them for the new extent
+    VkExtent2D renderExtent = getRenderExtent();
+    if (renderExtent.width == f.renderExtent.width && renderExtent.height == f.renderExtent.height) return;
+    f.renderExtent = renderExtent;
+    f.rerecordRenderCommands = true;
+    if (headless) return;
+    recordCommandBufferComposite(frame);
+    for (int s = 0; s < swapchain.numImages; s++)
+        recordSwapchainCopy(perSwapchainImage[s].commandBufferImageCopy[frame], f.renderImage.image, f.renderExtent, s);
+}
+
+VkExtent2D getRenderExtent() {
+    if (headless) return swapchain.extent;
+    return {
+        std::max(1u, static_cast<uint32_t>(std::round(swapchain.extent.width * dynamicResolution.scale))),
+        std::max(1u, static_cast<uint32_t>(std::round(swapchain.extent.height * dynamicResolution.scale)))
+    };
+}
+
+Vk::IDRegion toRenderPixels(const Vk::IDRegion& region, VkExtent2D renderExtent) {
+    glm::vec2 scale = glm::vec2(renderExtent.width, renderExtent.height) / glm::vec2(swapchain.extent.width, swapchain.extent.height);
+    Vk::IDRegion scaled;
+    scaled.offset = glm::ivec2(glm::floor(glm::vec2(region.offset) * scale));
+    scaled.extent = glm::ivec2(glm::ceil(glm::vec2(region.offset + region.extent) * scale)) - scaled.offset;
+    for (glm::vec2 point : region.lasso) scaled.lasso.push_back(point * scale);
+    return scaled;
+}
+
+void setDynamicResolution(bool enabled, float traceBudget) {
+    if (!enabled && dynamicResolution.scale != 1.f) markSceneChanged();
+    dynamicResolution.enabled = enabled;
+    dynamicResolution.budget = std::max(traceBudget, 0.1f);
+    if (!enabled) dynamicResolution.scale = 1.f;
+    dynamicResolution.framesSinceChange = 0;
+}
+
+bool isDynamicResolution() {
+    return dynamicResolution.enabled;
+}
+
+float getTraceBudget() {
+    return dynamicResolution.budget;
+}
+
+void setRefinement(bool enabled, uint32_t stride) {
+    if (!SparsePattern::isValidStride(stride)) {
+        AID_WARN("Renderer::setRefinement() stride {} is not 1, 2 or 4", stride);
+        return;
+    }
+    // an unfinished refinement would stay incomplete, start over with a full trace
+    if (enabled != refinement.enabled || stride != refinement.stride) markSceneChanged();
+    if (stride != refinement.stride) {
+        // the sparse launch size changes
+        refinement.stride = stride;
+        refinement.phase = 0;
+        for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) perFrame[f].rerecordRenderCommands = true;
+    }
+    refinement.enabled = enabled;
+}
+
+bool isRefinement() {
+    return refinement.enabled;
+}
+
+uint32_t getRefinementStride() {
+    return refinement.stride;
+}
+
+void setRenderOnDemand(bool enabled) {
+    renderOnDemand = enabled;
+}
+
+bool isRenderOnDemand() {
+    return renderOnDemand;
+}
+
+Stats getStats() {
+    // picks up the timings of a finished BLAS build submission without blocking
+    if (vkGetFenceStatus(device, blasBuildQueue.fence) == VK_SUCCESS) waitForBLASBuilds();
+
+    stats.rayTracing = rayTracing;
+    stats.ellipsoidCount = ellipsoidLocations.size();
+    stats.ellipsoidBufferCapacity = perFrame[currentFrame].ellipsoidCapacity;
+
+    std::vector<ClusterPlanner::Cluster> plannerClusters;
+    for (const _Cluster& cluster : clusters) {
+        if (cluster.ellipsoidIDs.empty()) continue;
+        ClusterPlanner::Cluster plannerCluster;
+        plannerCluster.primitiveCount = static_cast<uint32_t>(cluster.ellipsoidIDs.size());
+        plannerCluster.bounds = cluster.bounds;
+        plannerClusters.push_back(plannerCluster);
+    }
+    ClusterPlanner::Stats clusterStats = ClusterPlanner::computeStats(plannerClusters.data(), static_cast<uint32_t>(plannerClusters.size()));
+    stats.blasCount = clusterStats.blasCount;
+    stats.blasSurfaceArea = clusterStats.totalSurfaceArea;
+    stats.estimatedRebuildCost = clusterStats.estimatedRebuildCost;
+    stats.staging = stagingRing.getStats();
+
+    stats.picksPending = static_cast<uint32_t>(pendingPicks.size());
+    for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) stats.picksPending += static_cast<uint32_t>(perFrame[f].picks.size());
+
+    stats.renderScale = dynamicResolution.scale;
+    stats.renderExtent = perFrame[lastRenderedFrame].renderExtent;
+    stats.fullResolutionTraceTime = dynamicResolution.fullResolutionTime;
+    stats.refinement.phaseCount = SparsePattern::getPhaseCount(refinement.stride);
+
+    float averageTraceTime = stats.tracedFrames > 0 ? stats.traceTimeTotal / stats.tracedFrames : 0.f;
+    stats.onDemand.gpuTimeSaved = averageTraceTime * stats.onDemand.framesReused;
+    return stats;
+}
+
+PickTicket requestObjectID(glm::uvec2 position) {
+    PickTicket ticket = nextPickTicket++;
+    pendingPicks.push_back({ ticket, position, high_resolution_clock::now(), frameNumber });
+    return ticket;
+}
+
+PickStatus pollObjectID(PickTicket ticket, int32_t& objectID) {
+    // frames can finish before their fence is waited on again
+    for (uint32_t f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+        if ((!perFrame[f].picks.empty() || perFrame[f].selection) && vkGetFenceStatus(device, perFrame[f].fenceRenderComplete) == VK_SUCCESS)
+            readIDReadbacks(f);
+    }
+
+    std::map<PickTicket, int32_t>::iterator result = pickResults.find(ticket);
+    if (result != pickResults.end()) {
+        objectID = result->second;
+        pickResults.erase(result);
+        return PickStatus::READY;
+    }
+
+    for (const _Pick& pick : pendingPicks) {
+        if (pick.ticket == ticket) return PickStatus::PENDING;
+    }
+    for (uint32_t f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
+        for (const _Pick& pick : perFrame[f].picks) {
+            if (pick.ticket == ticket) return PickStatus::PENDING;
+        }
+    }
+    return PickStatus::INVALID;
+}
+
+void requestSelection(const Vk::IDRegion& region) {
+    pendingSelection = region;
+    selectionRequested = true;
+}
+
+bool isSelectionPending() {
+    return selectionRequested || selectionInFlight;
+}
+
+SelectionBenchmark benchmarkSelection(const Vk::IDRegion& region) {
+    vkDeviceWaitIdle(device);
+    for (uint32_t f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) readIDReadbacks(f);
+
+    Vk::StorageImage& objectIDs = perFrame[lastRenderedFrame].objectIDsImage;
+    uint32_t width = objectIDs.extent.width, height = objectIDs.extent.height;
+    SelectionBenchmark result;
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    // gpu histogram, only the distinct ids are read back
+    auto start = high_resolution_clock::now();
+    VkCommandBuffer commandBuffer = Vk::beginSingleTimeCommands(device, commandPool);
+    vkCmdPipelineBarrier(commandBuffer,
+        getTraceStage(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    // only the traced part of the id image, region is in swapchain pixels
+    VkExtent2D renderExtent = perFrame[lastRenderedFrame].renderExtent;
+    Vk::IDRegion renderRegion = toRenderPixels(region, renderExtent);
+    selectionPass.record(commandBuffer, objectIDs.view, renderExtent, renderRegion, PrimitiveManager::getObjectIDCapacity());
+    Vk::endSingleTimeCommands(device, commandBuffer, queues.graphics, commandPool);
+    std::vector<Vk::IDCoverage> gpuCoverage = selectionPass.getResults(&result.truncated);
+    result.gpuTotalTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    result.gpuPassTime = selectionPass.getGPUTime();
+
+    // whole id image copied back and scanned on the cpu
+    start = high_resolution_clock::now();
+    Vk::BufferHostVisible readbackBuffer;
+    readbackBuffer.create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(int32_t) * static_cast<VkDeviceSize>(width) * height, device, physicalDevice, MemoryAllocator::Category::STAGING);
+
+    commandBuffer = Vk::beginSingleTimeCommands(device, commandPool);
+    vkCmdPipelineBarrier(commandBuffer,
+        getTraceStage(), VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 
     VkBufferImageCopy copyRegion{};
-    copyRegion.bufferOffset = 0;
-    copyRegion.bufferRowLength = 0;
-    copyRegion.bufferImageHeight = 0;
     copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-    copyRegion.imageOffset = { static_cast<int32_t>(position.x), static_cast<int32_t>(position.y), 0 };
-    copyRegion.imageExtent = { 1, 1, 1 };
-    vkCmdCopyImageToBuffer(commandBuffer, perFrame[lastRenderedFrame].objectIDsImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, bufferObjectIDFetch.buffer, 1, &copyRegion);
+    copyRegion.imageExtent = { width, height, 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, objectIDs.image, VK_IMAGE_LAYOUT_GENERAL, readbackBuffer.buffer, 1, &copyRegion);
+
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    Vk::endSingleTimeCommands(device, commandBuffer, queues.graphics, commandPool);
+
+    Model::Span<const int32_t> ids = readbackBuffer.read<int32_t>(0, width * height);
+    result.readbackTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+
+    start = high_resolution_clock::now();
+    std::vector<Vk::IDCoverage> cpuCoverage = Vk::scanIDHistogram(ids.data(), width, height,
+        renderRegion.clamped(glm::uvec2(renderExtent.width, renderExtent.height)), PrimitiveManager::getObjectIDCapacity());
+    result.cpuScanTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    readbackBuffer.destroy(device);
+
+    result.idCount = static_cast<uint32_t>(gpuCoverage.size());
+    result.matches = gpuCoverage.size() == cpuCoverage.size() && std::equal(gpuCoverage.begin(), gpuCoverage.end(), cpuCoverage.begin(),
+        [](const Vk::IDCoverage& a, const Vk::IDCoverage& b) { return a.objectID == b.objectID && a.pixelCount == b.pixelCount; });
+
+    AID_INFO("Selection benchmark {}x{}: gpu pass {} ms ({} ms with submit and readback), copy back {} ms + cpu scan {} ms, {} ids, {}",
+        region.extent.x, region.extent.y, result.gpuPassTime, result.gpuTotalTime, result.readbackTime, result.cpuScanTime,
+        result.idCount, result.matches ? "results match" : "RESULTS DIFFER");
+    return result;
+}
 
-    recordImageLayoutTransition(
-        commandBuffer,
-        perFrame[lastRenderedFrame].objectIDsImage.image,
-        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        VK_IMAGE_LAYOUT_GENERAL,
-        subresourceRange);
+BLASBuildTiming flushClusterBuilds() {
+    BLASBuildTiming timing;
+    if (!rayTracing) {
+        AID_WARN("Renderer::flushClusterBuilds() the compute pipeline has no BLASs");
+        return timing;
+    }
+
+    UpdateCounters before = frameCounters;
+    auto start = high_resolution_clock::now();
+    buildDirtyClusters();
+    timing.cpuTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    timing.blasCount = frameCounters.blasRebuilds + frameCounters.blasRefits - before.blasRebuilds - before.blasRefits;
+    if (timing.blasCount == 0) return timing;
+
+    waitForBLASBuilds();
+    timing.totalTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    timing.gpuTime = stats.blasBuildTime;
+    timing.aabbCount = stats.blasBuildAABBCount;
+    return timing;
+}
+
+void submitIDReadbacks(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+    f.selection = selectionRequested && !selectionInFlight;
+    if (pendingPicks.empty() && !f.selection) return;
+
+    // the rest wait for the next frame
+    size_t count = std::min<size_t>(pendingPicks.size(), MAX_PICKS_PER_FRAME);
+    f.picks.assign(pendingPicks.begin(), pendingPicks.begin() + count);
+    pendingPicks.erase(pendingPicks.begin(), pendingPicks.begin() + count);
 
-    // copy the id value from the host visible buffer
+    VkCommandBuffer commandBuffer = f.commandBufferPick;
 
-    int32_t* idPointer;
-    int32_t id;
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "failed to begin pick command buffer");
+
+    // the trace (and refine.comp) submitted before this writes the id image, which stays in the general layout for the
+    // copy and the selection pass
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        getTraceStage() | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    if (f.selection) {
+        selectionPass.record(commandBuffer, f.objectIDsImage.view, f.renderExtent, toRenderPixels(pendingSelection, f.renderExtent), PrimitiveManager::getObjectIDCapacity());
+        selectionRequested = false;
+        selectionInFlight = true;
+    }
 
-    // todo VkPhysicalDeviceLimits::minMemoryMapAlignment (see vkMapMemory in spec)
-    vkMapMemory(device, bufferObjectIDFetch.memory, 0, sizeof(int32_t), 0, (void**)&idPointer);
-    id = *idPointer;
-    vkUnmapMemory(device, bufferObjectIDFetch.memory);
+    if (count == 0) {
+        VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end pick command buffer");
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, VK_NULL_HANDLE), "failed to submit selection");
+        return;
+    }
 
-    return id;
+    std::vector<VkBufferImageCopy> copyRegions(count);
+    for (size_t p = 0; p < count; p++) {
+        // swapchain pixel -> traced pixel
+        glm::uvec2 position = glm::uvec2(glm::vec2(f.picks[p].position) * glm::vec2(f.renderExtent.width, f.renderExtent.height) / glm::vec2(swapchain.extent.width, swapchain.extent.height));
+        position = glm::min(position, glm::uvec2(f.renderExtent.width - 1, f.renderExtent.height - 1));
+
+        copyRegions[p] = {};
+        copyRegions[p].bufferOffset = sizeof(int32_t) * p;
+        copyRegions[p].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copyRegions[p].imageOffset = { static_cast<int32_t>(position.x), static_cast<int32_t>(position.y), 0 };
+        copyRegions[p].imageExtent = { 1, 1, 1 };
+    }
+    vkCmdCopyImageToBuffer(commandBuffer, f.objectIDsImage.image, VK_IMAGE_LAYOUT_GENERAL, f.pickReadbackBuffer.buffer,
+        static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end pick command buffer");
+
+    // the frame fence is signaled by a later submission on the same queue
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, VK_NULL_HANDLE), "failed to submit picks");
+}
+
+void readIDReadbacks(uint32_t frame) {
+    _PerFrame& f = perFrame[frame];
+
+    if (f.selection) {
+        bool truncated = false;
+        std::vector<Vk::IDCoverage> coverage = selectionPass.getResults(&truncated);
+
+        std::vector<Model::SelectedEllipsoid> selection;
+        selection.reserve(coverage.size());
+        for (const Vk::IDCoverage& c : coverage) {
+            Model::EllipsoidID id = PrimitiveManager::getEllipsoidID(c.objectID);
+            if (id.isValid()) selection.push_back({ id, c.pixelCount });
+        }
+        PrimitiveManager::setSelection(std::move(selection));
+
+        stats.selectionCount = static_cast<uint32_t>(PrimitiveManager::getSelection().size());
+        stats.selectionTruncated = truncated;
+        stats.selectionTime = selectionPass.getGPUTime();
+        f.selection = false;
+        selectionInFlight = false;
+    }
+
+    if (f.picks.empty()) return;
+
+    Model::Span<const int32_t> ids = f.pickReadbackBuffer.read<int32_t>(0, static_cast<uint32_t>(f.picks.size()));
+    for (uint32_t p = 0; p < ids.size(); p++) pickResults[f.picks[p].ticket] = ids[p];
+
+    const _Pick& oldest = f.picks.front();
+    stats.pickLatency = duration<float, std::milli>(high_resolution_clock::now() - oldest.requestTime).count();
+    stats.pickLatencyFrames = static_cast<uint32_t>(frameNumber - oldest.requestFrame);
+    stats.picksResolved += static_cast<uint32_t>(f.picks.size());
+    f.picks.clear();
+
+    while (pickResults.size() > MAX_PICK_RESULTS) pickResults.erase(pickResults.begin());
 }
 
 void recreateSwapChain() {
@@ -1374,24 +3099,51 @@ void cleanUp() {
 
     vkDestroyPipeline(device, pipeline, VK_ALLOCATOR);
     vkDestroyPipelineLayout(device, pipelineLayout, VK_ALLOCATOR);
+    vkDestroyPipeline(device, refinePipeline, VK_ALLOCATOR);
+    vkDestroyPipelineLayout(device, refinePipelineLayout, VK_ALLOCATOR);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayoutModels, VK_ALLOCATOR);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayoutRender, VK_ALLOCATOR);
 
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         perFrame[i].spheresBuffer.destroy(device);
-        vkDestroyAccelerationStructureNV(device, perFrame[i].tlas.accelerationStructure, nullptr);
-        vkFreeMemory(device, perFrame[i].tlas.memory, VK_ALLOCATOR);
+        cleanUpAccelerationStructure(perFrame[i].tlas);
+        perFrame[i].tlasInstanceBuffer.destroy(device);
+        perFrame[i].tlasScratchBuffer.destroy(device);
+        vkDestroyQueryPool(device, perFrame[i].tlasTimestampQueryPool, VK_ALLOCATOR);
+        vkDestroyQueryPool(device, perFrame[i].traceTimestampQueryPool, VK_ALLOCATOR);
+        perFrame[i].bvhNodeBuffer.destroy(device);
+        perFrame[i].bvhPrimitiveBuffer.destroy(device);
+        vkFreeCommandBuffers(device, commandPool, 1, &perFrame[i].commandBufferTLAS);
+        vkFreeCommandBuffers(device, commandPool, 1, &perFrame[i].commandBufferUpload);
+        vkFreeCommandBuffers(device, commandPool, 1, &perFrame[i].commandBufferPick);
+        perFrame[i].pickReadbackBuffer.destroy(device);
+        perFrame[i].retiredEllipsoidBuffer.destroy(device);
+        if (headless) {
+            vkFreeCommandBuffers(device, commandPool, 1, &perFrame[i].commandBufferReadback);
+            perFrame[i].colorReadbackBuffer.destroy(device);
+            perFrame[i].idReadbackBuffer.destroy(device);
+            perFrame[i].readbackPending = false;
+        }
     }
+    readbackFrames.clear();
+    selectionPass.destroy();
     perSwapchainImage.clear();
 
-    ellipsoidIDs.clear();
-    for (Vk::AccelerationStructure& as : ellipsoidBLASs) cleanUpAccelerationStructure(as);
-    ellipsoidBLASs.clear();
-    ellipsoidInstances.clear();
+    waitForBLASBuilds();
+    blasBuildQueue.aabbArena.destroy(device);
+    blasBuildQueue.scratchArena.destroy(device);
+    vkDestroyQueryPool(device, blasBuildQueue.timestampQueryPool, VK_ALLOCATOR);
+    vkDestroyFence(device, blasBuildQueue.fence, VK_ALLOCATOR);
+
+    for (_Cluster& cluster : clusters) cleanUpAccelerationStructure(cluster.blas);
+    clusters.clear();
+    ellipsoidLocations.clear();
+    computeBVH.nodes.clear();
+    computeBVH.primitives.clear();
 
     bufferUBO.destroy(device);
     shaderBindingTable.destroy(device);
-    bufferObjectIDFetch.destroy(device);
+    stagingRing.destroy();
     vkDestroyDescriptorPool(device, descriptorPoolModels, VK_ALLOCATOR);
 
     cleanupSwapChain();
@@ -1406,31 +3158,38 @@ void cleanUp() {
     vkDestroyCommandPool(device, commandPool, VK_ALLOCATOR);
 
     perSwapchainImage.clear();
+    MemoryAllocator::logReport();
+    MemoryAllocator::cleanUp();
     vkDestroyDevice(device, VK_ALLOCATOR);
 
     if (enableValidationLayers)
         destroyDebugUtilsMessengerEXT(instance, debugMessenger, VK_ALLOCATOR);
 
-    vkDestroySurfaceKHR(instance, surface, VK_ALLOCATOR);
+    if (!headless) vkDestroySurfaceKHR(instance, surface, VK_ALLOCATOR);
     vkDestroyInstance(instance, VK_ALLOCATOR);
 }
 
 void cleanupSwapChain() {
-    vkDestroySwapchainKHR(device, swapchain.swapchain, VK_ALLOCATOR);
+    if (!headless) vkDestroySwapchainKHR(device, swapchain.swapchain, VK_ALLOCATOR);
     for (int s = 0; s < perSwapchainImage.size(); s++) {
         vkFreeCommandBuffers(device, commandPool, MAX_FRAMES_IN_FLIGHT, perSwapchainImage[s].commandBufferImageCopy);
+        vkFreeCommandBuffers(device, commandPool, MAX_FRAMES_IN_FLIGHT, perSwapchainImage[s].commandBufferOverlayCopy);
     }
     for (int f = 0; f < MAX_FRAMES_IN_FLIGHT; f++) {
         vkFreeCommandBuffers(device, commandPool, 1, &perFrame[f].commandBufferRender);
+        vkFreeCommandBuffers(device, commandPool, 1, &perFrame[f].commandBufferRefine);
+        if (!headless) vkFreeCommandBuffers(device, commandPool, 1, &perFrame[f].commandBufferComposite);
         perFrame[f].renderImage.destroy(device);
+        perFrame[f].overlayImage.destroy(device);
         perFrame[f].objectIDsImage.destroy(device);
+        perFrame[f].depthImage.destroy(device);
     }
     vkDestroyDescriptorPool(device, descriptorPoolRender, VK_ALLOCATOR);
 }
 
 void cleanUpAccelerationStructure(Vk::AccelerationStructure& as) {
-    if (as.memory) vkFreeMemory(device, as.memory, VK_ALLOCATOR);
     if (as.accelerationStructure) Renderer::vkDestroyAccelerationStructureNV(device, as.accelerationStructure, nullptr);
+    MemoryAllocator::free(as.allocation);
 }
 
 // HELPER FUNCTIONS
@@ -1490,13 +3249,14 @@ bool isDeviceSuitable(VkPhysicalDevice device) {
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    // headless there's nothing to present to
+    bool swapChainAdequate = headless;
+    if (extensionsSupported && !headless) {
         Vk::SwapChainSupportDetails swapChainSupport = Vk::querySwapChainSupport(device, surface);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate;
+    return indices.isComplete(!headless) && extensionsSupported && swapChainAdequate;
 }
 
 bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -1508,8 +3268,8 @@ bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
 
     std::set<std::string> requiredExtensions;
 
-    for (int i = 0; i < ARRAY_SIZE(deviceExtensions); i++)
-        requiredExtensions.insert(deviceExtensions[i]);
+    for (const char* extension : getDeviceExtensions())
+        requiredExtensions.insert(extension);
 
     for (const auto& extension : availableExtensions)
         requiredExtensions.erase(extension.extensionName);
@@ -1517,6 +3277,20 @@ bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
+std::vector<const char*> getDeviceExtensions() {
+    std::vector<const char*> extensions;
+    for (const char* extension : deviceExtensions) {
+        if (headless && strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) continue;
+        if (!rayTracing && strcmp(extension, VK_NV_RAY_TRACING_EXTENSION_NAME) == 0) continue;
+        extensions.push_back(extension);
+    }
+    return extensions;
+}
+
+VkPipelineStageFlags getTraceStage() {
+    return rayTracing ? VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+}
+
 std::vector<const char*> getRequiredExtensions() {
     std::vector<const char*> extensions;
 
@@ -1709,6 +3483,7 @@ void createTopLevelAccelerationStructure(Vk::AccelerationStructure& tlas, uint32
     VkAccelerationStructureInfoNV accelerationStructureInfo{};
     accelerationStructureInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
     accelerationStructureInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
+    accelerationStructureInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV;
     accelerationStructureInfo.instanceCount = instanceCount;
     accelerationStructureInfo.geometryCount = 0;
 
@@ -1725,37 +3500,29 @@ void createTopLevelAccelerationStructure(Vk::AccelerationStructure& tlas, uint32
     VkMemoryRequirements2 memoryRequirements{};
     vkGetAccelerationStructureMemoryRequirementsNV(device, &memoryRequirementsInfo, &memoryRequirements);
 
-    VkMemoryAllocateInfo memoryAllocateInfo{};
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.allocationSize = memoryRequirements.memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = Vk::findMemoryType(physicalDevice, memoryRequirements.memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK_RESULT(vkAllocateMemory(device, &memoryAllocateInfo, VK_ALLOCATOR, &tlas.memory), "failed to allocate top level acceleration structure memory");
+    tlas.allocation = MemoryAllocator::allocate(memoryRequirements.memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryAllocator::Category::ACCELERATION_STRUCTURE);
 
     VkBindAccelerationStructureMemoryInfoNV accelerationStructureMemoryInfo{};
     accelerationStructureMemoryInfo.sType = VK_STRUCTURE_TYPE_BIND_ACCELERATION_STRUCTURE_MEMORY_INFO_NV;
     accelerationStructureMemoryInfo.accelerationStructure = tlas.accelerationStructure;
-    accelerationStructureMemoryInfo.memory = tlas.memory;
+    accelerationStructureMemoryInfo.memory = tlas.allocation.memory;
+    accelerationStructureMemoryInfo.memoryOffset = tlas.allocation.offset;
     VK_CHECK_RESULT(vkBindAccelerationStructureMemoryNV(device, 1, &accelerationStructureMemoryInfo), "failed to bind acceleration structure memory");
 
     VK_CHECK_RESULT(vkGetAccelerationStructureHandleNV(device, tlas.accelerationStructure, sizeof(uint64_t), &tlas.handle), "failed to get top level acceleration structure handle");
 }
 
-void createBLAS(Vk::AccelerationStructure& blas, Vk::AABB aabb) {
-
-    Vk::BufferHostVisible AABBBuffer;
-    AABBBuffer.create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(Vk::AABB), device, physicalDevice);
-    AABBBuffer.upload(&aabb, sizeof(Vk::AABB), 0, device);
-
+VkGeometryNV createAABBGeometry(VkBuffer aabbBuffer, uint32_t aabbCount, VkDeviceSize offset) {
     VkGeometryAABBNV geometryAabbSphere = {};
     geometryAabbSphere.sType = VK_STRUCTURE_TYPE_GEOMETRY_AABB_NV;
-    geometryAabbSphere.aabbData = AABBBuffer.buffer;
-    geometryAabbSphere.numAABBs = 1;
+    geometryAabbSphere.aabbData = aabbBuffer;
+    geometryAabbSphere.numAABBs = aabbCount;
     geometryAabbSphere.stride = sizeof(Vk::AABB);
-    geometryAabbSphere.offset = 0;
+    geometryAabbSphere.offset = offset;
 
-    VkGeometryNV geometrySphere{};
+    VkGeometryNV geometrySphere = {};
     geometrySphere.sType = VK_STRUCTURE_TYPE_GEOMETRY_NV;
-    geometrySphere.flags;// = VK_GEOMETRY_OPAQUE_BIT_NV; TODO need this for scene but not for shadows
+    geometrySphere.flags = 0; // = VK_GEOMETRY_OPAQUE_BIT_NV; TODO need this for scene but not for shadows
     geometrySphere.geometryType = VK_GEOMETRY_TYPE_AABBS_NV;
     geometrySphere.geometry.aabbs = geometryAabbSphere;
 
@@ -1763,85 +3530,221 @@ void createBLAS(Vk::AccelerationStructure& blas, Vk::AABB aabb) {
     geometrySphere.geometry.triangles.vertexCount = 0;
     geometrySphere.geometry.triangles.indexCount = 0;
 
-    // create BLAS
-    {
-        VkAccelerationStructureInfoNV accelerationStructureInfo{};
-        accelerationStructureInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
-        accelerationStructureInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
-        accelerationStructureInfo.instanceCount = 0;
-        accelerationStructureInfo.geometryCount = 1;
-        accelerationStructureInfo.pGeometries = &geometrySphere;
-
-        VkAccelerationStructureCreateInfoNV accelerationStructureCI{};
-        accelerationStructureCI.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_NV;
-        accelerationStructureCI.info = accelerationStructureInfo;
-        VK_CHECK_RESULT(vkCreateAccelerationStructureNV(device, &accelerationStructureCI, VK_ALLOCATOR, &blas.accelerationStructure), "failed to create bottom level acceleration structure");
+    return geometrySphere;
+}
 
-        VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{};
-        memoryRequirementsInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
-        memoryRequirementsInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_OBJECT_NV;
-        memoryRequirementsInfo.accelerationStructure = blas.accelerationStructure;
+void createClusterBLAS(Vk::AccelerationStructure& blas) {
+    // sized for a full cluster so it can be rebuilt in place with any ellipsoid count
+    VkGeometryNV geometry = createAABBGeometry(VK_NULL_HANDLE, MAX_PRIMITIVES_PER_BLAS, 0);
+
+    VkAccelerationStructureInfoNV accelerationStructureInfo{};
+    accelerationStructureInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+    accelerationStructureInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
+    accelerationStructureInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV;
+    accelerationStructureInfo.instanceCount = 0;
+    accelerationStructureInfo.geometryCount = 1;
+    accelerationStructureInfo.pGeometries = &geometry;
+
+    VkAccelerationStructureCreateInfoNV accelerationStructureCI{};
+    accelerationStructureCI.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_NV;
+    accelerationStructureCI.info = accelerationStructureInfo;
+    VK_CHECK_RESULT(vkCreateAccelerationStructureNV(device, &accelerationStructureCI, VK_ALLOCATOR, &blas.accelerationStructure), "failed to create bottom level acceleration structure");
+
+    VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{};
+    memoryRequirementsInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
+    memoryRequirementsInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_OBJECT_NV;
+    memoryRequirementsInfo.accelerationStructure = blas.accelerationStructure;
+
+    VkMemoryRequirements2 memoryRequirements{};
+    vkGetAccelerationStructureMemoryRequirementsNV(device, &memoryRequirementsInfo, &memoryRequirements);
 
-        VkMemoryRequirements2 memoryRequirements{};
-        vkGetAccelerationStructureMemoryRequirementsNV(device, &memoryRequirementsInfo, &memoryRequirements);
+    blas.allocation = MemoryAllocator::allocate(memoryRequirements.memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryAllocator::Category::ACCELERATION_STRUCTURE);
 
-        VkMemoryAllocateInfo memoryAllocateInfo{};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.allocationSize = memoryRequirements.memoryRequirements.size;
-        memoryAllocateInfo.memoryTypeIndex = Vk::findMemoryType(physicalDevice, memoryRequirements.memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        VK_CHECK_RESULT(vkAllocateMemory(device, &memoryAllocateInfo, VK_ALLOCATOR, &blas.memory), "failed to allocate bottom level acceleration structure memory");
+    VkBindAccelerationStructureMemoryInfoNV accelerationStructureMemoryInfo{};
+    accelerationStructureMemoryInfo.sType = VK_STRUCTURE_TYPE_BIND_ACCELERATION_STRUCTURE_MEMORY_INFO_NV;
+    accelerationStructureMemoryInfo.accelerationStructure = blas.accelerationStructure;
+    accelerationStructureMemoryInfo.memory = blas.allocation.memory;
+    accelerationStructureMemoryInfo.memoryOffset = blas.allocation.offset;
+    VK_CHECK_RESULT(vkBindAccelerationStructureMemoryNV(device, 1, &accelerationStructureMemoryInfo), "failed to bind acceleration structure memory");
 
-        VkBindAccelerationStructureMemoryInfoNV accelerationStructureMemoryInfo{};
-        accelerationStructureMemoryInfo.sType = VK_STRUCTURE_TYPE_BIND_ACCELERATION_STRUCTURE_MEMORY_INFO_NV;
-        accelerationStructureMemoryInfo.accelerationStructure = blas.accelerationStructure;
-        accelerationStructureMemoryInfo.memory = blas.memory;
-        VK_CHECK_RESULT(vkBindAccelerationStructureMemoryNV(device, 1, &accelerationStructureMemoryInfo), "failed to bind acceleration structure memory");
+    VK_CHECK_RESULT(vkGetAccelerationStructureHandleNV(device, blas.accelerationStructure, sizeof(uint64_t), &blas.handle), "failed to get bottom level acceleration structure handle");
+}
 
-        VK_CHECK_RESULT(vkGetAccelerationStructureHandleNV(device, blas.accelerationStructure, sizeof(uint64_t), &blas.handle), "failed to get bottom level acceleration structure handle");
+void createBLASBuildQueue() {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocInfo, &blasBuildQueue.commandBuffer), "failed to allocate BLAS build command buffer");
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, VK_ALLOCATOR, &blasBuildQueue.fence), "failed to create BLAS build fence");
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+    VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, VK_ALLOCATOR, &blasBuildQueue.timestampQueryPool), "failed to create BLAS build query pool");
+}
+
+void submitClusterBLASBuilds(const std::vector<uint32_t>& rebuildClusters, const std::vector<uint32_t>& refitClusters) {
+    // rebuilds first, refits after. every build gets its own input and scratch range so they need no barriers between them
+    std::vector<uint32_t> clusterIndices = rebuildClusters;
+    clusterIndices.insert(clusterIndices.end(), refitClusters.begin(), refitClusters.end());
+    uint32_t rebuildCount = static_cast<uint32_t>(rebuildClusters.size());
+
+    // the previous submission may still be reading the arenas
+    waitForBLASBuilds();
+
+    // gather the aabbs of all clusters and recompute the cluster bounds
+
+    std::vector<Vk::AABB> aabbs;
+    std::vector<VkDeviceSize> aabbOffsets(clusterIndices.size());
+
+    for (uint32_t i = 0; i < clusterIndices.size(); i++) {
+        _Cluster& cluster = clusters[clusterIndices[i]];
+        aabbOffsets[i] = sizeof(Vk::AABB) * aabbs.size();
+        cluster.bounds = Vk::AABB::empty();
+
+        for (Model::EllipsoidID ellipsoidID : cluster.ellipsoidIDs) {
+            aabbs.push_back(Vk::AABB(PrimitiveManager::getEllipsoid(ellipsoidID)));
+            cluster.bounds.grow(aabbs.back());
+        }
     }
 
-    // build the blas
-    {
+    // scratch ranges
+
+    std::vector<VkDeviceSize> scratchOffsets(clusterIndices.size());
+    VkDeviceSize scratchSize = 0;
+
+    for (uint32_t i = 0; i < clusterIndices.size(); i++) {
         VkAccelerationStructureMemoryRequirementsInfoNV memoryRequirementsInfo{};
         memoryRequirementsInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
-        memoryRequirementsInfo.type = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV;
+        memoryRequirementsInfo.type = i < rebuildCount ? VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV : VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_UPDATE_SCRATCH_NV;
+        memoryRequirementsInfo.accelerationStructure = clusters[clusterIndices[i]].blas.accelerationStructure;
 
-        VkMemoryRequirements2 blasMemoryrequirements;
-        memoryRequirementsInfo.accelerationStructure = blas.accelerationStructure;
-        vkGetAccelerationStructureMemoryRequirementsNV(device, &memoryRequirementsInfo, &blasMemoryrequirements);
+        VkMemoryRequirements2 scratchRequirements{};
+        vkGetAccelerationStructureMemoryRequirementsNV(device, &memoryRequirementsInfo, &scratchRequirements);
 
-        Vk::BufferDeviceLocal scratchBuffer;
-        scratchBuffer.create(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, blasMemoryrequirements.memoryRequirements.size, device, physicalDevice);
+        VkDeviceSize alignment = std::max<VkDeviceSize>(scratchRequirements.memoryRequirements.alignment, 1);
+        scratchOffsets[i] = alignment * ((scratchSize + alignment - 1) / alignment);
+        scratchSize = scratchOffsets[i] + scratchRequirements.memoryRequirements.size;
+    }
+
+    // grow the arenas to the next size class if needed
+
+    VkDeviceSize aabbSize = sizeof(Vk::AABB) * aabbs.size();
+    if (aabbSize > blasBuildQueue.aabbArena.size) {
+        blasBuildQueue.aabbArena.destroy(device);
+        blasBuildQueue.aabbArena.create(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, getArenaSizeClass(aabbSize), device, physicalDevice);
+    }
+    if (scratchSize > blasBuildQueue.scratchArena.size) {
+        blasBuildQueue.scratchArena.destroy(device);
+        blasBuildQueue.scratchArena.create(VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, getArenaSizeClass(scratchSize), device, physicalDevice);
+    }
+    blasBuildQueue.aabbArena.upload(aabbs.data(), aabbSize, 0, device);
 
-        VkCommandBuffer commandBufferBuild = Vk::beginSingleTimeCommands(device, commandPool);
+    // record
+
+    VkCommandBuffer commandBuffer = blasBuildQueue.commandBuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "failed to begin BLAS build command buffer");
+
+    // the frames in flight were submitted to this queue before, so this orders the in place builds after their tlas
+    // builds and traces read the old BLASs, without the cpu waiting for their fences. their tlases are refit or
+    // rebuilt before they trace again (updateEllipsoidTLAS)
+    VkMemoryBarrier inFlightBarrier{};
+    inFlightBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    inFlightBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+    inFlightBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+        0, 1, &inFlightBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdResetQueryPool(commandBuffer, blasBuildQueue.timestampQueryPool, 0, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, blasBuildQueue.timestampQueryPool, 0);
+
+    for (uint32_t i = 0; i < clusterIndices.size(); i++) {
+        bool refit = i >= rebuildCount;
+        VkGeometryNV geometry = createAABBGeometry(blasBuildQueue.aabbArena.buffer, static_cast<uint32_t>(clusters[clusterIndices[i]].ellipsoidIDs.size()), aabbOffsets[i]);
 
         VkAccelerationStructureInfoNV buildInfo{};
         buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
         buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
+        buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV;
         buildInfo.instanceCount = 0;
         buildInfo.geometryCount = 1;
-        buildInfo.pGeometries = &geometrySphere;
+        buildInfo.pGeometries = &geometry;
 
+        // a refit updates the existing bvh in place (same aabb count, only the aabbs moved)
+        VkAccelerationStructureNV blas = clusters[clusterIndices[i]].blas.accelerationStructure;
         vkCmdBuildAccelerationStructureNV(
-            commandBufferBuild,
+            commandBuffer,
             &buildInfo,
             VK_NULL_HANDLE,
             0,
-            VK_FALSE,
-            blas.accelerationStructure,
-            VK_NULL_HANDLE,
-            scratchBuffer.buffer,
-            0);
+            refit ? VK_TRUE : VK_FALSE,
+            blas,
+            refit ? blas : VK_NULL_HANDLE,
+            blasBuildQueue.scratchArena.buffer,
+            scratchOffsets[i]);
+    }
+
+    // make the BLASs visible to everything submitted to the queue after this (tlas builds and tracing)
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+    memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV,
+        0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, blasBuildQueue.timestampQueryPool, 1);
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer), "failed to end BLAS build command buffer");
+
+    // submit without waiting
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
 
-        Vk::endSingleTimeCommands(device, commandBufferBuild, queues.graphics, commandPool);
+    vkResetFences(device, 1, &blasBuildQueue.fence);
+    VK_CHECK_RESULT(vkQueueSubmit(queues.graphics, 1, &submitInfo, blasBuildQueue.fence), "failed to submit BLAS builds");
 
-        scratchBuffer.destroy(device);
+    blasBuildQueue.timestampsPending = true;
+    blasBuildQueue.aabbCount = static_cast<uint32_t>(aabbs.size());
+    AID_TRACE("Submitted {} BLAS builds and {} refits ({} aabbs, {} bytes scratch)", rebuildCount, refitClusters.size(), aabbs.size(), scratchSize);
+}
+
+void waitForBLASBuilds() {
+    vkWaitForFences(device, 1, &blasBuildQueue.fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
+    if (!blasBuildQueue.timestampsPending) return;
+
+    uint64_t timestamps[2] = {};
+    if (vkGetQueryPoolResults(device, blasBuildQueue.timestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        double milliseconds = static_cast<double>(timestamps[1] - timestamps[0]) * physicalDeviceProperties.limits.timestampPeriod * 1e-6;
+        stats.blasBuildTime = static_cast<float>(milliseconds);
+        stats.blasBuildAABBCount = blasBuildQueue.aabbCount;
     }
+    blasBuildQueue.timestampsPending = false;
+}
 
-    AABBBuffer.destroy(device);
+VkDeviceSize getArenaSizeClass(VkDeviceSize size) {
+    VkDeviceSize sizeClass = BLAS_ARENA_MIN_SIZE;
+    while (sizeClass < size) sizeClass *= 2;
+    return sizeClass;
 }
 
-Vk::BLASInstance createInstance(uint64_t blasHandle) {
+Vk::BLASInstance createInstance(uint64_t blasHandle, uint32_t customIndex) {
 
     glm::mat3x4 transform = {
         1.0f, 0.0f, 0.0f, 0.0f,
@@ -1852,7 +3755,7 @@ Vk::BLASInstance createInstance(uint64_t blasHandle) {
 
     Vk::BLASInstance instance{};
     instance.transform = transform;
-    instance.instanceId = 0;
+    instance.instanceId = customIndex; // gl_InstanceCustomIndexNV, 24 bits
     instance.mask = 0xff;
     instance.instanceOffset = 0;
     instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_CULL_DISABLE_BIT_NV;
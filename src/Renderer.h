@@ -1,26 +1,203 @@
 #pragma once
 
 #include "Model.h"
+#include "tools/IDHistogram.h"
+#include "tools/StagingRing.h"
 #include "tools/VkHelper.h"
 #include "vulkan/vulkan.h"
 #include <vector>
 
-// also defined in sphere.rint
-#define SPHERE_COUNT_PER_TLAS 8
-
 namespace Renderer {
 
+    // how ellipsoid edits were handled during the last frame
+    struct UpdateCounters {
+        uint32_t materialUpdates = 0;   // only color changed, buffer patch
+        uint32_t translateUpdates = 0;  // only center changed, cluster BLAS refit
+        uint32_t shapeUpdates = 0;      // radius changed, cluster BLAS rebuild
+        uint32_t blasRefits = 0;
+        uint32_t blasRebuilds = 0;
+        uint32_t tlasRefits = 0;
+        uint32_t tlasRebuilds = 0;
+    };
+
+    // offscreen frame loop without a window (see initHeadless())
+    struct HeadlessStats {
+        uint64_t framesSubmitted = 0;
+        uint64_t framesRead = 0;                // copied out of the readback buffers
+        uint32_t framesDropped = 0;             // read back but not polled before MAX_READBACK_FRAMES newer ones
+        float fenceWaitTime = 0.f;              // cpu milliseconds the last drawFrameHeadless() waited for a frame slot
+        float fenceWaitTotal = 0.f;             // summed over all frames
+        float copyTime = 0.f;                   // cpu milliseconds to copy the last frame out of the readback buffers
+        float readbackLatency = 0.f;            // milliseconds from submitting the last read frame to copying it out
+    };
+
+    // frames that dispatched rays vs frames that presented the cached trace (see setRenderOnDemand())
+    struct OnDemandStats {
+        uint64_t framesTraced = 0;
+        uint64_t framesReused = 0;
+        float cpuTimeTraced = 0.f;              // cpu milliseconds of drawFrame() between acquire and present, summed
+        float cpuTimeReused = 0.f;
+        float gpuTimeSaved = 0.f;               // milliseconds, reused frames times the average trace time
+    };
+
+    // progressive refinement (see setRefinement()), rays are primary rays, one per traced pixel
+    struct RefinementStats {
+        uint32_t raysTraced = 0;                // by the last frame, 0 if it reused its render image
+        uint32_t pixelCount = 0;                // of its launch, raysTraced / pixelCount is the traced fraction
+        uint32_t phasesTraced = 0;              // pattern phases traced since the camera stopped, complete at phaseCount
+        uint32_t phaseCount = 1;                // stride * stride
+        uint64_t sparseFrames = 0;              // frames that traced the sparse pattern
+        float sparseFrameTime = 0.f;            // gpu milliseconds of the last sparse trace and refine pass
+        float convergenceTime = 0.f;            // cpu milliseconds from the first frame after the camera stopped to the first complete one
+        uint32_t convergenceFrames = 0;         // frames in between
+    };
+
+    // counters reported by the renderer (see getStats())
+    struct Stats {
+        uint32_t ellipsoidCount = 0;
+        uint32_t ellipsoidBufferCapacity = 0;   // ellipsoids that fit in the per frame ellipsoid buffers
+        uint32_t ellipsoidBufferGrowths = 0;    // number of times a per frame ellipsoid buffer was reallocated
+        uint32_t blasCount = 0;                 // non empty ellipsoid clusters, one blas each
+        float blasSurfaceArea = 0.f;            // sum of the cluster bounds surface areas
+        float estimatedRebuildCost = 0.f;       // expected aabbs rebuilt per random ellipsoid edit
+        float blasBuildTime = 0.f;              // gpu milliseconds of the last BLAS build submission
+        uint32_t blasBuildAABBCount = 0;        // aabbs built or refit in that submission
+        float tlasRebuildTime = 0.f;            // gpu milliseconds of the last tlas rebuild
+        float tlasRefitTime = 0.f;              // gpu milliseconds of the last tlas refit
+        float tlasRebuildCPUTime = 0.f;         // cpu milliseconds to write the instances and record/submit the last rebuild
+        float tlasRefitCPUTime = 0.f;
+        VkDeviceSize uniformBytesWritten = 0;        // host writes through mapped buffers during the last frame
+        VkDeviceSize tlasInstanceBytesWritten = 0;
+        VkDeviceSize blasAABBBytesWritten = 0;
+        Vk::StagingRing::Stats staging;
+        uint32_t picksPending = 0;              // requested or in flight
+        uint32_t picksResolved = 0;             // total
+        float pickLatency = 0.f;                // milliseconds from request to result, oldest pick of the last resolved batch
+        uint32_t pickLatencyFrames = 0;         // frames submitted in between
+        uint32_t selectionCount = 0;            // ellipsoids in the last resolved selection
+        bool selectionTruncated = false;        // it hit more distinct ids than the pass reads back
+        float selectionTime = 0.f;              // gpu milliseconds of its histogram pass
+        UpdateCounters lastFrame;
+        HeadlessStats headless;
+        OnDemandStats onDemand;
+        RefinementStats refinement;
+        float renderScale = 1.f;                // traced fraction of the window width and height (see setDynamicResolution())
+        VkExtent2D renderExtent = { 0, 0 };     // traced pixels of the last frame
+        float fullResolutionTraceTime = 0.f;    // smoothed gpu milliseconds the trace would take at scale 1
+        uint32_t renderScaleChanges = 0;
+        bool rayTracing = true;                 // false: scene.comp traces a bvh built on the cpu (see forceComputeTracing())
+        float traceTime = 0.f;                  // gpu milliseconds of the last finished frame's trace or compute dispatch
+        float traceTimeTotal = 0.f;             // summed over tracedFrames
+        uint64_t tracedFrames = 0;              // frames whose trace time was read
+        uint32_t computeBVHNodeCount = 0;       // compute tracing only
+        float computeBVHBuildTime = 0.f;        // cpu milliseconds of its last build
+    };
+
+    // object id picking, 0 is never a valid ticket
+    using PickTicket = uint64_t;
+
+    enum struct PickStatus {
+        PENDING,    // waiting for the frame that reads it back
+        READY,
+        INVALID     // unknown, already polled or dropped because it wasn't polled in time
+    };
+
+    // gpu histogram pass vs copying the whole id image back and scanning it on the cpu (see benchmarkSelection())
+    struct SelectionBenchmark {
+        float gpuPassTime = 0.f;    // milliseconds between the pass timestamps
+        float gpuTotalTime = 0.f;   // cpu milliseconds including record, submit, wait and reading the results
+        float readbackTime = 0.f;   // cpu milliseconds to copy the id image into host memory and wait for it
+        float cpuScanTime = 0.f;
+        uint32_t idCount = 0;
+        bool truncated = false;
+        bool matches = false;       // both found the same ids and pixel counts
+    };
+
+    // cluster BLAS builds submitted and waited for by flushClusterBuilds()
+    struct BLASBuildTiming {
+        uint32_t blasCount = 0;     // rebuilt or refit
+        uint32_t aabbCount = 0;
+        float cpuTime = 0.f;        // milliseconds to gather the aabbs, record and submit
+        float gpuTime = 0.f;        // milliseconds between the build timestamps
+        float totalTime = 0.f;      // cpu milliseconds until the build fence signaled
+    };
+
+    // a headless frame, copied out of host memory once its fence signaled
+    struct ReadbackFrame {
+        uint64_t frameNumber = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> colors;        // r, g, b, a per pixel, rows top to bottom
+        std::vector<int32_t> objectIDs;     // -1 where nothing was hit
+    };
+
     // public functions declarations
 
+    // before init(): trace with the compute pipeline even if the device supports VK_NV_ray_tracing. devices without
+    // it always use the compute pipeline
+    void forceComputeTracing(bool force);
+    bool isRayTracing(); // false once init() chose the compute pipeline
+
     void init(std::vector<const char*>& requiredExtensions, glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos);
     void drawFrame(bool framebufferResized, glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos, bool renderImGui = false);
     void cleanUp();
 
+    // on by default: drawFrame() skips the trace when camera and scene didn't change since this frame slot last
+    // traced, and presents its render image again. imgui is composited onto a copy of it, so the overlay can change
+    // without a trace. headless frames are always traced
+    void setRenderOnDemand(bool enabled);
+    bool isRenderOnDemand();
+
+    // off by default, windowed only: while the camera moves a frame traces one pixel per stride x stride cell (stride 2
+    // or 4, a quarter or a sixteenth of the pixels) and fills in the others by reprojecting the previous frame or
+    // interpolating between the traced pixels. once it stops, the following stride * stride frames trace the remaining
+    // pixels and render on demand takes over. stride 1 traces every pixel. scene edits restart with a full trace
+    void setRefinement(bool enabled, uint32_t stride);
+    bool isRefinement();
+    uint32_t getRefinementStride();
+
+    // on by default, windowed only: the trace resolution is scaled between a quarter and all of the window size to
+    // keep the gpu time of the trace within traceBudget milliseconds, and blitted to the window. picks and selections
+    // stay in window pixels
+    void setDynamicResolution(bool enabled, float traceBudget);
+    bool isDynamicResolution();
+    float getTraceBudget();
+
+    // instead of init(): no window, surface, swapchain or present queue. frames are traced into offscreen images of
+    // width x height and copied into host memory, without imgui
+    void initHeadless(uint32_t width, uint32_t height, glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos);
+    bool isHeadless();
+    // drawFrame() of the headless mode. the copy to host memory is part of the frame's submission, so this only
+    // waits when MAX_FRAMES_IN_FLIGHT frames are still running
+    void drawFrameHeadless(glm::mat4 viewInverse, glm::mat4 projInverse, glm::vec3 cameraPos);
+    // the oldest frame that finished, in submission order, without blocking. false if none has finished yet
+    bool pollReadback(ReadbackFrame& frame);
+    // blocks until every submitted frame finished, pollReadback() returns them afterwards
+    void finishReadbacks();
+
     int addEllipsoid(Model::EllipsoidID ellipsoidID); // returns 0 for success
     int updateEllipsoid(Model::EllipsoidID ellipsoidID);
     int removeEllipsoid(Model::EllipsoidID ellipsoidID);
 
-    int32_t getRenderedObjectID(glm::uvec2 position);
+    // batch versions: one aabb upload and one build submission for all the BLASs in the batch
+    int addEllipsoids(Model::Span<const Model::EllipsoidID> ellipsoidIDs); // returns 0 for success
+    int updateEllipsoids(Model::Span<const Model::EllipsoidID> ellipsoidIDs);
+    int removeEllipsoids(Model::Span<const Model::EllipsoidID> ellipsoidIDs);
+
+    // the pixel is copied out by the next traced frame, its result is ready once that frame's fence signals
+    PickTicket requestObjectID(glm::uvec2 position);
+    PickStatus pollObjectID(PickTicket ticket, int32_t& objectID); // sets objectID when READY
+
+    // counts the covered pixels per ellipsoid in the region of the next traced frame, the result replaces the
+    // PrimitiveManager selection once that frame's fence signals
+    void requestSelection(const Vk::IDRegion& region);
+    bool isSelectionPending();
+    // blocks until the device is idle, runs on the last rendered frame
+    SelectionBenchmark benchmarkSelection(const Vk::IDRegion& region);
+    // builds the BLASs of the clusters edited since the last frame now instead of in the next frame and waits for
+    // them, ray tracing only. for build throughput benchmarks
+    BLASBuildTiming flushClusterBuilds();
+    Stats getStats();
 
     VkDevice getDevice();
     VkPhysicalDevice getPhysicalDevice();
@@ -29,5 +206,6 @@ namespace Renderer {
     VkCommandPool getCommandPool();
     uint32_t getNumSwapchainImages();
     Vk::StorageImage getRenderImage(uint32_t frame);
+    Vk::StorageImage getOverlayImage(uint32_t frame); // imgui's target, windowed only
 };
 
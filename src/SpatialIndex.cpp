@@ -0,0 +1,319 @@
+#include "SpatialIndex.h"
+
+#include "tools/BVHBuilder.h"
+#include "tools/JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+using namespace std::chrono;
+
+// queries per thread below which a batch isn't split further
+#define BATCH_MIN_QUERIES_PER_THREAD 256
+// rebuild instead of refitting once this many primitives were removed, relative to the tree size
+#define REBUILD_REMOVED_FRACTION 0.25f
+// or once refitting made the tree this much more expensive to traverse than right after the build
+#define REBUILD_COST_FACTOR 1.5f
+// padding of the ellipsoid bounds before they were made tight, on each side relative to the extent
+#define PADDED_BOUNDS_FACTOR 1.1f
+
+namespace SpatialIndex {
+
+    // private variables
+
+    struct _Shape {
+        glm::vec3 center;
+        glm::vec3 radius;
+        glm::vec4 rotation;
+    };
+
+    Spatial::BVH bvh;
+    Spatial::BuildMethod buildMethod = Spatial::BuildMethod::SAH;
+    std::vector<_Shape> shapes; // by object id (ellipsoid slot index)
+    bool needsBuild = false;
+    float builtCost = 0.f;
+    Stats stats;
+
+    // private function declarations
+
+    void prepare();
+    void gatherEllipsoids(std::vector<uint32_t>& keys, std::vector<Vk::AABB>& aabbs);
+    void build();
+    void storeShape(Model::EllipsoidID id);
+    template <class Function>
+    void parallelFor(uint32_t count, Function&& function);
+
+    // function implimentations
+
+    void addEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        for (Model::EllipsoidID id : ids) storeShape(id);
+        needsBuild = true;
+    }
+
+    void updateEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        for (Model::EllipsoidID id : ids) {
+            storeShape(id);
+            if (!needsBuild) bvh.update(id.getIndex(), Vk::AABB(PrimitiveManager::getEllipsoid(id)));
+        }
+        // building from scratch is about as fast as refitting and keeps the tree tight
+        if (buildMethod == Spatial::BuildMethod::LBVH && !ids.empty()) needsBuild = true;
+    }
+
+    void removeEllipsoids(Model::Span<const Model::EllipsoidID> ids) {
+        if (needsBuild) return;
+        for (Model::EllipsoidID id : ids) bvh.remove(id.getIndex());
+    }
+
+    void storeShape(Model::EllipsoidID id) {
+        Model::Ellipsoid ellipsoid = PrimitiveManager::getEllipsoid(id);
+        if (id.getIndex() >= shapes.size()) shapes.resize(static_cast<size_t>(id.getIndex()) + 1);
+        shapes[id.getIndex()] = { glm::vec3(ellipsoid.center), glm::vec3(ellipsoid.radius), ellipsoid.rotation };
+    }
+
+    void gatherEllipsoids(std::vector<uint32_t>& keys, std::vector<Vk::AABB>& aabbs) {
+        const std::vector<Model::EllipsoidID>& ids = PrimitiveManager::getEllipsoidIDs();
+        keys.resize(ids.size());
+        aabbs.resize(ids.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            keys[i] = ids[i].getIndex();
+            aabbs[i] = Vk::AABB(PrimitiveManager::getEllipsoid(ids[i]));
+        }
+    }
+
+    void build() {
+        auto start = high_resolution_clock::now();
+
+        std::vector<uint32_t> keys;
+        std::vector<Vk::AABB> aabbs;
+        gatherEllipsoids(keys, aabbs);
+        bvh.build(keys.data(), aabbs.data(), static_cast<uint32_t>(keys.size()), buildMethod);
+
+        builtCost = bvh.sahCost();
+        needsBuild = false;
+        stats.builds++;
+        stats.buildTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    }
+
+    // brings the tree up to date before queries
+    void prepare() {
+        uint32_t treeSize = bvh.getPrimitiveCount() + bvh.getRemovedCount();
+        if (needsBuild || bvh.getRemovedCount() > REBUILD_REMOVED_FRACTION * treeSize) {
+            build();
+            return;
+        }
+        if (!bvh.needsRefit()) return;
+
+        auto start = high_resolution_clock::now();
+        bvh.refit();
+        stats.refits++;
+        stats.refitTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+
+        if (bvh.sahCost() > REBUILD_COST_FACTOR * builtCost) build();
+    }
+
+    // runs function(begin, end) over ranges of [0, count) as job system jobs, on the calling thread for small counts
+    template <class Function>
+    void parallelFor(uint32_t count, Function&& function) {
+        uint32_t threadCount = std::min(JobSystem::getThreadCount(), std::max(1u, count / BATCH_MIN_QUERIES_PER_THREAD));
+        stats.batchSize = count;
+        stats.batchThreads = threadCount;
+
+        // a few ranges per thread so the ones that finish early steal from the others
+        uint32_t grainSize = threadCount == 1 ? count : std::max<uint32_t>(BATCH_MIN_QUERIES_PER_THREAD, count / (4 * threadCount));
+        JobSystem::parallelFor(0, count, grainSize, function);
+    }
+
+    PickResult pickPrepared(Spatial::Ray ray) {
+        PickResult result;
+        uint32_t hitKey = Spatial::BVH::INVALID_INDEX;
+
+        bvh.intersect(ray, [&hitKey](uint32_t key, Spatial::Ray& ray) {
+            float t;
+            if (!Spatial::intersectRayEllipsoid(ray, shapes[key].center, shapes[key].radius, shapes[key].rotation, t)) return false;
+            ray.tMax = t;
+            hitKey = key;
+            return true;
+        });
+
+        if (hitKey != Spatial::BVH::INVALID_INDEX) {
+            result.id = PrimitiveManager::getEllipsoidID(static_cast<int32_t>(hitKey));
+            result.distance = ray.tMax;
+        }
+        return result;
+    }
+
+    std::vector<Model::EllipsoidID> overlappingPrepared(const Vk::AABB& box) {
+        std::vector<Model::EllipsoidID> result;
+        bvh.overlap(box, [&result](uint32_t key) { result.push_back(PrimitiveManager::getEllipsoidID(static_cast<int32_t>(key))); });
+        return result;
+    }
+
+    std::vector<Model::EllipsoidID> nearestPrepared(glm::vec3 point, uint32_t k) {
+        std::vector<std::pair<float, uint32_t>> closest;
+        bvh.nearest(point, k, [point](uint32_t key) {
+            glm::vec3 d = shapes[key].center - point;
+            return glm::dot(d, d);
+        }, closest);
+
+        std::vector<Model::EllipsoidID> result(closest.size());
+        for (size_t i = 0; i < closest.size(); i++) result[i] = PrimitiveManager::getEllipsoidID(static_cast<int32_t>(closest[i].second));
+        return result;
+    }
+
+    PickResult pick(Spatial::Ray ray) {
+        prepare();
+        auto start = high_resolution_clock::now();
+        PickResult result = pickPrepared(ray);
+        stats.pickTime = duration<float, std::micro>(high_resolution_clock::now() - start).count();
+        return result;
+    }
+
+    std::vector<Model::EllipsoidID> overlapping(const Vk::AABB& box) {
+        prepare();
+        return overlappingPrepared(box);
+    }
+
+    std::vector<Model::EllipsoidID> nearest(glm::vec3 point, uint32_t k) {
+        prepare();
+        return nearestPrepared(point, k);
+    }
+
+    void pick(Model::Span<const Spatial::Ray> rays, Model::Span<PickResult> results) {
+        prepare();
+        auto start = high_resolution_clock::now();
+        parallelFor(rays.size(), [&rays, &results](uint32_t begin, uint32_t end) {
+            for (uint32_t r = begin; r < end; r++) results[r] = pickPrepared(rays[r]);
+        });
+        stats.batchTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    }
+
+    void overlapping(Model::Span<const Vk::AABB> boxes, std::vector<std::vector<Model::EllipsoidID>>& results) {
+        prepare();
+        auto start = high_resolution_clock::now();
+        results.resize(boxes.size());
+        parallelFor(boxes.size(), [&boxes, &results](uint32_t begin, uint32_t end) {
+            for (uint32_t b = begin; b < end; b++) results[b] = overlappingPrepared(boxes[b]);
+        });
+        stats.batchTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    }
+
+    void nearest(Model::Span<const glm::vec3> points, uint32_t k, std::vector<std::vector<Model::EllipsoidID>>& results) {
+        prepare();
+        auto start = high_resolution_clock::now();
+        results.resize(points.size());
+        parallelFor(points.size(), [&points, &results, k](uint32_t begin, uint32_t end) {
+            for (uint32_t p = begin; p < end; p++) results[p] = nearestPrepared(points[p], k);
+        });
+        stats.batchTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+    }
+
+    void setBuildMethod(Spatial::BuildMethod method) {
+        if (method == buildMethod) return;
+        buildMethod = method;
+        needsBuild = true;
+    }
+
+    Spatial::BuildMethod getBuildMethod() {
+        return buildMethod;
+    }
+
+    BuilderComparison compareBuilders() {
+        BuilderComparison comparison;
+        std::vector<uint32_t> keys;
+        std::vector<Vk::AABB> aabbs;
+        gatherEllipsoids(keys, aabbs);
+        comparison.ellipsoidCount = static_cast<uint32_t>(aabbs.size());
+
+        auto start = high_resolution_clock::now();
+        Spatial::BinaryBVH tree = Spatial::buildBinnedSAH(aabbs.data(), comparison.ellipsoidCount);
+        comparison.sahBuildTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+        comparison.sahCost = Spatial::sahCost(tree.nodes);
+
+        start = high_resolution_clock::now();
+        tree = Spatial::buildLBVH(aabbs.data(), comparison.ellipsoidCount);
+        comparison.lbvhBuildTime = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+        comparison.lbvhCost = Spatial::sahCost(tree.nodes);
+        return comparison;
+    }
+
+    BoundsStats measureBounds(Model::Span<const Spatial::Ray> rays) {
+        BoundsStats result;
+        result.rayCount = rays.size();
+
+        std::vector<uint32_t> keys;
+        std::vector<Vk::AABB> tight;
+        gatherEllipsoids(keys, tight);
+        std::vector<Vk::AABB> padded(tight.size());
+        double ellipsoidVolume = 0.0, tightVolume = 0.0, paddedVolume = 0.0;
+        for (size_t i = 0; i < tight.size(); i++) {
+            glm::vec3 halfExtent = tight[i].extent() * 0.5f;
+            padded[i] = Vk::AABB(tight[i].center() - halfExtent * (1.f + PADDED_BOUNDS_FACTOR), tight[i].center() + halfExtent * (1.f + PADDED_BOUNDS_FACTOR));
+
+            glm::vec3 radius = shapes[keys[i]].radius;
+            glm::vec3 tightExtent = tight[i].extent(), paddedExtent = padded[i].extent();
+            ellipsoidVolume += 4.0 / 3.0 * 3.14159265358979 * radius.x * radius.y * radius.z;
+            tightVolume += static_cast<double>(tightExtent.x) * tightExtent.y * tightExtent.z;
+            paddedVolume += static_cast<double>(paddedExtent.x) * paddedExtent.y * paddedExtent.z;
+        }
+        if (ellipsoidVolume > 0.0) {
+            result.tightVolumeRatio = static_cast<float>(tightVolume / ellipsoidVolume);
+            result.paddedVolumeRatio = static_cast<float>(paddedVolume / ellipsoidVolume);
+        }
+
+        // boxes by key, the trees only hand out keys
+        uint32_t keyCount = 0;
+        for (uint32_t key : keys) keyCount = std::max(keyCount, key + 1);
+        std::vector<Vk::AABB> tightByKey(keyCount, Vk::AABB::empty()), paddedByKey(keyCount, Vk::AABB::empty());
+        for (size_t i = 0; i < keys.size(); i++) {
+            tightByKey[keys[i]] = tight[i];
+            paddedByKey[keys[i]] = padded[i];
+        }
+
+        Spatial::BVH tightTree, paddedTree;
+        tightTree.build(keys.data(), tight.data(), static_cast<uint32_t>(keys.size()), buildMethod);
+        paddedTree.build(keys.data(), padded.data(), static_cast<uint32_t>(keys.size()), buildMethod);
+
+        std::atomic<uint64_t> counters[5] = {}; // hit rays, padded box, padded true, tight box, tight true
+        parallelFor(rays.size(), [&](uint32_t begin, uint32_t end) {
+            uint64_t local[5] = {};
+            // returns whether the ray hit anything
+            auto trace = [&local](const Spatial::BVH& tree, const std::vector<Vk::AABB>& boxes, Spatial::Ray ray, int counter) {
+                glm::vec3 inverseDirection = glm::vec3(1.f) / ray.direction;
+                bool hit = false;
+                tree.intersect(ray, [&](uint32_t key, Spatial::Ray& ray) {
+                    float t;
+                    if (!Spatial::intersectRayAABB(ray.origin, inverseDirection, ray.tMax, boxes[key], t)) return false;
+                    local[counter]++;
+                    if (!Spatial::intersectRayEllipsoid(ray, shapes[key].center, shapes[key].radius, shapes[key].rotation, t)) return false;
+                    local[counter + 1]++;
+                    ray.tMax = t;
+                    hit = true;
+                    return true;
+                });
+                return hit;
+            };
+            for (uint32_t r = begin; r < end; r++) {
+                trace(paddedTree, paddedByKey, rays[r], 1);
+                if (trace(tightTree, tightByKey, rays[r], 3)) local[0]++;
+            }
+            for (int c = 0; c < 5; c++) counters[c] += local[c];
+        });
+
+        result.hitRayCount = static_cast<uint32_t>(counters[0]);
+        result.paddedBoxHits = counters[1];
+        result.paddedTrueHits = counters[2];
+        result.tightBoxHits = counters[3];
+        result.tightTrueHits = counters[4];
+        return result;
+    }
+
+    Stats getStats() {
+        Stats s = stats;
+        s.ellipsoidCount = bvh.getPrimitiveCount();
+        s.nodeCount = bvh.getNodeCount();
+        s.depth = bvh.getDepth();
+        s.sahCost = bvh.sahCost();
+        return s;
+    }
+};
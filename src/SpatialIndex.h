@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Model.h"
+#include "tools/AABB.h"
+#include "tools/BVH.h"
+#include "tools/Intersection.h"
+
+#include <glm.hpp>
+#include <vector>
+
+/*
+    CPU bounding volume hierarchy over the ellipsoids, kept in sync with PrimitiveManager. Answers picks and spatial
+    queries without waiting for the gpu. Additions rebuild the tree lazily on the next query, edits and deletions are
+    refit. With the LBVH build method edits rebuild too, for scenes where everything moves every frame. Queries must come from the thread that edits the scene; the batch versions split their work across threads
+    themselves.
+*/
+namespace SpatialIndex {
+
+    struct PickResult {
+        Model::EllipsoidID id;      // invalid if nothing was hit
+        float distance = 0.f;       // along the ray, in multiples of its direction
+    };
+
+    struct Stats {
+        uint32_t ellipsoidCount = 0;
+        uint32_t nodeCount = 0;
+        uint32_t depth = 0;
+        float sahCost = 0.f;
+        uint32_t builds = 0;
+        uint32_t refits = 0;
+        float buildTime = 0.f;          // milliseconds of the last build
+        float refitTime = 0.f;          // milliseconds of the last refit
+        float pickTime = 0.f;           // microseconds of the last single pick
+        uint32_t batchSize = 0;         // queries in the last batch
+        uint32_t batchThreads = 0;
+        float batchTime = 0.f;          // milliseconds of the last batch
+    };
+
+    // closest hit traversal with the current tight bounds and with the old ones (the ellipsoid's extent plus 1.1 times
+    // it on every side). a box hit is what runs the intersection shader on the gpu, a true hit is one that reports
+    struct BoundsStats {
+        uint32_t rayCount = 0;
+        uint32_t hitRayCount = 0;
+        uint64_t paddedBoxHits = 0;
+        uint64_t paddedTrueHits = 0;
+        uint64_t tightBoxHits = 0;
+        uint64_t tightTrueHits = 0;
+        float paddedVolumeRatio = 0.f;  // summed box volume / summed ellipsoid volume
+        float tightVolumeRatio = 0.f;
+    };
+
+    // both builders over the current ellipsoids
+    struct BuilderComparison {
+        uint32_t ellipsoidCount = 0;
+        float sahBuildTime = 0.f;       // milliseconds
+        float sahCost = 0.f;
+        float lbvhBuildTime = 0.f;
+        float lbvhCost = 0.f;
+    };
+
+    // called by PrimitiveManager
+    void addEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+    void updateEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+    void removeEllipsoids(Model::Span<const Model::EllipsoidID> ids);
+
+    PickResult pick(Spatial::Ray ray);
+    // ellipsoids whose bounds overlap the box
+    std::vector<Model::EllipsoidID> overlapping(const Vk::AABB& box);
+    // k ellipsoids with the closest centers, closest first
+    std::vector<Model::EllipsoidID> nearest(glm::vec3 point, uint32_t k);
+
+    // batch versions, results[i] belongs to query i
+    void pick(Model::Span<const Spatial::Ray> rays, Model::Span<PickResult> results);
+    void overlapping(Model::Span<const Vk::AABB> boxes, std::vector<std::vector<Model::EllipsoidID>>& results);
+    void nearest(Model::Span<const glm::vec3> points, uint32_t k, std::vector<std::vector<Model::EllipsoidID>>& results);
+
+    void setBuildMethod(Spatial::BuildMethod method);
+    Spatial::BuildMethod getBuildMethod();
+    BuilderComparison compareBuilders();
+    BoundsStats measureBounds(Model::Span<const Spatial::Ray> rays);
+
+    Stats getStats();
+};
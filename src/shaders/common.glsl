@@ -2,11 +2,18 @@ precision highp float;
 
 // global config
 
-#define ELLIPSOID_COUNT_PER_TLAS 8
 #define MAX_MARCHING_STEPS 100
 #define EPSILON 0.0001
 #define MAX_DISTANCE 100.0
 
+// Ellipsoid.intersection, matches Model::IntersectionMethod
+#define INTERSECTION_ANALYTIC 0
+#define INTERSECTION_SPHERE_TRACE 1
+
+// CameraProperties.pattern.w, how refine.comp fills the pixels the sparse trace skipped. matches REFINE_* in Renderer.cpp
+#define REFINE_REPROJECT 1	// camera moved: reproject the history image, interpolate where that fails
+#define REFINE_COPY 2		// same camera: keep the history pixels
+
 #define AMBIENT 0.2
 #define T_MIN_SHADOW 0.0001
 
@@ -21,6 +28,7 @@ struct HitPayload {
 struct RayPayload {
     vec4 color;
 	int objectID;
+	float distance;	// along the normalized ray direction, -1 for misses
 };
 
 struct ShadowPayload {
@@ -29,7 +37,84 @@ struct ShadowPayload {
 
 struct Ellipsoid {
 	vec4 center;
-	vec4 radius;
+	vec4 radius;	// along the local axes
+	vec4 rotation;	// unit quaternion (x, y, z, w), local to world
 	vec4 color;
 	int objectID;
-};
\ No newline at end of file
+	int intersection;	// INTERSECTION_*
+};
+
+// functions
+
+vec3 rotate_quat(vec4 q, vec3 v)
+{
+	vec3 t = 2.0 * cross(q.xyz, v);
+	return v + q.w * t + cross(q.xyz, t);
+}
+
+vec3 inverse_rotate_quat(vec4 q, vec3 v)
+{
+	return rotate_quat(vec4(-q.xyz, q.w), v);
+}
+
+// ellipsoid intersection in its local frame, shared by the intersection shader and the compute pipeline
+
+float sdf_ellipsoid(vec3 point, vec3 center, vec3 radius)
+{
+	point -= center;
+	float k0 = length(point / radius);
+    float k1 = length(point / (radius*radius));
+    return k0*(k0-1.0)/k1;
+}
+
+vec3 calc_normal(vec3 point, vec3 center, vec3 radius)
+{
+    vec2 e = vec2(0.0005,0.0);
+    return normalize(vec3( 
+        sdf_ellipsoid(point + e.xyy, center, radius) - sdf_ellipsoid(point - e.xyy, center, radius),
+		sdf_ellipsoid(point + e.yxy, center, radius) - sdf_ellipsoid(point - e.yxy, center, radius),
+		sdf_ellipsoid(point + e.yyx, center, radius) - sdf_ellipsoid(point - e.yyx, center, radius)));
+}
+
+// closed form: the quadratic of the ray against the unit sphere after scaling by 1 / radius
+bool intersect_analytic(vec3 ray_o, vec3 ray_d, vec3 radius, float t_min, float t_max, out float t, out vec3 normal)
+{
+	vec3 o = ray_o / radius;
+	vec3 d = ray_d / radius;
+	float a = dot(d, d);
+	float b = dot(o, d);
+	float c = dot(o, o) - 1.0;
+	float discriminant = b * b - a * c;
+	if (discriminant < 0.0) return false;
+
+	float s = sqrt(discriminant);
+	float t_near = (-b - s) / a;
+	t = t_near >= t_min ? t_near : (-b + s) / a;
+	if (t < t_min || t > t_max) return false;
+
+	// gradient of dot(p / radius, p / radius)
+	normal = normalize((ray_o + ray_d * t) / (radius * radius));
+	return true;
+}
+
+bool intersect_sphere_traced(vec3 ray_o, vec3 ray_d, vec3 radius, out float t, out vec3 normal)
+{
+	vec3 center = vec3(0.0);
+	float depth = 0.0;
+	for (int i = 0; i < MAX_MARCHING_STEPS; i++) {
+		vec3 point = ray_o + ray_d * depth;
+		float dist = sdf_ellipsoid(point, center, radius);
+
+		depth += dist;
+		if (dist < EPSILON) {
+			t = depth;
+			normal = calc_normal(point, center, radius);
+			return true;
+		}
+
+		if (dist >= MAX_DISTANCE) {
+			break;
+		}
+	}
+	return false;
+}
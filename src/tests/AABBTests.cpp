@@ -0,0 +1,55 @@
+#include "tests/Tests.h"
+
+#include "tools/AABB.h"
+#include "tools/Intersection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace Tests {
+
+    // function implimentations
+
+    void aabb() {
+        std::mt19937 rng(16);
+        std::uniform_real_distribution<float> position(-50.f, 50.f);
+        std::uniform_real_distribution<float> radius(0.05f, 5.f);
+        std::normal_distribution<float> axis(0.f, 1.f);
+
+        // points on the surface of random rotated ellipsoids with very different radii lie in the box, and the
+        // furthest of them reach every face of it. 1% of the half extent is a cap of 0.5% of the sampled directions
+        uint32_t outside = 0, loose = 0;
+        for (uint32_t e = 0; e < 200; e++) {
+            glm::vec4 q = glm::vec4(axis(rng), axis(rng), axis(rng), axis(rng));
+            glm::vec3 center = glm::vec3(position(rng), position(rng), position(rng));
+            glm::vec3 radii = glm::vec3(radius(rng), radius(rng), radius(rng));
+            Model::Ellipsoid ellipsoid(center, radii, glm::vec4(1.f), Model::EllipsoidID(), q / std::sqrt(glm::dot(q, q)));
+            Vk::AABB box(ellipsoid);
+            glm::vec3 boxMin = box.minPoint(), boxMax = box.maxPoint();
+            glm::vec3 halfExtent = (boxMax - boxMin) * 0.5f;
+            float scale = std::max({ std::abs(center.x), std::abs(center.y), std::abs(center.z), radii.x, radii.y, radii.z });
+            float tolerance = 1e-5f * scale;
+
+            glm::vec3 lowest = center, highest = center;
+            for (uint32_t s = 0; s < 4000; s++) {
+                glm::vec3 direction = glm::normalize(glm::vec3(axis(rng), axis(rng), axis(rng)));
+                glm::vec3 point = center + Spatial::rotate(ellipsoid.rotation, radii * direction);
+                lowest = glm::min(lowest, point);
+                highest = glm::max(highest, point);
+            }
+            for (uint32_t a = 0; a < 3; a++) {
+                outside += lowest[a] < boxMin[a] - tolerance || highest[a] > boxMax[a] + tolerance;
+                loose += lowest[a] - boxMin[a] > 0.01f * halfExtent[a] || boxMax[a] - highest[a] > 0.01f * halfExtent[a];
+            }
+        }
+        CHECK_EQUAL(outside, 0u);
+        CHECK_EQUAL(loose, 0u);
+
+        // unrotated, the box is the radii plus the margin
+        Vk::AABB axisAligned(Model::Ellipsoid(glm::vec3(1.f, 2.f, 3.f), glm::vec3(4.f, 0.5f, 2.f), glm::vec4(1.f), Model::EllipsoidID()));
+        CHECK_NEAR(axisAligned.aabb_minx, -3.f, 1e-3f);
+        CHECK_NEAR(axisAligned.aabb_maxy, 2.5f, 1e-3f);
+        CHECK_NEAR(axisAligned.aabb_maxz, 5.f, 1e-3f);
+    }
+};
@@ -0,0 +1,150 @@
+#include "tests/Tests.h"
+
+#include "tools/AABB.h"
+#include "tools/BVHBuilder.h"
+#include "tools/Intersection.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace Tests {
+
+    // private function declarations
+
+    void checkTree(const Spatial::BinaryBVH& tree, const std::vector<Vk::AABB>& aabbs, uint32_t maxLeafSize);
+    bool contains(const Vk::AABB& outer, const Vk::AABB& inner);
+    template <uint32_t N>
+    void checkClosestHits(const Spatial::WideBVH<N>& tree, const std::vector<Vk::AABB>& aabbs, std::mt19937& rng);
+
+    // function implimentations
+
+    void bvhBuilder() {
+        std::mt19937 rng(14);
+        std::uniform_real_distribution<float> position(-50.f, 50.f);
+        std::uniform_real_distribution<float> size(0.2f, 3.f);
+
+        std::vector<Vk::AABB> aabbs(5000);
+        for (Vk::AABB& aabb : aabbs) {
+            glm::vec3 center = glm::vec3(position(rng), position(rng), position(rng));
+            glm::vec3 halfSize = glm::vec3(size(rng), size(rng), size(rng));
+            aabb = Vk::AABB(center - halfSize, center + halfSize);
+        }
+        uint32_t count = static_cast<uint32_t>(aabbs.size());
+
+        Spatial::BuildSettings settings;
+        Spatial::BinaryBVH sah = Spatial::buildBinnedSAH(aabbs.data(), count, settings);
+        checkTree(sah, aabbs, settings.maxLeafSize);
+        Spatial::BinaryBVH lbvh = Spatial::buildLBVH(aabbs.data(), count, settings);
+        checkTree(lbvh, aabbs, settings.maxLeafSize);
+
+        // the point of the sah builder
+        float sahCost = Spatial::sahCost(sah.nodes);
+        float lbvhCost = Spatial::sahCost(lbvh.nodes);
+        CHECK(sahCost > 0.f);
+        CHECK(sahCost <= lbvhCost);
+
+        // other settings and a single thread build the same kind of tree
+        settings.threadCount = 1;
+        settings.binCount = BVH_BUILDER_MAX_BINS;
+        settings.maxLeafSize = 1;
+        checkTree(Spatial::buildBinnedSAH(aabbs.data(), count, settings), aabbs, settings.maxLeafSize);
+        settings.mortonBits = 63;
+        checkTree(Spatial::buildLBVH(aabbs.data(), count, settings), aabbs, settings.maxLeafSize);
+
+        // closest hits of the collapsed layouts against brute force
+        checkClosestHits(Spatial::collapse<4>(sah), aabbs, rng);
+        checkClosestHits(Spatial::collapse<8>(sah), aabbs, rng);
+        checkClosestHits(Spatial::collapse<4>(lbvh), aabbs, rng);
+        checkClosestHits(Spatial::collapse<8>(lbvh), aabbs, rng);
+
+        // identical boxes can't be split by position, neither builder may recurse past the depth limit
+        std::vector<Vk::AABB> same(1000, Vk::AABB(glm::vec3(0.f), glm::vec3(1.f)));
+        Spatial::BinaryBVH sameSAH = Spatial::buildBinnedSAH(same.data(), 1000);
+        Spatial::BinaryBVH sameLBVH = Spatial::buildLBVH(same.data(), 1000);
+        checkTree(sameSAH, same, 1000);
+        checkTree(sameLBVH, same, 1000);
+        CHECK(sameSAH.depth <= BVH_MAX_DEPTH);
+        CHECK(sameLBVH.depth <= BVH_MAX_DEPTH);
+
+        // a single primitive is a root leaf
+        Spatial::BinaryBVH single = Spatial::buildBinnedSAH(aabbs.data(), 1);
+        CHECK_EQUAL(single.nodes.size(), 1u);
+        CHECK(single.nodes[0].isLeaf());
+        checkClosestHits(Spatial::collapse<4>(Spatial::buildLBVH(aabbs.data(), 1)), std::vector<Vk::AABB>(1, aabbs[0]), rng);
+    }
+
+    void checkTree(const Spatial::BinaryBVH& tree, const std::vector<Vk::AABB>& aabbs, uint32_t maxLeafSize) {
+        uint32_t count = static_cast<uint32_t>(aabbs.size());
+        CHECK(!tree.nodes.empty());
+        if (tree.nodes.empty()) return;
+        CHECK(tree.depth <= BVH_MAX_DEPTH);
+
+        // every primitive exactly once
+        std::vector<uint32_t> order = tree.primitiveOrder;
+        std::sort(order.begin(), order.end());
+        bool permutation = order.size() == count;
+        for (uint32_t i = 0; permutation && i < count; i++) permutation = order[i] == i;
+        CHECK(permutation);
+
+        // every node bounds its children and primitives, and every primitive is in exactly one leaf
+        uint32_t primitivesInLeaves = 0, badLinks = 0, badBounds = 0, largeLeaves = 0;
+        for (uint32_t n = 0; n < tree.nodes.size(); n++) {
+            const Spatial::BVHNode& node = tree.nodes[n];
+            if (node.isLeaf()) {
+                primitivesInLeaves += node.count;
+                largeLeaves += node.count > maxLeafSize;
+                if (node.first + node.count > tree.primitiveOrder.size()) {
+                    badLinks++;
+                    continue;
+                }
+                for (uint32_t p = node.first; p < node.first + node.count; p++) badBounds += !contains(node.bounds, aabbs[tree.primitiveOrder[p]]);
+                continue;
+            }
+            if (node.first + 1 >= tree.nodes.size()) {
+                badLinks++;
+                continue;
+            }
+            for (uint32_t c = node.first; c < node.first + 2; c++) {
+                badLinks += tree.nodes[c].parent != n;
+                badBounds += !contains(node.bounds, tree.nodes[c].bounds);
+            }
+        }
+        CHECK_EQUAL(primitivesInLeaves, count);
+        CHECK_EQUAL(badLinks, 0u);
+        CHECK_EQUAL(badBounds, 0u);
+        CHECK_EQUAL(largeLeaves, 0u);
+    }
+
+    bool contains(const Vk::AABB& outer, const Vk::AABB& inner) {
+        return outer.aabb_minx <= inner.aabb_minx && outer.aabb_miny <= inner.aabb_miny && outer.aabb_minz <= inner.aabb_minz &&
+            outer.aabb_maxx >= inner.aabb_maxx && outer.aabb_maxy >= inner.aabb_maxy && outer.aabb_maxz >= inner.aabb_maxz;
+    }
+
+    template <uint32_t N>
+    void checkClosestHits(const Spatial::WideBVH<N>& tree, const std::vector<Vk::AABB>& aabbs, std::mt19937& rng) {
+        std::uniform_real_distribution<float> position(-60.f, 60.f);
+
+        for (uint32_t r = 0; r < 300; r++) {
+            glm::vec3 origin = glm::vec3(position(rng), position(rng), position(rng));
+            glm::vec3 target = glm::vec3(position(rng), position(rng), position(rng)) * 0.5f;
+            Spatial::Ray ray(origin, target - origin);
+            glm::vec3 inverseDirection = glm::vec3(1.f) / ray.direction;
+
+            // boxes overlapping the origin all hit at 0, so the distances are compared, not the primitives
+            tree.intersect(ray, [&](uint32_t primitive, Spatial::Ray& ray) {
+                float t;
+                if (!Spatial::intersectRayAABB(ray.origin, inverseDirection, ray.tMax, aabbs[primitive], t) || t >= ray.tMax) return false;
+                ray.tMax = t;
+                return true;
+            });
+
+            float closest = std::numeric_limits<float>::infinity();
+            for (const Vk::AABB& aabb : aabbs) {
+                float t;
+                if (Spatial::intersectRayAABB(origin, inverseDirection, closest, aabb, t) && t < closest) closest = t;
+            }
+            CHECK_EQUAL(ray.tMax, closest);
+        }
+    }
+};
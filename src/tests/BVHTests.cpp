@@ -0,0 +1,189 @@
+#include "tests/Tests.h"
+
+#include "tools/AABB.h"
+#include "tools/BVH.h"
+#include "tools/Intersection.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+// SpatialIndex answers its queries with these exact BVH calls, but needs PrimitiveManager and with it the renderer,
+// so the tree is checked directly against brute force over the same kind of ellipsoids
+namespace Tests {
+
+    // private variables
+
+    struct _Ellipsoid {
+        glm::vec3 center;
+        glm::vec3 radius;
+        glm::vec4 rotation;
+    };
+
+    // private function declarations
+
+    _Ellipsoid randomEllipsoid(std::mt19937& rng);
+    Vk::AABB boundsOf(const _Ellipsoid& ellipsoid);
+    void checkQueries(const Spatial::BVH& bvh, const std::vector<_Ellipsoid>& ellipsoids, const std::vector<bool>& live, std::mt19937& rng);
+
+    // function implimentations
+
+    void bvh() {
+        std::mt19937 rng(13);
+        const uint32_t count = 2000;
+        std::vector<_Ellipsoid> ellipsoids(count);
+        for (_Ellipsoid& ellipsoid : ellipsoids) ellipsoid = randomEllipsoid(rng);
+
+        for (Spatial::BuildMethod method : { Spatial::BuildMethod::SAH, Spatial::BuildMethod::LBVH }) {
+            std::vector<_Ellipsoid> scene = ellipsoids;
+            std::vector<uint32_t> keys(count);
+            std::vector<Vk::AABB> aabbs(count);
+            for (uint32_t i = 0; i < count; i++) {
+                keys[i] = i;
+                aabbs[i] = boundsOf(scene[i]);
+            }
+
+            Spatial::BVH bvh;
+            bvh.build(keys.data(), aabbs.data(), count, method);
+            CHECK_EQUAL(bvh.getPrimitiveCount(), count);
+            CHECK(bvh.getDepth() <= BVH_MAX_DEPTH);
+            std::vector<bool> live(count, true);
+            checkQueries(bvh, scene, live, rng);
+
+            // move every 7th and remove every 11th, queries see both after the refit
+            uint32_t removed = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                if (i % 11 == 0) {
+                    bvh.remove(i);
+                    live[i] = false;
+                    removed++;
+                } else if (i % 7 == 0) {
+                    scene[i] = randomEllipsoid(rng);
+                    bvh.update(i, boundsOf(scene[i]));
+                }
+            }
+            CHECK(bvh.needsRefit());
+            bvh.refit();
+            CHECK(!bvh.needsRefit());
+            CHECK_EQUAL(bvh.getPrimitiveCount(), count - removed);
+            CHECK_EQUAL(bvh.getRemovedCount(), removed);
+            CHECK(!bvh.contains(0));
+            CHECK(bvh.contains(1));
+            checkQueries(bvh, scene, live, rng);
+        }
+
+        // nothing to hit in an empty tree
+        Spatial::BVH empty;
+        Spatial::Ray ray(glm::vec3(0.f), glm::vec3(0.f, 0.f, 1.f));
+        bool visited = false;
+        empty.intersect(ray, [&visited](uint32_t, Spatial::Ray&) { visited = true; return true; });
+        empty.overlap(Vk::AABB(glm::vec3(-1.f), glm::vec3(1.f)), [&visited](uint32_t) { visited = true; });
+        CHECK(!visited);
+    }
+
+    _Ellipsoid randomEllipsoid(std::mt19937& rng) {
+        std::uniform_real_distribution<float> position(-50.f, 50.f);
+        std::uniform_real_distribution<float> radius(0.5f, 2.f);
+        std::normal_distribution<float> axis(0.f, 1.f);
+
+        _Ellipsoid ellipsoid;
+        ellipsoid.center = glm::vec3(position(rng), position(rng), position(rng));
+        ellipsoid.radius = glm::vec3(radius(rng), radius(rng), radius(rng));
+        glm::vec4 q = glm::vec4(axis(rng), axis(rng), axis(rng), axis(rng));
+        ellipsoid.rotation = q / std::sqrt(glm::dot(q, q));
+        return ellipsoid;
+    }
+
+    Vk::AABB boundsOf(const _Ellipsoid& ellipsoid) {
+        // the bounding sphere's box, loose but never too small for a rotated ellipsoid
+        float r = std::max(ellipsoid.radius.x, std::max(ellipsoid.radius.y, ellipsoid.radius.z));
+        return Vk::AABB(ellipsoid.center - glm::vec3(r), ellipsoid.center + glm::vec3(r));
+    }
+
+    void checkQueries(const Spatial::BVH& bvh, const std::vector<_Ellipsoid>& ellipsoids, const std::vector<bool>& live, std::mt19937& rng) {
+        std::uniform_real_distribution<float> position(-60.f, 60.f);
+        uint32_t count = static_cast<uint32_t>(ellipsoids.size());
+
+        // closest and any hit of rays from all around through the scene
+        uint32_t hits = 0;
+        for (uint32_t r = 0; r < 300; r++) {
+            glm::vec3 origin = glm::vec3(position(rng), position(rng), position(rng));
+            glm::vec3 target = glm::vec3(position(rng), position(rng), position(rng)) * 0.5f;
+            Spatial::Ray ray(origin, target - origin);
+
+            uint32_t hitKey = Spatial::BVH::INVALID_INDEX;
+            bvh.intersect(ray, [&](uint32_t key, Spatial::Ray& ray) {
+                float t;
+                const _Ellipsoid& e = ellipsoids[key];
+                if (!Spatial::intersectRayEllipsoid(ray, e.center, e.radius, e.rotation, t)) return false;
+                ray.tMax = t;
+                hitKey = key;
+                return true;
+            });
+            bool anyHit = bvh.intersectAny(Spatial::Ray(origin, target - origin), [&](uint32_t key, const Spatial::Ray& ray) {
+                float t;
+                const _Ellipsoid& e = ellipsoids[key];
+                return Spatial::intersectRayEllipsoid(ray, e.center, e.radius, e.rotation, t);
+            });
+
+            uint32_t bruteKey = Spatial::BVH::INVALID_INDEX;
+            Spatial::Ray bruteRay(origin, target - origin);
+            for (uint32_t i = 0; i < count; i++) {
+                float t;
+                if (!live[i] || !Spatial::intersectRayEllipsoid(bruteRay, ellipsoids[i].center, ellipsoids[i].radius, ellipsoids[i].rotation, t)) continue;
+                bruteRay.tMax = t;
+                bruteKey = i;
+            }
+
+            CHECK_EQUAL(hitKey, bruteKey);
+            CHECK_EQUAL(anyHit, bruteKey != Spatial::BVH::INVALID_INDEX);
+            if (bruteKey != Spatial::BVH::INVALID_INDEX) CHECK_NEAR(ray.tMax, bruteRay.tMax, 1e-5f * bruteRay.tMax);
+            hits += bruteKey != Spatial::BVH::INVALID_INDEX;
+        }
+        // the scene is dense enough that misses alone can't pass
+        CHECK(hits > 30);
+
+        // overlapping boxes
+        std::uniform_real_distribution<float> extent(0.5f, 15.f);
+        for (uint32_t b = 0; b < 100; b++) {
+            glm::vec3 center = glm::vec3(position(rng), position(rng), position(rng));
+            glm::vec3 halfSize = glm::vec3(extent(rng), extent(rng), extent(rng));
+            Vk::AABB box(center - halfSize, center + halfSize);
+
+            std::vector<uint32_t> result;
+            bvh.overlap(box, [&result](uint32_t key) { result.push_back(key); });
+            std::sort(result.begin(), result.end());
+
+            std::vector<uint32_t> brute;
+            for (uint32_t i = 0; i < count; i++) {
+                if (live[i] && boundsOf(ellipsoids[i]).overlaps(box)) brute.push_back(i);
+            }
+            CHECK_EQUAL(result.size(), brute.size());
+            CHECK(result == brute);
+        }
+
+        // k nearest centers
+        for (uint32_t p = 0; p < 50; p++) {
+            glm::vec3 point = glm::vec3(position(rng), position(rng), position(rng));
+            uint32_t k = 1 + p % 16;
+
+            std::vector<std::pair<float, uint32_t>> result;
+            bvh.nearest(point, k, [&](uint32_t key) {
+                glm::vec3 d = ellipsoids[key].center - point;
+                return glm::dot(d, d);
+            }, result);
+
+            std::vector<std::pair<float, uint32_t>> brute;
+            for (uint32_t i = 0; i < count; i++) {
+                glm::vec3 d = ellipsoids[i].center - point;
+                if (live[i]) brute.push_back({ glm::dot(d, d), i });
+            }
+            std::sort(brute.begin(), brute.end());
+            brute.resize(std::min<size_t>(k, brute.size()));
+
+            CHECK_EQUAL(result.size(), brute.size());
+            CHECK(result == brute);
+        }
+    }
+};
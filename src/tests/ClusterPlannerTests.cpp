@@ -0,0 +1,128 @@
+#include "tests/Tests.h"
+
+#include "tools/ClusterPlanner.h"
+#include "tools/Morton.h"
+#include "tools/config.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace Tests {
+
+    // private function declarations
+
+    void checkPlan(const std::vector<Vk::AABB>& aabbs, const ClusterPlanner::Plan& plan, uint32_t clusterCount);
+
+    // function implimentations
+
+    void clusterPlanner() {
+        // cluster counts for the 256 primitive limit
+        CHECK_EQUAL(ClusterPlanner::clusterCountFor(0, MAX_PRIMITIVES_PER_BLAS), 0u);
+        CHECK_EQUAL(ClusterPlanner::clusterCountFor(1, MAX_PRIMITIVES_PER_BLAS), 1u);
+        CHECK_EQUAL(ClusterPlanner::clusterCountFor(256, 256), 1u);
+        CHECK_EQUAL(ClusterPlanner::clusterCountFor(257, 256), 2u);
+        CHECK_EQUAL(ClusterPlanner::clusterCountFor(10000, 256), 40u);
+        CHECK_EQUAL(ClusterPlanner::clusterCountFor(7, 0), 7u);
+
+        // the corners of a cube given in reverse, morton order interleaves x, y, z with x the highest bit
+        std::vector<Vk::AABB> corners;
+        for (int c = 7; c >= 0; c--) {
+            glm::vec3 corner = glm::vec3(static_cast<float>(c >> 2 & 1), static_cast<float>(c >> 1 & 1), static_cast<float>(c & 1));
+            corners.push_back(Vk::AABB(corner - glm::vec3(0.1f), corner + glm::vec3(0.1f)));
+        }
+        ClusterPlanner::Plan cornerPlan = ClusterPlanner::plan(corners.data(), 8, 2);
+        for (uint32_t i = 0; i < 8; i++) CHECK_EQUAL(cornerPlan.primitiveOrder[i], 7 - i);
+        checkPlan(corners, cornerPlan, 2);
+        // the x = 0 and x = 1 faces
+        CHECK_NEAR(cornerPlan.clusters[0].bounds.aabb_maxx, 0.1f, 1e-6f);
+        CHECK_NEAR(cornerPlan.clusters[1].bounds.aabb_minx, 0.9f, 1e-6f);
+
+        // equal centers keep their index order
+        std::vector<Vk::AABB> same(5, Vk::AABB(glm::vec3(0.f), glm::vec3(1.f)));
+        ClusterPlanner::Plan samePlan = ClusterPlanner::plan(same.data(), 5, 1);
+        for (uint32_t i = 0; i < 5; i++) CHECK_EQUAL(samePlan.primitiveOrder[i], i);
+
+        // cluster counts are clamped to [1, count]
+        CHECK(ClusterPlanner::plan(corners.data(), 0, 4).clusters.empty());
+        checkPlan(corners, ClusterPlanner::plan(corners.data(), 8, 0), 1);
+        checkPlan(corners, ClusterPlanner::plan(corners.data(), 8, 100), 8);
+
+        // random scenes sized around the limit
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> position(-20.f, 20.f);
+        std::uniform_real_distribution<float> radius(0.05f, 0.5f);
+        for (uint32_t count : { 255u, 256u, 257u, 1000u, 10000u }) {
+            std::vector<Vk::AABB> aabbs(count);
+            for (Vk::AABB& aabb : aabbs) {
+                glm::vec3 center = glm::vec3(position(rng), position(rng), position(rng));
+                aabb = Vk::AABB(center - glm::vec3(radius(rng)), center + glm::vec3(radius(rng)));
+            }
+            uint32_t clusterCount = ClusterPlanner::clusterCountFor(count, MAX_PRIMITIVES_PER_BLAS);
+            ClusterPlanner::Plan plan = ClusterPlanner::plan(aabbs.data(), count, clusterCount);
+            checkPlan(aabbs, plan, clusterCount);
+            for (const ClusterPlanner::Cluster& cluster : plan.clusters) CHECK(cluster.primitiveCount <= MAX_PRIMITIVES_PER_BLAS);
+
+            // non decreasing codes along the order, with the planner's normalization
+            Vk::AABB centerBounds = Vk::AABB::empty();
+            for (const Vk::AABB& aabb : aabbs) centerBounds.grow(aabb.center());
+            glm::vec3 inverseExtent = glm::vec3(1.f) / centerBounds.extent();
+            uint32_t previous = 0, outOfOrder = 0;
+            for (uint32_t primitive : plan.primitiveOrder) {
+                uint32_t code = Morton::encode30(Morton::normalize(aabbs[primitive].center(), centerBounds.minPoint(), inverseExtent));
+                outOfOrder += code < previous;
+                previous = code;
+            }
+            CHECK_EQUAL(outOfOrder, 0u);
+        }
+
+        // stats of hand made clusters: a unit cube of 2 primitives, an empty cluster and a 2 x 1 x 1 box of 4
+        ClusterPlanner::Cluster clusters[3];
+        clusters[0].primitiveCount = 2;
+        clusters[0].bounds = Vk::AABB(glm::vec3(0.f), glm::vec3(1.f));
+        clusters[1].firstPrimitive = 2;
+        clusters[1].bounds = Vk::AABB(glm::vec3(0.f), glm::vec3(5.f)); // ignored, the cluster has no primitives
+        clusters[2].firstPrimitive = 2;
+        clusters[2].primitiveCount = 4;
+        clusters[2].bounds = Vk::AABB(glm::vec3(0.f), glm::vec3(2.f, 1.f, 1.f));
+        ClusterPlanner::Stats stats = ClusterPlanner::computeStats(clusters, 3);
+        CHECK_EQUAL(stats.blasCount, 2u);
+        CHECK_EQUAL(stats.primitiveCount, 6u);
+        CHECK_NEAR(stats.totalSurfaceArea, 6.f + 10.f, 1e-4f);
+        CHECK_NEAR(stats.estimatedRebuildCost, (2.f * 2.f + 4.f * 4.f) / 6.f, 1e-4f);
+        CHECK_EQUAL(ClusterPlanner::computeStats(clusters, 0).blasCount, 0u);
+        CHECK_EQUAL(ClusterPlanner::computeStats(clusters, 0).estimatedRebuildCost, 0.f);
+    }
+
+    // contiguous runs over a permutation that differ in size by at most one, with bounds around their primitives
+    void checkPlan(const std::vector<Vk::AABB>& aabbs, const ClusterPlanner::Plan& plan, uint32_t clusterCount) {
+        uint32_t count = static_cast<uint32_t>(plan.primitiveOrder.size());
+        CHECK_EQUAL(plan.clusters.size(), static_cast<size_t>(clusterCount));
+        if (plan.clusters.size() != clusterCount) return;
+
+        std::vector<uint32_t> sorted = plan.primitiveOrder;
+        std::sort(sorted.begin(), sorted.end());
+        for (uint32_t i = 0; i < count; i++) CHECK_EQUAL(sorted[i], i);
+
+        uint32_t first = 0, smallest = UINT32_MAX, largest = 0;
+        float surfaceArea = 0.f;
+        for (const ClusterPlanner::Cluster& cluster : plan.clusters) {
+            CHECK_EQUAL(cluster.firstPrimitive, first);
+            smallest = std::min(smallest, cluster.primitiveCount);
+            largest = std::max(largest, cluster.primitiveCount);
+
+            Vk::AABB bounds = Vk::AABB::empty();
+            for (uint32_t i = cluster.firstPrimitive; i < cluster.firstPrimitive + cluster.primitiveCount && i < count; i++)
+                bounds.grow(aabbs[plan.primitiveOrder[i]]);
+            CHECK(bounds.minPoint() == cluster.bounds.minPoint() && bounds.maxPoint() == cluster.bounds.maxPoint());
+            surfaceArea += cluster.bounds.surfaceArea();
+            first += cluster.primitiveCount;
+        }
+        CHECK_EQUAL(first, count);
+        CHECK(largest - smallest <= 1);
+
+        CHECK_EQUAL(plan.stats.blasCount, clusterCount);
+        CHECK_EQUAL(plan.stats.primitiveCount, count);
+        CHECK_NEAR(plan.stats.totalSurfaceArea, surfaceArea, surfaceArea * 1e-5f);
+    }
+};
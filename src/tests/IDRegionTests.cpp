@@ -0,0 +1,135 @@
+#include "tests/Tests.h"
+
+#include "tools/IDRegion.h"
+
+#include <cmath>
+#include <vector>
+
+namespace Tests {
+
+    // private function declarations
+
+    std::vector<glm::vec2> uShape(glm::vec2 shift);
+    uint32_t countContained(const Vk::IDRegion& region, glm::ivec2 lower, glm::ivec2 upper);
+
+    // function implimentations
+
+    void idRegion() {
+        // any two corners, rounded outwards
+        Vk::IDRegion rect = Vk::IDRegion::fromRect(glm::vec2(5.5f, 7.2f), glm::vec2(1.2f, 2.9f));
+        CHECK(rect.offset == glm::ivec2(1, 2));
+        CHECK(rect.extent == glm::ivec2(5, 6));
+        CHECK(rect.contains(glm::ivec2(1, 2)));
+        CHECK(rect.contains(glm::ivec2(5, 7)));
+        CHECK(!rect.contains(glm::ivec2(6, 7)));
+        CHECK(!rect.contains(glm::ivec2(5, 8)));
+        CHECK(!rect.contains(glm::ivec2(0, 2)));
+
+        // clamped at every edge of a 5x4 image, the lasso stays in image pixels
+        Vk::IDRegion over = Vk::IDRegion::fromLasso(uShape(glm::vec2(-3.f, -2.f)));
+        Vk::IDRegion inside = over.clamped(glm::uvec2(5, 4));
+        CHECK(inside.offset == glm::ivec2(0, 0));
+        CHECK(inside.extent == glm::ivec2(5, 4));
+        CHECK_EQUAL(inside.lasso.size(), over.lasso.size());
+        rect.offset = glm::ivec2(3, 2);
+        rect.extent = glm::ivec2(10, 10);
+        CHECK(rect.clamped(glm::uvec2(5, 4)).offset == glm::ivec2(3, 2));
+        CHECK(rect.clamped(glm::uvec2(5, 4)).extent == glm::ivec2(2, 2));
+        rect.offset = glm::ivec2(-4, 6);
+        CHECK(rect.clamped(glm::uvec2(5, 4)).extent == glm::ivec2(5, 0));
+        rect.offset = glm::ivec2(-20, -20);
+        CHECK(rect.clamped(glm::uvec2(5, 4)).extent == glm::ivec2(0, 0));
+
+        // a concave lasso covers its area, the notch between the arms isn't selected
+        Vk::IDRegion u = Vk::IDRegion::fromLasso(uShape(glm::vec2(0.f)));
+        CHECK(u.offset == glm::ivec2(0, 0));
+        CHECK(u.extent == glm::ivec2(9, 9));
+        CHECK(u.contains(glm::ivec2(1, 5)));
+        CHECK(u.contains(glm::ivec2(7, 5)));
+        CHECK(u.contains(glm::ivec2(4, 1)));
+        CHECK(!u.contains(glm::ivec2(4, 5)));
+        CHECK(!u.contains(glm::ivec2(4, 8)));
+        CHECK_EQUAL(countContained(u, glm::ivec2(-2), glm::ivec2(12)), 9u * 9u - 3u * 6u);
+
+        // self intersecting: the even-odd rule leaves the middle of a pentagram out
+        std::vector<glm::vec2> star;
+        for (uint32_t p = 0; p < 5; p++) {
+            float angle = -1.5707963f + p * 2.5132741f;
+            star.push_back(glm::vec2(25.f) + 20.f * glm::vec2(std::cos(angle), std::sin(angle)));
+        }
+        Vk::IDRegion pentagram = Vk::IDRegion::fromLasso(star);
+        CHECK(!pentagram.contains(glm::ivec2(24, 24)));
+        CHECK(pentagram.contains(glm::ivec2(24, 8)));
+        CHECK(!pentagram.contains(glm::ivec2(10, 10)));
+
+        // degenerate and long lassos
+        Vk::IDRegion line = Vk::IDRegion::fromLasso({ glm::vec2(1.f), glm::vec2(5.f) });
+        CHECK(line.extent == glm::ivec2(0));
+        CHECK(line.lasso.empty());
+        std::vector<glm::vec2> circle(5000);
+        for (uint32_t p = 0; p < circle.size(); p++) {
+            float angle = p * 6.2831853f / circle.size();
+            circle[p] = glm::vec2(100.f) + 50.f * glm::vec2(std::cos(angle), std::sin(angle));
+        }
+        Vk::IDRegion resampled = Vk::IDRegion::fromLasso(circle);
+        CHECK_EQUAL(resampled.lasso.size(), size_t(ID_HISTOGRAM_MAX_LASSO_POINTS));
+        CHECK(resampled.contains(glm::ivec2(100, 100)));
+        CHECK(!resampled.contains(glm::ivec2(52, 52)));
+
+        // negative ids are the background, ids from the capacity up are ignored like the gpu pass does
+        const int32_t ids[] = {
+            0, 1, 1, -1, 8, 2,
+            0, 1, 7, -5, 100, 2,
+            3, 3, 3, 3, 3, 3,
+            7, 8, -1, 1, 1, 0 };
+        std::vector<Vk::IDCoverage> all = Vk::scanIDHistogram(ids, 6, 4, Vk::IDRegion::fromRect(glm::vec2(0.f), glm::vec2(100.f)), 8);
+        const Vk::IDCoverage expected[] = { { 0, 3 }, { 1, 5 }, { 2, 2 }, { 3, 6 }, { 7, 2 } };
+        CHECK_EQUAL(all.size(), 5u);
+        for (uint32_t c = 0; c < all.size() && c < 5; c++) {
+            CHECK_EQUAL(all[c].objectID, expected[c].objectID);
+            CHECK_EQUAL(all[c].pixelCount, expected[c].pixelCount);
+        }
+        std::vector<Vk::IDCoverage> larger = Vk::scanIDHistogram(ids, 6, 4, Vk::IDRegion::fromRect(glm::vec2(0.f), glm::vec2(6.f, 4.f)), 101);
+        CHECK_EQUAL(larger.size(), 7u);
+        if (larger.size() == 7) {
+            CHECK_EQUAL(larger[5].objectID, 8);
+            CHECK_EQUAL(larger[5].pixelCount, 2u);
+            CHECK_EQUAL(larger[6].objectID, 100);
+        }
+        CHECK(Vk::scanIDHistogram(ids, 6, 4, Vk::IDRegion::fromRect(glm::vec2(0.f), glm::vec2(6.f, 4.f)), 0).empty());
+
+        // a region hanging over the top left corner
+        std::vector<Vk::IDCoverage> corner = Vk::scanIDHistogram(ids, 6, 4, Vk::IDRegion::fromRect(glm::vec2(-2.f, -3.f), glm::vec2(4.f, 3.f)), 8);
+        CHECK_EQUAL(corner.size(), 4u);
+        if (corner.size() == 4) {
+            CHECK(corner[0].objectID == 0 && corner[0].pixelCount == 2);
+            CHECK(corner[1].objectID == 1 && corner[1].pixelCount == 3);
+            CHECK(corner[2].objectID == 3 && corner[2].pixelCount == 4);
+            CHECK(corner[3].objectID == 7 && corner[3].pixelCount == 1);
+        }
+        CHECK(Vk::scanIDHistogram(ids, 6, 4, Vk::IDRegion::fromRect(glm::vec2(7.f), glm::vec2(9.f)), 8).empty());
+
+        // a concave lasso cut by the left edge: the left arm is outside, the bottom and the right arm count
+        std::vector<int32_t> filled(12 * 12, 4);
+        std::vector<Vk::IDCoverage> cut = Vk::scanIDHistogram(filled.data(), 12, 12, Vk::IDRegion::fromLasso(uShape(glm::vec2(-3.f, 0.f))), 8);
+        CHECK_EQUAL(cut.size(), 1u);
+        if (!cut.empty()) CHECK_EQUAL(cut[0].pixelCount, 6u * 3u + 3u * 6u);
+    }
+
+    // 9x9 square with a 3 wide notch 6 deep cut into its top (larger y) edge
+    std::vector<glm::vec2> uShape(glm::vec2 shift) {
+        std::vector<glm::vec2> points = {
+            glm::vec2(0.f, 0.f), glm::vec2(9.f, 0.f), glm::vec2(9.f, 9.f), glm::vec2(6.f, 9.f),
+            glm::vec2(6.f, 3.f), glm::vec2(3.f, 3.f), glm::vec2(3.f, 9.f), glm::vec2(0.f, 9.f) };
+        for (glm::vec2& p : points) p += shift;
+        return points;
+    }
+
+    uint32_t countContained(const Vk::IDRegion& region, glm::ivec2 lower, glm::ivec2 upper) {
+        uint32_t count = 0;
+        for (int32_t y = lower.y; y < upper.y; y++) {
+            for (int32_t x = lower.x; x < upper.x; x++) count += region.contains(glm::ivec2(x, y));
+        }
+        return count;
+    }
+};
@@ -0,0 +1,103 @@
+#include "tests/Tests.h"
+
+#include "tools/JobSystem.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace Tests {
+
+    // private variables
+
+    // ranges a reduction saw, in the order they were combined
+    struct _Ranges {
+        std::vector<uint32_t> begins;
+        std::vector<uint32_t> ends;
+    };
+
+    // function implimentations
+
+    void jobSystem() {
+        for (uint32_t threadCount : { 1u, 2u, 4u }) {
+            JobSystem::Settings settings;
+            settings.threadCount = threadCount;
+            JobSystem::init(settings);
+            CHECK_EQUAL(JobSystem::getThreadCount(), threadCount);
+
+            // every index exactly once, for grain sizes below, at and above the range
+            for (uint32_t grainSize : { 1u, 7u, 1000u, 5000u }) {
+                std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[3000]);
+                for (uint32_t i = 0; i < 3000; i++) visits[i] = 0;
+                JobSystem::parallelFor(500, 3000, grainSize, [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t i = begin; i < end; i++) visits[i]++;
+                });
+                uint32_t wrong = 0;
+                for (uint32_t i = 0; i < 3000; i++) wrong += visits[i] != (i >= 500 ? 1u : 0u);
+                CHECK_EQUAL(wrong, 0u);
+            }
+
+            // sums
+            uint64_t sum = JobSystem::parallelReduce(0u, 100000u, 333u, uint64_t(0), [](uint32_t begin, uint32_t end) {
+                uint64_t partial = 0;
+                for (uint32_t i = begin; i < end; i++) partial += i;
+                return partial;
+            }, [](uint64_t a, uint64_t b) { return a + b; });
+            CHECK_EQUAL(sum, uint64_t(99999) * 100000 / 2);
+            CHECK_EQUAL(JobSystem::parallelReduce(5u, 5u, 1u, 42, [](uint32_t, uint32_t) { return 0; }, [](int a, int b) { return a + b; }), 42);
+            // grain size 0 is taken as 1
+            CHECK_EQUAL(JobSystem::parallelReduce(0u, 10u, 0u, 0u, [](uint32_t begin, uint32_t end) { return end - begin; }, [](uint32_t a, uint32_t b) { return a + b; }), 10u);
+
+            // combined in range order whatever thread ran them, with a combine that isn't commutative
+            _Ranges ranges = JobSystem::parallelReduce(10u, 1010u, 64u, _Ranges(), [](uint32_t begin, uint32_t end) {
+                _Ranges r;
+                r.begins.push_back(begin);
+                r.ends.push_back(end);
+                return r;
+            }, [](_Ranges a, const _Ranges& b) {
+                a.begins.insert(a.begins.end(), b.begins.begin(), b.begins.end());
+                a.ends.insert(a.ends.end(), b.ends.begin(), b.ends.end());
+                return a;
+            });
+            CHECK_EQUAL(ranges.begins.size(), 16u);
+            uint32_t outOfOrder = 0;
+            for (uint32_t r = 0; r < ranges.begins.size(); r++) {
+                outOfOrder += ranges.begins[r] != 10 + r * 64 || ranges.ends[r] != std::min(1010u, 10 + (r + 1) * 64);
+            }
+            CHECK_EQUAL(outOfOrder, 0u);
+
+            // jobs that wait on their own jobs
+            std::atomic<uint32_t> inner{ 0 };
+            JobSystem::parallelFor(0, 8, 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) {
+                    JobSystem::parallelFor(0, 100, 10, [&](uint32_t b, uint32_t e) { inner += e - b; });
+                }
+            });
+            CHECK_EQUAL(inner.load(), 800u);
+
+            std::atomic<bool> ran{ false };
+            JobSystem::JobGroup group;
+            JobSystem::run(group, [&ran]() { ran = true; });
+            JobSystem::wait(group);
+            CHECK(ran.load());
+        }
+
+        // float sums come out bit identical for every thread count
+        float sums[3];
+        for (uint32_t t = 0; t < 3; t++) {
+            JobSystem::Settings settings;
+            settings.threadCount = 1u << t;
+            JobSystem::init(settings);
+            sums[t] = JobSystem::parallelReduce(0u, 200000u, 1000u, 0.f, [](uint32_t begin, uint32_t end) {
+                float partial = 0.f;
+                for (uint32_t i = begin; i < end; i++) partial += 1.f / (1.f + static_cast<float>(i));
+                return partial;
+            }, [](float a, float b) { return a + b; });
+        }
+        CHECK(std::memcmp(&sums[0], &sums[1], sizeof(float)) == 0);
+        CHECK(std::memcmp(&sums[0], &sums[2], sizeof(float)) == 0);
+
+        JobSystem::init();
+    }
+};
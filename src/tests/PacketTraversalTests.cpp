@@ -0,0 +1,159 @@
+#include "tests/Tests.h"
+
+#include "tools/AABB.h"
+#include "tools/BVH.h"
+#include "tools/Intersection.h"
+#include "tools/PacketTraversal.h"
+#include "tools/SIMD.h"
+
+#include <random>
+#include <vector>
+
+namespace Tests {
+
+#ifdef SIMD_X86
+
+    // private function declarations
+
+    bool intersectScalar(const Model::Ellipsoid& ellipsoid, const Spatial::Ray& ray, float tMin, float& t);
+    void checkPackets(const Spatial::BVH& bvh, const std::vector<Model::Ellipsoid>& ellipsoids, Spatial::InstructionSet instructionSet, std::mt19937& rng);
+
+    // function implimentations
+
+    void packetTraversal() {
+        std::mt19937 rng(19);
+        std::uniform_real_distribution<float> position(-20.f, 20.f);
+        std::uniform_real_distribution<float> radius(0.3f, 2.f);
+        std::normal_distribution<float> axis(0.f, 1.f);
+
+        // both kernels, rotated
+        std::vector<Model::Ellipsoid> ellipsoids(600);
+        std::vector<uint32_t> keys(ellipsoids.size());
+        std::vector<Vk::AABB> aabbs(ellipsoids.size());
+        for (uint32_t i = 0; i < ellipsoids.size(); i++) {
+            glm::vec4 q = glm::vec4(axis(rng), axis(rng), axis(rng), axis(rng));
+            ellipsoids[i] = Model::Ellipsoid(glm::vec3(position(rng), position(rng), position(rng)), glm::vec3(radius(rng), radius(rng), radius(rng)),
+                glm::vec4(1.f), Model::EllipsoidID(), q / std::sqrt(glm::dot(q, q)));
+            ellipsoids[i].intersection = i % 3 == 0 ? Model::IntersectionMethod::SPHERE_TRACE : Model::IntersectionMethod::ANALYTIC;
+            keys[i] = i;
+            aabbs[i] = Vk::AABB(ellipsoids[i]);
+        }
+        Spatial::BVH bvh;
+        bvh.build(keys.data(), aabbs.data(), static_cast<uint32_t>(keys.size()));
+
+        CHECK(Spatial::detectInstructionSet() != Spatial::InstructionSet::NONE);
+        checkPackets(bvh, ellipsoids, Spatial::InstructionSet::SSE, rng);
+        if (Spatial::detectInstructionSet() == Spatial::InstructionSet::AVX2) {
+            checkPackets(bvh, ellipsoids, Spatial::InstructionSet::AVX2, rng);
+        } else {
+            AID_WARN("PacketTraversal: no AVX2 on this cpu, only the SSE packets were checked");
+        }
+    }
+
+    // the scalar path of CPURenderer
+    bool intersectScalar(const Model::Ellipsoid& ellipsoid, const Spatial::Ray& ray, float tMin, float& t) {
+        glm::vec3 radius = glm::vec3(ellipsoid.radius);
+        glm::vec3 origin = Spatial::inverseRotate(ellipsoid.rotation, ray.origin - glm::vec3(ellipsoid.center));
+        glm::vec3 direction = Spatial::inverseRotate(ellipsoid.rotation, ray.direction);
+        glm::vec3 normal;
+
+        bool hit;
+        if (ellipsoid.intersection == Model::IntersectionMethod::SPHERE_TRACE) {
+            uint32_t steps;
+            hit = Spatial::intersectEllipsoidSphereTraced(origin, direction, radius, t, normal, steps);
+        } else {
+            hit = Spatial::intersectEllipsoidAnalytic(origin, direction, radius, tMin, ray.tMax, t, normal);
+        }
+        return hit && t >= tMin && t <= ray.tMax;
+    }
+
+    void checkPackets(const Spatial::BVH& bvh, const std::vector<Model::Ellipsoid>& ellipsoids, Spatial::InstructionSet instructionSet, std::mt19937& rng) {
+        std::uniform_real_distribution<float> position(-30.f, 30.f);
+        std::uniform_real_distribution<float> spread(-0.05f, 0.05f);
+        std::uniform_int_distribution<uint32_t> lanes(1, (1u << PACKET_SIZE) - 1);
+        const float tMin = 0.001f, tMax = 100.f;
+        bool avx2 = instructionSet == Spatial::InstructionSet::AVX2;
+
+        Spatial::PacketScene scene;
+        scene.nodes = bvh.getNodes().data();
+        scene.nodeCount = bvh.getNodeCount();
+        scene.primitiveKeys = bvh.getPrimitiveKeys().data();
+        scene.ellipsoids = ellipsoids.data();
+
+        uint32_t wrongHits = 0, wrongKeys = 0, wrongDistances = 0, wrongOcclusions = 0, hitCount = 0;
+        for (uint32_t p = 0; p < 400; p++) {
+            // coherent packets like a camera's, every fourth one incoherent, with some lanes inactive
+            bool coherent = p % 4 != 0;
+            uint32_t activeLanes = p % 2 == 0 ? (1u << PACKET_SIZE) - 1 : lanes(rng);
+            glm::vec3 origin = glm::vec3(position(rng), position(rng), position(rng));
+            glm::vec3 target = glm::vec3(position(rng), position(rng), position(rng)) * 0.3f;
+
+            Spatial::Ray rays[PACKET_SIZE];
+            Spatial::RayPacket packet;
+            for (uint32_t lane = 0; lane < PACKET_SIZE; lane++) {
+                glm::vec3 laneOrigin = coherent ? origin : glm::vec3(position(rng), position(rng), position(rng));
+                glm::vec3 direction = glm::normalize(target - laneOrigin + (coherent ? glm::vec3(spread(rng), spread(rng), spread(rng)) * 30.f : glm::vec3(0.f)));
+                rays[lane] = Spatial::Ray(laneOrigin, direction, tMax);
+                packet.originX[lane] = laneOrigin.x;
+                packet.originY[lane] = laneOrigin.y;
+                packet.originZ[lane] = laneOrigin.z;
+                packet.directionX[lane] = direction.x;
+                packet.directionY[lane] = direction.y;
+                packet.directionZ[lane] = direction.z;
+                packet.tMax[lane] = tMax;
+            }
+            Spatial::RayPacket shadowPacket = packet;
+
+            uint64_t tests = 0;
+            uint32_t hitKeys[PACKET_SIZE];
+            uint32_t hitLanes = avx2 ?
+                Spatial::intersectPacketAVX2(scene, packet, activeLanes, tMin, hitKeys, tests) :
+                Spatial::intersectPacketSSE(scene, packet, activeLanes, tMin, hitKeys, tests);
+            uint32_t occludedLanes = avx2 ?
+                Spatial::occludedPacketAVX2(scene, shadowPacket, activeLanes, tMin, tests) :
+                Spatial::occludedPacketSSE(scene, shadowPacket, activeLanes, tMin, tests);
+
+            for (uint32_t lane = 0; lane < PACKET_SIZE; lane++) {
+                bool active = (activeLanes & (1u << lane)) != 0;
+                Spatial::Ray ray = rays[lane];
+                uint32_t key = Spatial::BVH::INVALID_INDEX;
+                if (active) {
+                    bvh.intersect(ray, [&](uint32_t k, Spatial::Ray& r) {
+                        float t;
+                        if (!intersectScalar(ellipsoids[k], r, tMin, t)) return false;
+                        r.tMax = t;
+                        key = k;
+                        return true;
+                    });
+                }
+                bool occluded = active && bvh.intersectAny(rays[lane], [&](uint32_t k, const Spatial::Ray& r) {
+                    float t;
+                    return intersectScalar(ellipsoids[k], r, tMin, t);
+                });
+
+                bool hit = key != Spatial::BVH::INVALID_INDEX;
+                hitCount += hit;
+                wrongHits += hit != ((hitLanes & (1u << lane)) != 0);
+                wrongOcclusions += occluded != ((occludedLanes & (1u << lane)) != 0);
+                if (hit && (hitLanes & (1u << lane))) {
+                    wrongKeys += hitKeys[lane] != key;
+                    wrongDistances += std::abs(packet.tMax[lane] - ray.tMax) > 1e-5f * ray.tMax;
+                }
+            }
+        }
+
+        CHECK(hitCount > 200);
+        CHECK_EQUAL(wrongHits, 0u);
+        CHECK_EQUAL(wrongKeys, 0u);
+        CHECK_EQUAL(wrongDistances, 0u);
+        CHECK_EQUAL(wrongOcclusions, 0u);
+    }
+
+#else
+
+    void packetTraversal() {
+        CHECK(Spatial::detectInstructionSet() == Spatial::InstructionSet::NONE);
+    }
+
+#endif // SIMD_X86
+};
@@ -0,0 +1,67 @@
+#include "tests/Tests.h"
+
+#include "tools/RadixSort.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace Tests {
+
+    // private function declarations
+
+    template <class Key>
+    void checkSort(std::vector<Key> keys, uint32_t threadCount);
+
+    // function implimentations
+
+    void radixSort() {
+        std::mt19937_64 rng(15);
+
+        for (uint32_t count : { 0u, 1u, 2u, 1000u, 300000u }) {
+            // full range, 30 bit morton codes (high digits all the same) and many duplicates for stability
+            std::vector<uint32_t> keys32(count), codes(count), duplicates(count);
+            std::vector<uint64_t> keys64(count), codes63(count);
+            for (uint32_t i = 0; i < count; i++) {
+                uint64_t r = rng();
+                keys32[i] = static_cast<uint32_t>(r);
+                codes[i] = static_cast<uint32_t>(r) & 0x3FFFFFFF;
+                duplicates[i] = static_cast<uint32_t>(r % 37);
+                keys64[i] = rng();
+                codes63[i] = r >> 1;
+            }
+
+            // a single chunk, and 4 chunks which scatter across chunk boundaries and recount every digit
+            for (uint32_t threadCount : { 1u, 4u }) {
+                checkSort(keys32, threadCount);
+                checkSort(codes, threadCount);
+                checkSort(duplicates, threadCount);
+                checkSort(keys64, threadCount);
+                checkSort(codes63, threadCount);
+            }
+        }
+
+        // all keys equal skip every digit
+        checkSort(std::vector<uint32_t>(1000, 7u), 1);
+    }
+
+    template <class Key>
+    void checkSort(std::vector<Key> keys, uint32_t threadCount) {
+        uint32_t count = static_cast<uint32_t>(keys.size());
+        std::vector<uint32_t> values(count);
+        for (uint32_t i = 0; i < count; i++) values[i] = i;
+
+        // stable, so equal keys keep their values in input order
+        std::vector<std::pair<Key, uint32_t>> expected(count);
+        for (uint32_t i = 0; i < count; i++) expected[i] = { keys[i], i };
+        std::stable_sort(expected.begin(), expected.end(), [](const std::pair<Key, uint32_t>& a, const std::pair<Key, uint32_t>& b) { return a.first < b.first; });
+
+        RadixSort::sort(keys, values, threadCount);
+        CHECK_EQUAL(keys.size(), expected.size());
+        CHECK_EQUAL(values.size(), expected.size());
+        uint32_t wrong = 0;
+        for (uint32_t i = 0; i < count && i < keys.size(); i++) wrong += keys[i] != expected[i].first || values[i] != expected[i].second;
+        CHECK_EQUAL(wrong, 0u);
+    }
+};
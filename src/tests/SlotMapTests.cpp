@@ -0,0 +1,87 @@
+#include "tests/Tests.h"
+
+#include "tools/SlotMap.h"
+
+#include <vector>
+
+namespace Tests {
+
+    // function implimentations
+
+    void slotMap() {
+        using IntHandle = Model::Handle<int>;
+        Model::SlotMap<int> map;
+
+        std::vector<IntHandle> handles;
+        for (int i = 0; i < 4; i++) handles.push_back(map.insert(10 + i));
+        for (uint32_t i = 0; i < 4; i++) {
+            CHECK_EQUAL(handles[i].getIndex(), i);
+            CHECK(map.handleFromSlot(i) == handles[i]);
+        }
+
+        // erasing moves the last element into the hole
+        CHECK_EQUAL(map.erase(handles[1]), 1u);
+        CHECK_EQUAL(map.size(), 3u);
+        CHECK_EQUAL(map[1], 13);
+        CHECK_EQUAL(map.denseIndex(handles[3]), 1u);
+        CHECK_EQUAL(map.erase(handles[3]), 1u);
+        CHECK_EQUAL(map.erase(handles[3]), IntHandle::INVALID_INDEX);
+
+        // freed slots resolve to nothing, whatever their free list links point at
+        for (uint32_t slot : { 1u, 3u }) {
+            CHECK(!map.handleFromSlot(slot).isValid());
+            CHECK(!map.contains(IntHandle(slot, 0)));
+            CHECK(!map.contains(IntHandle(slot, 1)));
+            CHECK(map.find(IntHandle(slot, 1)) == nullptr);
+        }
+        CHECK(!map.contains(handles[1]));
+        CHECK(!map.handleFromSlot(7).isValid());
+        CHECK_EQUAL(*map.find(handles[0]), 10);
+        CHECK_EQUAL(*map.find(handles[2]), 12);
+
+        // the last freed slot is reused with a new generation, the old handle stays stale
+        IntHandle reused = map.insert(20);
+        CHECK_EQUAL(reused.getIndex(), 3u);
+        CHECK(reused != handles[3]);
+        CHECK(!map.contains(handles[3]));
+        CHECK(map.handleFromSlot(3) == reused);
+        CHECK_EQUAL(*map.find(reused), 20);
+        IntHandle reused2 = map.insert(21);
+        CHECK_EQUAL(reused2.getIndex(), 1u);
+        CHECK_EQUAL(map.insert(22).getIndex(), 4u);
+        CHECK_EQUAL(map.slotCount(), 5u);
+
+        // clear invalidates every handle and every slot
+        std::vector<IntHandle> live = map.handles();
+        map.clear();
+        CHECK(map.empty());
+        for (const IntHandle& handle : live) CHECK(!map.contains(handle));
+        uint32_t resolved = 0;
+        for (uint32_t slot = 0; slot < map.slotCount(); slot++) resolved += map.handleFromSlot(slot).isValid();
+        CHECK_EQUAL(resolved, 0u);
+        IntHandle afterClear = map.insert(30);
+        CHECK(afterClear.getIndex() < 5u);
+        CHECK_EQUAL(map.size(), 1u);
+        CHECK(map.handleFromSlot(afterClear.getIndex()) == afterClear);
+
+        // sparse set keyed by the handles of another map
+        Model::SparseSet<float, IntHandle> set;
+        CHECK_EQUAL(set.insert(IntHandle(2, 0), 2.f), 0u);
+        CHECK_EQUAL(set.insert(IntHandle(5, 1), 5.f), 1u);
+        CHECK_EQUAL(set.insert(IntHandle(7, 0), 7.f), 2u);
+        CHECK_EQUAL(set.insert(IntHandle(5, 1), 0.f), IntHandle::INVALID_INDEX);
+        CHECK_EQUAL(set.insert(IntHandle(), 0.f), IntHandle::INVALID_INDEX);
+        CHECK(!set.contains(IntHandle(5, 0)));
+        CHECK_EQUAL(set.erase(IntHandle(2, 0)), 0u);
+        CHECK_EQUAL(set[0], 7.f);
+        CHECK_EQUAL(set.denseIndex(IntHandle(7, 0)), 0u);
+        CHECK(!set.contains(IntHandle(2, 0)));
+        CHECK_EQUAL(set.erase(IntHandle(2, 0)), IntHandle::INVALID_INDEX);
+        // the same slot with the next generation
+        CHECK_EQUAL(set.insert(IntHandle(2, 1), 3.f), 2u);
+        CHECK(!set.contains(IntHandle(2, 0)));
+        set.clear();
+        CHECK(!set.contains(IntHandle(7, 0)));
+        CHECK(set.empty());
+    }
+};
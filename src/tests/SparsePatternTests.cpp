@@ -0,0 +1,116 @@
+#include "tests/Tests.h"
+
+#include "tools/SparsePattern.h"
+#include "tools/config.h"
+
+#include <cmath>
+#include <vector>
+
+namespace Tests {
+
+    // private function declarations
+
+    void checkPattern(uint32_t stride, glm::uvec2 size);
+
+    // function implimentations
+
+    void sparsePattern() {
+        CHECK(SparsePattern::isValidStride(1));
+        CHECK(SparsePattern::isValidStride(2));
+        CHECK(SparsePattern::isValidStride(4));
+        CHECK(!SparsePattern::isValidStride(0));
+        CHECK(!SparsePattern::isValidStride(3));
+        CHECK(!SparsePattern::isValidStride(8));
+        CHECK_EQUAL(SparsePattern::getPhaseCount(4), 16u);
+
+        // the 2x2 bayer order, repeating after the phase count
+        const glm::uvec2 order[] = { glm::uvec2(0, 0), glm::uvec2(1, 1), glm::uvec2(1, 0), glm::uvec2(0, 1) };
+        for (uint32_t phase = 0; phase < 8; phase++) CHECK(SparsePattern::getOffset(2, phase) == order[phase % 4]);
+        CHECK(SparsePattern::getOffset(1, 5) == glm::uvec2(0));
+
+        // any 4 consecutive phases of stride 4 cover each 2x2 quadrant of the cell once
+        for (uint32_t first = 0; first < 16; first += 4) {
+            uint32_t quadrants = 0;
+            for (uint32_t phase = first; phase < first + 4; phase++) {
+                glm::uvec2 offset = SparsePattern::getOffset(4, phase);
+                quadrants |= 1u << (offset.x / 2 + 2 * (offset.y / 2));
+            }
+            CHECK_EQUAL(quadrants, 15u);
+        }
+
+        CHECK(SparsePattern::getLaunchSize(glm::uvec2(1201, 801), 4) == glm::uvec2(301, 201));
+        CHECK_EQUAL(SparsePattern::getTracedPixelCount(glm::uvec2(5, 7), 2, glm::uvec2(1, 0)), 2u * 4u);
+
+        // halfway between two traced pixels of a row
+        SparsePattern::Interpolation between = SparsePattern::getInterpolation(glm::uvec2(1, 0), glm::uvec2(8, 8), 2, glm::uvec2(0));
+        CHECK(between.samples[0] == glm::uvec2(0, 0));
+        CHECK(between.samples[1] == glm::uvec2(2, 0));
+        CHECK_NEAR(between.weights[0], 0.5f, 1e-6f);
+        CHECK_NEAR(between.weights[1], 0.5f, 1e-6f);
+        CHECK_NEAR(between.weights[2] + between.weights[3], 0.f, 1e-6f);
+
+        // tiny, odd and window sized images, the window one with the launch's extra row and column
+        for (uint32_t stride : { 1u, 2u, 4u }) {
+            for (glm::uvec2 size : { glm::uvec2(4, 4), glm::uvec2(5, 7), glm::uvec2(33, 17), glm::uvec2(WINDOW_SIZE_X + 1, WINDOW_SIZE_Y + 1) }) {
+                uint32_t failures = getFailureCount();
+                checkPattern(stride, size);
+                if (getFailureCount() != failures) AID_WARN("SparsePattern: the failures above are stride {} at {}x{}", stride, size.x, size.y);
+            }
+        }
+    }
+
+    // over all phases every pixel is traced exactly once, the traced counts match the launch and the pixels in between
+    // only interpolate traced ones, with weights summing to one. like the shaders do it, per launch id and per pixel
+    void checkPattern(uint32_t stride, glm::uvec2 size) {
+        std::vector<uint32_t> traceCounts(static_cast<size_t>(size.x) * size.y, 0);
+        glm::uvec2 launch = SparsePattern::getLaunchSize(size, stride);
+        uint32_t badOffsets = 0, badLaunches = 0, wrongCounts = 0, badSamples = 0, badWeights = 0, badNearest = 0;
+
+        for (uint32_t phase = 0; phase < SparsePattern::getPhaseCount(stride); phase++) {
+            glm::uvec2 offset = SparsePattern::getOffset(stride, phase);
+            badOffsets += offset.x >= stride || offset.y >= stride;
+
+            // scene.rgen and scene.comp
+            uint32_t launched = 0;
+            for (uint32_t y = 0; y < launch.y; y++) {
+                for (uint32_t x = 0; x < launch.x; x++) {
+                    glm::uvec2 pixel = glm::uvec2(x, y) * stride + offset;
+                    if (pixel.x >= size.x || pixel.y >= size.y) continue;
+                    badLaunches += !SparsePattern::isTraced(pixel, stride, offset);
+                    traceCounts[static_cast<size_t>(pixel.y) * size.x + pixel.x]++;
+                    launched++;
+                }
+            }
+            wrongCounts += launched != SparsePattern::getTracedPixelCount(size, stride, offset);
+
+            // refine.comp
+            for (uint32_t y = 0; y < size.y; y++) {
+                for (uint32_t x = 0; x < size.x; x++) {
+                    glm::uvec2 pixel(x, y);
+                    if (SparsePattern::isTraced(pixel, stride, offset)) continue;
+                    SparsePattern::Interpolation interpolation = SparsePattern::getInterpolation(pixel, size, stride, offset);
+                    float weightSum = 0.f;
+                    for (uint32_t s = 0; s < 4; s++) {
+                        glm::uvec2 sample = interpolation.samples[s];
+                        badSamples += sample.x >= size.x || sample.y >= size.y || !SparsePattern::isTraced(sample, stride, offset);
+                        badWeights += interpolation.weights[s] < 0.f;
+                        weightSum += interpolation.weights[s];
+                    }
+                    badWeights += std::abs(weightSum - 1.f) > 1e-5f;
+                    glm::uvec2 nearest = interpolation.nearest;
+                    badNearest += nearest.x >= size.x || nearest.y >= size.y || !SparsePattern::isTraced(nearest, stride, offset);
+                }
+            }
+        }
+
+        uint32_t notOnce = 0;
+        for (uint32_t count : traceCounts) notOnce += count != 1;
+        CHECK_EQUAL(notOnce, 0u);
+        CHECK_EQUAL(badOffsets, 0u);
+        CHECK_EQUAL(badLaunches, 0u);
+        CHECK_EQUAL(wrongCounts, 0u);
+        CHECK_EQUAL(badSamples, 0u);
+        CHECK_EQUAL(badWeights, 0u);
+        CHECK_EQUAL(badNearest, 0u);
+    }
+};
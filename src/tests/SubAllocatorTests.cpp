@@ -0,0 +1,102 @@
+#include "tests/Tests.h"
+
+#include "tools/SubAllocator.h"
+
+namespace Tests {
+
+    // function implimentations
+
+    void subAllocator() {
+        using namespace Memory;
+
+        // buddy splits: 100 bytes round up to a 128 block, the rest of the range splits into 128, 256 and 512
+        BuddyAllocator buddy(1024, 64);
+        CHECK_EQUAL(buddy.getFreeBlockCount(), 1u);
+        CHECK_EQUAL(buddy.allocate(100, 1), 0ull);
+        CHECK_EQUAL(buddy.getUsed(), 128ull);
+        CHECK_EQUAL(buddy.getFreeBlockCount(), 3u);
+        CHECK_EQUAL(buddy.getLargestFreeBlock(), 512ull);
+        CHECK_EQUAL(buddy.allocate(64, 1), 128ull);
+        CHECK_EQUAL(buddy.allocate(64, 1), 192ull);
+        CHECK_EQUAL(buddy.allocate(0, 1), INVALID_OFFSET);
+        CHECK_EQUAL(buddy.allocate(2048, 1), INVALID_OFFSET);
+
+        // freeing merges buddies back into the whole range
+        CHECK(buddy.free(128));
+        CHECK(buddy.free(0));
+        CHECK_EQUAL(buddy.getLargestFreeBlock(), 512ull);
+        CHECK(buddy.free(192));
+        CHECK_EQUAL(buddy.getFreeBlockCount(), 1u);
+        CHECK_EQUAL(buddy.getLargestFreeBlock(), 1024ull);
+        CHECK_EQUAL(buddy.getUsed(), 0ull);
+        CHECK_EQUAL(buddy.getAllocationCount(), 0u);
+        CHECK(!buddy.free(0));
+        CHECK(!buddy.free(64));
+
+        // only buddies merge, 256 and 512 sit in different 512 halves
+        for (uint64_t i = 0; i < 4; i++) CHECK_EQUAL(buddy.allocate(256, 1), i * 256);
+        CHECK_EQUAL(buddy.allocate(1, 1), INVALID_OFFSET);
+        CHECK(buddy.free(256));
+        CHECK(buddy.free(512));
+        CHECK_EQUAL(buddy.getFreeBlockCount(), 2u);
+        CHECK_EQUAL(buddy.getLargestFreeBlock(), 256ull);
+        CHECK_NEAR(fragmentation(buddy.getSize() - buddy.getUsed(), buddy.getLargestFreeBlock()), 0.5f, 1e-6f);
+        CHECK(buddy.free(0));
+        CHECK_EQUAL(buddy.getLargestFreeBlock(), 512ull);
+        CHECK(buddy.free(768));
+        CHECK_EQUAL(buddy.getFreeBlockCount(), 1u);
+        CHECK_EQUAL(buddy.getLargestFreeBlock(), 1024ull);
+
+        // alignment above the size takes a block as big as the alignment
+        CHECK_EQUAL(buddy.allocate(64, 1), 0ull);
+        uint64_t aligned = buddy.allocate(64, 256);
+        CHECK_EQUAL(aligned % 256, 0ull);
+        CHECK_EQUAL(aligned, 256ull);
+        CHECK_EQUAL(buddy.getUsed(), 64ull + 256ull);
+        CHECK(buddy.free(0));
+        CHECK(buddy.free(aligned));
+        CHECK_EQUAL(buddy.getLargestFreeBlock(), 1024ull);
+
+        // linear allocator aligns the head and only resets once everything is freed
+        LinearAllocator linear(256);
+        CHECK(!linear.free(0));
+        CHECK_EQUAL(linear.allocate(10, 1), 0ull);
+        CHECK_EQUAL(linear.allocate(10, 16), 16ull);
+        CHECK_EQUAL(linear.getUsed(), 26ull);
+        CHECK_EQUAL(linear.allocate(300, 1), INVALID_OFFSET);
+        // past the head can't be an allocation, the count stays
+        CHECK(!linear.free(26));
+        CHECK_EQUAL(linear.getAllocationCount(), 2u);
+        CHECK(linear.free(16));
+        CHECK_EQUAL(linear.getUsed(), 26ull);
+        CHECK(linear.free(0));
+        CHECK_EQUAL(linear.getUsed(), 0ull);
+        CHECK(!linear.free(0));
+
+        // ring skips the end of the ring once the oldest frame is released
+        RingAllocator ring(1024);
+        CHECK_EQUAL(ring.allocate(600, 1), 0ull);
+        ring.closeFrame(0);
+        CHECK_EQUAL(ring.allocate(300, 1), 600ull);
+        ring.closeFrame(1);
+        CHECK_EQUAL(ring.allocate(500, 1), INVALID_OFFSET);
+        ring.releaseFrame(0);
+        CHECK_EQUAL(ring.getOldestFrame(), 1u);
+        CHECK_EQUAL(ring.allocate(500, 1), 0ull);
+        CHECK_EQUAL(ring.getUsed(), 300ull + 124ull + 500ull);
+        ring.closeFrame(2);
+        ring.releaseFrame(2);
+        CHECK_EQUAL(ring.getUsed(), 0ull);
+        CHECK_EQUAL(ring.getOldestFrame(), UINT32_MAX);
+
+        // anything over half a block gets its own memory
+        CHECK(!needsDedicatedBlock(128, 256));
+        CHECK(needsDedicatedBlock(129, 256));
+        CHECK(!needsDedicatedBlock(1, 256));
+
+        // fragmentation report
+        CHECK_NEAR(fragmentation(0, 0), 0.f, 1e-6f);
+        CHECK_NEAR(fragmentation(1024, 1024), 0.f, 1e-6f);
+        CHECK_NEAR(fragmentation(1024, 256), 0.75f, 1e-6f);
+    }
+};
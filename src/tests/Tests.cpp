@@ -0,0 +1,57 @@
+#include "tests/Tests.h"
+
+#include "tools/JobSystem.h"
+
+#include <stdlib.h>
+
+namespace Tests {
+
+    // private variables
+
+    struct _Test {
+        const char* name;
+        void (*run)();
+    };
+
+    const _Test tests[] = {
+        { "AABB", aabb },
+        { "BVH", bvh },
+        { "BVHBuilder", bvhBuilder },
+        { "ClusterPlanner", clusterPlanner },
+        { "IDRegion", idRegion },
+        { "JobSystem", jobSystem },
+        { "PacketTraversal", packetTraversal },
+        { "RadixSort", radixSort },
+        { "SlotMap", slotMap },
+        { "SparsePattern", sparsePattern },
+        { "SubAllocator", subAllocator },
+    };
+
+    uint32_t failureCount = 0;
+
+    // function implimentations
+
+    void fail(const char* file, int line, const std::string& message) {
+        failureCount++;
+        AID_WARN("FAILED {} [line: {}]: {}", file, line, message);
+    }
+
+    uint32_t getFailureCount() { return failureCount; }
+};
+
+// ENTRY POINT
+
+int main() {
+    Log::init();
+    JobSystem::init();
+
+    for (const Tests::_Test& test : Tests::tests) {
+        uint32_t failuresBefore = Tests::getFailureCount();
+        test.run();
+        AID_REPORT("{}: {}", test.name, Tests::getFailureCount() == failuresBefore ? "passed" : "FAILED");
+    }
+
+    JobSystem::shutdown();
+    AID_REPORT("{} failed checks", Tests::getFailureCount());
+    return Tests::getFailureCount() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
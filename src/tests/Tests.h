@@ -0,0 +1,41 @@
+#pragma once
+
+#include "tools/Log.h"
+
+#include <cmath>
+#include <stdint.h>
+
+/*
+    Checks for the pure CPU modules, built into the AidanicTests executable and run by ctest. Each module has one test
+    function in tests/<Module>Tests.cpp that reports failed checks with the macros below and keeps going, the
+    executable exits with a failure when any check failed.
+*/
+namespace Tests {
+
+    // public function declarations
+
+    void fail(const char* file, int line, const std::string& message);
+    uint32_t getFailureCount();
+
+    // one per module
+    void aabb();
+    void bvh();
+    void bvhBuilder();
+    void clusterPlanner();
+    void idRegion();
+    void jobSystem();
+    void packetTraversal();
+    void radixSort();
+    void slotMap();
+    void sparsePattern();
+    void subAllocator();
+};
+
+// CHECK MACROS
+
+#define CHECK(_CONDITION) \
+    if (!(_CONDITION)) Tests::fail(__FILE__, __LINE__, #_CONDITION)
+#define CHECK_EQUAL(_A, _B) \
+    if (!((_A) == (_B))) Tests::fail(__FILE__, __LINE__, std::string(#_A " == " #_B ", ") + std::to_string(_A) + " vs " + std::to_string(_B))
+#define CHECK_NEAR(_A, _B, _TOLERANCE) \
+    if (!(std::abs((_A) - (_B)) <= (_TOLERANCE))) Tests::fail(__FILE__, __LINE__, std::string(#_A " ~ " #_B ", ") + std::to_string(_A) + " vs " + std::to_string(_B))
@@ -0,0 +1,64 @@
+#include "AABB.h"
+
+#include "tools/Intersection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// absolute, the distance at which the intersection shader's march counts as a hit (EPSILON in shaders/common.glsl)
+#define AABB_MARGIN 0.0001f
+
+namespace Vk {
+
+    AABB::AABB(Model::Sphere sphere) {
+        glm::vec3 center = glm::vec3(sphere.posRadius);
+        glm::vec3 halfExtent = glm::vec3(sphere.posRadius.w + AABB_MARGIN);
+        *this = AABB(center - halfExtent, center + halfExtent);
+    }
+
+    AABB::AABB(Model::Ellipsoid ellipsoid) {
+        // the extent along a world axis is the length of that row of rotation * diag(radius)
+        glm::vec3 axisX = Spatial::rotate(ellipsoid.rotation, glm::vec3(ellipsoid.radius.x, 0.f, 0.f));
+        glm::vec3 axisY = Spatial::rotate(ellipsoid.rotation, glm::vec3(0.f, ellipsoid.radius.y, 0.f));
+        glm::vec3 axisZ = Spatial::rotate(ellipsoid.rotation, glm::vec3(0.f, 0.f, ellipsoid.radius.z));
+        glm::vec3 halfExtent(
+            std::sqrt(axisX.x * axisX.x + axisY.x * axisY.x + axisZ.x * axisZ.x),
+            std::sqrt(axisX.y * axisX.y + axisY.y * axisY.y + axisZ.y * axisZ.y),
+            std::sqrt(axisX.z * axisX.z + axisY.z * axisY.z + axisZ.z * axisZ.z));
+        halfExtent += glm::vec3(AABB_MARGIN);
+
+        glm::vec3 center = glm::vec3(ellipsoid.center);
+        *this = AABB(center - halfExtent, center + halfExtent);
+    }
+
+    AABB AABB::empty() {
+        float inf = std::numeric_limits<float>::infinity();
+        return AABB(glm::vec3(inf), glm::vec3(-inf));
+    }
+
+    float AABB::surfaceArea() const {
+        if (isEmpty()) return 0.f;
+        glm::vec3 e = extent();
+        return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    void AABB::grow(const AABB& other) {
+        aabb_minx = std::min(aabb_minx, other.aabb_minx);
+        aabb_miny = std::min(aabb_miny, other.aabb_miny);
+        aabb_minz = std::min(aabb_minz, other.aabb_minz);
+        aabb_maxx = std::max(aabb_maxx, other.aabb_maxx);
+        aabb_maxy = std::max(aabb_maxy, other.aabb_maxy);
+        aabb_maxz = std::max(aabb_maxz, other.aabb_maxz);
+    }
+
+    void AABB::grow(glm::vec3 point) {
+        grow(AABB(point, point));
+    }
+
+    bool AABB::overlaps(const AABB& other) const {
+        return aabb_minx <= other.aabb_maxx && aabb_maxx >= other.aabb_minx &&
+               aabb_miny <= other.aabb_maxy && aabb_maxy >= other.aabb_miny &&
+               aabb_minz <= other.aabb_maxz && aabb_maxz >= other.aabb_minz;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Model.h"
+
+#include <glm.hpp>
+
+namespace Vk {
+
+    // layout matches VkAabbPositionsKHR, used directly as BLAS aabb data
+    struct AABB {
+        float aabb_minx;
+        float aabb_miny;
+        float aabb_minz;
+        float aabb_maxx;
+        float aabb_maxy;
+        float aabb_maxz;
+
+        AABB() {}
+        AABB(glm::vec3 min, glm::vec3 max) :
+            aabb_minx(min.x), aabb_miny(min.y), aabb_minz(min.z), aabb_maxx(max.x), aabb_maxy(max.y), aabb_maxz(max.z) {}
+        // exact bounds plus AABB_MARGIN
+        AABB(Model::Sphere sphere);
+        AABB(Model::Ellipsoid ellipsoid);
+
+        // inverted box, growing it by anything gives that thing's bounds
+        static AABB empty();
+
+        glm::vec3 minPoint() const { return glm::vec3(aabb_minx, aabb_miny, aabb_minz); }
+        glm::vec3 maxPoint() const { return glm::vec3(aabb_maxx, aabb_maxy, aabb_maxz); }
+        glm::vec3 center() const { return (minPoint() + maxPoint()) * 0.5f; }
+        glm::vec3 extent() const { return maxPoint() - minPoint(); }
+        bool isEmpty() const { return aabb_minx > aabb_maxx; }
+
+        float surfaceArea() const;
+        void grow(const AABB& other);
+        void grow(glm::vec3 point);
+        bool overlaps(const AABB& other) const;
+    };
+}
@@ -0,0 +1,102 @@
+#include "BVH.h"
+
+#include "tools/BVHBuilder.h"
+
+namespace Spatial {
+
+    bool sameBounds(const Vk::AABB& a, const Vk::AABB& b) {
+        return a.aabb_minx == b.aabb_minx && a.aabb_miny == b.aabb_miny && a.aabb_minz == b.aabb_minz &&
+               a.aabb_maxx == b.aabb_maxx && a.aabb_maxy == b.aabb_maxy && a.aabb_maxz == b.aabb_maxz;
+    }
+
+    void BVH::build(const uint32_t* keys, const Vk::AABB* aabbs, uint32_t count, BuildMethod method) {
+        clear();
+        if (count == 0) return;
+
+        BinaryBVH tree = method == BuildMethod::LBVH ? buildLBVH(aabbs, count) : buildBinnedSAH(aabbs, count);
+        nodes = std::move(tree.nodes);
+        depth = tree.depth;
+        const std::vector<uint32_t>& order = tree.primitiveOrder;
+
+        // primitives in leaf order
+        uint32_t maxKey = 0;
+        primitiveKeys.resize(count);
+        primitiveBounds.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            primitiveKeys[i] = keys[order[i]];
+            primitiveBounds[i] = aabbs[order[i]];
+            maxKey = std::max(maxKey, keys[order[i]]);
+        }
+
+        primitiveLeaf.resize(count);
+        for (uint32_t n = 0; n < nodes.size(); n++) {
+            if (!nodes[n].isLeaf()) continue;
+            for (uint32_t p = nodes[n].first; p < nodes[n].first + nodes[n].count; p++) primitiveLeaf[p] = n;
+        }
+
+        keyToPrimitive.assign(static_cast<size_t>(maxKey) + 1, INVALID_INDEX);
+        for (uint32_t p = 0; p < count; p++) keyToPrimitive[primitiveKeys[p]] = p;
+        leafDirty.assign(nodes.size(), false);
+    }
+
+    void BVH::clear() {
+        nodes.clear();
+        primitiveKeys.clear();
+        primitiveBounds.clear();
+        primitiveLeaf.clear();
+        keyToPrimitive.clear();
+        dirtyLeaves.clear();
+        leafDirty.clear();
+        removedCount = 0;
+        depth = 0;
+    }
+
+    void BVH::update(uint32_t key, const Vk::AABB& aabb) {
+        if (!contains(key)) return;
+        uint32_t primitive = keyToPrimitive[key];
+        if (primitiveBounds[primitive].isEmpty()) return; // removed
+
+        primitiveBounds[primitive] = aabb;
+        markDirty(primitive);
+    }
+
+    void BVH::remove(uint32_t key) {
+        if (!contains(key)) return;
+        uint32_t primitive = keyToPrimitive[key];
+
+        primitiveBounds[primitive] = Vk::AABB::empty();
+        keyToPrimitive[key] = INVALID_INDEX;
+        removedCount++;
+        markDirty(primitive);
+    }
+
+    void BVH::markDirty(uint32_t primitive) {
+        uint32_t leaf = primitiveLeaf[primitive];
+        if (leafDirty[leaf]) return;
+        leafDirty[leaf] = true;
+        dirtyLeaves.push_back(leaf);
+    }
+
+    void BVH::refit() {
+        for (uint32_t leaf : dirtyLeaves) {
+            leafDirty[leaf] = false;
+
+            BVHNode& node = nodes[leaf];
+            node.bounds = Vk::AABB::empty();
+            for (uint32_t p = node.first; p < node.first + node.count; p++) node.bounds.grow(primitiveBounds[p]);
+
+            // stop as soon as an ancestor doesn't change, everything above it is still valid
+            for (uint32_t n = node.parent; n != INVALID_INDEX; n = nodes[n].parent) {
+                Vk::AABB bounds = nodes[nodes[n].first].bounds;
+                bounds.grow(nodes[nodes[n].first + 1].bounds);
+                if (sameBounds(bounds, nodes[n].bounds)) break;
+                nodes[n].bounds = bounds;
+            }
+        }
+        dirtyLeaves.clear();
+    }
+
+    float BVH::sahCost() const {
+        return Spatial::sahCost(nodes);
+    }
+}
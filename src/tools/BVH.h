@@ -0,0 +1,209 @@
+#pragma once
+
+#include "tools/AABB.h"
+#include "tools/Intersection.h"
+
+#include <glm.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#define BVH_MAX_DEPTH 64 // traversal stack size, builders make leaves beyond it
+
+namespace Spatial {
+
+    enum struct BuildMethod {
+        SAH,    // binned surface area heuristic, better trees
+        LBVH    // linear, sorted by morton code. several times faster to build, for scenes that rebuild every frame
+    };
+
+    struct BVHNode {
+        Vk::AABB bounds = Vk::AABB::empty();
+        uint32_t first = 0;     // interior: left child, the right child follows it. leaf: first primitive
+        uint32_t count = 0;     // primitives in a leaf, 0 for interior nodes
+        uint32_t parent = UINT32_MAX;
+
+        bool isLeaf() const { return count > 0; }
+    };
+
+    /*
+        Binary bounding volume hierarchy over primitive aabbs, CPU only. Primitives are identified by a key (e.g. a slot
+        index) which indexes a lookup table, so keys should be dense. Built with one of the builders in BVHBuilder.h.
+        Moved primitives are handled by refitting: update()/remove() only touch the leaf, refit() then propagates all
+        changed leaves up to the root in one pass. Refitting keeps the topology, so the tree gets worse with large
+        movements, sahCost() compared to the cost right after build() tells when to rebuild.
+        Queries are const and can run on several threads at once, as long as nothing modifies the tree meanwhile.
+    */
+    class BVH {
+    public:
+        static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+        void build(const uint32_t* keys, const Vk::AABB* aabbs, uint32_t count, BuildMethod method = BuildMethod::SAH);
+        void clear();
+
+        bool contains(uint32_t key) const { return key < keyToPrimitive.size() && keyToPrimitive[key] != INVALID_INDEX; }
+        // new bounds for a primitive already in the tree, visible to queries after refit()
+        void update(uint32_t key, const Vk::AABB& aabb);
+        // the primitive keeps its leaf with empty bounds until the next build()
+        void remove(uint32_t key);
+        bool needsRefit() const { return !dirtyLeaves.empty(); }
+        void refit();
+
+        uint32_t getPrimitiveCount() const { return static_cast<uint32_t>(primitiveKeys.size()) - removedCount; }
+        uint32_t getRemovedCount() const { return removedCount; }
+        uint32_t getNodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+        uint32_t getDepth() const { return depth; }
+        const std::vector<BVHNode>& getNodes() const { return nodes; }
+        const std::vector<uint32_t>& getPrimitiveKeys() const { return primitiveKeys; } // leaf order
+        // expected node visits + primitive tests of a random ray, relative to the root surface area
+        float sahCost() const;
+
+        // closest hit. hit(key, ray) tests the primitive exactly and shortens ray.tMax on a hit, returns true if it did
+        template <class HitFunction>
+        void intersect(Ray& ray, HitFunction&& hit) const {
+            if (nodes.empty()) return;
+            glm::vec3 inverseDirection = glm::vec3(1.f) / ray.direction;
+
+            uint32_t stack[BVH_MAX_DEPTH];
+            uint32_t stackSize = 0;
+            float tEntry;
+            if (!intersectRayAABB(ray.origin, inverseDirection, ray.tMax, nodes[0].bounds, tEntry)) return;
+            stack[stackSize++] = 0;
+
+            while (stackSize > 0) {
+                const BVHNode& node = nodes[stack[--stackSize]];
+
+                if (node.isLeaf()) {
+                    for (uint32_t p = node.first; p < node.first + node.count; p++) {
+                        if (!primitiveBounds[p].isEmpty()) hit(primitiveKeys[p], ray);
+                    }
+                    continue;
+                }
+
+                // nearer child on top of the stack, boxes are tested against the shortened ray when popped
+                float tLeft, tRight;
+                bool hitLeft = intersectRayAABB(ray.origin, inverseDirection, ray.tMax, nodes[node.first].bounds, tLeft);
+                bool hitRight = intersectRayAABB(ray.origin, inverseDirection, ray.tMax, nodes[node.first + 1].bounds, tRight);
+                if (hitLeft && hitRight) {
+                    bool leftFirst = tLeft <= tRight;
+                    stack[stackSize++] = leftFirst ? node.first + 1 : node.first;
+                    stack[stackSize++] = leftFirst ? node.first : node.first + 1;
+                } else if (hitLeft) {
+                    stack[stackSize++] = node.first;
+                } else if (hitRight) {
+                    stack[stackSize++] = node.first + 1;
+                }
+            }
+        }
+
+        // any hit, stops at the first primitive hit(key, ray) returns true for. for shadow rays
+        template <class HitFunction>
+        bool intersectAny(const Ray& ray, HitFunction&& hit) const {
+            if (nodes.empty()) return false;
+            glm::vec3 inverseDirection = glm::vec3(1.f) / ray.direction;
+
+            uint32_t stack[BVH_MAX_DEPTH];
+            uint32_t stackSize = 0;
+            float tEntry;
+            if (!intersectRayAABB(ray.origin, inverseDirection, ray.tMax, nodes[0].bounds, tEntry)) return false;
+            stack[stackSize++] = 0;
+
+            while (stackSize > 0) {
+                const BVHNode& node = nodes[stack[--stackSize]];
+
+                if (node.isLeaf()) {
+                    for (uint32_t p = node.first; p < node.first + node.count; p++) {
+                        if (!primitiveBounds[p].isEmpty() && hit(primitiveKeys[p], ray)) return true;
+                    }
+                    continue;
+                }
+                if (intersectRayAABB(ray.origin, inverseDirection, ray.tMax, nodes[node.first].bounds, tEntry)) stack[stackSize++] = node.first;
+                if (intersectRayAABB(ray.origin, inverseDirection, ray.tMax, nodes[node.first + 1].bounds, tEntry)) stack[stackSize++] = node.first + 1;
+            }
+            return false;
+        }
+
+        // visit(key) for every primitive whose bounds overlap box
+        template <class VisitFunction>
+        void overlap(const Vk::AABB& box, VisitFunction&& visit) const {
+            if (nodes.empty() || !nodes[0].bounds.overlaps(box)) return;
+
+            uint32_t stack[BVH_MAX_DEPTH];
+            uint32_t stackSize = 0;
+            stack[stackSize++] = 0;
+
+            while (stackSize > 0) {
+                const BVHNode& node = nodes[stack[--stackSize]];
+
+                if (node.isLeaf()) {
+                    for (uint32_t p = node.first; p < node.first + node.count; p++) {
+                        if (!primitiveBounds[p].isEmpty() && primitiveBounds[p].overlaps(box)) visit(primitiveKeys[p]);
+                    }
+                    continue;
+                }
+                if (nodes[node.first].bounds.overlaps(box)) stack[stackSize++] = node.first;
+                if (nodes[node.first + 1].bounds.overlaps(box)) stack[stackSize++] = node.first + 1;
+            }
+        }
+
+        // k closest primitives as (squared distance, key), closest first. distanceSquared(key) must never be smaller
+        // than the squared distance from point to the primitive's bounds
+        template <class DistanceFunction>
+        void nearest(glm::vec3 point, uint32_t k, DistanceFunction&& distanceSquared, std::vector<std::pair<float, uint32_t>>& result) const {
+            result.clear();
+            if (nodes.empty() || k == 0) return;
+
+            // best first: nodes in a min heap by box distance, results in a max heap of size k
+            std::vector<std::pair<float, uint32_t>> queue;
+            queue.push_back({ Spatial::distanceSquared(point, nodes[0].bounds), 0 });
+            auto farther = [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; };
+            auto closer = [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first < b.first; };
+
+            while (!queue.empty()) {
+                std::pop_heap(queue.begin(), queue.end(), farther);
+                std::pair<float, uint32_t> entry = queue.back();
+                queue.pop_back();
+                if (result.size() == k && entry.first >= result.front().first) break;
+
+                const BVHNode& node = nodes[entry.second];
+                if (node.isLeaf()) {
+                    for (uint32_t p = node.first; p < node.first + node.count; p++) {
+                        if (primitiveBounds[p].isEmpty()) continue;
+                        float d = distanceSquared(primitiveKeys[p]);
+                        if (result.size() < k) {
+                            result.push_back({ d, primitiveKeys[p] });
+                            std::push_heap(result.begin(), result.end(), closer);
+                        } else if (d < result.front().first) {
+                            std::pop_heap(result.begin(), result.end(), closer);
+                            result.back() = { d, primitiveKeys[p] };
+                            std::push_heap(result.begin(), result.end(), closer);
+                        }
+                    }
+                    continue;
+                }
+
+                for (uint32_t c = node.first; c < node.first + 2; c++) {
+                    queue.push_back({ Spatial::distanceSquared(point, nodes[c].bounds), c });
+                    std::push_heap(queue.begin(), queue.end(), farther);
+                }
+            }
+
+            std::sort_heap(result.begin(), result.end(), closer);
+        }
+
+    private:
+        std::vector<BVHNode> nodes; // root first
+        std::vector<uint32_t> primitiveKeys;    // leaf order, each leaf is a contiguous run
+        std::vector<Vk::AABB> primitiveBounds;  // leaf order, empty once removed
+        std::vector<uint32_t> primitiveLeaf;    // leaf order -> node
+        std::vector<uint32_t> keyToPrimitive;   // key -> leaf order
+        std::vector<uint32_t> dirtyLeaves;
+        std::vector<bool> leafDirty;            // per node
+        uint32_t removedCount = 0;
+        uint32_t depth = 0;
+
+        void markDirty(uint32_t primitive);
+    };
+}
@@ -0,0 +1,646 @@
+#include "BVHBuilder.h"
+
+#include "tools/Morton.h"
+#include "tools/Parallel.h"
+#include "tools/RadixSort.h"
+
+#include <atomic>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// subtrees with at least this many primitives are built as their own job
+#define BVH_BUILDER_TASK_SIZE 4096
+// nodes with at least this many primitives bin on several threads
+#define BVH_BUILDER_PARALLEL_BIN_SIZE (1 << 18)
+// nodes or primitives per thread below which a linear builder pass isn't split further
+#define LBVH_MIN_ITEMS_PER_THREAD (1 << 14)
+
+namespace Spatial {
+
+    // inlined min/max pair, bounds are grown several times per primitive and level
+    struct _Bounds {
+        glm::vec3 lower;
+        glm::vec3 upper;
+
+        _Bounds() : lower(std::numeric_limits<float>::infinity()), upper(-std::numeric_limits<float>::infinity()) {}
+        _Bounds(const Vk::AABB& aabb) : lower(aabb.minPoint()), upper(aabb.maxPoint()) {}
+
+        void grow(const _Bounds& other) {
+            lower = glm::min(lower, other.lower);
+            upper = glm::max(upper, other.upper);
+        }
+        void grow(glm::vec3 point) {
+            lower = glm::min(lower, point);
+            upper = glm::max(upper, point);
+        }
+        float area() const {
+            glm::vec3 e = upper - lower;
+            return e.x < 0.f ? 0.f : 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+    };
+
+    struct _Bin {
+        _Bounds bounds;
+        uint32_t count = 0;
+    };
+
+    // only the first binCount bins per axis are used
+    struct _Bins {
+        _Bin bins[3][BVH_BUILDER_MAX_BINS];
+
+        _Bins(uint32_t binCount) {
+            for (int axis = 0; axis < 3; axis++) std::fill(bins[axis], bins[axis] + binCount, _Bin());
+        }
+
+        void merge(const _Bins& other, uint32_t binCount) {
+            for (int axis = 0; axis < 3; axis++) {
+                for (uint32_t b = 0; b < binCount; b++) {
+                    bins[axis][b].bounds.grow(other.bins[axis][b].bounds);
+                    bins[axis][b].count += other.bins[axis][b].count;
+                }
+            }
+        }
+    };
+
+    class _Builder {
+    public:
+        _Builder(const Vk::AABB* aabbs, uint32_t count, const BuildSettings& settings, BinaryBVH& out) : aabbs(aabbs), settings(settings), out(out) {
+            this->settings.binCount = std::max(2u, std::min<uint32_t>(settings.binCount, BVH_BUILDER_MAX_BINS));
+            this->settings.maxLeafSize = std::max(1u, settings.maxLeafSize);
+            threadCount = Parallel::threadCount(settings.threadCount);
+
+            centers.resize(count);
+            out.primitiveOrder.resize(count);
+            Parallel::forEachChunk(0, count, chunksFor(count), [this](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t p = begin; p < end; p++) {
+                    centers[p] = this->aabbs[p].center();
+                    this->out.primitiveOrder[p] = p;
+                }
+            });
+
+            // a binary tree with at least one primitive per leaf
+            out.nodes.resize(2 * static_cast<size_t>(count) - 1);
+        }
+
+        void build(uint32_t count) {
+            nodeCount = 1;
+            out.nodes[0].parent = UINT32_MAX;
+            buildNode(0, 0, count, 1);
+            out.nodes.resize(nodeCount);
+            out.nodes.shrink_to_fit();
+            out.depth = maxDepth;
+        }
+
+    private:
+        const Vk::AABB* aabbs;
+        BuildSettings settings;
+        BinaryBVH& out;
+        uint32_t threadCount;
+        std::vector<glm::vec3> centers;
+
+        std::atomic<uint32_t> nodeCount{ 0 };
+        std::atomic<uint32_t> maxDepth{ 0 };
+
+        uint32_t chunksFor(uint32_t size) const {
+            return std::max(1u, std::min(threadCount, size / BVH_BUILDER_PARALLEL_BIN_SIZE));
+        }
+
+        void makeLeaf(BVHNode& node, uint32_t begin, uint32_t end) {
+            node.first = begin;
+            node.count = end - begin;
+        }
+
+        void buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth) {
+            uint32_t previousDepth = maxDepth.load();
+            while (depth > previousDepth && !maxDepth.compare_exchange_weak(previousDepth, depth)) {}
+
+            BVHNode& node = out.nodes[nodeIndex];
+            uint32_t* order = out.primitiveOrder.data();
+            uint32_t count = end - begin;
+
+            // node and centroid bounds
+            _Bounds bounds, centerBounds;
+            uint32_t chunkCount = chunksFor(count);
+            if (chunkCount == 1) {
+                for (uint32_t i = begin; i < end; i++) {
+                    bounds.grow(aabbs[order[i]]);
+                    centerBounds.grow(centers[order[i]]);
+                }
+            } else {
+                std::vector<_Bounds> chunkBounds(chunkCount), chunkCenterBounds(chunkCount);
+                Parallel::forEachChunk(begin, end, chunkCount, [&](uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd) {
+                    for (uint32_t i = chunkBegin; i < chunkEnd; i++) {
+                        chunkBounds[chunk].grow(aabbs[order[i]]);
+                        chunkCenterBounds[chunk].grow(centers[order[i]]);
+                    }
+                });
+                for (uint32_t c = 0; c < chunkCount; c++) {
+                    bounds.grow(chunkBounds[c]);
+                    centerBounds.grow(chunkCenterBounds[c]);
+                }
+            }
+            node.bounds = Vk::AABB(bounds.lower, bounds.upper);
+
+            if (count == 1 || depth + 1 >= BVH_MAX_DEPTH) {
+                makeLeaf(node, begin, end);
+                return;
+            }
+
+            // bin the centroids along every axis
+            const uint32_t binCount = settings.binCount;
+            glm::vec3 centerMin = centerBounds.lower;
+            glm::vec3 extent = centerBounds.upper - centerBounds.lower;
+            glm::vec3 scale;
+            for (int axis = 0; axis < 3; axis++) scale[axis] = extent[axis] > 0.f ? binCount * (1.f - 1e-6f) / extent[axis] : 0.f;
+
+            auto binRange = [&](_Bins& bins, uint32_t rangeBegin, uint32_t rangeEnd) {
+                for (uint32_t i = rangeBegin; i < rangeEnd; i++) {
+                    glm::vec3 c = centers[order[i]];
+                    for (int axis = 0; axis < 3; axis++) {
+                        uint32_t b = std::min(binCount - 1, static_cast<uint32_t>((c[axis] - centerMin[axis]) * scale[axis]));
+                        bins.bins[axis][b].bounds.grow(aabbs[order[i]]);
+                        bins.bins[axis][b].count++;
+                    }
+                }
+            };
+
+            _Bins bins(binCount);
+            if (chunkCount == 1) {
+                binRange(bins, begin, end);
+            } else {
+                std::vector<_Bins> chunkBins(chunkCount - 1, _Bins(binCount));
+                Parallel::forEachChunk(begin, end, chunkCount, [&](uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd) {
+                    binRange(chunk == 0 ? bins : chunkBins[chunk - 1], chunkBegin, chunkEnd);
+                });
+                for (const _Bins& other : chunkBins) bins.merge(other, binCount);
+            }
+
+            // sweep: cost of splitting after bin s is area(left) * countLeft + area(right) * countRight
+            float bestCost = std::numeric_limits<float>::infinity();
+            int bestAxis = -1;
+            uint32_t bestSplit = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                if (scale[axis] == 0.f) continue;
+
+                float rightCost[BVH_BUILDER_MAX_BINS];
+                _Bounds right;
+                uint32_t rightCount = 0;
+                for (uint32_t b = binCount - 1; b > 0; b--) {
+                    right.grow(bins.bins[axis][b].bounds);
+                    rightCount += bins.bins[axis][b].count;
+                    rightCost[b] = right.area() * rightCount;
+                }
+
+                _Bounds left;
+                uint32_t leftCount = 0;
+                for (uint32_t s = 1; s < binCount; s++) {
+                    left.grow(bins.bins[axis][s - 1].bounds);
+                    leftCount += bins.bins[axis][s - 1].count;
+                    float cost = left.area() * leftCount + rightCost[s];
+                    if (cost < bestCost && leftCount > 0 && leftCount < count) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = s;
+                    }
+                }
+            }
+
+            float area = bounds.area();
+            float leafCost = area * count;
+            float splitCost = settings.traversalCost * area + bestCost;
+            if (count <= settings.maxLeafSize && leafCost <= splitCost) {
+                makeLeaf(node, begin, end);
+                return;
+            }
+
+            uint32_t mid;
+            if (bestAxis >= 0) {
+                mid = static_cast<uint32_t>(std::partition(order + begin, order + end, [&](uint32_t p) {
+                    return std::min(binCount - 1, static_cast<uint32_t>((centers[p][bestAxis] - centerMin[bestAxis]) * scale[bestAxis])) < bestSplit;
+                }) - order);
+            } else {
+                // all centroids in one point, any split is as good as another
+                mid = begin + count / 2;
+            }
+
+            uint32_t left = nodeCount.fetch_add(2);
+            out.nodes[left].parent = nodeIndex;
+            out.nodes[left + 1].parent = nodeIndex;
+            node.first = left;
+            node.count = 0;
+
+            // idle threads steal the left subtree, or this one builds it after the right one
+            if (count >= BVH_BUILDER_TASK_SIZE && threadCount > 1) {
+                JobSystem::JobGroup group;
+                auto buildLeft = [this, left, begin, mid, depth]() { buildNode(left, begin, mid, depth + 1); };
+                JobSystem::run(group, buildLeft);
+                buildNode(left + 1, mid, end, depth + 1);
+                JobSystem::wait(group);
+            } else {
+                buildNode(left, begin, mid, depth + 1);
+                buildNode(left + 1, mid, end, depth + 1);
+            }
+        }
+    };
+
+    BinaryBVH buildBinnedSAH(const Vk::AABB* aabbs, uint32_t count, const BuildSettings& settings) {
+        BinaryBVH bvh;
+        if (count == 0) return bvh;
+
+        _Builder builder(aabbs, count, settings, bvh);
+        builder.build(count);
+        return bvh;
+    }
+
+    // 64 for 0
+    inline uint32_t countLeadingZeros(uint64_t v) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        return _BitScanReverse64(&index, v) ? 63 - index : 64;
+#else
+        return v == 0 ? 64 : __builtin_clzll(v);
+#endif
+    }
+
+    /*
+        Karras' layout: internal node i covers a run of sorted primitives that starts or ends at i, internal nodes are
+        [0, count - 1) with the root at 0. Its children are the internal nodes or single primitives left and right of
+        the split, which is the first bit where the codes in the run differ (or their index when codes repeat).
+        Output: runs of at most maxLeafSize become leaves, and the children of the interior node with rank r (counting
+        interior internal nodes in index order) go to 2r + 1 and 2r + 2, so every interior node is placed without
+        knowing anything about the rest of the tree.
+    */
+    template <class Key>
+    class _LinearBuilder {
+    public:
+        _LinearBuilder(const Vk::AABB* aabbs, uint32_t count, const BuildSettings& settings, BinaryBVH& out) :
+            aabbs(aabbs), count(count), out(out) {
+            maxLeafSize = std::max(1u, settings.maxLeafSize);
+            threadCount = Parallel::threadCount(settings.threadCount);
+        }
+
+        void build() {
+            sortPrimitives();
+            if (count <= maxLeafSize) {
+                _Bounds bounds;
+                for (uint32_t i = 0; i < count; i++) bounds.grow(aabbs[i]);
+                out.nodes.resize(1);
+                out.nodes[0].bounds = Vk::AABB(bounds.lower, bounds.upper);
+                out.nodes[0].first = 0;
+                out.nodes[0].count = count;
+                out.depth = 1;
+                return;
+            }
+
+            uint32_t internalCount = count - 1;
+            children.resize(2 * static_cast<size_t>(internalCount));
+            ranges.resize(2 * static_cast<size_t>(internalCount));
+            parents.resize(internalCount + static_cast<size_t>(count));
+            parents[0] = NONE;
+            Parallel::forEachChunk(0, internalCount, chunksFor(internalCount), [this](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) findChildren(i);
+            });
+
+            computeBounds();
+            markInterior();
+            emit();
+        }
+
+    private:
+        static constexpr uint32_t LEAF = 0x80000000u;  // child flag, the rest is a sorted primitive
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        const Vk::AABB* aabbs;
+        uint32_t count;
+        BinaryBVH& out;
+        uint32_t maxLeafSize;
+        uint32_t threadCount;
+
+        std::vector<Key> codes;             // sorted
+        std::vector<uint32_t> children;     // 2 per internal node
+        std::vector<uint32_t> ranges;       // first and last sorted primitive per internal node
+        std::vector<uint32_t> parents;      // internal nodes, then sorted primitives
+        std::vector<_Bounds> bounds;        // internal nodes
+        std::vector<uint32_t> heights;      // internal nodes, levels below them in the output tree
+        std::vector<uint8_t> interior;      // internal nodes that stay interior in the output
+        std::vector<uint32_t> ranks;        // among interior nodes
+
+        uint32_t chunksFor(uint32_t size) const {
+            return std::max(1u, std::min(threadCount, size / LBVH_MIN_ITEMS_PER_THREAD));
+        }
+
+        uint32_t rangeSize(uint32_t node) const { return ranges[2 * node + 1] - ranges[2 * node] + 1; }
+
+        void sortPrimitives() {
+            // morton codes relative to the bounds of the centers
+            uint32_t chunkCount = chunksFor(count);
+            std::vector<_Bounds> chunkBounds(chunkCount);
+            Parallel::forEachChunk(0, count, chunkCount, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) chunkBounds[chunk].grow(aabbs[i].center());
+            });
+            _Bounds centerBounds;
+            for (const _Bounds& b : chunkBounds) centerBounds.grow(b);
+
+            glm::vec3 extent = centerBounds.upper - centerBounds.lower;
+            glm::vec3 inverseExtent(
+                extent.x > 0.f ? 1.f / extent.x : 0.f,
+                extent.y > 0.f ? 1.f / extent.y : 0.f,
+                extent.z > 0.f ? 1.f / extent.z : 0.f);
+
+            codes.resize(count);
+            out.primitiveOrder.resize(count);
+            Parallel::forEachChunk(0, count, chunkCount, [&](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) {
+                    glm::vec3 unitPosition = Morton::normalize(aabbs[i].center(), centerBounds.lower, inverseExtent);
+                    codes[i] = sizeof(Key) == 4 ? static_cast<Key>(Morton::encode30(unitPosition)) : static_cast<Key>(Morton::encode63(unitPosition));
+                    out.primitiveOrder[i] = i;
+                }
+            });
+            RadixSort::sort(codes, out.primitiveOrder, threadCount);
+        }
+
+        // length of the common prefix of the codes at a and b, repeated codes are told apart by their index
+        int delta(int64_t a, int64_t b) const {
+            if (b < 0 || b >= count) return -1;
+            Key x = codes[a], y = codes[b];
+            return x == y ? 64 + static_cast<int>(countLeadingZeros(static_cast<uint64_t>(a ^ b))) : static_cast<int>(countLeadingZeros(static_cast<uint64_t>(x ^ y)));
+        }
+
+        void findChildren(uint32_t node) {
+            int64_t i = node;
+
+            // the run extends towards the neighbour with the longer common prefix
+            int64_t direction = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+            int deltaMin = delta(i, i - direction);
+            int64_t lengthMax = 2;
+            while (delta(i, i + lengthMax * direction) > deltaMin) lengthMax *= 2;
+            int64_t length = 0;
+            for (int64_t t = lengthMax / 2; t >= 1; t /= 2) {
+                if (delta(i, i + (length + t) * direction) > deltaMin) length += t;
+            }
+            int64_t j = i + length * direction;
+
+            // split: the last primitive sharing more than the run's common prefix with i
+            int deltaNode = delta(i, j);
+            int64_t split = 0;
+            int64_t t = length;
+            do {
+                t = (t + 1) / 2;
+                if (delta(i, i + (split + t) * direction) > deltaNode) split += t;
+            } while (t > 1);
+            uint32_t gamma = static_cast<uint32_t>(i + split * direction + std::min<int64_t>(direction, 0));
+
+            uint32_t first = static_cast<uint32_t>(std::min(i, j));
+            uint32_t last = static_cast<uint32_t>(std::max(i, j));
+            uint32_t left = gamma == first ? LEAF | gamma : gamma;
+            uint32_t right = gamma + 1 == last ? LEAF | (gamma + 1) : gamma + 1;
+
+            children[2 * node] = left;
+            children[2 * node + 1] = right;
+            ranges[2 * node] = first;
+            ranges[2 * node + 1] = last;
+            parents[left & LEAF ? count - 1 + (left & ~LEAF) : left] = node;
+            parents[right & LEAF ? count - 1 + (right & ~LEAF) : right] = node;
+        }
+
+        // every primitive walks up, the second one to reach a node computes it and continues
+        void computeBounds() {
+            uint32_t internalCount = count - 1;
+            bounds.resize(internalCount);
+            heights.resize(internalCount);
+            std::unique_ptr<std::atomic<uint32_t>[]> arrivals(new std::atomic<uint32_t>[internalCount]);
+            for (uint32_t i = 0; i < internalCount; i++) arrivals[i].store(0, std::memory_order_relaxed);
+
+            Parallel::forEachChunk(0, count, chunksFor(count), [&](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t p = begin; p < end; p++) {
+                    for (uint32_t node = parents[internalCount + p]; node != NONE; node = parents[node]) {
+                        if (arrivals[node].fetch_add(1, std::memory_order_acq_rel) == 0) break;
+
+                        _Bounds nodeBounds;
+                        uint32_t height = 0;
+                        for (uint32_t c = 0; c < 2; c++) {
+                            uint32_t child = children[2 * node + c];
+                            if (child & LEAF) {
+                                nodeBounds.grow(aabbs[out.primitiveOrder[child & ~LEAF]]);
+                            } else {
+                                nodeBounds.grow(bounds[child]);
+                                height = std::max(height, heights[child]);
+                            }
+                        }
+                        bounds[node] = nodeBounds;
+                        heights[node] = rangeSize(node) <= maxLeafSize ? 0 : height + 1;
+                    }
+                }
+            });
+        }
+
+        void markInterior() {
+            uint32_t internalCount = count - 1;
+            interior.resize(internalCount);
+            out.depth = heights[0] + 1;
+            if (out.depth < BVH_MAX_DEPTH) {
+                Parallel::forEachChunk(0, internalCount, chunksFor(internalCount), [this](uint32_t, uint32_t begin, uint32_t end) {
+                    for (uint32_t i = begin; i < end; i++) interior[i] = rangeSize(i) > maxLeafSize;
+                });
+                return;
+            }
+
+            // too deep for the traversal stacks, like the SAH builder make leaves at the depth limit
+            std::fill(interior.begin(), interior.end(), 0);
+            std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0u, 1u } }; // node, depth
+            while (!stack.empty()) {
+                std::pair<uint32_t, uint32_t> entry = stack.back();
+                stack.pop_back();
+                if (rangeSize(entry.first) <= maxLeafSize || entry.second + 1 >= BVH_MAX_DEPTH) continue;
+
+                interior[entry.first] = 1;
+                for (uint32_t c = 0; c < 2; c++) {
+                    uint32_t child = children[2 * entry.first + c];
+                    if (!(child & LEAF)) stack.push_back({ child, entry.second + 1 });
+                }
+            }
+            out.depth = BVH_MAX_DEPTH - 1;
+        }
+
+        uint32_t outputIndex(uint32_t node) const {
+            if (node == 0) return 0;
+            uint32_t parent = parents[node];
+            return 2 * ranks[parent] + (children[2 * parent] == node ? 1 : 2);
+        }
+
+        void emit() {
+            uint32_t internalCount = count - 1;
+
+            // exclusive prefix sum of the interior flags
+            uint32_t chunkCount = chunksFor(internalCount);
+            std::vector<uint32_t> chunkSums(chunkCount + 1, 0);
+            ranks.resize(internalCount);
+            Parallel::forEachChunk(0, internalCount, chunkCount, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) chunkSums[chunk + 1] += interior[i];
+            });
+            for (uint32_t c = 0; c < chunkCount; c++) chunkSums[c + 1] += chunkSums[c];
+            Parallel::forEachChunk(0, internalCount, chunkCount, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+                uint32_t rank = chunkSums[chunk];
+                for (uint32_t i = begin; i < end; i++) {
+                    ranks[i] = rank;
+                    rank += interior[i];
+                }
+            });
+
+            // interior nodes write themselves and their leaf children
+            out.nodes.resize(2 * static_cast<size_t>(chunkSums[chunkCount]) + 1);
+            Parallel::forEachChunk(0, internalCount, chunkCount, [&](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) {
+                    if (!interior[i]) continue;
+
+                    uint32_t index = outputIndex(i);
+                    BVHNode& node = out.nodes[index];
+                    node.bounds = Vk::AABB(bounds[i].lower, bounds[i].upper);
+                    node.first = 2 * ranks[i] + 1;
+                    node.count = 0;
+                    node.parent = i == 0 ? NONE : outputIndex(parents[i]);
+
+                    for (uint32_t c = 0; c < 2; c++) {
+                        uint32_t child = children[2 * i + c];
+                        if (!(child & LEAF) && interior[child]) continue;
+
+                        BVHNode& leaf = out.nodes[node.first + c];
+                        leaf.parent = index;
+                        if (child & LEAF) {
+                            leaf.bounds = aabbs[out.primitiveOrder[child & ~LEAF]];
+                            leaf.first = child & ~LEAF;
+                            leaf.count = 1;
+                        } else {
+                            leaf.bounds = Vk::AABB(bounds[child].lower, bounds[child].upper);
+                            leaf.first = ranges[2 * child];
+                            leaf.count = rangeSize(child);
+                        }
+                    }
+                }
+            });
+        }
+    };
+
+    BinaryBVH buildLBVH(const Vk::AABB* aabbs, uint32_t count, const BuildSettings& settings) {
+        BinaryBVH bvh;
+        if (count == 0) return bvh;
+
+        if (settings.mortonBits > 32) {
+            _LinearBuilder<uint64_t> builder(aabbs, count, settings, bvh);
+            builder.build();
+        } else {
+            _LinearBuilder<uint32_t> builder(aabbs, count, settings, bvh);
+            builder.build();
+        }
+        return bvh;
+    }
+
+    float sahCost(const std::vector<BVHNode>& nodes, float traversalCost) {
+        if (nodes.empty() || nodes[0].bounds.isEmpty()) return 0.f;
+
+        float cost = 0.f;
+        for (const BVHNode& node : nodes) {
+            float area = node.bounds.surfaceArea();
+            cost += node.isLeaf() ? area * static_cast<float>(node.count) : area * traversalCost;
+        }
+        return cost / nodes[0].bounds.surfaceArea();
+    }
+
+    template <uint32_t N>
+    uint32_t collapseNode(const BinaryBVH& bvh, uint32_t binaryNode, WideBVH<N>& wide) {
+        uint32_t index = static_cast<uint32_t>(wide.nodes.size());
+        wide.nodes.push_back(WideNode<N>());
+
+        // open the interior child with the largest surface area until the node is full
+        uint32_t children[N];
+        uint32_t childCount = 0;
+        children[childCount++] = bvh.nodes[binaryNode].first;
+        children[childCount++] = bvh.nodes[binaryNode].first + 1;
+        while (childCount < N) {
+            int largest = -1;
+            float largestArea = -1.f;
+            for (uint32_t c = 0; c < childCount; c++) {
+                const BVHNode& child = bvh.nodes[children[c]];
+                if (!child.isLeaf() && child.bounds.surfaceArea() > largestArea) {
+                    largest = static_cast<int>(c);
+                    largestArea = child.bounds.surfaceArea();
+                }
+            }
+            if (largest < 0) break;
+
+            uint32_t opened = children[largest];
+            children[largest] = bvh.nodes[opened].first;
+            children[childCount++] = bvh.nodes[opened].first + 1;
+        }
+
+        for (uint32_t c = 0; c < N; c++) {
+            WideNode<N>& node = wide.nodes[index];
+            if (c >= childCount) {
+                node.minX[c] = node.minY[c] = node.minZ[c] = 0.f;
+                node.maxX[c] = node.maxY[c] = node.maxZ[c] = 0.f;
+                node.child[c] = WideNode<N>::EMPTY;
+                node.count[c] = 0;
+                continue;
+            }
+
+            const BVHNode& child = bvh.nodes[children[c]];
+            node.minX[c] = child.bounds.aabb_minx;
+            node.minY[c] = child.bounds.aabb_miny;
+            node.minZ[c] = child.bounds.aabb_minz;
+            node.maxX[c] = child.bounds.aabb_maxx;
+            node.maxY[c] = child.bounds.aabb_maxy;
+            node.maxZ[c] = child.bounds.aabb_maxz;
+
+            if (child.isLeaf()) {
+                node.child[c] = child.first;
+                node.count[c] = child.count;
+            } else {
+                // may reallocate wide.nodes, so node isn't used past this
+                uint32_t wideChild = collapseNode(bvh, children[c], wide);
+                wide.nodes[index].child[c] = wideChild;
+                wide.nodes[index].count[c] = 0;
+            }
+        }
+        return index;
+    }
+
+    template <uint32_t N>
+    WideBVH<N> collapse(const BinaryBVH& bvh) {
+        WideBVH<N> wide;
+        if (bvh.nodes.empty()) return wide;
+
+        wide.primitiveOrder = bvh.primitiveOrder;
+        wide.bounds = bvh.nodes[0].bounds;
+
+        if (bvh.nodes[0].isLeaf()) {
+            // single leaf under an otherwise empty root
+            WideNode<N> root;
+            for (uint32_t c = 0; c < N; c++) {
+                root.minX[c] = root.minY[c] = root.minZ[c] = 0.f;
+                root.maxX[c] = root.maxY[c] = root.maxZ[c] = 0.f;
+                root.child[c] = WideNode<N>::EMPTY;
+                root.count[c] = 0;
+            }
+            root.minX[0] = wide.bounds.aabb_minx;
+            root.minY[0] = wide.bounds.aabb_miny;
+            root.minZ[0] = wide.bounds.aabb_minz;
+            root.maxX[0] = wide.bounds.aabb_maxx;
+            root.maxY[0] = wide.bounds.aabb_maxy;
+            root.maxZ[0] = wide.bounds.aabb_maxz;
+            root.child[0] = bvh.nodes[0].first;
+            root.count[0] = bvh.nodes[0].count;
+            wide.nodes.push_back(root);
+            return wide;
+        }
+
+        wide.nodes.reserve(bvh.nodes.size() / (N - 1) + 1);
+        collapseNode<N>(bvh, 0, wide);
+        return wide;
+    }
+
+    template WideBVH<4> collapse<4>(const BinaryBVH& bvh);
+    template WideBVH<8> collapse<8>(const BinaryBVH& bvh);
+}
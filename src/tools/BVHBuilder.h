@@ -0,0 +1,132 @@
+#pragma once
+
+#include "tools/AABB.h"
+#include "tools/BVH.h"
+#include "tools/Intersection.h"
+
+#include <glm.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#define BVH_BUILDER_MAX_BINS 32
+
+/*
+    Top down binned SAH builder over primitive aabbs. At every node the centroids are binned along all three axes and
+    the split with the lowest surface area heuristic cost is taken, or a leaf when that is cheaper. Subtrees above a
+    size threshold are built on their own thread, and the binning of the largest nodes (near the root, where there is
+    no subtree parallelism yet) is split across threads too.
+    The linear (LBVH) builder trades tree quality for speed, for scenes that rebuild every frame: primitives are sorted
+    by the morton code of their center (RadixSort.h) and every interior node is found from the sorted codes on its own
+    (Karras 2012, "Maximizing parallelism in the construction of BVHs, octrees, and k-d trees"), so all steps run in
+    parallel. Compare sahCost() of both builders to choose for a scene.
+    The binary tree can be collapsed into 4 or 8 wide nodes that store their children's bounds as separate min/max
+    arrays per axis, so a ray is tested against all children of a node in one vectorizable loop.
+    Pure CPU code, doesn't touch vulkan.
+*/
+namespace Spatial {
+
+    struct BuildSettings {
+        uint32_t maxLeafSize = 4;       // larger leaves are only made at BVH_MAX_DEPTH
+        uint32_t binCount = 16;         // at most BVH_BUILDER_MAX_BINS
+        uint32_t threadCount = 0;       // 0 = all threads of the job system
+        float traversalCost = 1.f;      // of a node relative to one primitive test
+        uint32_t mortonBits = 30;       // linear builder only, 30 (10 per axis) or 63 (21 per axis)
+    };
+
+    struct BinaryBVH {
+        std::vector<BVHNode> nodes;             // root first, the children of a node are adjacent
+        std::vector<uint32_t> primitiveOrder;   // leaves reference runs of it, values index the input aabbs
+        uint32_t depth = 0;
+    };
+
+    BinaryBVH buildBinnedSAH(const Vk::AABB* aabbs, uint32_t count, const BuildSettings& settings = BuildSettings());
+    // binCount and traversalCost are ignored, subtrees with at most maxLeafSize primitives become leaves
+    BinaryBVH buildLBVH(const Vk::AABB* aabbs, uint32_t count, const BuildSettings& settings = BuildSettings());
+
+    // expected node visits + primitive tests of a random ray, relative to the root surface area
+    float sahCost(const std::vector<BVHNode>& nodes, float traversalCost = 1.f);
+
+    template <uint32_t N>
+    struct WideNode {
+        static constexpr uint32_t EMPTY = UINT32_MAX;
+
+        // child bounds, structure of arrays
+        float minX[N], minY[N], minZ[N];
+        float maxX[N], maxY[N], maxZ[N];
+        uint32_t child[N];  // interior: wide node index, leaf: first entry of primitiveOrder, EMPTY for unused slots
+        uint32_t count[N];  // primitives of a leaf child, 0 for interior children
+    };
+
+    template <uint32_t N>
+    struct WideBVH {
+        std::vector<WideNode<N>> nodes; // root first
+        std::vector<uint32_t> primitiveOrder;
+        Vk::AABB bounds = Vk::AABB::empty();
+
+        // closest hit. hit(primitive, ray) tests an input primitive exactly and shortens ray.tMax on a hit
+        template <class HitFunction>
+        void intersect(Ray& ray, HitFunction&& hit) const {
+            if (nodes.empty()) return;
+            glm::vec3 inverseDirection = glm::vec3(1.f) / ray.direction;
+            float tRoot;
+            if (!intersectRayAABB(ray.origin, inverseDirection, ray.tMax, bounds, tRoot)) return;
+
+            struct _Entry {
+                uint32_t child, count;
+                float t;
+            };
+            _Entry stack[BVH_MAX_DEPTH * N];
+            uint32_t stackSize = 0;
+            stack[stackSize++] = { 0, 0, tRoot };
+
+            const float infinity = std::numeric_limits<float>::infinity();
+            while (stackSize > 0) {
+                _Entry entry = stack[--stackSize];
+                if (entry.t > ray.tMax) continue;
+
+                if (entry.count > 0) {
+                    for (uint32_t p = entry.child; p < entry.child + entry.count; p++) hit(primitiveOrder[p], ray);
+                    continue;
+                }
+
+                // all children at once
+                const WideNode<N>& node = nodes[entry.child];
+                float tEntry[N];
+                for (uint32_t c = 0; c < N; c++) {
+                    float tx0 = (node.minX[c] - ray.origin.x) * inverseDirection.x;
+                    float tx1 = (node.maxX[c] - ray.origin.x) * inverseDirection.x;
+                    float ty0 = (node.minY[c] - ray.origin.y) * inverseDirection.y;
+                    float ty1 = (node.maxY[c] - ray.origin.y) * inverseDirection.y;
+                    float tz0 = (node.minZ[c] - ray.origin.z) * inverseDirection.z;
+                    float tz1 = (node.maxZ[c] - ray.origin.z) * inverseDirection.z;
+                    float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.f));
+                    float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), ray.tMax));
+                    tEntry[c] = tNear <= tFar && node.child[c] != WideNode<N>::EMPTY ? tNear : infinity;
+                }
+
+                // hit children sorted far to near, so the nearest is popped first
+                uint32_t first = stackSize;
+                for (uint32_t c = 0; c < N; c++) {
+                    if (tEntry[c] == infinity) continue;
+                    _Entry childEntry = { node.child[c], node.count[c], tEntry[c] };
+                    uint32_t i = stackSize++;
+                    while (i > first && stack[i - 1].t < childEntry.t) {
+                        stack[i] = stack[i - 1];
+                        i--;
+                    }
+                    stack[i] = childEntry;
+                }
+            }
+        }
+    };
+
+    using BVH4 = WideBVH<4>;
+    using BVH8 = WideBVH<8>;
+
+    // instantiated for 4 and 8
+    template <uint32_t N>
+    WideBVH<N> collapse(const BinaryBVH& bvh);
+}
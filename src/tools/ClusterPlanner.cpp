@@ -0,0 +1,78 @@
+#include "ClusterPlanner.h"
+#include "Morton.h"
+#include "RadixSort.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace ClusterPlanner {
+
+    Plan plan(const Vk::AABB* aabbs, uint32_t count, uint32_t clusterCount) {
+        Plan result;
+        if (count == 0) return result;
+        clusterCount = std::min(std::max(clusterCount, 1u), count);
+
+        // sort the aabb centers along a morton curve through the scene bounds
+
+        Vk::AABB centerBounds = Vk::AABB::empty();
+        for (uint32_t i = 0; i < count; i++) centerBounds.grow(aabbs[i].center());
+
+        glm::vec3 extent = centerBounds.extent();
+        glm::vec3 inverseExtent(
+            extent.x > 0.f ? 1.f / extent.x : 0.f,
+            extent.y > 0.f ? 1.f / extent.y : 0.f,
+            extent.z > 0.f ? 1.f / extent.z : 0.f);
+
+        std::vector<uint32_t> codes(count);
+        result.primitiveOrder.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            glm::vec3 unitPosition = Morton::normalize(aabbs[i].center(), centerBounds.minPoint(), inverseExtent);
+            codes[i] = Morton::encode30(unitPosition);
+            result.primitiveOrder[i] = i;
+        }
+        // stable, so equal codes keep their index order
+        RadixSort::sort(codes, result.primitiveOrder);
+
+        // cut the curve into runs that differ in size by at most one
+
+        uint32_t baseSize = count / clusterCount;
+        uint32_t remainder = count % clusterCount;
+        result.clusters.resize(clusterCount);
+
+        uint32_t first = 0;
+        for (uint32_t c = 0; c < clusterCount; c++) {
+            Cluster& cluster = result.clusters[c];
+            cluster.firstPrimitive = first;
+            cluster.primitiveCount = baseSize + (c < remainder ? 1 : 0);
+            for (uint32_t i = first; i < first + cluster.primitiveCount; i++)
+                cluster.bounds.grow(aabbs[result.primitiveOrder[i]]);
+            first += cluster.primitiveCount;
+        }
+
+        result.stats = computeStats(result.clusters.data(), clusterCount);
+        return result;
+    }
+
+    uint32_t clusterCountFor(uint32_t primitiveCount, uint32_t maxPrimitivesPerCluster) {
+        if (maxPrimitivesPerCluster == 0) return primitiveCount;
+        return (primitiveCount + maxPrimitivesPerCluster - 1) / maxPrimitivesPerCluster;
+    }
+
+    Stats computeStats(const Cluster* clusters, uint32_t clusterCount) {
+        Stats stats;
+        double squaredSizes = 0.0;
+
+        for (uint32_t c = 0; c < clusterCount; c++) {
+            if (clusters[c].primitiveCount == 0) continue;
+            stats.blasCount++;
+            stats.primitiveCount += clusters[c].primitiveCount;
+            stats.totalSurfaceArea += clusters[c].bounds.surfaceArea();
+            squaredSizes += static_cast<double>(clusters[c].primitiveCount) * clusters[c].primitiveCount;
+        }
+
+        // a primitive in a cluster of n primitives is picked with probability n / total and costs n aabbs to rebuild
+        if (stats.primitiveCount != 0)
+            stats.estimatedRebuildCost = static_cast<float>(squaredSizes / stats.primitiveCount);
+        return stats;
+    }
+}
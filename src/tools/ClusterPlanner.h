@@ -0,0 +1,42 @@
+#pragma once
+
+#include "tools/AABB.h"
+
+#include <stdint.h>
+#include <vector>
+
+/*
+    Groups primitive aabbs into spatially coherent clusters, one BLAS per cluster, by sorting the aabb
+    centers along a morton curve and cutting the curve into equally sized runs. Editing a primitive
+    then only requires rebuilding the BLAS of its cluster.
+    Pure CPU code, doesn't touch vulkan.
+*/
+namespace ClusterPlanner {
+
+    struct Cluster {
+        uint32_t firstPrimitive = 0; // into Plan::primitiveOrder
+        uint32_t primitiveCount = 0;
+        Vk::AABB bounds = Vk::AABB::empty();
+    };
+
+    struct Stats {
+        uint32_t blasCount = 0;
+        uint32_t primitiveCount = 0;
+        float totalSurfaceArea = 0.f;       // sum of the cluster bounds surface areas, what TLAS traversal cost scales with
+        float estimatedRebuildCost = 0.f;   // expected number of aabbs rebuilt when a random primitive is edited
+    };
+
+    struct Plan {
+        std::vector<uint32_t> primitiveOrder; // primitive indices in morton order, each cluster is a contiguous run
+        std::vector<Cluster> clusters;
+        Stats stats;
+    };
+
+    // clusterCount is clamped to [1, count]. cluster sizes differ by at most one primitive
+    Plan plan(const Vk::AABB* aabbs, uint32_t count, uint32_t clusterCount);
+
+    // smallest cluster count that keeps every cluster at or below maxPrimitivesPerCluster
+    uint32_t clusterCountFor(uint32_t primitiveCount, uint32_t maxPrimitivesPerCluster);
+
+    Stats computeStats(const Cluster* clusters, uint32_t clusterCount);
+}
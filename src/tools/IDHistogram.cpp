@@ -0,0 +1,244 @@
+#include "IDHistogram.h"
+
+#include "tools/config.h"
+
+#include <algorithm>
+
+#define SHADER_SRC_SELECTION "spirv/selection.comp.spv"
+
+// distinct ids read back per pass, ids hit after that are dropped (reported as truncated)
+#define ID_HISTOGRAM_MAX_ENTRIES 65536
+#define ID_HISTOGRAM_MIN_ID_CAPACITY 4096
+// byte offset of the entries in the result buffer, the count is padded to 16 bytes
+#define ID_HISTOGRAM_HEADER_SIZE 16
+#define ID_HISTOGRAM_GROUP_SIZE 8
+
+namespace Vk {
+
+    // matches the push constant block of selection.comp
+    struct _Params {
+        glm::ivec2 offset;
+        glm::ivec2 extent;
+        uint32_t pointCount;
+        uint32_t idCapacity;
+        uint32_t maxEntries;
+        uint32_t pass;
+    };
+
+    void IDHistogramPass::create(VkDevice device, VkPhysicalDevice physicalDevice) {
+        this->device = device;
+        this->physicalDevice = physicalDevice;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
+
+        // descriptor set and pipeline layout
+
+        VkDescriptorSetLayoutBinding bindings[4] = {};
+        for (uint32_t b = 0; b < ARRAY_SIZE(bindings); b++) {
+            bindings[b].binding = b;
+            bindings[b].descriptorType = b == 0 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[b].descriptorCount = 1;
+            bindings[b].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = ARRAY_SIZE(bindings);
+        layoutInfo.pBindings = bindings;
+        VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &layoutInfo, VK_ALLOCATOR, &descriptorSetLayout), "failed to create id histogram descriptor set layout");
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(_Params);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutInfo, VK_ALLOCATOR, &pipelineLayout), "failed to create id histogram pipeline layout");
+
+        // compute pipeline
+
+        VkShaderModule shaderModule;
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = loadShader(device, std::string(_CONFIG::getAssetsPath()) + std::string(SHADER_SRC_SELECTION), VK_SHADER_STAGE_COMPUTE_BIT, shaderModule);
+        pipelineInfo.layout = pipelineLayout;
+        VK_CHECK_RESULT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, VK_ALLOCATOR, &pipeline), "failed to create id histogram pipeline");
+        vkDestroyShaderModule(device, shaderModule, VK_ALLOCATOR);
+
+        // descriptor set, written at record time since the id image and coverage buffer change
+
+        VkDescriptorPoolSize poolSizes[] = {
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 }
+        };
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = ARRAY_SIZE(poolSizes);
+        poolInfo.pPoolSizes = poolSizes;
+        VK_CHECK_RESULT(vkCreateDescriptorPool(device, &poolInfo, VK_ALLOCATOR, &descriptorPool), "failed to create id histogram descriptor pool");
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &descriptorSetLayout;
+        VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet), "failed to allocate id histogram descriptor set");
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2;
+        VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, VK_ALLOCATOR, &timestampQueryPool), "failed to create id histogram query pool");
+
+        // buffers
+
+        resultBuffer.create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            ID_HISTOGRAM_HEADER_SIZE + sizeof(glm::uvec2) * ID_HISTOGRAM_MAX_ENTRIES, device, physicalDevice);
+        lassoBuffer.create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::vec2) * ID_HISTOGRAM_MAX_LASSO_POINTS, device, physicalDevice);
+        reserveCoverage(ID_HISTOGRAM_MIN_ID_CAPACITY);
+    }
+
+    void IDHistogramPass::destroy() {
+        coverageBuffer.destroy(device);
+        resultBuffer.destroy(device);
+        lassoBuffer.destroy(device);
+        vkDestroyQueryPool(device, timestampQueryPool, VK_ALLOCATOR);
+        vkDestroyDescriptorPool(device, descriptorPool, VK_ALLOCATOR);
+        vkDestroyPipeline(device, pipeline, VK_ALLOCATOR);
+        vkDestroyPipelineLayout(device, pipelineLayout, VK_ALLOCATOR);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, VK_ALLOCATOR);
+    }
+
+    void IDHistogramPass::reserveCoverage(uint32_t idCapacity) {
+        if (idCapacity <= coverageCapacity) return;
+
+        uint32_t newCapacity = std::max<uint32_t>(coverageCapacity, ID_HISTOGRAM_MIN_ID_CAPACITY);
+        while (newCapacity < idCapacity) newCapacity *= 2;
+
+        // the previous pass has completed, see record()
+        coverageBuffer.destroy(device);
+        coverageBuffer = BufferDeviceLocal();
+        coverageBuffer.create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            sizeof(uint32_t) * static_cast<VkDeviceSize>(newCapacity), device, physicalDevice);
+        coverageCapacity = newCapacity;
+    }
+
+    void IDHistogramPass::writeDescriptorSet(VkImageView objectIDs) {
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageView = objectIDs;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorBufferInfo bufferInfos[3] = {
+            { coverageBuffer.buffer, 0, VK_WHOLE_SIZE },
+            { resultBuffer.buffer, 0, VK_WHOLE_SIZE },
+            { lassoBuffer.buffer, 0, VK_WHOLE_SIZE }
+        };
+
+        VkWriteDescriptorSet writes[4] = {};
+        for (uint32_t w = 0; w < ARRAY_SIZE(writes); w++) {
+            writes[w].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[w].dstSet = descriptorSet;
+            writes[w].dstBinding = w;
+            writes[w].descriptorCount = 1;
+            if (w == 0) {
+                writes[w].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                writes[w].pImageInfo = &imageInfo;
+            } else {
+                writes[w].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[w].pBufferInfo = &bufferInfos[w - 1];
+            }
+        }
+        vkUpdateDescriptorSets(device, ARRAY_SIZE(writes), writes, 0, nullptr);
+    }
+
+    void IDHistogramPass::record(VkCommandBuffer commandBuffer, VkImageView objectIDs, VkExtent2D imageExtent, const IDRegion& region, uint32_t idCapacity) {
+        IDRegion r = region.clamped(glm::uvec2(imageExtent.width, imageExtent.height));
+        reserveCoverage(idCapacity);
+
+        _Params params{};
+        params.offset = r.offset;
+        params.extent = r.extent;
+        params.idCapacity = idCapacity;
+        params.maxEntries = ID_HISTOGRAM_MAX_ENTRIES;
+
+        if (!r.lasso.empty()) {
+            uint32_t count = std::min<uint32_t>(static_cast<uint32_t>(r.lasso.size()), ID_HISTOGRAM_MAX_LASSO_POINTS);
+            Model::Span<glm::vec2> points = lassoBuffer.write<glm::vec2>(0, count);
+            std::copy(r.lasso.begin(), r.lasso.begin() + count, points.begin());
+            lassoBuffer.flush(device);
+            params.pointCount = count;
+        }
+
+        writeDescriptorSet(objectIDs);
+
+        vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 0, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, 0);
+
+        vkCmdFillBuffer(commandBuffer, coverageBuffer.buffer, 0, sizeof(uint32_t) * static_cast<VkDeviceSize>(idCapacity == 0 ? 1 : idCapacity), 0);
+        vkCmdFillBuffer(commandBuffer, resultBuffer.buffer, 0, ID_HISTOGRAM_HEADER_SIZE, 0);
+
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+        // histogram
+        params.pass = 0;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(_Params), &params);
+        vkCmdDispatch(commandBuffer,
+            (static_cast<uint32_t>(r.extent.x) + ID_HISTOGRAM_GROUP_SIZE - 1) / ID_HISTOGRAM_GROUP_SIZE,
+            (static_cast<uint32_t>(r.extent.y) + ID_HISTOGRAM_GROUP_SIZE - 1) / ID_HISTOGRAM_GROUP_SIZE, 1);
+
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        // gather, one invocation per possible entry
+        params.pass = 1;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(_Params), &params);
+        vkCmdDispatch(commandBuffer, ID_HISTOGRAM_MAX_ENTRIES / (ID_HISTOGRAM_GROUP_SIZE * ID_HISTOGRAM_GROUP_SIZE), 1, 1);
+
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, 1);
+    }
+
+    std::vector<IDCoverage> IDHistogramPass::getResults(bool* truncated) {
+        uint32_t count = resultBuffer.read<uint32_t>(0, 1)[0];
+        if (truncated != nullptr) *truncated = count > ID_HISTOGRAM_MAX_ENTRIES;
+        count = std::min<uint32_t>(count, ID_HISTOGRAM_MAX_ENTRIES);
+
+        Model::Span<const glm::uvec2> entries = resultBuffer.read<glm::uvec2>(ID_HISTOGRAM_HEADER_SIZE, count);
+        std::vector<IDCoverage> result(count);
+        for (uint32_t e = 0; e < count; e++) result[e] = { static_cast<int32_t>(entries[e].x), entries[e].y };
+
+        // appended in whatever order the invocations got there
+        std::sort(result.begin(), result.end(), [](const IDCoverage& a, const IDCoverage& b) { return a.objectID < b.objectID; });
+        return result;
+    }
+
+    float IDHistogramPass::getGPUTime() {
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(device, timestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return 0.f;
+        return static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * timestampPeriod * 1e-6);
+    }
+}
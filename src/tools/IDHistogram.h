@@ -0,0 +1,53 @@
+#pragma once
+
+#include "tools/IDRegion.h"
+#include "tools/VkHelper.h"
+
+#include <glm.hpp>
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+namespace Vk {
+
+    /*
+        Counts the pixels of each object id inside a region of the object id image on the gpu (shaders/selection.comp),
+        so a selection only reads back the distinct ids instead of the image. The first pass builds a histogram over
+        all object ids and appends each id the first time it is hit, the second gathers the counts of the appended ids.
+        Only core Vulkan features are used.
+        One pass in flight: after record() the command buffer has to complete before getResults() or the next record().
+    */
+    class IDHistogramPass {
+    public:
+        void create(VkDevice device, VkPhysicalDevice physicalDevice);
+        void destroy();
+
+        // objectIDs is in the general layout and its writes are visible to compute shaders. idCapacity is one
+        // past the largest object id, larger ids are ignored
+        void record(VkCommandBuffer commandBuffer, VkImageView objectIDs, VkExtent2D imageExtent, const IDRegion& region, uint32_t idCapacity);
+
+        // sorted by object id. truncated is set when more distinct ids were hit than fit in the result buffer
+        std::vector<IDCoverage> getResults(bool* truncated = nullptr);
+        float getGPUTime(); // milliseconds of the last pass
+
+    private:
+        VkDevice device = VK_NULL_HANDLE;
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        float timestampPeriod = 1.f;
+
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+
+        BufferDeviceLocal coverageBuffer;   // pixel count per object id
+        uint32_t coverageCapacity = 0;
+        BufferHostVisible resultBuffer;     // count + (object id, pixel count) entries
+        BufferHostVisible lassoBuffer;
+
+        void reserveCoverage(uint32_t idCapacity);
+        void writeDescriptorSet(VkImageView objectIDs);
+    };
+}
@@ -0,0 +1,77 @@
+#include "IDRegion.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace Vk {
+
+    IDRegion IDRegion::fromRect(glm::vec2 a, glm::vec2 b) {
+        IDRegion region;
+        region.offset = glm::ivec2(glm::floor(glm::min(a, b)));
+        region.extent = glm::ivec2(glm::ceil(glm::max(a, b))) - region.offset;
+        return region;
+    }
+
+    IDRegion IDRegion::fromLasso(std::vector<glm::vec2> points) {
+        IDRegion region;
+        if (points.size() < 3) return region;
+
+        glm::vec2 lower = points[0], upper = points[0];
+        for (const glm::vec2& p : points) {
+            lower = glm::min(lower, p);
+            upper = glm::max(upper, p);
+        }
+        region = fromRect(lower, upper);
+
+        if (points.size() > ID_HISTOGRAM_MAX_LASSO_POINTS) {
+            region.lasso.resize(ID_HISTOGRAM_MAX_LASSO_POINTS);
+            for (size_t p = 0; p < region.lasso.size(); p++) region.lasso[p] = points[p * points.size() / region.lasso.size()];
+        } else {
+            region.lasso = std::move(points);
+        }
+        return region;
+    }
+
+    IDRegion IDRegion::clamped(glm::uvec2 imageSize) const {
+        IDRegion region;
+        glm::ivec2 lower = glm::max(offset, glm::ivec2(0));
+        glm::ivec2 upper = glm::min(offset + extent, glm::ivec2(imageSize));
+        region.offset = lower;
+        region.extent = glm::max(upper - lower, glm::ivec2(0));
+        region.lasso = lasso;
+        return region;
+    }
+
+    bool IDRegion::contains(glm::ivec2 pixel) const {
+        if (glm::any(glm::lessThan(pixel, offset)) || glm::any(glm::greaterThanEqual(pixel, offset + extent))) return false;
+        if (lasso.empty()) return true;
+
+        glm::vec2 p = glm::vec2(pixel) + glm::vec2(0.5f);
+        bool inside = false;
+        for (size_t i = 0, j = lasso.size() - 1; i < lasso.size(); j = i++) {
+            const glm::vec2& a = lasso[i];
+            const glm::vec2& b = lasso[j];
+            if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+                inside = !inside;
+        }
+        return inside;
+    }
+
+    std::vector<IDCoverage> scanIDHistogram(const int32_t* ids, uint32_t width, uint32_t height, const IDRegion& region, uint32_t idCapacity) {
+        IDRegion r = region.clamped(glm::uvec2(width, height));
+
+        std::unordered_map<int32_t, uint32_t> counts;
+        for (int32_t y = r.offset.y; y < r.offset.y + r.extent.y; y++) {
+            for (int32_t x = r.offset.x; x < r.offset.x + r.extent.x; x++) {
+                int32_t id = ids[static_cast<size_t>(y) * width + x];
+                if (id >= 0 && static_cast<uint32_t>(id) < idCapacity && r.contains({ x, y })) counts[id]++;
+            }
+        }
+
+        std::vector<IDCoverage> result;
+        result.reserve(counts.size());
+        for (const auto& c : counts) result.push_back({ c.first, c.second });
+        std::sort(result.begin(), result.end(), [](const IDCoverage& a, const IDCoverage& b) { return a.objectID < b.objectID; });
+        return result;
+    }
+}
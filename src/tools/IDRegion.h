@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+// longer lassos are resampled to this many points by IDRegion::fromLasso()
+#define ID_HISTOGRAM_MAX_LASSO_POINTS 1024
+
+/*
+    Selection region of the object id image and the cpu reference of the id histogram, IDHistogramPass
+    (IDHistogram.h) and selection.comp do the same on the gpu. tests/IDRegionTests.cpp checks this copy.
+    Pure CPU code, doesn't touch vulkan.
+*/
+namespace Vk {
+
+    // rectangle of the object id image, optionally masked by a lasso polygon (in pixels, even-odd rule)
+    struct IDRegion {
+        glm::ivec2 offset = glm::ivec2(0);
+        glm::ivec2 extent = glm::ivec2(0);
+        std::vector<glm::vec2> lasso; // empty = the whole rectangle
+
+        static IDRegion fromRect(glm::vec2 a, glm::vec2 b); // any two opposite corners
+        static IDRegion fromLasso(std::vector<glm::vec2> points); // the rectangle is the bounds of the points, needs 3 points
+
+        IDRegion clamped(glm::uvec2 imageSize) const;
+        // same test as the shader, at the pixel center
+        bool contains(glm::ivec2 pixel) const;
+    };
+
+    struct IDCoverage {
+        int32_t objectID;
+        uint32_t pixelCount;
+    };
+
+    // cpu reference of IDHistogramPass, ids is a tightly packed width * height image. negative ids and ids from
+    // idCapacity up are ignored like the pass does. sorted by object id
+    std::vector<IDCoverage> scanIDHistogram(const int32_t* ids, uint32_t width, uint32_t height, const IDRegion& region, uint32_t idCapacity);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "tools/AABB.h"
+
+#include <glm.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// sphere tracing, same as MAX_MARCHING_STEPS, EPSILON and MAX_DISTANCE in shaders/common.glsl
+#define SDF_MAX_MARCHING_STEPS 100
+#define SDF_EPSILON 0.0001f
+#define SDF_MAX_DISTANCE 100.f
+// central difference offset of the sphere traced normal, as in shaders/ellipsoid.rint
+#define SDF_NORMAL_OFFSET 0.0005f
+
+namespace Spatial {
+
+    struct Ray {
+        glm::vec3 origin = glm::vec3(0.f);
+        glm::vec3 direction = glm::vec3(0.f, 0.f, 1.f); // distances are in multiples of its length
+        float tMax = std::numeric_limits<float>::infinity();
+
+        Ray() {}
+        Ray(glm::vec3 origin, glm::vec3 direction, float tMax = std::numeric_limits<float>::infinity()) :
+            origin(origin), direction(direction), tMax(tMax) {}
+    };
+
+    // v rotated by the unit quaternion q = (x, y, z, w)
+    inline glm::vec3 rotate(glm::vec4 q, glm::vec3 v) {
+        glm::vec3 u = glm::vec3(q.x, q.y, q.z);
+        glm::vec3 t = 2.f * glm::cross(u, v);
+        return v + q.w * t + glm::cross(u, t);
+    }
+
+    inline glm::vec3 inverseRotate(glm::vec4 q, glm::vec3 v) {
+        return rotate(glm::vec4(-q.x, -q.y, -q.z, q.w), v);
+    }
+
+    // slab test against a box, inverseDirection = 1 / ray.direction. tEntry is clamped to 0 when the origin is inside
+    inline bool intersectRayAABB(glm::vec3 origin, glm::vec3 inverseDirection, float tMax, const Vk::AABB& aabb, float& tEntry) {
+        if (aabb.isEmpty()) return false;
+        glm::vec3 t0 = (aabb.minPoint() - origin) * inverseDirection;
+        glm::vec3 t1 = (aabb.maxPoint() - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+
+        tEntry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+        float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+        return tEntry <= tExit;
+    }
+
+    // first hit in [0, ray.tMax), the exit point when the origin is inside the ellipsoid
+    inline bool intersectRayEllipsoid(const Ray& ray, glm::vec3 center, glm::vec3 radius, float& t) {
+        // unit sphere space
+        glm::vec3 o = (ray.origin - center) / radius;
+        glm::vec3 d = ray.direction / radius;
+
+        float a = glm::dot(d, d);
+        float b = glm::dot(o, d);
+        float c = glm::dot(o, o) - 1.f;
+        float discriminant = b * b - a * c;
+        if (discriminant < 0.f || a == 0.f) return false;
+
+        float s = std::sqrt(discriminant);
+        float tNear = (-b - s) / a;
+        float tFar = (-b + s) / a;
+        t = tNear >= 0.f ? tNear : tFar;
+        return t >= 0.f && t < ray.tMax;
+    }
+
+    // rotated ellipsoid, the ray is intersected in the ellipsoid's local frame. t is the same in both frames
+    inline bool intersectRayEllipsoid(const Ray& ray, glm::vec3 center, glm::vec3 radius, glm::vec4 rotation, float& t) {
+        Ray local(inverseRotate(rotation, ray.origin - center), inverseRotate(rotation, ray.direction), ray.tMax);
+        return intersectRayEllipsoid(local, glm::vec3(0.f), radius, t);
+    }
+
+    /*
+        CPU mirrors of the two kernels in shaders/ellipsoid.rint, in the ellipsoid's local frame (centered, unrotated)
+        with a normalized direction, so t is a distance. Unlike intersectRayEllipsoid() they have the shader's float
+        operations and tMin handling, to compare results and cost.
+    */
+
+    inline bool intersectEllipsoidAnalytic(glm::vec3 origin, glm::vec3 direction, glm::vec3 radius, float tMin, float tMax, float& t, glm::vec3& normal) {
+        glm::vec3 o = origin / radius;
+        glm::vec3 d = direction / radius;
+        float a = glm::dot(d, d);
+        float b = glm::dot(o, d);
+        float c = glm::dot(o, o) - 1.f;
+        float discriminant = b * b - a * c;
+        if (discriminant < 0.f) return false;
+
+        float s = std::sqrt(discriminant);
+        float tNear = (-b - s) / a;
+        t = tNear >= tMin ? tNear : (-b + s) / a;
+        if (t < tMin || t > tMax) return false;
+
+        normal = glm::normalize((origin + direction * t) / (radius * radius));
+        return true;
+    }
+
+    // not an exact distance, but a bound good enough to march with
+    inline float sdfEllipsoid(glm::vec3 point, glm::vec3 radius) {
+        float k0 = glm::length(point / radius);
+        float k1 = glm::length(point / (radius * radius));
+        return k0 * (k0 - 1.f) / k1;
+    }
+
+    // steps is set to the number of sdf evaluations of the march, the normal takes 6 more on a hit
+    inline bool intersectEllipsoidSphereTraced(glm::vec3 origin, glm::vec3 direction, glm::vec3 radius, float& t, glm::vec3& normal, uint32_t& steps) {
+        float depth = 0.f;
+        for (steps = 1; steps <= SDF_MAX_MARCHING_STEPS; steps++) {
+            glm::vec3 point = origin + direction * depth;
+            float distance = sdfEllipsoid(point, radius);
+
+            depth += distance;
+            if (distance < SDF_EPSILON) {
+                t = depth;
+                glm::vec3 ex(SDF_NORMAL_OFFSET, 0.f, 0.f), ey(0.f, SDF_NORMAL_OFFSET, 0.f), ez(0.f, 0.f, SDF_NORMAL_OFFSET);
+                normal = glm::normalize(glm::vec3(
+                    sdfEllipsoid(point + ex, radius) - sdfEllipsoid(point - ex, radius),
+                    sdfEllipsoid(point + ey, radius) - sdfEllipsoid(point - ey, radius),
+                    sdfEllipsoid(point + ez, radius) - sdfEllipsoid(point - ez, radius)));
+                return true;
+            }
+            if (distance >= SDF_MAX_DISTANCE) break;
+        }
+        steps = std::min<uint32_t>(steps, SDF_MAX_MARCHING_STEPS);
+        return false;
+    }
+
+    // 0 inside the box
+    inline float distanceSquared(glm::vec3 point, const Vk::AABB& aabb) {
+        glm::vec3 d = glm::max(glm::max(aabb.minPoint() - point, point - aabb.maxPoint()), glm::vec3(0.f));
+        return glm::dot(d, d);
+    }
+}
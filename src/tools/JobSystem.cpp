@@ -0,0 +1,267 @@
+#include "JobSystem.h"
+
+#include "tools/Log.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+// how long an idle worker sleeps before looking for work again, pushes wake one up earlier
+#define JOB_IDLE_SLEEP_MICROSECONDS 1000
+
+namespace JobSystem {
+
+    // private variables
+
+    struct _Job {
+        JobFunction function;
+        const void* context;
+        uint32_t begin, end;
+        uint32_t grainSize;
+        JobGroup* group;
+    };
+
+    // one per worker, plus slot 0 for every thread outside the pool
+    struct _Slot {
+        std::mutex mutex;
+        std::deque<_Job> jobs[static_cast<uint32_t>(Priority::COUNT)];
+        std::atomic<uint32_t> queued{ 0 }; // lets thieves skip empty slots without locking them
+
+        std::atomic<uint64_t> jobCount{ 0 };
+        std::atomic<uint64_t> itemCount{ 0 };
+        std::atomic<uint64_t> stealCount{ 0 };
+        std::atomic<uint64_t> busyNanoseconds{ 0 };
+    };
+
+    Settings settings;
+    std::vector<std::unique_ptr<_Slot>> slots;
+    std::vector<std::thread> workers;
+    std::atomic<bool> started{ false };
+    std::atomic<bool> running{ false };
+    std::mutex poolMutex; // init/shutdown
+
+    std::atomic<uint32_t> queuedTotal{ 0 };
+    std::atomic<uint32_t> sleeping{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    // joins the workers if shutdown() wasn't called, std::thread terminates the program if destroyed while running
+    struct _ShutdownAtExit {
+        ~_ShutdownAtExit();
+    } shutdownAtExit;
+
+    thread_local uint32_t currentSlot = 0;
+    thread_local uint32_t executeDepth = 0; // jobs run by wait() inside a job don't count towards busy time twice
+
+    // private function declarations
+
+    void ensureStarted();
+    void workerLoop(uint32_t slot);
+    void pinThread(std::thread& thread, uint32_t cpu);
+    void push(uint32_t slot, const _Job& job, Priority priority);
+    bool pop(uint32_t slot, _Job& job, Priority& priority);
+    void execute(uint32_t slot, _Job job, Priority priority);
+
+    // function implimentations
+
+    void init(const Settings& newSettings) {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (started) {
+            running = false;
+            wake.notify_all();
+            for (std::thread& worker : workers) worker.join();
+            workers.clear();
+        }
+
+        settings = newSettings;
+        uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        uint32_t workerCount = (settings.threadCount > 0 ? settings.threadCount : hardwareThreads) - 1;
+
+        slots.clear();
+        for (uint32_t s = 0; s <= workerCount; s++) slots.push_back(std::make_unique<_Slot>());
+        queuedTotal = 0;
+        running = true;
+        for (uint32_t w = 0; w < workerCount; w++) {
+            workers.emplace_back(workerLoop, w + 1);
+            if (settings.pinWorkers) pinThread(workers.back(), (w + 1) % hardwareThreads);
+        }
+        started = true;
+    }
+
+    void shutdown() {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (!started) return;
+        running = false;
+        wake.notify_all();
+        for (std::thread& worker : workers) worker.join();
+        workers.clear();
+        slots.clear();
+        started = false;
+    }
+
+    Settings getSettings() {
+        return settings;
+    }
+
+    uint32_t getThreadCount() {
+        ensureStarted();
+        return static_cast<uint32_t>(slots.size());
+    }
+
+    uint32_t getSlot() {
+        return currentSlot;
+    }
+
+    void submit(JobGroup& group, JobFunction function, const void* context, uint32_t begin, uint32_t end, uint32_t grainSize, Priority priority) {
+        if (begin >= end) return;
+        ensureStarted();
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        push(currentSlot, { function, context, begin, end, std::max(1u, grainSize), &group }, priority);
+    }
+
+    void wait(JobGroup& group) {
+        ensureStarted();
+        _Job job;
+        Priority priority;
+        while (group.pending.load(std::memory_order_acquire) > 0) {
+            if (pop(currentSlot, job, priority)) execute(currentSlot, job, priority);
+            else std::this_thread::yield(); // the last jobs run elsewhere
+        }
+    }
+
+    Stats getStats() {
+        Stats stats;
+        for (const std::unique_ptr<_Slot>& slot : slots) {
+            WorkerStats worker;
+            worker.jobs = slot->jobCount;
+            worker.items = slot->itemCount;
+            worker.steals = slot->stealCount;
+            worker.busyTime = slot->busyNanoseconds / 1000000.f;
+            stats.workers.push_back(worker);
+        }
+        return stats;
+    }
+
+    void resetStats() {
+        for (std::unique_ptr<_Slot>& slot : slots) {
+            slot->jobCount = 0;
+            slot->itemCount = 0;
+            slot->stealCount = 0;
+            slot->busyNanoseconds = 0;
+        }
+    }
+
+    _ShutdownAtExit::~_ShutdownAtExit() {
+        shutdown();
+    }
+
+    void ensureStarted() {
+        if (!started.load(std::memory_order_acquire)) init(settings);
+    }
+
+    void workerLoop(uint32_t slot) {
+        currentSlot = slot;
+        _Job job;
+        Priority priority;
+        while (running) {
+            if (pop(slot, job, priority)) {
+                execute(slot, job, priority);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeping++;
+            wake.wait_for(lock, std::chrono::microseconds(JOB_IDLE_SLEEP_MICROSECONDS), []() { return queuedTotal > 0 || !running; });
+            sleeping--;
+        }
+    }
+
+    void pinThread(std::thread& thread, uint32_t cpu) {
+#if defined(_WIN32)
+        if (cpu >= 64 || SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << cpu) == 0)
+            AID_WARN("Could not pin worker thread to cpu {}", cpu);
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0)
+            AID_WARN("Could not pin worker thread to cpu {}", cpu);
+#else
+        AID_WARN("Pinning worker threads is not supported on this platform");
+#endif
+    }
+
+    void push(uint32_t slot, const _Job& job, Priority priority) {
+        _Slot& target = *slots[slot];
+        {
+            std::lock_guard<std::mutex> lock(target.mutex);
+            target.jobs[static_cast<uint32_t>(priority)].push_back(job);
+            target.queued.fetch_add(1, std::memory_order_release);
+            queuedTotal.fetch_add(1, std::memory_order_release);
+        }
+        if (sleeping.load(std::memory_order_relaxed) > 0) wake.notify_one();
+    }
+
+    // higher priorities first, own newest job before stealing another slot's oldest
+    bool pop(uint32_t slot, _Job& job, Priority& priority) {
+        uint32_t slotCount = static_cast<uint32_t>(slots.size());
+        for (uint32_t p = 0; p < static_cast<uint32_t>(Priority::COUNT); p++) {
+            for (uint32_t i = 0; i < slotCount; i++) {
+                uint32_t victim = (slot + i) % slotCount;
+                _Slot& source = *slots[victim];
+                if (source.queued.load(std::memory_order_acquire) == 0) continue;
+
+                std::lock_guard<std::mutex> lock(source.mutex);
+                std::deque<_Job>& jobs = source.jobs[p];
+                if (jobs.empty()) continue;
+                if (i == 0) {
+                    job = jobs.back();
+                    jobs.pop_back();
+                } else {
+                    job = jobs.front();
+                    jobs.pop_front();
+                    slots[slot]->stealCount.fetch_add(1, std::memory_order_relaxed);
+                }
+                source.queued.fetch_sub(1, std::memory_order_relaxed);
+                queuedTotal.fetch_sub(1, std::memory_order_relaxed);
+                priority = static_cast<Priority>(p);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(uint32_t slot, _Job job, Priority priority) {
+        // keep the lower half, offer the upper halves to the others
+        while (job.end - job.begin > job.grainSize) {
+            uint32_t mid = job.begin + (job.end - job.begin) / 2;
+            job.group->pending.fetch_add(1, std::memory_order_relaxed);
+            push(slot, { job.function, job.context, mid, job.end, job.grainSize, job.group }, priority);
+            job.end = mid;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        executeDepth++;
+        job.function(job.context, job.begin, job.end);
+        executeDepth--;
+        auto time = std::chrono::high_resolution_clock::now() - start;
+
+        _Slot& stats = *slots[slot];
+        stats.jobCount.fetch_add(1, std::memory_order_relaxed);
+        stats.itemCount.fetch_add(job.end - job.begin, std::memory_order_relaxed);
+        if (executeDepth == 0)
+            stats.busyNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(), std::memory_order_relaxed);
+        // the group may be gone once it reaches 0
+        job.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+/*
+    Work stealing thread pool for CPU work like render tiles, BVH subtrees and query batches. Every worker owns a
+    deque per priority: it pushes and pops its own jobs at the back (depth first, cache warm) and idle workers steal
+    from the front of the others' (the oldest jobs, which are the largest ranges). A job over a range splits itself
+    in halves until it's no larger than its grain size, pushing the upper halves for others to steal, so a parallel
+    for over N items costs log(N) pushes on the submitting thread instead of N.
+    Threads outside the pool (the main thread) share one more deque, and wait() runs jobs instead of blocking, so
+    jobs can wait on jobs they submitted. Functions are referenced by the jobs, not copied: they have to stay alive
+    until the wait() on their group returns, which parallelFor() and parallelReduce() do themselves.
+*/
+namespace JobSystem {
+
+    enum struct Priority {
+        HIGH,
+        NORMAL,
+        LOW,
+        COUNT
+    };
+
+    struct Settings {
+        uint32_t threadCount = 0;   // workers + the waiting thread, which works too. 0 = one per hardware thread
+        bool pinWorkers = false;    // worker i only runs on logical cpu i, the waiting thread usually takes cpu 0
+    };
+
+    // per thread slot, slot 0 is all threads outside the pool
+    struct WorkerStats {
+        uint64_t jobs = 0;          // ranges run
+        uint64_t items = 0;         // summed range sizes
+        uint64_t steals = 0;        // jobs taken from another slot's deque
+        float busyTime = 0.f;       // milliseconds spent running jobs
+    };
+
+    struct Stats {
+        std::vector<WorkerStats> workers;
+    };
+
+    // unfinished jobs of one submission, wait() on it before it goes out of scope
+    struct JobGroup {
+        std::atomic<uint32_t> pending{ 0 };
+    };
+
+    // function(context, begin, end) for one range
+    using JobFunction = void (*)(const void* context, uint32_t begin, uint32_t end);
+
+    // (re)starts the pool, called with default settings by the first submit otherwise. not from inside a job
+    void init(const Settings& settings = Settings());
+    void shutdown();
+    Settings getSettings();
+    uint32_t getThreadCount();  // workers + the thread waiting on them
+    uint32_t getSlot();         // stats slot of the calling thread, 0 outside the pool
+
+    // runs function on [begin, end), split into ranges no larger than grainSize
+    void submit(JobGroup& group, JobFunction function, const void* context, uint32_t begin, uint32_t end, uint32_t grainSize, Priority priority = Priority::NORMAL);
+    // runs queued jobs on the calling thread until the group is done
+    void wait(JobGroup& group);
+
+    Stats getStats();
+    void resetStats();
+
+    // function() once, later
+    template <class Function>
+    void run(JobGroup& group, const Function& function, Priority priority = Priority::NORMAL) {
+        submit(group, [](const void* context, uint32_t, uint32_t) { (*static_cast<const Function*>(context))(); }, &function, 0, 1, 1, priority);
+    }
+
+    // function(begin, end) over [begin, end) in ranges of at most grainSize, returns once all ran
+    template <class Function>
+    void parallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const Function& function, Priority priority = Priority::NORMAL) {
+        if (begin >= end) return;
+        if (end - begin <= grainSize) {
+            function(begin, end);
+            return;
+        }
+        JobGroup group;
+        submit(group, [](const void* context, uint32_t b, uint32_t e) { (*static_cast<const Function*>(context))(b, e); }, &function, begin, end, grainSize, priority);
+        wait(group);
+    }
+
+    // map(begin, end) -> T per range of grainSize items, combined in range order so the result doesn't depend on
+    // which threads ran what
+    template <class T, class Map, class Combine>
+    T parallelReduce(uint32_t begin, uint32_t end, uint32_t grainSize, T identity, const Map& map, const Combine& combine, Priority priority = Priority::NORMAL) {
+        if (begin >= end) return identity;
+        grainSize = std::max(1u, grainSize);
+        uint32_t rangeCount = (end - begin + grainSize - 1) / grainSize;
+        std::vector<T> partials(rangeCount, identity);
+        parallelFor(0, rangeCount, 1, [&](uint32_t first, uint32_t last) {
+            for (uint32_t r = first; r < last; r++) partials[r] = map(begin + r * grainSize, std::min(end, begin + (r + 1) * grainSize));
+        }, priority);
+
+        T result = identity;
+        for (const T& partial : partials) result = combine(result, partial);
+        return result;
+    }
+}
@@ -38,6 +38,8 @@ private:
 #define AID_INFO(...)
 #endif // _VERBOSE_OUTPUT
 #define AID_WARN(...)   Log::getLogger()->warn(__VA_ARGS__)
+// benchmark and headless mode results, printed in release builds too
+#define AID_REPORT(...) Log::getLogger()->info(__VA_ARGS__)
 // always put AID_ERROR on a new line!
 #define AID_ERROR(...)  Log::getLogger()->error("ERROR - " + std::string(__FILE__) + \
     " [line: " + std::to_string(__LINE__) + "]\n" + __VA_ARGS__); _DEBUG_BREAK;      \
@@ -0,0 +1,325 @@
+#include "MemoryAllocator.h"
+#include "SubAllocator.h"
+#include "VkHelper.h"
+
+#include <algorithm>
+
+// size of the device memory blocks that get sub-allocated (smaller on small heaps)
+#define MEMORY_BLOCK_SIZE (64ull << 20)
+// smallest buddy block, allocations are rounded up to this
+#define MEMORY_MIN_BLOCK_SIZE 256
+
+namespace MemoryAllocator {
+
+    // private variables
+
+    struct _Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE; // VK_NULL_HANDLE = slot is unused
+        void* mapped = nullptr;
+        Memory::BuddyAllocator buddy;
+        Memory::LinearAllocator linear;
+    };
+
+    // one pool per memory type and resource kind. optimal tiling images get their own pools so
+    // bufferImageGranularity never has to be considered between neighbouring allocations
+    struct _Pool {
+        uint32_t memoryTypeIndex = 0;
+        bool images = false;
+        bool linear = false;
+        bool hostVisible = false;
+        bool hostCoherent = false;
+        VkDeviceSize blockSize = MEMORY_BLOCK_SIZE;
+        std::vector<_Block> blocks;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDeviceSize nonCoherentAtomSize = 1;
+
+    std::vector<_Pool> pools;
+    CategoryUsage categoryUsage[static_cast<size_t>(Category::COUNT)];
+    uint32_t deviceMemoryCount = 0;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize dedicatedBytes = 0;
+
+    // private function declarations
+
+    uint32_t getPool(uint32_t memoryTypeIndex, bool images, bool linear);
+    bool allocateFromBlock(_Pool& pool, uint32_t blockIndex, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation);
+    uint32_t createBlock(_Pool& pool);
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped);
+    void freeDeviceMemory(VkDeviceMemory memory);
+    VkMappedMemoryRange getMappedRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+
+    // function implementations
+
+    void init(VkDevice device_, VkPhysicalDevice physicalDevice_) {
+        device = device_;
+        physicalDevice = physicalDevice_;
+
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+    }
+
+    void cleanUp() {
+        for (size_t c = 0; c < static_cast<size_t>(Category::COUNT); c++) {
+            if (categoryUsage[c].allocations != 0)
+                AID_WARN("MemoryAllocator::cleanUp() {} {} allocations were never freed", categoryUsage[c].allocations, getCategoryName(static_cast<Category>(c)));
+        }
+
+        for (_Pool& pool : pools) {
+            for (_Block& block : pool.blocks) {
+                if (block.memory != VK_NULL_HANDLE) freeDeviceMemory(block.memory);
+            }
+        }
+        pools.clear();
+    }
+
+    Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, Category category) {
+        Allocation allocation;
+        allocation.category = category;
+
+        uint32_t memoryTypeIndex = Vk::findMemoryType(physicalDevice, requirements.memoryTypeBits, properties);
+        allocation.poolIndex = getPool(memoryTypeIndex, category == Category::IMAGE, category == Category::STAGING);
+        _Pool& pool = pools[allocation.poolIndex];
+
+        // non coherent memory is flushed in whole atoms, so allocations must not share one
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+        VkDeviceSize size = requirements.size;
+        if (pool.hostVisible && !pool.hostCoherent) {
+            alignment = std::max(alignment, nonCoherentAtomSize);
+            size = Memory::alignUp(size, nonCoherentAtomSize);
+        }
+
+        if (Memory::needsDedicatedBlock(size, pool.blockSize)) {
+            allocation.memory = allocateDeviceMemory(size, memoryTypeIndex, &allocation.mapped);
+            allocation.size = size;
+            dedicatedCount++;
+            dedicatedBytes += size;
+        } else {
+            bool allocated = false;
+            for (uint32_t b = 0; b < pool.blocks.size() && !allocated; b++) {
+                if (pool.blocks[b].memory != VK_NULL_HANDLE) allocated = allocateFromBlock(pool, b, size, alignment, allocation);
+            }
+            if (!allocated && !allocateFromBlock(pool, createBlock(pool), size, alignment, allocation)) {
+                AID_ERROR("MemoryAllocator::allocate() failed to allocate {} bytes", size);
+            }
+        }
+
+        categoryUsage[static_cast<size_t>(category)].bytes += allocation.size;
+        categoryUsage[static_cast<size_t>(category)].allocations++;
+        return allocation;
+    }
+
+    void free(Allocation& allocation) {
+        if (!allocation.isValid()) return;
+
+        categoryUsage[static_cast<size_t>(allocation.category)].bytes -= allocation.size;
+        categoryUsage[static_cast<size_t>(allocation.category)].allocations--;
+
+        if (allocation.blockIndex == UINT32_MAX) {
+            freeDeviceMemory(allocation.memory);
+            dedicatedCount--;
+            dedicatedBytes -= allocation.size;
+            allocation = Allocation();
+            return;
+        }
+
+        _Pool& pool = pools[allocation.poolIndex];
+        _Block& block = pool.blocks[allocation.blockIndex];
+
+        uint32_t remaining;
+        bool freed;
+        if (pool.linear) {
+            freed = block.linear.free(allocation.offset);
+            remaining = block.linear.getAllocationCount();
+        } else {
+            freed = block.buddy.free(allocation.offset);
+            remaining = block.buddy.getAllocationCount();
+        }
+        if (!freed) {
+            AID_WARN("MemoryAllocator::free() offset {} isn't allocated in block {} of its pool", allocation.offset, allocation.blockIndex);
+        }
+
+        // empty blocks are given back to the driver as long as the pool keeps another one
+        if (remaining == 0) {
+            uint32_t liveBlocks = 0;
+            for (const _Block& b : pool.blocks) liveBlocks += b.memory != VK_NULL_HANDLE;
+
+            if (liveBlocks > 1) {
+                freeDeviceMemory(block.memory);
+                block = _Block();
+            }
+        }
+
+        allocation = Allocation();
+    }
+
+    void flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+        if (!allocation.isValid() || pools[allocation.poolIndex].hostCoherent) return;
+
+        VkMappedMemoryRange range = getMappedRange(allocation, offset, size);
+        VK_CHECK_RESULT(vkFlushMappedMemoryRanges(device, 1, &range), "failed to flush mapped memory range");
+    }
+
+    void invalidate(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+        if (!allocation.isValid() || pools[allocation.poolIndex].hostCoherent) return;
+
+        VkMappedMemoryRange range = getMappedRange(allocation, offset, size);
+        VK_CHECK_RESULT(vkInvalidateMappedMemoryRanges(device, 1, &range), "failed to invalidate mapped memory range");
+    }
+
+    Report getReport() {
+        Report report;
+        for (size_t c = 0; c < static_cast<size_t>(Category::COUNT); c++) report.categories[c] = categoryUsage[c];
+        report.deviceMemoryCount = deviceMemoryCount;
+        report.dedicatedCount = dedicatedCount;
+        report.dedicatedBytes = dedicatedBytes;
+
+        for (const _Pool& pool : pools) {
+            PoolStats stats;
+            stats.memoryTypeIndex = pool.memoryTypeIndex;
+            stats.images = pool.images;
+            stats.linear = pool.linear;
+
+            for (const _Block& block : pool.blocks) {
+                if (block.memory == VK_NULL_HANDLE) continue;
+                stats.blockCount++;
+                stats.blockBytes += pool.blockSize;
+
+                if (pool.linear) {
+                    stats.usedBytes += block.linear.getUsed();
+                    stats.largestFreeRange = std::max<VkDeviceSize>(stats.largestFreeRange, block.linear.getLargestFreeBlock());
+                    stats.freeRangeCount += block.linear.getLargestFreeBlock() != 0;
+                } else {
+                    stats.usedBytes += block.buddy.getUsed();
+                    stats.largestFreeRange = std::max<VkDeviceSize>(stats.largestFreeRange, block.buddy.getLargestFreeBlock());
+                    stats.freeRangeCount += block.buddy.getFreeBlockCount();
+                }
+            }
+
+            stats.fragmentation = Memory::fragmentation(stats.blockBytes - stats.usedBytes, stats.largestFreeRange);
+            report.pools.push_back(stats);
+        }
+        return report;
+    }
+
+    void logReport() {
+        Report report = getReport();
+
+        AID_INFO("Device memory: {} vkDeviceMemory objects ({} dedicated, {} bytes)", report.deviceMemoryCount, report.dedicatedCount, report.dedicatedBytes);
+        for (size_t c = 0; c < static_cast<size_t>(Category::COUNT); c++) {
+            AID_INFO("  {}: {} bytes in {} allocations", getCategoryName(static_cast<Category>(c)), report.categories[c].bytes, report.categories[c].allocations);
+        }
+        for (const PoolStats& pool : report.pools) {
+            AID_INFO("  pool type {}{}{}: {} blocks, {}/{} bytes used, {} free ranges, fragmentation {:.2f}",
+                pool.memoryTypeIndex, pool.images ? " images" : "", pool.linear ? " linear" : "",
+                pool.blockCount, pool.usedBytes, pool.blockBytes, pool.freeRangeCount, pool.fragmentation);
+        }
+    }
+
+    const char* getCategoryName(Category category) {
+        switch (category) {
+        case Category::BUFFER: return "buffer";
+        case Category::STAGING: return "staging";
+        case Category::IMAGE: return "image";
+        case Category::ACCELERATION_STRUCTURE: return "acceleration structure";
+        case Category::IMGUI: return "imgui";
+        default: return "unknown";
+        }
+    }
+
+    uint32_t getPool(uint32_t memoryTypeIndex, bool images, bool linear) {
+        for (uint32_t p = 0; p < pools.size(); p++) {
+            if (pools[p].memoryTypeIndex == memoryTypeIndex && pools[p].images == images && pools[p].linear == linear) return p;
+        }
+
+        _Pool pool;
+        pool.memoryTypeIndex = memoryTypeIndex;
+        pool.images = images;
+        pool.linear = linear;
+
+        VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+        pool.hostVisible = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+        pool.hostCoherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+        // don't take more than an eighth of small heaps (e.g. 256MB device local + host visible) per block
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+        while (pool.blockSize > MEMORY_MIN_BLOCK_SIZE && pool.blockSize > heapSize / 8) pool.blockSize /= 2;
+
+        pools.push_back(pool);
+        return static_cast<uint32_t>(pools.size() - 1);
+    }
+
+    bool allocateFromBlock(_Pool& pool, uint32_t blockIndex, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation) {
+        _Block& block = pool.blocks[blockIndex];
+
+        uint64_t offset = pool.linear ? block.linear.allocate(size, alignment) : block.buddy.allocate(size, alignment);
+        if (offset == Memory::INVALID_OFFSET) return false;
+
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.blockIndex = blockIndex;
+        allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+        return true;
+    }
+
+    uint32_t createBlock(_Pool& pool) {
+        _Block block;
+        block.memory = allocateDeviceMemory(pool.blockSize, pool.memoryTypeIndex, &block.mapped);
+        if (pool.linear) block.linear = Memory::LinearAllocator(pool.blockSize);
+        else block.buddy = Memory::BuddyAllocator(pool.blockSize, MEMORY_MIN_BLOCK_SIZE);
+
+        for (uint32_t b = 0; b < pool.blocks.size(); b++) {
+            if (pool.blocks[b].memory == VK_NULL_HANDLE) {
+                pool.blocks[b] = block;
+                return b;
+            }
+        }
+        pool.blocks.push_back(block);
+        return static_cast<uint32_t>(pool.blocks.size() - 1);
+    }
+
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        VkDeviceMemory memory;
+        VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, VK_ALLOCATOR, &memory), "failed to allocate device memory!");
+        deviceMemoryCount++;
+
+        *mapped = nullptr;
+        if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            VK_CHECK_RESULT(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped), "failed to map device memory");
+        }
+        return memory;
+    }
+
+    void freeDeviceMemory(VkDeviceMemory memory) {
+        vkFreeMemory(device, memory, VK_ALLOCATOR); // implicitly unmaps
+        deviceMemoryCount--;
+    }
+
+    VkMappedMemoryRange getMappedRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+        // the range has to start and end on atom boundaries, or at the end of the memory object
+        VkDeviceSize memorySize = allocation.blockIndex == UINT32_MAX ? allocation.size : pools[allocation.poolIndex].blockSize;
+        VkDeviceSize begin = allocation.offset + offset;
+        VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + size;
+        begin = begin / nonCoherentAtomSize * nonCoherentAtomSize;
+        end = Memory::alignUp(end, nonCoherentAtomSize);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = begin;
+        range.size = end >= memorySize ? VK_WHOLE_SIZE : end - begin;
+        return range;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+#include <vector>
+
+/*
+    Device memory allocator. Every buffer, image and acceleration structure gets its memory from here
+    instead of calling vkAllocateMemory, which keeps us well below maxMemoryAllocationCount.
+    Memory is allocated in large blocks per memory type and sub-allocated with a buddy allocator, or a
+    linear allocator for short lived staging memory (see SubAllocator.h). Requests bigger than a block
+    get a dedicated allocation. Host visible blocks stay mapped for their whole lifetime.
+*/
+namespace MemoryAllocator {
+
+    enum struct Category {
+        BUFFER,
+        STAGING,
+        IMAGE,
+        ACCELERATION_STRUCTURE,
+        IMGUI,
+        COUNT
+    };
+
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr; // host visible memory only, already offset
+
+        // bookkeeping
+        uint32_t poolIndex = UINT32_MAX;
+        uint32_t blockIndex = UINT32_MAX; // UINT32_MAX for dedicated allocations
+        Category category = Category::BUFFER;
+
+        bool isValid() const { return memory != VK_NULL_HANDLE; }
+    };
+
+    struct CategoryUsage {
+        VkDeviceSize bytes = 0;
+        uint32_t allocations = 0;
+    };
+
+    struct PoolStats {
+        uint32_t memoryTypeIndex = 0;
+        bool images = false;
+        bool linear = false;
+        uint32_t blockCount = 0;
+        VkDeviceSize blockBytes = 0;   // allocated from the device
+        VkDeviceSize usedBytes = 0;    // handed out, including alignment/buddy rounding
+        VkDeviceSize largestFreeRange = 0;
+        uint32_t freeRangeCount = 0;
+        float fragmentation = 0.f;     // 1 - largest free range / free bytes, 0 when all free space is contiguous
+    };
+
+    struct Report {
+        CategoryUsage categories[static_cast<size_t>(Category::COUNT)];
+        std::vector<PoolStats> pools;
+        uint32_t deviceMemoryCount = 0; // live vkAllocateMemory allocations (blocks + dedicated)
+        uint32_t dedicatedCount = 0;
+        VkDeviceSize dedicatedBytes = 0;
+    };
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice);
+    void cleanUp();
+
+    // staging allocations use the linear allocator, everything else the buddy allocator
+    Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, Category category);
+    void free(Allocation& allocation);
+
+    // makes host writes to non coherent memory visible, offset and size are relative to the allocation
+    void flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+    // makes device writes to non coherent memory visible to the host
+    void invalidate(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+    Report getReport();
+    void logReport();
+    const char* getCategoryName(Category category);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+
+namespace Morton {
+
+    // inserts two zero bits after each of the lower 10 bits of v
+    inline uint32_t expandBits10(uint32_t v) {
+        v &= 0x000003ff;
+        v = (v * 0x00010001u) & 0xff0000ffu;
+        v = (v * 0x00000101u) & 0x0f00f00fu;
+        v = (v * 0x00000011u) & 0xc30c30c3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    // inserts two zero bits after each of the lower 21 bits of v
+    inline uint64_t expandBits21(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x001f00000000ffffull;
+        v = (v | v << 16) & 0x001f0000ff0000ffull;
+        v = (v | v << 8)  & 0x100f00f00f00f00full;
+        v = (v | v << 4)  & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2)  & 0x1249249249249249ull;
+        return v;
+    }
+
+    // 30 bit morton code (10 bits per axis) of a point in the unit cube
+    inline uint32_t encode30(glm::vec3 unitPosition) {
+        uint32_t x = static_cast<uint32_t>(std::min(std::max(unitPosition.x * 1024.f, 0.f), 1023.f));
+        uint32_t y = static_cast<uint32_t>(std::min(std::max(unitPosition.y * 1024.f, 0.f), 1023.f));
+        uint32_t z = static_cast<uint32_t>(std::min(std::max(unitPosition.z * 1024.f, 0.f), 1023.f));
+        return (expandBits10(x) << 2) | (expandBits10(y) << 1) | expandBits10(z);
+    }
+
+    // 63 bit morton code (21 bits per axis) of a point in the unit cube
+    inline uint64_t encode63(glm::vec3 unitPosition) {
+        uint64_t x = static_cast<uint64_t>(std::min(std::max(unitPosition.x * 2097152.f, 0.f), 2097151.f));
+        uint64_t y = static_cast<uint64_t>(std::min(std::max(unitPosition.y * 2097152.f, 0.f), 2097151.f));
+        uint64_t z = static_cast<uint64_t>(std::min(std::max(unitPosition.z * 2097152.f, 0.f), 2097151.f));
+        return (expandBits21(x) << 2) | (expandBits21(y) << 1) | expandBits21(z);
+    }
+
+    // maps a point inside bounds (given as min and 1 / extent) to the unit cube
+    inline glm::vec3 normalize(glm::vec3 position, glm::vec3 boundsMin, glm::vec3 inverseExtent) {
+        return (position - boundsMin) * inverseExtent;
+    }
+}
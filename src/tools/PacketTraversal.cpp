@@ -0,0 +1,39 @@
+#include "PacketTraversal.h"
+
+#include "tools/PacketTraversalKernels.h"
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Spatial {
+
+    InstructionSet detectInstructionSet() {
+#if !defined(SIMD_X86)
+        return InstructionSet::NONE;
+#elif defined(_MSC_VER)
+        // avx2 needs the cpu feature and the os saving the ymm registers
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return InstructionSet::SSE;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return InstructionSet::SSE;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0 ? InstructionSet::AVX2 : InstructionSet::SSE;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? InstructionSet::AVX2 : InstructionSet::SSE;
+#endif
+    }
+
+#ifdef SIMD_X86
+    uint32_t intersectPacketSSE(const PacketScene& scene, RayPacket& packet, uint32_t activeLanes, float tMin, uint32_t* hitKeys, uint64_t& intersectionTests) {
+        return traversePacket<SIMD::Float8SSE, false>(scene, packet, packet.tMax, activeLanes, tMin, hitKeys, intersectionTests);
+    }
+
+    uint32_t occludedPacketSSE(const PacketScene& scene, const RayPacket& packet, uint32_t activeLanes, float tMin, uint64_t& intersectionTests) {
+        return traversePacket<SIMD::Float8SSE, true>(scene, packet, nullptr, activeLanes, tMin, nullptr, intersectionTests);
+    }
+#endif // SIMD_X86
+}
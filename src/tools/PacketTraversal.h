@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Model.h"
+#include "tools/BVH.h"
+
+#include <stdint.h>
+
+#define PACKET_SIZE 8
+
+/*
+    Traversal of a Spatial::BVH with packets of 8 coherent rays against the ellipsoids, for the CPU renderer. Each
+    node's box is slab tested for all rays of the packet at once and the packet descends while any of its active
+    lanes hit the box. Leaves run the ellipsoid's kernel (analytic or sphere traced, like ellipsoid.rint) on all lanes
+    that reached them. The kernels repeat the float operations of the scalar ones in Intersection.h lane by lane, so a
+    lane finds the same hits as a single ray would.
+    The functions exist once per instruction set: the SSE ones on any x86 cpu, the AVX2 ones after detectInstructionSet()
+    found AVX2. PacketTraversalAVX2.cpp is compiled with AVX2 enabled (see src/CMakeLists.txt), so only lane types and
+    plain data may be used there, an inline function from another header compiled with AVX2 could be picked by the
+    linker for the whole program.
+*/
+namespace Spatial {
+
+    enum struct InstructionSet {
+        NONE,   // not x86, no packet traversal
+        SSE,
+        AVX2
+    };
+
+    // structure of arrays, one lane per ray
+    struct alignas(32) RayPacket {
+        float originX[PACKET_SIZE], originY[PACKET_SIZE], originZ[PACKET_SIZE];
+        float directionX[PACKET_SIZE], directionY[PACKET_SIZE], directionZ[PACKET_SIZE]; // normalized, t is a distance
+        float tMax[PACKET_SIZE];
+    };
+
+    // plain pointers into a bvh without removed primitives and the ellipsoids its keys index
+    struct PacketScene {
+        const BVHNode* nodes = nullptr;
+        uint32_t nodeCount = 0;
+        const uint32_t* primitiveKeys = nullptr;    // leaf order
+        const Model::Ellipsoid* ellipsoids = nullptr;
+    };
+
+    InstructionSet detectInstructionSet();
+
+    // closest hit of every lane in activeLanes (bit i = lane i) within [tMin, tMax]. tMax of a lane that hit becomes
+    // the hit distance and hitKeys[lane] the ellipsoid's key. returns the lanes that hit. intersectionTests counts
+    // kernel runs per lane
+    uint32_t intersectPacketSSE(const PacketScene& scene, RayPacket& packet, uint32_t activeLanes, float tMin, uint32_t* hitKeys, uint64_t& intersectionTests);
+    uint32_t intersectPacketAVX2(const PacketScene& scene, RayPacket& packet, uint32_t activeLanes, float tMin, uint32_t* hitKeys, uint64_t& intersectionTests);
+
+    // any hit, returns the occluded lanes. a lane stops traversing at its first hit, the packet once all are occluded
+    uint32_t occludedPacketSSE(const PacketScene& scene, const RayPacket& packet, uint32_t activeLanes, float tMin, uint64_t& intersectionTests);
+    uint32_t occludedPacketAVX2(const PacketScene& scene, const RayPacket& packet, uint32_t activeLanes, float tMin, uint64_t& intersectionTests);
+}
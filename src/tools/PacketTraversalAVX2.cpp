@@ -0,0 +1,21 @@
+// compiled with AVX2 enabled, only called after detectInstructionSet() returned AVX2
+#include "PacketTraversal.h"
+
+#include "tools/PacketTraversalKernels.h"
+
+#if defined(SIMD_X86) && !defined(__AVX2__)
+#error "PacketTraversalAVX2.cpp has to be compiled with AVX2 enabled, see src/CMakeLists.txt"
+#endif
+
+namespace Spatial {
+
+#ifdef SIMD_X86
+    uint32_t intersectPacketAVX2(const PacketScene& scene, RayPacket& packet, uint32_t activeLanes, float tMin, uint32_t* hitKeys, uint64_t& intersectionTests) {
+        return traversePacket<SIMD::Float8AVX2, false>(scene, packet, packet.tMax, activeLanes, tMin, hitKeys, intersectionTests);
+    }
+
+    uint32_t occludedPacketAVX2(const PacketScene& scene, const RayPacket& packet, uint32_t activeLanes, float tMin, uint64_t& intersectionTests) {
+        return traversePacket<SIMD::Float8AVX2, true>(scene, packet, nullptr, activeLanes, tMin, nullptr, intersectionTests);
+    }
+#endif // SIMD_X86
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "tools/Intersection.h"
+#include "tools/PacketTraversal.h"
+#include "tools/SIMD.h"
+
+/*
+    Templates over the lane type (SIMD::Float8SSE or SIMD::Float8AVX2) behind PacketTraversal.h, only included by its
+    two translation units. Everything is static so each one keeps its own copy compiled for its instruction set.
+    The float operations are those of intersectRayAABB(), rotate() and the ellipsoid kernels in Intersection.h, in
+    the same order, and glm's dot() and cross() expanded.
+*/
+namespace Spatial {
+
+    template <class F>
+    struct _Lanes3 {
+        F x, y, z;
+    };
+
+    static inline uint32_t laneCount(uint32_t lanes) {
+        uint32_t count = 0;
+        for (; lanes != 0; lanes &= lanes - 1) count++;
+        return count;
+    }
+
+    template <class F>
+    static inline F dot(const _Lanes3<F>& a, const _Lanes3<F>& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    template <class F>
+    static inline _Lanes3<F> cross(const _Lanes3<F>& a, const _Lanes3<F>& b) {
+        return { a.y * b.z - b.y * a.z, a.z * b.x - b.z * a.x, a.x * b.y - b.x * a.y };
+    }
+
+    // Spatial::rotate() with the same quaternion in every lane
+    template <class F>
+    static inline _Lanes3<F> rotate(float qx, float qy, float qz, float qw, const _Lanes3<F>& v) {
+        _Lanes3<F> u = { F::broadcast(qx), F::broadcast(qy), F::broadcast(qz) };
+        _Lanes3<F> c = cross(u, v);
+        F two = F::broadcast(2.f), w = F::broadcast(qw);
+        _Lanes3<F> t = { two * c.x, two * c.y, two * c.z };
+        _Lanes3<F> d = cross(u, t);
+        return { v.x + w * t.x + d.x, v.y + w * t.y + d.y, v.z + w * t.z + d.z };
+    }
+
+    // intersectRayAABB() per lane
+    template <class F>
+    static inline F slabTest(const Vk::AABB& box, const _Lanes3<F>& origin, const _Lanes3<F>& inverseDirection, F tMax, F& tEntry) {
+        F t0x = (F::broadcast(box.aabb_minx) - origin.x) * inverseDirection.x;
+        F t0y = (F::broadcast(box.aabb_miny) - origin.y) * inverseDirection.y;
+        F t0z = (F::broadcast(box.aabb_minz) - origin.z) * inverseDirection.z;
+        F t1x = (F::broadcast(box.aabb_maxx) - origin.x) * inverseDirection.x;
+        F t1y = (F::broadcast(box.aabb_maxy) - origin.y) * inverseDirection.y;
+        F t1z = (F::broadcast(box.aabb_maxz) - origin.z) * inverseDirection.z;
+
+        tEntry = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), F::broadcast(0.f)));
+        F tExit = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), tMax));
+        return tEntry <= tExit;
+    }
+
+    // intersectEllipsoidAnalytic() and intersectEllipsoidSphereTraced() without the normal, on the lanes in active.
+    // returns the lanes that hit within [tMin, tMax] like reportIntersectionNV() accepts them
+    template <class F>
+    static inline F intersectEllipsoid(const Model::Ellipsoid& ellipsoid, const _Lanes3<F>& rayOrigin, const _Lanes3<F>& rayDirection, F active, F tMin, F tMax, F& t) {
+        // local frame, inverseRotate() is rotate() by the conjugate
+        float qx = -ellipsoid.rotation.x, qy = -ellipsoid.rotation.y, qz = -ellipsoid.rotation.z, qw = ellipsoid.rotation.w;
+        _Lanes3<F> relative = { rayOrigin.x - F::broadcast(ellipsoid.center.x), rayOrigin.y - F::broadcast(ellipsoid.center.y),
+            rayOrigin.z - F::broadcast(ellipsoid.center.z) };
+        _Lanes3<F> origin = rotate(qx, qy, qz, qw, relative);
+        _Lanes3<F> direction = rotate(qx, qy, qz, qw, rayDirection);
+        _Lanes3<F> radius = { F::broadcast(ellipsoid.radius.x), F::broadcast(ellipsoid.radius.y), F::broadcast(ellipsoid.radius.z) };
+
+        F hit;
+        if (ellipsoid.intersection == Model::IntersectionMethod::SPHERE_TRACE) {
+            _Lanes3<F> radiusSquared = { radius.x * radius.x, radius.y * radius.y, radius.z * radius.z };
+            F epsilon = F::broadcast(SDF_EPSILON), maxDistance = F::broadcast(SDF_MAX_DISTANCE), one = F::broadcast(1.f);
+            F depth = F::broadcast(0.f);
+            F marching = active;
+            hit = F::broadcast(0.f);
+            t = depth;
+
+            for (uint32_t step = 1; step <= SDF_MAX_MARCHING_STEPS && marching.mask() != 0; step++) {
+                _Lanes3<F> point = { origin.x + direction.x * depth, origin.y + direction.y * depth, origin.z + direction.z * depth };
+                _Lanes3<F> scaled = { point.x / radius.x, point.y / radius.y, point.z / radius.z };
+                _Lanes3<F> gradient = { point.x / radiusSquared.x, point.y / radiusSquared.y, point.z / radiusSquared.z };
+                F k0 = sqrt(dot(scaled, scaled));
+                F k1 = sqrt(dot(gradient, gradient));
+                F distance = k0 * (k0 - one) / k1;
+
+                depth = select(marching, depth + distance, depth);
+                F converged = marching & (distance < epsilon);
+                t = select(converged, depth, t);
+                hit = hit | converged;
+                marching = andNot(converged | (distance >= maxDistance), marching);
+            }
+        } else {
+            _Lanes3<F> o = { origin.x / radius.x, origin.y / radius.y, origin.z / radius.z };
+            _Lanes3<F> d = { direction.x / radius.x, direction.y / radius.y, direction.z / radius.z };
+            F a = dot(d, d);
+            F b = dot(o, d);
+            F c = dot(o, o) - F::broadcast(1.f);
+            F discriminant = b * b - a * c;
+
+            F s = sqrt(discriminant);
+            F tNear = (-b - s) / a;
+            t = select(tNear >= tMin, tNear, (-b + s) / a);
+            hit = andNot(discriminant < F::broadcast(0.f), active);
+        }
+        return andNot((t < tMin) | (t > tMax), hit);
+    }
+
+    // closest hit, or any hit with ANY_HIT. returns the lanes that hit
+    template <class F, bool ANY_HIT>
+    static inline uint32_t traversePacket(const PacketScene& scene, const RayPacket& packet, float* tMaxOut, uint32_t activeLanes, float tMinValue,
+        uint32_t* hitKeys, uint64_t& intersectionTests) {
+        if (scene.nodeCount == 0 || activeLanes == 0) return 0;
+
+        _Lanes3<F> origin = { F::load(packet.originX), F::load(packet.originY), F::load(packet.originZ) };
+        _Lanes3<F> direction = { F::load(packet.directionX), F::load(packet.directionY), F::load(packet.directionZ) };
+        F one = F::broadcast(1.f);
+        _Lanes3<F> inverseDirection = { one / direction.x, one / direction.y, one / direction.z };
+        F tMax = F::load(packet.tMax);
+        F tMin = F::broadcast(tMinValue);
+        uint32_t hitLanes = 0;
+
+        struct Entry {
+            uint32_t node;
+            uint32_t lanes; // active lanes that hit the node's box
+        };
+        Entry stack[BVH_MAX_DEPTH];
+        uint32_t stackSize = 0;
+
+        F tEntry;
+        uint32_t rootLanes = slabTest(scene.nodes[0].bounds, origin, inverseDirection, tMax, tEntry).mask() & activeLanes;
+        if (rootLanes != 0) stack[stackSize++] = { 0, rootLanes };
+
+        while (stackSize > 0) {
+            Entry entry = stack[--stackSize];
+            uint32_t lanes = ANY_HIT ? entry.lanes & ~hitLanes : entry.lanes;
+            if (lanes == 0) continue;
+            const BVHNode& node = scene.nodes[entry.node];
+
+            if (node.count > 0) {
+                for (uint32_t p = node.first; p < node.first + node.count && lanes != 0; p++) {
+                    uint32_t key = scene.primitiveKeys[p];
+                    intersectionTests += laneCount(lanes);
+
+                    F t;
+                    F hit = intersectEllipsoid(scene.ellipsoids[key], origin, direction, F::fromMask(lanes), tMin, tMax, t);
+                    uint32_t hitMask = hit.mask();
+                    if (hitMask == 0) continue;
+                    hitLanes |= hitMask;
+
+                    if (ANY_HIT) {
+                        if (hitLanes == activeLanes) return hitLanes;
+                        lanes &= ~hitMask;
+                    } else {
+                        tMax = select(hit, t, tMax);
+                        for (uint32_t lane = 0; lane < PACKET_SIZE; lane++) {
+                            if (hitMask & (1u << lane)) hitKeys[lane] = key;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            // the child nearer for most lanes on top of the stack
+            F tLeft, tRight;
+            uint32_t leftLanes = slabTest(scene.nodes[node.first].bounds, origin, inverseDirection, tMax, tLeft).mask() & lanes;
+            uint32_t rightLanes = slabTest(scene.nodes[node.first + 1].bounds, origin, inverseDirection, tMax, tRight).mask() & lanes;
+            if (leftLanes != 0 && rightLanes != 0) {
+                uint32_t both = leftLanes & rightLanes;
+                bool leftFirst = 2 * laneCount((tLeft <= tRight).mask() & both) >= laneCount(both);
+                stack[stackSize++] = leftFirst ? Entry{ node.first + 1, rightLanes } : Entry{ node.first, leftLanes };
+                stack[stackSize++] = leftFirst ? Entry{ node.first, leftLanes } : Entry{ node.first + 1, rightLanes };
+            } else if (leftLanes != 0) {
+                stack[stackSize++] = { node.first, leftLanes };
+            } else if (rightLanes != 0) {
+                stack[stackSize++] = { node.first + 1, rightLanes };
+            }
+        }
+
+        if (!ANY_HIT) tMax.store(tMaxOut);
+        return hitLanes;
+    }
+}
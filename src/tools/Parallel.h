@@ -0,0 +1,27 @@
+#pragma once
+
+#include "tools/JobSystem.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+
+namespace Parallel {
+
+    // 0 = every thread of the job system
+    inline uint32_t threadCount(uint32_t requested) {
+        return requested > 0 ? requested : JobSystem::getThreadCount();
+    }
+
+    // runs function(chunk, begin, end) over chunkCount contiguous chunks of [begin, end) as job system jobs, the
+    // calling thread takes part. chunks may run in any order and on any thread
+    template <class Function>
+    void forEachChunk(uint32_t begin, uint32_t end, uint32_t chunkCount, Function&& function) {
+        uint64_t size = end - begin;
+        JobSystem::parallelFor(0, chunkCount, 1, [&](uint32_t first, uint32_t last) {
+            for (uint32_t c = first; c < last; c++) {
+                function(c, begin + static_cast<uint32_t>(size * c / chunkCount), begin + static_cast<uint32_t>(size * (c + 1) / chunkCount));
+            }
+        });
+    }
+}
@@ -0,0 +1,103 @@
+#include "RadixSort.h"
+
+#include "tools/Parallel.h"
+
+#define RADIX_SORT_DIGIT_BITS 8
+#define RADIX_SORT_BUCKETS (1 << RADIX_SORT_DIGIT_BITS)
+// keys per thread below which the sort isn't split further
+#define RADIX_SORT_MIN_KEYS_PER_THREAD (1 << 16)
+
+namespace RadixSort {
+
+    // private function declarations
+
+    template <class Key, uint32_t Digit = 0>
+    void countDigits(Key key, uint32_t* counts);
+
+    // function implimentations
+
+    template <class Key>
+    void sortPairs(std::vector<Key>& keys, std::vector<uint32_t>& values, uint32_t threadCount) {
+        constexpr uint32_t digitCount = sizeof(Key) * 8 / RADIX_SORT_DIGIT_BITS;
+        uint32_t count = static_cast<uint32_t>(keys.size());
+        if (count < 2) return;
+
+        uint32_t chunkCount = std::min(Parallel::threadCount(threadCount), std::max(1u, count / RADIX_SORT_MIN_KEYS_PER_THREAD));
+
+        // histograms of every digit per chunk, one read of the keys
+        std::vector<uint32_t> histograms(static_cast<size_t>(chunkCount) * digitCount * RADIX_SORT_BUCKETS, 0);
+        auto histogram = [&histograms](uint32_t chunk, uint32_t digit) {
+            return histograms.data() + (static_cast<size_t>(chunk) * digitCount + digit) * RADIX_SORT_BUCKETS;
+        };
+        Parallel::forEachChunk(0, count, chunkCount, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+            uint32_t* counts = histogram(chunk, 0);
+            for (uint32_t i = begin; i < end; i++) countDigits(keys[i], counts);
+        });
+
+        std::vector<Key> keysTemp(count);
+        std::vector<uint32_t> valuesTemp(count);
+        bool countsCurrent = true; // the per chunk counts of the next digit match the current order of the keys
+
+        for (uint32_t d = 0; d < digitCount; d++) {
+            uint32_t shift = d * RADIX_SORT_DIGIT_BITS;
+
+            // total per bucket, a digit that all keys share doesn't reorder anything
+            uint32_t totals[RADIX_SORT_BUCKETS] = {};
+            for (uint32_t c = 0; c < chunkCount; c++) {
+                const uint32_t* counts = histogram(c, d);
+                for (uint32_t b = 0; b < RADIX_SORT_BUCKETS; b++) totals[b] += counts[b];
+            }
+            bool skip = false;
+            for (uint32_t b = 0; b < RADIX_SORT_BUCKETS; b++) skip |= totals[b] == count;
+            if (skip) continue;
+
+            // earlier passes moved keys between chunks, count this digit again
+            if (!countsCurrent) {
+                Parallel::forEachChunk(0, count, chunkCount, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+                    uint32_t* counts = histogram(chunk, d);
+                    std::fill(counts, counts + RADIX_SORT_BUCKETS, 0);
+                    for (uint32_t i = begin; i < end; i++) counts[(keys[i] >> shift) & (RADIX_SORT_BUCKETS - 1)]++;
+                });
+            }
+
+            // chunk c writes bucket b after all smaller buckets and after the earlier chunks' keys in bucket b
+            std::vector<uint32_t> offsets(static_cast<size_t>(chunkCount) * RADIX_SORT_BUCKETS);
+            uint32_t offset = 0;
+            for (uint32_t b = 0; b < RADIX_SORT_BUCKETS; b++) {
+                for (uint32_t c = 0; c < chunkCount; c++) {
+                    offsets[c * RADIX_SORT_BUCKETS + b] = offset;
+                    offset += histogram(c, d)[b];
+                }
+            }
+
+            Parallel::forEachChunk(0, count, chunkCount, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+                uint32_t* chunkOffsets = offsets.data() + chunk * RADIX_SORT_BUCKETS;
+                for (uint32_t i = begin; i < end; i++) {
+                    uint32_t destination = chunkOffsets[(keys[i] >> shift) & (RADIX_SORT_BUCKETS - 1)]++;
+                    keysTemp[destination] = keys[i];
+                    valuesTemp[destination] = values[i];
+                }
+            });
+            keys.swap(keysTemp);
+            values.swap(valuesTemp);
+            countsCurrent = chunkCount == 1;
+        }
+    }
+
+    // unrolled at compile time: the shifts become constants and the increments of different digits don't wait on each
+    // other. a loop over the digits only got that at -O3, at -O2 it was 2x slower. the increments themselves are
+    // scattered, so extracting the digits of four keys at once with SSE2 was slower than this
+    template <class Key, uint32_t Digit>
+    void countDigits(Key key, uint32_t* counts) {
+        counts[Digit * RADIX_SORT_BUCKETS + ((key >> (Digit * RADIX_SORT_DIGIT_BITS)) & (RADIX_SORT_BUCKETS - 1))]++;
+        if constexpr ((Digit + 1) * RADIX_SORT_DIGIT_BITS < sizeof(Key) * 8) countDigits<Key, Digit + 1>(key, counts);
+    }
+
+    void sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, uint32_t threadCount) {
+        sortPairs(keys, values, threadCount);
+    }
+
+    void sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, uint32_t threadCount) {
+        sortPairs(keys, values, threadCount);
+    }
+}
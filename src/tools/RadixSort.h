@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+/*
+    Least significant digit radix sort of keys with a value per key, 8 bit digits. One pass over the keys counts all
+    digits at once, digits that are the same for every key (e.g. the unused high bits of morton codes) are skipped.
+    Large inputs are counted and scattered on several threads, each thread owns a contiguous chunk and scatters it to
+    offsets that keep the sort stable.
+*/
+namespace RadixSort {
+
+    // stable ascending sort by key, values are moved along with their keys. threadCount 0 = all threads of the job system
+    void sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, uint32_t threadCount = 0);
+    void sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, uint32_t threadCount = 0);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+    Eight float lanes with the same interface on SSE (two 4 wide halves, always available on x86-64) and AVX2, so
+    kernels can be written once as templates over the lane type. Masks are lane types too, all bits set in the lanes
+    that are true. min() and max() have std::min/std::max semantics, including which argument a NaN lane returns.
+    Float8AVX2 only exists in translation units compiled with AVX2 enabled, which are only called after
+    PacketTraversal's runtime check.
+*/
+namespace SIMD {
+
+#ifdef SIMD_X86
+
+    struct Float8SSE {
+        __m128 lo, hi;
+
+        Float8SSE() {}
+        Float8SSE(__m128 lo, __m128 hi) : lo(lo), hi(hi) {}
+
+        static Float8SSE broadcast(float value) { return Float8SSE(_mm_set1_ps(value), _mm_set1_ps(value)); }
+        static Float8SSE load(const float* p) { return Float8SSE(_mm_load_ps(p), _mm_load_ps(p + 4)); } // 16 byte aligned
+        void store(float* p) const { _mm_store_ps(p, lo); _mm_store_ps(p + 4, hi); }
+
+        // lane i is true if bit i is set
+        static Float8SSE fromMask(uint32_t bits) {
+            __m128i b = _mm_set1_epi32(static_cast<int>(bits));
+            __m128i lanesLo = _mm_setr_epi32(1, 2, 4, 8), lanesHi = _mm_setr_epi32(16, 32, 64, 128);
+            return Float8SSE(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, lanesLo), lanesLo)),
+                _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, lanesHi), lanesHi)));
+        }
+        uint32_t mask() const { return static_cast<uint32_t>(_mm_movemask_ps(lo) | (_mm_movemask_ps(hi) << 4)); }
+
+        friend Float8SSE operator - (Float8SSE a) { return Float8SSE(_mm_xor_ps(a.lo, _mm_set1_ps(-0.f)), _mm_xor_ps(a.hi, _mm_set1_ps(-0.f))); }
+        friend Float8SSE operator + (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+        friend Float8SSE operator - (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+        friend Float8SSE operator * (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+        friend Float8SSE operator / (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)); }
+        friend Float8SSE operator & (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)); }
+        friend Float8SSE operator | (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_or_ps(a.lo, b.lo), _mm_or_ps(a.hi, b.hi)); }
+        friend Float8SSE andNot(Float8SSE a, Float8SSE b) { return Float8SSE(_mm_andnot_ps(a.lo, b.lo), _mm_andnot_ps(a.hi, b.hi)); } // !a && b
+        friend Float8SSE operator < (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi)); }
+        friend Float8SSE operator <= (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_cmple_ps(a.lo, b.lo), _mm_cmple_ps(a.hi, b.hi)); }
+        friend Float8SSE operator >= (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_cmpge_ps(a.lo, b.lo), _mm_cmpge_ps(a.hi, b.hi)); }
+        friend Float8SSE operator > (Float8SSE a, Float8SSE b) { return Float8SSE(_mm_cmpgt_ps(a.lo, b.lo), _mm_cmpgt_ps(a.hi, b.hi)); }
+        friend Float8SSE min(Float8SSE a, Float8SSE b) { return Float8SSE(_mm_min_ps(b.lo, a.lo), _mm_min_ps(b.hi, a.hi)); }
+        friend Float8SSE max(Float8SSE a, Float8SSE b) { return Float8SSE(_mm_max_ps(b.lo, a.lo), _mm_max_ps(b.hi, a.hi)); }
+        friend Float8SSE sqrt(Float8SSE a) { return Float8SSE(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+        // mask ? a : b
+        friend Float8SSE select(Float8SSE mask, Float8SSE a, Float8SSE b) { return (mask & a) | andNot(mask, b); }
+    };
+
+#ifdef __AVX2__
+    struct Float8AVX2 {
+        __m256 v;
+
+        Float8AVX2() {}
+        Float8AVX2(__m256 v) : v(v) {}
+
+        static Float8AVX2 broadcast(float value) { return _mm256_set1_ps(value); }
+        static Float8AVX2 load(const float* p) { return _mm256_load_ps(p); } // 32 byte aligned
+        void store(float* p) const { _mm256_store_ps(p, v); }
+
+        static Float8AVX2 fromMask(uint32_t bits) {
+            __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+            return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(bits)), lanes), lanes));
+        }
+        uint32_t mask() const { return static_cast<uint32_t>(_mm256_movemask_ps(v)); }
+
+        friend Float8AVX2 operator - (Float8AVX2 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)); }
+        friend Float8AVX2 operator + (Float8AVX2 a, Float8AVX2 b) { return _mm256_add_ps(a.v, b.v); }
+        friend Float8AVX2 operator - (Float8AVX2 a, Float8AVX2 b) { return _mm256_sub_ps(a.v, b.v); }
+        friend Float8AVX2 operator * (Float8AVX2 a, Float8AVX2 b) { return _mm256_mul_ps(a.v, b.v); }
+        friend Float8AVX2 operator / (Float8AVX2 a, Float8AVX2 b) { return _mm256_div_ps(a.v, b.v); }
+        friend Float8AVX2 operator & (Float8AVX2 a, Float8AVX2 b) { return _mm256_and_ps(a.v, b.v); }
+        friend Float8AVX2 operator | (Float8AVX2 a, Float8AVX2 b) { return _mm256_or_ps(a.v, b.v); }
+        friend Float8AVX2 andNot(Float8AVX2 a, Float8AVX2 b) { return _mm256_andnot_ps(a.v, b.v); }
+        friend Float8AVX2 operator < (Float8AVX2 a, Float8AVX2 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+        friend Float8AVX2 operator <= (Float8AVX2 a, Float8AVX2 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+        friend Float8AVX2 operator >= (Float8AVX2 a, Float8AVX2 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+        friend Float8AVX2 operator > (Float8AVX2 a, Float8AVX2 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+        friend Float8AVX2 min(Float8AVX2 a, Float8AVX2 b) { return _mm256_min_ps(b.v, a.v); }
+        friend Float8AVX2 max(Float8AVX2 a, Float8AVX2 b) { return _mm256_max_ps(b.v, a.v); }
+        friend Float8AVX2 sqrt(Float8AVX2 a) { return _mm256_sqrt_ps(a.v); }
+        friend Float8AVX2 select(Float8AVX2 mask, Float8AVX2 a, Float8AVX2 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+    };
+#endif // __AVX2__
+
+#endif // SIMD_X86
+}
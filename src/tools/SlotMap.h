@@ -0,0 +1,245 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace Model {
+
+    /*
+        Generational handle into a SlotMap. index selects the slot, generation is bumped every time
+        the slot is freed so a handle to a deleted object can never alias a newer one.
+        T is only used as a tag so handles to different object types can't be mixed up.
+    */
+    template <class T>
+    class Handle {
+    public:
+        static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+        Handle() {}
+        Handle(uint32_t index, uint32_t generation) : index(index), generation(generation) {}
+
+        // value written to the object id image (slot indices are unique among live objects)
+        int32_t getID() const { return isValid() ? static_cast<int32_t>(index) : -1; }
+        uint32_t getIndex() const { return index; }
+        uint32_t getGeneration() const { return generation; }
+
+        void invalidate() { index = INVALID_INDEX; }
+        bool isValid() const { return index != INVALID_INDEX; }
+
+        bool operator == (const Handle& other) const { return index == other.index && generation == other.generation; }
+        bool operator != (const Handle& other) const { return !(*this == other); }
+        bool operator <  (const Handle& other) const { return index < other.index || (index == other.index && generation < other.generation); }
+
+    private:
+        uint32_t index = INVALID_INDEX;
+        uint32_t generation = 0;
+    };
+
+    /*
+        Owns objects of type T in a densely packed array and hands out generational handles to them.
+        Insert, erase and lookup are O(1). Erasing moves the last element into the hole so iteration
+        over data() always touches contiguous memory.
+    */
+    template <class T>
+    class SlotMap {
+    public:
+        using HandleType = Handle<T>;
+        static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+        HandleType insert(const T& value) {
+            uint32_t slotIndex;
+            if (freeHead != INVALID_INDEX) {
+                slotIndex = freeHead;
+                freeHead = slots[slotIndex].nextFree;
+            } else {
+                slotIndex = static_cast<uint32_t>(slots.size());
+                slots.push_back(Slot());
+            }
+
+            slots[slotIndex].denseIndex = static_cast<uint32_t>(dense.size());
+            dense.push_back(value);
+            denseHandles.push_back(HandleType(slotIndex, slots[slotIndex].generation));
+            return denseHandles.back();
+        }
+
+        // returns the dense index the element was removed from (INVALID_INDEX if the handle is stale).
+        // if the returned index is < size() the previously last element now lives there
+        uint32_t erase(HandleType handle) {
+            uint32_t removedIndex = denseIndex(handle);
+            if (removedIndex == INVALID_INDEX) return INVALID_INDEX;
+
+            uint32_t lastIndex = static_cast<uint32_t>(dense.size()) - 1;
+            if (removedIndex != lastIndex) {
+                dense[removedIndex] = std::move(dense[lastIndex]);
+                denseHandles[removedIndex] = denseHandles[lastIndex];
+                slots[denseHandles[removedIndex].getIndex()].denseIndex = removedIndex;
+            }
+            dense.pop_back();
+            denseHandles.pop_back();
+
+            Slot& slot = slots[handle.getIndex()];
+            slot.generation++;
+            slot.denseIndex = INVALID_INDEX;
+            slot.nextFree = freeHead;
+            freeHead = handle.getIndex();
+
+            return removedIndex;
+        }
+
+        bool contains(HandleType handle) const { return denseIndex(handle) != INVALID_INDEX; }
+
+        // position of the element in data(), INVALID_INDEX if the handle is stale
+        uint32_t denseIndex(HandleType handle) const {
+            if (!handle.isValid() || handle.getIndex() >= slots.size()) return INVALID_INDEX;
+            const Slot& slot = slots[handle.getIndex()];
+            if (slot.generation != handle.getGeneration() || slot.denseIndex >= denseHandles.size()) return INVALID_INDEX;
+            return denseHandles[slot.denseIndex] == handle ? slot.denseIndex : INVALID_INDEX;
+        }
+
+        // nullptr if the handle is stale
+        T* find(HandleType handle) {
+            uint32_t index = denseIndex(handle);
+            return index == INVALID_INDEX ? nullptr : &dense[index];
+        }
+        const T* find(HandleType handle) const {
+            uint32_t index = denseIndex(handle);
+            return index == INVALID_INDEX ? nullptr : &dense[index];
+        }
+
+        // handle currently occupying a slot (e.g. to resolve an id read back from the gpu), invalid if the slot is free
+        HandleType handleFromSlot(uint32_t slotIndex) const {
+            if (slotIndex >= slots.size()) return HandleType();
+            HandleType handle(slotIndex, slots[slotIndex].generation);
+            return contains(handle) ? handle : HandleType();
+        }
+
+        HandleType handleAt(uint32_t denseIndex) const { return denseHandles[denseIndex]; }
+        const std::vector<HandleType>& handles() const { return denseHandles; }
+
+        T& operator [] (uint32_t denseIndex) { return dense[denseIndex]; }
+        const T& operator [] (uint32_t denseIndex) const { return dense[denseIndex]; }
+
+        T* data() { return dense.data(); }
+        const T* data() const { return dense.data(); }
+        typename std::vector<T>::iterator begin() { return dense.begin(); }
+        typename std::vector<T>::iterator end() { return dense.end(); }
+        typename std::vector<T>::const_iterator begin() const { return dense.begin(); }
+        typename std::vector<T>::const_iterator end() const { return dense.end(); }
+
+        uint32_t size() const { return static_cast<uint32_t>(dense.size()); }
+        bool empty() const { return dense.empty(); }
+        uint32_t slotCount() const { return static_cast<uint32_t>(slots.size()); } // one past the largest slot index ever used
+
+        void reserve(uint32_t count) {
+            slots.reserve(count);
+            dense.reserve(count);
+            denseHandles.reserve(count);
+        }
+
+        // invalidates every outstanding handle
+        void clear() {
+            for (const HandleType& handle : denseHandles) {
+                Slot& slot = slots[handle.getIndex()];
+                slot.generation++;
+                slot.denseIndex = INVALID_INDEX;
+                slot.nextFree = freeHead;
+                freeHead = handle.getIndex();
+            }
+            dense.clear();
+            denseHandles.clear();
+        }
+
+    private:
+        struct Slot {
+            uint32_t denseIndex = INVALID_INDEX; // INVALID_INDEX while the slot is free
+            uint32_t generation = 0;
+            uint32_t nextFree = INVALID_INDEX;   // free list link, only meaningful while the slot is free
+        };
+
+        std::vector<Slot> slots;
+        std::vector<T> dense;
+        std::vector<HandleType> denseHandles;
+        uint32_t freeHead = INVALID_INDEX;
+    };
+
+    /*
+        Densely packed data keyed by handles that are owned by a SlotMap somewhere else. Used to keep
+        per-object data in another system (e.g. renderer resources) without searching for ids.
+        Same O(1) swap-remove semantics as SlotMap.
+    */
+    template <class T, class HandleT>
+    class SparseSet {
+    public:
+        static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+        // returns the dense index of the new element, INVALID_INDEX if the key is already present
+        uint32_t insert(HandleT key, const T& value) {
+            if (!key.isValid() || contains(key)) return INVALID_INDEX;
+            if (key.getIndex() >= sparse.size()) sparse.resize(static_cast<size_t>(key.getIndex()) + 1);
+
+            sparse[key.getIndex()] = { static_cast<uint32_t>(dense.size()), key.getGeneration() };
+            dense.push_back(value);
+            denseKeys.push_back(key);
+            return sparse[key.getIndex()].denseIndex;
+        }
+
+        // same return semantics as SlotMap::erase
+        uint32_t erase(HandleT key) {
+            uint32_t removedIndex = denseIndex(key);
+            if (removedIndex == INVALID_INDEX) return INVALID_INDEX;
+
+            uint32_t lastIndex = static_cast<uint32_t>(dense.size()) - 1;
+            if (removedIndex != lastIndex) {
+                dense[removedIndex] = std::move(dense[lastIndex]);
+                denseKeys[removedIndex] = denseKeys[lastIndex];
+                sparse[denseKeys[removedIndex].getIndex()].denseIndex = removedIndex;
+            }
+            dense.pop_back();
+            denseKeys.pop_back();
+            sparse[key.getIndex()].denseIndex = INVALID_INDEX;
+
+            return removedIndex;
+        }
+
+        bool contains(HandleT key) const { return denseIndex(key) != INVALID_INDEX; }
+
+        uint32_t denseIndex(HandleT key) const {
+            if (!key.isValid() || key.getIndex() >= sparse.size()) return INVALID_INDEX;
+            const Entry& entry = sparse[key.getIndex()];
+            if (entry.generation != key.getGeneration() || entry.denseIndex >= denseKeys.size()) return INVALID_INDEX;
+            return denseKeys[entry.denseIndex] == key ? entry.denseIndex : INVALID_INDEX;
+        }
+
+        HandleT keyAt(uint32_t denseIndex) const { return denseKeys[denseIndex]; }
+        const std::vector<HandleT>& keys() const { return denseKeys; }
+
+        T& operator [] (uint32_t denseIndex) { return dense[denseIndex]; }
+        const T& operator [] (uint32_t denseIndex) const { return dense[denseIndex]; }
+
+        T* data() { return dense.data(); }
+        const T* data() const { return dense.data(); }
+        typename std::vector<T>::iterator begin() { return dense.begin(); }
+        typename std::vector<T>::iterator end() { return dense.end(); }
+
+        uint32_t size() const { return static_cast<uint32_t>(dense.size()); }
+        bool empty() const { return dense.empty(); }
+
+        void clear() {
+            sparse.clear();
+            dense.clear();
+            denseKeys.clear();
+        }
+
+    private:
+        struct Entry {
+            uint32_t denseIndex = INVALID_INDEX;
+            uint32_t generation = 0;
+        };
+
+        std::vector<Entry> sparse;
+        std::vector<T> dense;
+        std::vector<HandleT> denseKeys;
+    };
+}
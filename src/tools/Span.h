@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace Model {
+
+    // non-owning view of contiguous elements (stand in for std::span until we move to c++20)
+    template <class T>
+    class Span {
+    public:
+        Span() {}
+        Span(T* data, uint32_t count) : pData(data), count(count) {}
+        Span(T& element) : pData(&element), count(1) {}
+        Span(T&& element) = delete; // would outlive the temporary
+        template <class U>
+        Span(std::vector<U>& vector) : pData(vector.data()), count(static_cast<uint32_t>(vector.size())) {}
+        template <class U>
+        Span(const std::vector<U>& vector) : pData(vector.data()), count(static_cast<uint32_t>(vector.size())) {}
+
+        T* data() const { return pData; }
+        uint32_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        T& operator [] (uint32_t index) const { return pData[index]; }
+        T* begin() const { return pData; }
+        T* end() const { return pData + count; }
+
+    private:
+        T* pData = nullptr;
+        uint32_t count = 0;
+    };
+}
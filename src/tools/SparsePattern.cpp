@@ -0,0 +1,68 @@
+#include "SparsePattern.h"
+
+namespace SparsePattern {
+
+    bool isValidStride(uint32_t stride) {
+        return stride == 1 || stride == 2 || stride == 4;
+    }
+
+    uint32_t getPhaseCount(uint32_t stride) {
+        return stride * stride;
+    }
+
+    glm::uvec2 getOffset(uint32_t stride, uint32_t phase) {
+        uint32_t levels = 0;
+        while ((1u << levels) < stride) levels++;
+        phase %= getPhaseCount(stride);
+
+        // inverse of the bayer matrix: the most significant base 4 digit of the phase picks the lowest coordinate
+        // bits, digit 2 * (x ^ y) + y orders a 2x2 block as (0,0), (1,1), (1,0), (0,1)
+        glm::uvec2 offset(0);
+        for (uint32_t l = 0; l < levels; l++) {
+            uint32_t digit = (phase >> (2 * (levels - 1 - l))) & 3u;
+            uint32_t y = digit & 1u;
+            uint32_t x = (digit >> 1) ^ y;
+            offset.x |= x << l;
+            offset.y |= y << l;
+        }
+        return offset;
+    }
+
+    bool isTraced(glm::uvec2 pixel, uint32_t stride, glm::uvec2 offset) {
+        return pixel.x % stride == offset.x && pixel.y % stride == offset.y;
+    }
+
+    glm::uvec2 getLaunchSize(glm::uvec2 size, uint32_t stride) {
+        return (size + glm::uvec2(stride - 1)) / stride;
+    }
+
+    uint32_t getTracedPixelCount(glm::uvec2 size, uint32_t stride, glm::uvec2 offset) {
+        uint32_t columns = offset.x < size.x ? (size.x - offset.x + stride - 1) / stride : 0;
+        uint32_t rows = offset.y < size.y ? (size.y - offset.y + stride - 1) / stride : 0;
+        return columns * rows;
+    }
+
+    Interpolation getInterpolation(glm::uvec2 pixel, glm::uvec2 size, uint32_t stride, glm::uvec2 offset) {
+        // traced pixels per row and column, offset + stride * k for k below this
+        glm::ivec2 counts = glm::max(glm::ivec2((size - offset + glm::uvec2(stride - 1)) / stride), glm::ivec2(1));
+
+        glm::vec2 cell = (glm::vec2(pixel) - glm::vec2(offset)) / static_cast<float>(stride);
+        glm::vec2 lower = glm::floor(cell);
+        glm::vec2 t = glm::clamp(cell - lower, glm::vec2(0.f), glm::vec2(1.f));
+        glm::ivec2 k0 = glm::clamp(glm::ivec2(lower), glm::ivec2(0), counts - 1);
+        glm::ivec2 k1 = glm::clamp(glm::ivec2(lower) + 1, glm::ivec2(0), counts - 1);
+        glm::ivec2 kNearest = glm::clamp(glm::ivec2(glm::floor(cell + 0.5f)), glm::ivec2(0), counts - 1);
+
+        Interpolation result;
+        result.samples[0] = offset + glm::uvec2(k0.x, k0.y) * stride;
+        result.samples[1] = offset + glm::uvec2(k1.x, k0.y) * stride;
+        result.samples[2] = offset + glm::uvec2(k0.x, k1.y) * stride;
+        result.samples[3] = offset + glm::uvec2(k1.x, k1.y) * stride;
+        result.weights[0] = (1.f - t.x) * (1.f - t.y);
+        result.weights[1] = t.x * (1.f - t.y);
+        result.weights[2] = (1.f - t.x) * t.y;
+        result.weights[3] = t.x * t.y;
+        result.nearest = offset + glm::uvec2(kNearest) * stride;
+        return result;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+
+/*
+    Sparse trace pattern of the progressive refinement (see Renderer::setRefinement()). The image is split into
+    stride x stride cells and a frame traces one pixel per cell, at the same offset in every cell. The offsets of
+    consecutive phases follow an ordered dither (bayer) matrix, so any run of stride * stride phases traces every
+    pixel exactly once and a shorter run is spread evenly over the cell. The untraced pixels of a frame are
+    interpolated from the four surrounding traced ones when they can't be reprojected.
+    scene.rgen, scene.comp and refine.comp do the same math, this is the cpu copy tests/SparsePatternTests.cpp checks.
+    Pure CPU code, doesn't touch vulkan.
+*/
+namespace SparsePattern {
+
+    // bilinear weights of the four traced pixels around an untraced one
+    struct Interpolation {
+        glm::uvec2 samples[4];  // (x0, y0), (x1, y0), (x0, y1), (x1, y1), repeated at the image edges
+        float weights[4];
+        glm::uvec2 nearest;     // the closest of them, for values that can't be blended like object ids
+    };
+
+    // 1, 2 or 4: every pixel, a quarter or a sixteenth of them per frame
+    bool isValidStride(uint32_t stride);
+    uint32_t getPhaseCount(uint32_t stride); // stride * stride, frames to trace every pixel once
+
+    // the traced pixel of each cell for the phase, taken modulo getPhaseCount()
+    glm::uvec2 getOffset(uint32_t stride, uint32_t phase);
+    bool isTraced(glm::uvec2 pixel, uint32_t stride, glm::uvec2 offset);
+
+    // launch or dispatch size over an image of size, launch id * stride + offset is the traced pixel
+    glm::uvec2 getLaunchSize(glm::uvec2 size, uint32_t stride);
+    // launch ids whose pixel falls inside the image, the rays a frame traces
+    uint32_t getTracedPixelCount(glm::uvec2 size, uint32_t stride, glm::uvec2 offset);
+
+    // size has to be at least stride in both dimensions, so every row and column of cells has a traced pixel
+    Interpolation getInterpolation(glm::uvec2 pixel, glm::uvec2 size, uint32_t stride, glm::uvec2 offset);
+}
@@ -0,0 +1,136 @@
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+// copy regions start at multiples of this, keeps the ellipsoids etc. naturally aligned in the ring
+#define STAGING_RING_ALIGNMENT 16
+
+namespace Vk {
+
+    void StagingRing::create(VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice) {
+        this->device = device;
+        this->physicalDevice = physicalDevice;
+
+        buffer.create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, device, physicalDevice, MemoryAllocator::Category::STAGING);
+        ring = Memory::RingAllocator(size);
+        stats.capacity = size;
+    }
+
+    void StagingRing::destroy() {
+        buffer.destroy(device);
+        for (_Retired& r : retired) r.buffer.destroy(device);
+        retired.clear();
+        copies.clear();
+    }
+
+    void StagingRing::beginFrame(uint32_t frame, VkFence fence) {
+        ring.releaseFrame(frame);
+
+        for (size_t r = 0; r < retired.size();) {
+            if (retired[r].frame == frame) {
+                retired[r].buffer.destroy(device);
+                retired[r] = retired.back();
+                retired.pop_back();
+            } else {
+                r++;
+            }
+        }
+
+        currentFrame = frame;
+        fences[frame] = fence;
+    }
+
+    void StagingRing::upload(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+        memcpy(allocate(dst, dstOffset, size), data, static_cast<size_t>(size));
+    }
+
+    void* StagingRing::allocate(VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size) {
+        uint64_t offset = ring.allocate(size, STAGING_RING_ALIGNMENT);
+
+        // wait for the oldest frame in flight until there is room
+        while (offset == Memory::INVALID_OFFSET && ring.getOldestFrame() != UINT32_MAX) {
+            uint32_t oldest = ring.getOldestFrame();
+            vkWaitForFences(device, 1, &fences[oldest], VK_TRUE, UINT64_MAX);
+            ring.releaseFrame(oldest);
+            stats.stalls++;
+            offset = ring.allocate(size, STAGING_RING_ALIGNMENT);
+        }
+
+        // this frame alone doesn't fit
+        if (offset == Memory::INVALID_OFFSET) {
+            grow(size);
+            offset = ring.allocate(size, STAGING_RING_ALIGNMENT);
+        }
+
+        stats.peakUsed = std::max<VkDeviceSize>(stats.peakUsed, ring.getUsed());
+
+        buffer.markDirty(offset, size);
+        copies.push_back({ buffer.buffer, dst, { offset, dstOffset, size } });
+        return static_cast<char*>(buffer.mapped) + offset;
+    }
+
+    void StagingRing::grow(VkDeviceSize size) {
+        VkDeviceSize newSize = ring.getSize() * 2;
+        while (newSize < size) newSize *= 2;
+
+        // copies already queued this frame still read from the old ring
+        buffer.flush(device);
+        retired.push_back({ currentFrame, buffer });
+
+        AID_INFO("Staging ring grew from {} to {} bytes", ring.getSize(), newSize);
+        buffer = BufferHostVisible();
+        buffer.create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, newSize, device, physicalDevice, MemoryAllocator::Category::STAGING);
+        ring = Memory::RingAllocator(newSize);
+
+        stats.capacity = newSize;
+        stats.growths++;
+    }
+
+    void StagingRing::record(VkCommandBuffer commandBuffer) {
+        if (copies.empty()) return;
+        buffer.flush(device);
+
+        // group by buffer pair and merge regions that are contiguous on both sides
+        std::stable_sort(copies.begin(), copies.end(), [](const _Copy& a, const _Copy& b) {
+            if (a.src != b.src) return std::less<VkBuffer>()(a.src, b.src);
+            if (a.dst != b.dst) return std::less<VkBuffer>()(a.dst, b.dst);
+            return a.region.dstOffset < b.region.dstOffset;
+        });
+
+        stats.bytesUploaded = 0;
+        stats.regionCount = 0;
+        stats.copyCount = 0;
+
+        std::vector<VkBufferCopy> regions;
+        for (size_t c = 0; c < copies.size(); c++) {
+            const VkBufferCopy& region = copies[c].region;
+            stats.bytesUploaded += region.size;
+
+            if (!regions.empty() && regions.back().srcOffset + regions.back().size == region.srcOffset
+                && regions.back().dstOffset + regions.back().size == region.dstOffset) {
+                regions.back().size += region.size;
+            } else {
+                regions.push_back(region);
+            }
+
+            bool lastOfPair = c + 1 == copies.size() || copies[c + 1].src != copies[c].src || copies[c + 1].dst != copies[c].dst;
+            if (lastOfPair) {
+                vkCmdCopyBuffer(commandBuffer, copies[c].src, copies[c].dst, static_cast<uint32_t>(regions.size()), regions.data());
+                stats.regionCount += static_cast<uint32_t>(regions.size());
+                stats.copyCount++;
+                regions.clear();
+            }
+        }
+
+        copies.clear();
+        ring.closeFrame(currentFrame);
+    }
+
+    StagingRing::Stats StagingRing::getStats() const {
+        Stats s = stats;
+        s.used = ring.getUsed();
+        return s;
+    }
+}
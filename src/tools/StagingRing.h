@@ -0,0 +1,79 @@
+#pragma once
+
+#include "tools/SubAllocator.h"
+#include "tools/VkHelper.h"
+#include "tools/config.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+namespace Vk {
+
+    /*
+        Host visible ring for uploads to device local buffers, shared by all frames in flight. Uploads made during a
+        frame are written straight into the ring and recorded as vkCmdCopyBuffer regions into that frame's command
+        buffer, merged where both sides are contiguous. A frame's part of the ring is reused once its fence has
+        signaled. When the ring is full the oldest frame in flight is waited on (a stall), and if a single frame
+        needs more than the whole ring it grows.
+        A destination range should only be uploaded once per frame, the copies are reordered.
+    */
+    class StagingRing {
+    public:
+        struct Stats {
+            VkDeviceSize capacity = 0;
+            VkDeviceSize used = 0;          // claimed by frames that may still be copying
+            VkDeviceSize peakUsed = 0;
+            VkDeviceSize bytesUploaded = 0; // by the last recorded frame
+            uint32_t regionCount = 0;       // copy regions of the last recorded frame, after merging
+            uint32_t copyCount = 0;         // vkCmdCopyBuffer calls of the last recorded frame
+            uint32_t stalls = 0;            // waits for an older frame to free ring space
+            uint32_t growths = 0;
+        };
+
+        void create(VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice);
+        void destroy();
+
+        // the frame's fence has been waited on so its previous copies are done, the fence guards this frame's copies
+        void beginFrame(uint32_t frame, VkFence fence);
+
+        // count elements to be written by the caller, copied to dst at dstOffset (in bytes)
+        template <class T>
+        Model::Span<T> upload(VkBuffer dst, VkDeviceSize dstOffset, uint32_t count) {
+            VkDeviceSize size = sizeof(T) * static_cast<VkDeviceSize>(count);
+            return Model::Span<T>(static_cast<T*>(allocate(dst, dstOffset, size)), count);
+        }
+        void upload(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+
+        bool hasPendingCopies() const { return !copies.empty(); }
+        // records the frame's copies, one vkCmdCopyBuffer per source/destination pair. the caller adds the barrier
+        void record(VkCommandBuffer commandBuffer);
+
+        Stats getStats() const;
+
+    private:
+        struct _Copy {
+            VkBuffer src;
+            VkBuffer dst;
+            VkBufferCopy region;
+        };
+        struct _Retired {
+            uint32_t frame;
+            BufferHostVisible buffer;
+        };
+
+        VkDevice device = VK_NULL_HANDLE;
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        BufferHostVisible buffer;
+        Memory::RingAllocator ring;
+
+        uint32_t currentFrame = 0;
+        VkFence fences[MAX_FRAMES_IN_FLIGHT] = {};
+        std::vector<_Copy> copies;
+        std::vector<_Retired> retired; // outgrown rings, destroyed once the frame that last used them is done
+
+        Stats stats;
+
+        void* allocate(VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size);
+        void grow(VkDeviceSize size);
+    };
+}
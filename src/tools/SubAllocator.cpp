@@ -0,0 +1,150 @@
+#include "SubAllocator.h"
+
+#include <algorithm>
+
+namespace Memory {
+
+    // buddy allocator
+
+    BuddyAllocator::BuddyAllocator(uint64_t size, uint64_t minBlockSize) : size(size), minBlockSize(std::min(minBlockSize, size)) {
+        levelCount = 1;
+        while ((size >> levelCount) >= this->minBlockSize && levelCount < 64) levelCount++;
+
+        freeBlocks.resize(levelCount);
+        freeBlocks[0].insert(0);
+    }
+
+    uint64_t BuddyAllocator::allocate(uint64_t requestedSize, uint64_t alignment) {
+        // blocks are aligned to their size, so alignment just raises the block size
+        uint64_t blockSize = std::max(std::max(requestedSize, alignment), minBlockSize);
+        if (blockSize > size || requestedSize == 0) return INVALID_OFFSET;
+
+        uint32_t level = levelCount - 1;
+        while (getBlockSize(level) < blockSize) level--;
+
+        // smallest free block that fits, split down to the requested level
+        int32_t freeLevel = static_cast<int32_t>(level);
+        while (freeLevel >= 0 && freeBlocks[freeLevel].empty()) freeLevel--;
+        if (freeLevel < 0) return INVALID_OFFSET;
+
+        uint64_t offset = *freeBlocks[freeLevel].begin();
+        freeBlocks[freeLevel].erase(freeBlocks[freeLevel].begin());
+
+        for (uint32_t l = static_cast<uint32_t>(freeLevel) + 1; l <= level; l++)
+            freeBlocks[l].insert(offset + getBlockSize(l)); // upper half stays free
+
+        allocated[offset] = level;
+        used += getBlockSize(level);
+        return offset;
+    }
+
+    bool BuddyAllocator::free(uint64_t offset) {
+        std::unordered_map<uint64_t, uint32_t>::iterator it = allocated.find(offset);
+        if (it == allocated.end()) return false;
+
+        uint32_t level = it->second;
+        allocated.erase(it);
+        used -= getBlockSize(level);
+
+        // merge with the buddy as long as it is free
+        while (level > 0) {
+            uint64_t buddy = offset ^ getBlockSize(level);
+            std::set<uint64_t>::iterator buddyIt = freeBlocks[level].find(buddy);
+            if (buddyIt == freeBlocks[level].end()) break;
+
+            freeBlocks[level].erase(buddyIt);
+            offset = std::min(offset, buddy);
+            level--;
+        }
+        freeBlocks[level].insert(offset);
+        return true;
+    }
+
+    uint64_t BuddyAllocator::getLargestFreeBlock() const {
+        for (uint32_t l = 0; l < levelCount; l++) {
+            if (!freeBlocks[l].empty()) return getBlockSize(l);
+        }
+        return 0;
+    }
+
+    uint32_t BuddyAllocator::getFreeBlockCount() const {
+        size_t count = 0;
+        for (const std::set<uint64_t>& level : freeBlocks) count += level.size();
+        return static_cast<uint32_t>(count);
+    }
+
+    // linear allocator
+
+    uint64_t LinearAllocator::allocate(uint64_t requestedSize, uint64_t alignment) {
+        uint64_t offset = alignUp(head, alignment);
+        if (requestedSize == 0 || offset + requestedSize > size) return INVALID_OFFSET;
+
+        head = offset + requestedSize;
+        allocationCount++;
+        return offset;
+    }
+
+    bool LinearAllocator::free(uint64_t offset) {
+        if (allocationCount == 0 || offset >= head) return false;
+        if (--allocationCount == 0) reset();
+        return true;
+    }
+
+    void LinearAllocator::reset() {
+        head = 0;
+        allocationCount = 0;
+    }
+
+    // ring allocator
+
+    uint64_t RingAllocator::allocate(uint64_t requestedSize, uint64_t alignment) {
+        if (requestedSize == 0 || requestedSize > size) return INVALID_OFFSET;
+        if (used == 0) head = tail = 0;
+
+        uint64_t offset = alignUp(head, alignment);
+        uint64_t consumed;
+
+        if (head > tail || used == 0) {
+            // free space is [head, size) and [0, tail)
+            if (offset + requestedSize <= size) {
+                consumed = offset + requestedSize - head;
+            } else if (requestedSize <= tail) {
+                // skip the end of the ring
+                consumed = size - head + requestedSize;
+                offset = 0;
+            } else {
+                return INVALID_OFFSET;
+            }
+        } else if (head < tail && offset + requestedSize <= tail) {
+            consumed = offset + requestedSize - head;
+        } else {
+            return INVALID_OFFSET;
+        }
+
+        head = offset + requestedSize;
+        if (head == size) head = 0;
+        used += consumed;
+        openBytes += consumed;
+        return offset;
+    }
+
+    void RingAllocator::closeFrame(uint32_t frame) {
+        if (openBytes == 0) return;
+        frames.push_back({ frame, head, openBytes });
+        openBytes = 0;
+    }
+
+    void RingAllocator::releaseFrame(uint32_t frame) {
+        bool found = false;
+        for (const _Frame& f : frames) found |= f.frame == frame;
+        if (!found) return;
+
+        while (!frames.empty()) {
+            _Frame f = frames.front();
+            frames.pop_front();
+            tail = f.end;
+            used -= f.bytes;
+            if (f.frame == frame) break;
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Offset bookkeeping for sub-allocating large memory blocks. Pure CPU code, doesn't touch vulkan, so
+    it can be tested without a device (see MemoryAllocator for the vulkan side).
+*/
+namespace Memory {
+
+    static constexpr uint64_t INVALID_OFFSET = UINT64_MAX;
+
+    inline uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return alignment <= 1 ? value : (value + alignment - 1) / alignment * alignment;
+    }
+
+    // allocations above half a block get their own memory, they would waste most of a block
+    inline bool needsDedicatedBlock(uint64_t size, uint64_t blockSize) {
+        return size > blockSize / 2;
+    }
+
+    // 0 if the free bytes are one contiguous range, towards 1 the more they are split into small ranges
+    inline float fragmentation(uint64_t freeBytes, uint64_t largestFreeRange) {
+        return freeBytes == 0 ? 0.f : 1.f - static_cast<float>(largestFreeRange) / static_cast<float>(freeBytes);
+    }
+
+    /*
+        Binary buddy allocator. Blocks are powers of two between minBlockSize and size and are always
+        aligned to their own size, so any alignment up to the block size comes for free.
+        Allocation and free are O(log(size / minBlockSize)).
+    */
+    class BuddyAllocator {
+    public:
+        BuddyAllocator() {}
+        BuddyAllocator(uint64_t size, uint64_t minBlockSize); // both powers of two
+
+        // returns INVALID_OFFSET if there is no free block big enough
+        uint64_t allocate(uint64_t size, uint64_t alignment);
+        // false if offset isn't a live allocation, nothing is freed then
+        bool free(uint64_t offset);
+
+        uint64_t getSize() const { return size; }
+        uint64_t getUsed() const { return used; } // in blocks handed out, including rounding
+        uint64_t getLargestFreeBlock() const;
+        uint32_t getAllocationCount() const { return static_cast<uint32_t>(allocated.size()); }
+        uint32_t getFreeBlockCount() const;
+
+    private:
+        uint64_t size = 0;
+        uint64_t minBlockSize = 0;
+        uint32_t levelCount = 0;  // level 0 is the whole range, level levelCount - 1 has minBlockSize blocks
+        uint64_t used = 0;
+
+        std::vector<std::set<uint64_t>> freeBlocks;      // offsets of the free blocks per level
+        std::unordered_map<uint64_t, uint32_t> allocated; // offset -> level
+
+        uint64_t getBlockSize(uint32_t level) const { return size >> level; }
+    };
+
+    /*
+        Bump allocator for short lived allocations that are released together (e.g. staging memory).
+        Only the whole block is ever reclaimed: free() counts the live allocations down without tracking
+        which ranges they covered, and the block starts over once the last one is freed.
+    */
+    class LinearAllocator {
+    public:
+        LinearAllocator() {}
+        LinearAllocator(uint64_t size) : size(size) {}
+
+        // returns INVALID_OFFSET if the rest of the block is too small
+        uint64_t allocate(uint64_t size, uint64_t alignment);
+        // false for an offset that can't belong to a live allocation (nothing allocated or at or past the head),
+        // the count is left alone then. freeing the same live offset twice can't be detected
+        bool free(uint64_t offset);
+        void reset();
+
+        uint64_t getSize() const { return size; }
+        uint64_t getUsed() const { return head; }
+        uint64_t getLargestFreeBlock() const { return size - head; }
+        uint32_t getAllocationCount() const { return allocationCount; }
+
+    private:
+        uint64_t size = 0;
+        uint64_t head = 0;
+        uint32_t allocationCount = 0;
+    };
+
+    /*
+        Ring allocator for per frame transient data (e.g. a staging ring). Allocations are made for the open
+        frame, closeFrame() seals them and releaseFrame() gives them back once the gpu is done with them.
+        Frames have to be released in the order they were closed.
+    */
+    class RingAllocator {
+    public:
+        RingAllocator() {}
+        RingAllocator(uint64_t size) : size(size) {}
+
+        // returns INVALID_OFFSET if there isn't enough contiguous space, allocations never wrap
+        uint64_t allocate(uint64_t size, uint64_t alignment);
+        void closeFrame(uint32_t frame);
+        // also releases every frame closed before it, does nothing if the frame holds nothing
+        void releaseFrame(uint32_t frame);
+        uint32_t getOldestFrame() const { return frames.empty() ? UINT32_MAX : frames.front().frame; }
+
+        uint64_t getSize() const { return size; }
+        uint64_t getUsed() const { return used; } // including alignment and the skipped end of the ring
+        uint64_t getOpenBytes() const { return openBytes; }
+
+    private:
+        struct _Frame {
+            uint32_t frame;
+            uint64_t end;   // head after the frame's last allocation
+            uint64_t bytes; // consumed by the frame
+        };
+
+        uint64_t size = 0;
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        uint64_t used = 0;
+        uint64_t openBytes = 0;
+        std::deque<_Frame> frames;
+    };
+}
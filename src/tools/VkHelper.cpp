@@ -4,11 +4,10 @@
 #include <stb_image.h>
 #include <vulkan/vulkan_core.h>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
-#define AABB_EDGE_FACTOR 1.1
-
 namespace Vk {
 
     void initRTXFuntions(VkDevice device) {
@@ -50,26 +49,6 @@ namespace Vk {
         }
     }
 
-    AABB::AABB(Model::Sphere sphere) {
-        float edge = sphere.posRadius.w * AABB_EDGE_FACTOR;
-        aabb_minx = sphere.posRadius.x - sphere.posRadius.w - edge;
-        aabb_miny = sphere.posRadius.y - sphere.posRadius.w - edge;
-        aabb_minz = sphere.posRadius.z - sphere.posRadius.w - edge;
-        aabb_maxx = sphere.posRadius.x + sphere.posRadius.w + edge;
-        aabb_maxy = sphere.posRadius.y + sphere.posRadius.w + edge;
-        aabb_maxz = sphere.posRadius.z + sphere.posRadius.w + edge;
-    }
-
-    AABB::AABB(Model::Ellipsoid ellipsoid) {
-        glm::vec4 edge = ellipsoid.radius * glm::vec4(AABB_EDGE_FACTOR);
-        aabb_minx = ellipsoid.center.x - ellipsoid.radius.x - edge.x;
-        aabb_miny = ellipsoid.center.y - ellipsoid.radius.y - edge.y;
-        aabb_minz = ellipsoid.center.z - ellipsoid.radius.z - edge.z;
-        aabb_maxx = ellipsoid.center.x + ellipsoid.radius.x + edge.x;
-        aabb_maxy = ellipsoid.center.y + ellipsoid.radius.y + edge.y;
-        aabb_maxz = ellipsoid.center.z + ellipsoid.radius.z + edge.z;
-    }
-
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface) {
         SwapChainSupportDetails details;
 
@@ -115,11 +94,11 @@ namespace Vk {
             //    indices.transferFamily = i;
 
             VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            if (surface != VK_NULL_HANDLE) vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
             if (presentSupport)
                 indices.presentFamily = i;
 
-            if (indices.isComplete()) break;
+            if (indices.isComplete(surface != VK_NULL_HANDLE)) break;
 
             i++;
         }
@@ -154,7 +133,7 @@ namespace Vk {
         AID_ERROR("failed to find suitable memory type!");
     }
 
-    void _BufferCommon::createCommon(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice) {
+    void _BufferCommon::createCommon(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkDeviceSize size, VkDevice device, MemoryAllocator::Category category) {
         VkBufferCreateInfo bufferInfo = {};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
@@ -166,56 +145,79 @@ namespace Vk {
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
-
-        VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, VK_ALLOCATOR, &memory), "failed to allocate buffer memory!");
+        allocation = MemoryAllocator::allocate(memRequirements, properties, category);
 
-        vkBindBufferMemory(device, buffer, memory, 0);
+        vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
         this->size = size;
     }
 
     void _BufferCommon::destroy(VkDevice device) {
         if (buffer != VK_NULL_HANDLE) vkDestroyBuffer(device, buffer, VK_ALLOCATOR);
-        if (memory != VK_NULL_HANDLE) vkFreeMemory(device, memory, VK_ALLOCATOR);
+        MemoryAllocator::free(allocation);
     }
 
-    void BufferDeviceLocal::create(VkBufferUsageFlags usage, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice) {
-        createCommon(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size, device, physicalDevice);
+    void BufferDeviceLocal::create(VkBufferUsageFlags usage, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator::Category category) {
+        createCommon(usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size, device, category);
     }
 
-    void BufferDeviceLocal::upload(void* data, VkDeviceSize size, VkDeviceSize bufferOffset, VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, VkCommandPool commandPool) {
-        BufferHostVisible stagingBuffer;
-        stagingBuffer.create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, device, physicalDevice);
-        stagingBuffer.upload(data, size, 0, device);
-
+    void BufferDeviceLocal::upload(const void* data, VkDeviceSize size, VkDeviceSize bufferOffset, VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, VkCommandPool commandPool) {
         VkBufferCopy copyRegion{};
         copyRegion.size = size;
         copyRegion.srcOffset = 0;
         copyRegion.dstOffset = bufferOffset;
 
+        upload(data, size, std::vector<VkBufferCopy>{ copyRegion }, device, physicalDevice, queue, commandPool);
+    }
+
+    void BufferDeviceLocal::upload(const void* data, VkDeviceSize size, const std::vector<VkBufferCopy>& regions, VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, VkCommandPool commandPool) {
+        if (regions.empty()) return;
+
+        BufferHostVisible stagingBuffer;
+        stagingBuffer.create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, device, physicalDevice, MemoryAllocator::Category::STAGING);
+        stagingBuffer.upload(data, size, 0, device);
+
         VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
-        vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, buffer, 1, &copyRegion);
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, buffer, static_cast<uint32_t>(regions.size()), regions.data());
         endSingleTimeCommands(device, commandBuffer, queue, commandPool);
 
         stagingBuffer.destroy(device);
     }
 
-    void BufferHostVisible::create(VkBufferUsageFlags usage, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice) {
-        createCommon(usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, size, device, physicalDevice);
+    void BufferHostVisible::create(VkBufferUsageFlags usage, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator::Category category) {
+        createCommon(usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, size, device, category);
+        mapped = allocation.mapped;
+        dirtyBegin = VK_WHOLE_SIZE;
+        dirtyEnd = 0;
+    }
+
+    void BufferHostVisible::upload(const void* data, VkDeviceSize size, VkDeviceSize bufferOffset, VkDevice device) {
+        memcpy(write<char>(bufferOffset, static_cast<uint32_t>(size)).data(), data, (size_t)size);
+        flush(device);
     }
 
-    void BufferHostVisible::upload(void* data, VkDeviceSize size, VkDeviceSize bufferOffset, VkDevice device) {
+    void BufferHostVisible::markDirty(VkDeviceSize bufferOffset, VkDeviceSize size) {
         if (size + bufferOffset > this->size) {
-            AID_ERROR("uploadBufferHostVisible: trying to upload outside of buffer memory");
+            AID_ERROR("BufferHostVisible: trying to write outside of buffer memory");
         }
 
-        void* dataDst;
-        VK_CHECK_RESULT(vkMapMemory(device, memory, bufferOffset, size, 0, &dataDst), "failed to map buffer memory");
-        memcpy(dataDst, data, (size_t)size);
-        vkUnmapMemory(device, memory);
+        dirtyBegin = std::min(dirtyBegin, bufferOffset);
+        dirtyEnd = std::max(dirtyEnd, bufferOffset + size);
+        bytesWritten += size;
+    }
+
+    void BufferHostVisible::flush(VkDevice device) {
+        if (dirtyEnd <= dirtyBegin) return;
+
+        // memory isn't necessarily host coherent
+        MemoryAllocator::flush(allocation, dirtyBegin, dirtyEnd - dirtyBegin);
+        dirtyBegin = VK_WHOLE_SIZE;
+        dirtyEnd = 0;
+    }
+
+    VkDeviceSize BufferHostVisible::resetBytesWritten() {
+        VkDeviceSize bytes = bytesWritten;
+        bytesWritten = 0;
+        return bytes;
     }
 
     VkCommandBuffer beginSingleTimeCommands(VkDevice device, VkCommandPool commandPool) {
@@ -252,9 +254,9 @@ namespace Vk {
     }
 
     void StorageImage::destroy(VkDevice device) {
-        vkFreeMemory(device, memory, VK_ALLOCATOR);
         vkDestroyImageView(device, view, VK_ALLOCATOR);
         vkDestroyImage(device, image, VK_ALLOCATOR);
+        MemoryAllocator::free(allocation);
     }
 
     void Texture::create(std::string path) {
@@ -274,8 +276,8 @@ namespace Vk {
     }
 
     void Texture::destroy(VkDevice device) {
-        vkFreeMemory(device, memory, VK_ALLOCATOR);
         vkDestroyImage(device, image, VK_ALLOCATOR);
+        MemoryAllocator::free(allocation);
     }
 
     std::vector<char> readFile(const std::string filename) {
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Model.h"
+#include "tools/AABB.h"
 #include "tools/Log.h"
+#include "tools/MemoryAllocator.h"
 
 #include <glm.hpp>
 #include <vulkan/vulkan.h>
@@ -25,8 +27,9 @@ namespace Vk {
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily, computeFamily, presentFamily;
 
-        bool isComplete() {
-            return graphicsFamily.has_value() && computeFamily.has_value() && presentFamily.has_value();
+        // present = false for headless rendering, without a surface
+        bool isComplete(bool present = true) {
+            return graphicsFamily.has_value() && computeFamily.has_value() && (presentFamily.has_value() || !present);
         }
     };
 
@@ -38,29 +41,59 @@ namespace Vk {
 
     struct _BufferCommon {
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation allocation;
         VkDeviceSize size = static_cast<VkDeviceSize>(0);
         VkDeviceSize dynamicStride = 0;
 
         void destroy(VkDevice device);
     protected:
-        void createCommon(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice);
+        void createCommon(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkDeviceSize size, VkDevice device, MemoryAllocator::Category category);
     };
 
     struct BufferDeviceLocal : _BufferCommon {
-        void create(VkBufferUsageFlags usage, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice);
-        void upload(void* data, VkDeviceSize size, VkDeviceSize bufferOffset, VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, VkCommandPool commandPool);
+        void create(VkBufferUsageFlags usage, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator::Category category = MemoryAllocator::Category::BUFFER);
+        void upload(const void* data, VkDeviceSize size, VkDeviceSize bufferOffset, VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, VkCommandPool commandPool);
+        // data is packed staging memory, srcOffset of each region is relative to data
+        void upload(const void* data, VkDeviceSize size, const std::vector<VkBufferCopy>& regions, VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, VkCommandPool commandPool);
     };
 
+    // mapped for its whole lifetime. writes go through write()/upload() so the dirty range and the number of
+    // bytes written are tracked, flush() then only flushes what changed
     struct BufferHostVisible : _BufferCommon {
-        void create(VkBufferUsageFlags usage, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice);
-        void upload(void* data, VkDeviceSize size, VkDeviceSize bufferOffset, VkDevice device);
+        void* mapped = nullptr; // set by create(), stays valid until destroy()
+        VkDeviceSize bytesWritten = 0; // since the last resetBytesWritten()
+
+        void create(VkBufferUsageFlags usage, VkDeviceSize size, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator::Category category = MemoryAllocator::Category::BUFFER);
+        // write + flush
+        void upload(const void* data, VkDeviceSize size, VkDeviceSize bufferOffset, VkDevice device);
+
+        // count elements starting at bufferOffset (in bytes), marked dirty
+        template <class T>
+        Model::Span<T> write(VkDeviceSize bufferOffset, uint32_t count) {
+            markDirty(bufferOffset, sizeof(T) * static_cast<VkDeviceSize>(count));
+            return Model::Span<T>(reinterpret_cast<T*>(static_cast<char*>(mapped) + bufferOffset), count);
+        }
+        // count elements written by the device, invalidated first
+        template <class T>
+        Model::Span<const T> read(VkDeviceSize bufferOffset, uint32_t count) {
+            MemoryAllocator::invalidate(allocation, bufferOffset, sizeof(T) * static_cast<VkDeviceSize>(count));
+            return Model::Span<const T>(reinterpret_cast<const T*>(static_cast<const char*>(mapped) + bufferOffset), count);
+        }
+
+        void markDirty(VkDeviceSize bufferOffset, VkDeviceSize size);
+        // flushes the dirty range (widened to nonCoherentAtomSize), nothing on coherent memory
+        void flush(VkDevice device);
+        VkDeviceSize resetBytesWritten(); // returns the bytes written since the last reset
+
+    private:
+        VkDeviceSize dirtyBegin = VK_WHOLE_SIZE;
+        VkDeviceSize dirtyEnd = 0;
     };
 
     struct StorageImage {
         VkImage image = VK_NULL_HANDLE;
         VkImageView view = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation allocation;
         VkFormat format;
         VkExtent2D extent;
 
@@ -69,7 +102,7 @@ namespace Vk {
 
     struct Texture {
         VkImage image = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation allocation;
         VkFormat format;
         VkExtent2D extent;
 
@@ -78,7 +111,7 @@ namespace Vk {
     };
 
     struct AccelerationStructure {
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation allocation;
         VkAccelerationStructureNV accelerationStructure = VK_NULL_HANDLE;
         uint64_t handle = UINT64_MAX;
     };
@@ -93,20 +126,8 @@ namespace Vk {
         uint64_t accelerationStructureHandle;
     };
 
-    struct AABB {
-        float aabb_minx;
-        float aabb_miny;
-        float aabb_minz;
-        float aabb_maxx;
-        float aabb_maxy;
-        float aabb_maxz;
-
-        AABB() {}
-        AABB(Model::Sphere sphere);
-        AABB(Model::Ellipsoid ellipsoid);
-    };
-
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
+    // surface VK_NULL_HANDLE leaves presentFamily empty
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface);
     uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
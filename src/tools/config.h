@@ -22,6 +22,8 @@
 #define WINDOW_SIZE_Y 800
 
 #define MAX_FRAMES_IN_FLIGHT 2
+#define MAX_PRIMITIVES_PER_BLAS 256 // ellipsoids per cluster BLAS
+#define MAX_PICKS_PER_FRAME 64 // object id picks read back per frame, the rest wait for the next one
 #define AID_PI 3.14159f
 
 // Size of a static C-style array. Don't use on pointers!